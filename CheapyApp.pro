@@ -0,0 +1,12 @@
+#-------------------------------------------------
+#
+# The application and its tests, "make check" runs the tests
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS = app \
+    tests
+
+app.file = CheapyApp_Desktop.pro
@@ -4,22 +4,22 @@
 #
 #-------------------------------------------------
 
-QT       += core gui sql network
+QT       += core gui sql network concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
+CONFIG += c++11
+
 TARGET = CheapyApp_Desktop
 TEMPLATE = app
 
 
 SOURCES += main.cpp\
-        mainwindow.cpp \
-    database.cpp \
-    dbclasses.cpp
+        mainwindow.cpp
+
+HEADERS  += mainwindow.h
 
-HEADERS  += mainwindow.h \
-    database.h \
-    dbclasses.h
+include(sources.pri)
 
 FORMS    += mainwindow.ui
 
@@ -0,0 +1,213 @@
+#include "amountsketch.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+//! Marks the start of a sketch blob
+const quint32 SketchMagic = 0x43534b54;
+
+//! Amounts below it are taken as zero
+const double MinValue = 1e-6;
+
+}
+
+/*!
+ * Empty AmountSketch constructor
+ */
+AmountSketch::AmountSketch(double relativeAccuracy)
+{
+    accuracy = qBound(1e-6, relativeAccuracy, 0.5);
+    gamma = (1 + accuracy) / (1 - accuracy);
+    logGamma = std::log(gamma);
+    offset = 0;
+    zeroCount = 0;
+    count = 0;
+    sum = 0;
+    min = 0;
+    max = 0;
+}
+
+/*!
+ * Returns the bucket of an amount, the smallest k with amount <= gamma^k
+ */
+int AmountSketch::bucketOf(double value) const
+{
+    return int(std::ceil(std::log(value) / logGamma));
+}
+
+/*!
+ * Returns the amount representing a bucket, at the same relative distance from both its ends
+ */
+double AmountSketch::bucketValue(int bucket) const
+{
+    return 2 * std::pow(gamma, bucket) / (gamma + 1);
+}
+
+/*!
+ * Adds a number of amounts to a bucket. The buckets are kept contiguous, growing at either end
+ */
+void AmountSketch::addToBucket(int bucket, qint64 times)
+{
+    if(counts.isEmpty())
+    {
+        offset = bucket;
+        counts.resize(1);
+    }
+    else if(bucket < offset)
+    {
+        const int shift = offset - bucket;
+        QVector<qint64> grown(counts.size() + shift, 0);
+        std::copy(counts.constBegin(), counts.constEnd(), grown.begin() + shift);
+        counts = grown;
+        offset = bucket;
+    }
+    else if(bucket - offset >= counts.size())
+        counts.resize(bucket - offset + 1);
+    counts[bucket - offset] += times;
+}
+
+/*!
+ * Adds an amount
+ */
+void AmountSketch::add(double value, qint64 times)
+{
+    if(times <= 0)
+        return;
+    value = qMax(0.0, value);
+    if(value < MinValue)
+        zeroCount += times;
+    else
+        addToBucket(bucketOf(value), times);
+
+    min = count ? qMin(min, value) : value;
+    max = count ? qMax(max, value) : value;
+    count += times;
+    sum += value * times;
+}
+
+/*!
+ * Adds the buckets of another sketch of the same accuracy
+ */
+bool AmountSketch::merge(const AmountSketch &other)
+{
+    if(qAbs(other.accuracy - accuracy) > 1e-12)
+        return false;
+    if(other.isEmpty())
+        return true;
+
+    for(int i = 0; i < other.counts.size(); i++)
+    {
+        if(other.counts.at(i))
+            addToBucket(other.offset + i, other.counts.at(i));
+    }
+    zeroCount += other.zeroCount;
+    min = count ? qMin(min, other.min) : other.min;
+    max = count ? qMax(max, other.max) : other.max;
+    count += other.count;
+    sum += other.sum;
+    return true;
+}
+
+/*!
+ * Returns the amount at a quantile: the value of the bucket holding the amount of that rank,
+ * kept between the smallest and the largest amount
+ */
+double AmountSketch::quantile(double q) const
+{
+    if(!count)
+        return 0;
+    const qint64 rank = qint64(qBound(0.0, q, 1.0) * (count - 1));
+    if(rank < zeroCount)
+        return 0;
+
+    qint64 seen = zeroCount;
+    for(int i = 0; i < counts.size(); i++)
+    {
+        seen += counts.at(i);
+        if(seen > rank)
+            return qBound(min, bucketValue(offset + i), max);
+    }
+    return max;
+}
+
+/*!
+ * Returns the histogram of the amounts. Each bucket of the sketch goes whole to the bin of its value
+ */
+QVector<AmountSketch::HistogramBin> AmountSketch::histogram(int bins) const
+{
+    QVector<HistogramBin> result;
+    if(!count || bins <= 0)
+        return result;
+
+    const double width = (max - min) / bins;
+    for(int i = 0; i < bins; i++)
+    {
+        HistogramBin bin = {min + i * width, i == bins - 1 ? max : min + (i + 1) * width, 0};
+        result.append(bin);
+    }
+    auto binOf = [this, width, bins](double value) {
+        return width > 0 ? qBound(0, int((value - min) / width), bins - 1) : 0;
+    };
+
+    result[0].count += zeroCount;
+    for(int i = 0; i < counts.size(); i++)
+    {
+        if(counts.at(i))
+            result[binOf(qBound(min, bucketValue(offset + i), max))].count += counts.at(i);
+    }
+    return result;
+}
+
+/*!
+ * Serializes the sketch to a compressed blob
+ *
+ * The buckets are written from the first to the last non-empty one, the empty ones in between
+ * are mostly compressed away.
+ */
+QByteArray AmountSketch::toByteArray() const
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_6);
+
+    out << SketchMagic << FormatVersion << accuracy << count << zeroCount << sum << min << max
+        << qint32(offset) << counts;
+
+    return qCompress(data);
+}
+
+/*!
+ * Deserializes a sketch from a blob written by toByteArray()
+ */
+AmountSketch AmountSketch::fromByteArray(const QByteArray &data, bool *ok)
+{
+    if(ok)
+        *ok = false;
+    QByteArray bytes = qUncompress(data);
+    QDataStream in(bytes);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic;
+    quint16 version;
+    double accuracy;
+    in >> magic >> version >> accuracy;
+    if(in.status() != QDataStream::Ok || magic != SketchMagic || version != FormatVersion || !(accuracy > 0 && accuracy < 1))
+        return AmountSketch();
+
+    AmountSketch sketch(accuracy);
+    qint32 offset;
+    in >> sketch.count >> sketch.zeroCount >> sketch.sum >> sketch.min >> sketch.max >> offset >> sketch.counts;
+    sketch.offset = offset;
+
+    qint64 total = sketch.zeroCount;
+    foreach(qint64 bucketCount, sketch.counts)
+        total += bucketCount;
+    if(in.status() != QDataStream::Ok || total != sketch.count)
+        return AmountSketch();
+
+    if(ok)
+        *ok = true;
+    return sketch;
+}
@@ -0,0 +1,156 @@
+#ifndef AMOUNTSKETCH_H
+#define AMOUNTSKETCH_H
+
+#include <QtCore>
+
+/*!
+ * \brief Mergeable streaming sketch of the distribution of amounts (DDSketch)
+ *
+ * An amount v is counted in the bucket k = ceil(log(v) / log(gamma)), gamma = (1 + a) / (1 - a),
+ * and every amount of a bucket is represented by 2 gamma^k / (gamma + 1), which is within a
+ * relative accuracy a of all of them. Quantiles are therefore answered within a of the exact
+ * ones, whatever the number of amounts, from a few hundred buckets instead of the sorted
+ * amounts. Two sketches with the same accuracy merge by adding their buckets, which gives
+ * exactly the sketch of all their amounts, so the sketches of each event and user are
+ * combined into the views of a user or of the whole ledger.
+ *
+ * Amounts are not negative; zero and amounts below a millionth are kept apart as zero.
+ */
+class AmountSketch
+{
+public:
+    /*!
+     * \brief Range of amounts counted by one bin of histogram()
+     */
+    struct HistogramBin
+    {
+        //! \brief Smallest amount of the bin
+        double lower;
+        //! \brief Largest amount of the bin
+        double upper;
+        //! \brief Number of amounts in the bin
+        qint64 count;
+    };
+
+    /*!
+     * \brief AmountSketch constructor, empty
+     * \param relativeAccuracy relative accuracy of the quantiles, between 0 and 1
+     */
+    explicit AmountSketch(double relativeAccuracy = 0.01);
+    /*!
+     * \brief Returns the relative accuracy of the quantiles
+     * \return relative accuracy
+     */
+    double getRelativeAccuracy() const {return accuracy;}
+    /*!
+     * \brief Returns the number of amounts added
+     * \return number of amounts
+     */
+    qint64 getCount() const {return count;}
+    /*!
+     * \brief Returns true if no amount has been added
+     * \return true if empty
+     */
+    bool isEmpty() const {return count == 0;}
+    /*!
+     * \brief Returns the total of the amounts added
+     * \return total amount
+     */
+    double getSum() const {return sum;}
+    /*!
+     * \brief Returns the smallest amount added
+     * \return smallest amount, 0 if empty
+     */
+    double getMin() const {return count ? min : 0;}
+    /*!
+     * \brief Returns the largest amount added
+     * \return largest amount, 0 if empty
+     */
+    double getMax() const {return count ? max : 0;}
+    /*!
+     * \brief Adds an amount
+     * \param value amount, negative ones are taken as zero
+     * \param times number of times it is added
+     */
+    void add(double value, qint64 times = 1);
+    /*!
+     * \brief Adds the amounts of another sketch
+     * \param other sketch with the same relative accuracy
+     * \return false if the accuracies differ, in which case nothing is added
+     */
+    bool merge(const AmountSketch &other);
+    /*!
+     * \brief Returns the amount at a quantile, within the relative accuracy of the exact one
+     *
+     * The exact quantile q of n amounts is taken as the sorted amount at position floor(q (n - 1)).
+     * \param q quantile between 0 and 1, e.g. 0.5 for the median
+     * \return amount, 0 if empty
+     */
+    double quantile(double q) const;
+    /*!
+     * \brief Returns the histogram of the amounts in bins of equal width between the smallest and the largest
+     * \param bins number of bins
+     * \return bins, empty if the sketch is empty
+     */
+    QVector<HistogramBin> histogram(int bins) const;
+    /*!
+     * \brief Serializes the sketch to a compressed blob
+     * \return blob
+     */
+    QByteArray toByteArray() const;
+    /*!
+     * \brief Deserializes a sketch from a blob written by toByteArray()
+     * \param data blob
+     * \param ok set to false if the blob is corrupt or of another version
+     * \return sketch, empty if not ok
+     */
+    static AmountSketch fromByteArray(const QByteArray &data, bool *ok = 0);
+
+private:
+    /*!
+     * \brief Format version of the blob, increased when the layout changes
+     */
+    static const quint16 FormatVersion = 1;
+
+    /*!
+     * \brief Returns the bucket of an amount which is not taken as zero
+     * \param value amount
+     * \return bucket index
+     */
+    int bucketOf(double value) const;
+    /*!
+     * \brief Returns the amount representing a bucket
+     * \param bucket bucket index
+     * \return amount
+     */
+    double bucketValue(int bucket) const;
+    /*!
+     * \brief Adds a number of amounts to a bucket, growing the buckets if needed
+     * \param bucket bucket index
+     * \param times number of amounts
+     */
+    void addToBucket(int bucket, qint64 times);
+
+    //! \brief Relative accuracy
+    double accuracy;
+    //! \brief Base of the buckets, (1 + accuracy) / (1 - accuracy)
+    double gamma;
+    //! \brief Natural logarithm of gamma
+    double logGamma;
+    //! \brief Index of the first bucket of counts
+    int offset;
+    //! \brief Number of amounts of each bucket from offset on
+    QVector<qint64> counts;
+    //! \brief Number of amounts taken as zero
+    qint64 zeroCount;
+    //! \brief Number of amounts
+    qint64 count;
+    //! \brief Total of the amounts
+    double sum;
+    //! \brief Smallest amount
+    double min;
+    //! \brief Largest amount
+    double max;
+};
+
+#endif // AMOUNTSKETCH_H
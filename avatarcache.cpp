@@ -0,0 +1,466 @@
+#include "avatarcache.h"
+#include "trace.h"
+
+#include <QPixmapCache>
+#include <QtConcurrent>
+
+/*!
+ * Returns true if the text is a valid MD5 hash (it is used as file name)
+ */
+static bool isValidHash(const QString &hash)
+{
+    if(hash.size() != 32)
+        return false;
+    foreach(QChar c, hash)
+    {
+        if(!((c >= QLatin1Char('0') && c <= QLatin1Char('9')) || (c >= QLatin1Char('a') && c <= QLatin1Char('f'))))
+            return false;
+    }
+    return true;
+}
+
+/*!
+ * Returns the key of an avatar in QPixmapCache
+ */
+static QString pixmapKey(const QString &hash)
+{
+    return QLatin1String("avatar:") + hash;
+}
+
+/*!
+ * AvatarCache constructor
+ *
+ * The on-disk cache is placed in the cache location of the application and limited to 50 MB.
+ * Entries are revalidated after one day. Up to 4 downloads run at once and up to 4 MB of
+ * thumbnails of 32 pixels are kept in memory.
+ */
+AvatarCache::AvatarCache(QObject *parent) :
+    QObject(parent),
+    baseUrl(QLatin1String("https://www.gravatar.com/avatar/")),
+    maxDiskBytes(50 * 1024 * 1024),
+    diskBytes(0),
+    revalidateAfter(24 * 3600),
+    networkRequestCount(0),
+    maxConcurrentDownloads(4),
+    activeDownloads(0),
+    thumbnailSize(32),
+    thumbnails(4 * 1024 * 1024)
+{
+    connect(&manager, SIGNAL(finished(QNetworkReply*)), this, SLOT(replyFinished(QNetworkReply*)));
+    setCacheDirectory(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QLatin1String("/avatars"));
+}
+
+/*!
+ * Sets the directory of the on-disk cache and loads its index from the files present
+ */
+void AvatarCache::setCacheDirectory(const QString &path)
+{
+    cacheDirectory = path;
+    diskIndex.clear();
+    diskBytes = 0;
+
+    QDir dir(path);
+    if(!dir.exists() && !dir.mkpath(QLatin1String(".")))
+        qWarning() << "Unable to create avatar cache directory" << path;
+
+    foreach(const QFileInfo &info, dir.entryInfoList(QDir::Files))
+    {
+        if(!isValidHash(info.fileName()))
+            continue;
+        DiskEntry entry = {info.size(), info.lastModified().toMSecsSinceEpoch()};
+        diskIndex.insert(info.fileName(), entry);
+        diskBytes += entry.size;
+    }
+    evict();
+}
+
+/*!
+ * Sets the maximum size of the on-disk cache
+ */
+void AvatarCache::setMaxDiskBytes(qint64 bytes)
+{
+    maxDiskBytes = bytes;
+    evict();
+}
+
+/*!
+ * Sets the maximum number of downloads running at once
+ */
+void AvatarCache::setMaxConcurrentDownloads(int count)
+{
+    maxConcurrentDownloads = qMax(1, count);
+    startQueuedDownloads();
+}
+
+/*!
+ * Looks up an avatar in the memory tier only
+ */
+bool AvatarCache::findInMemory(const QString &hash, QPixmap *pixmap)
+{
+    return QPixmapCache::find(pixmapKey(hash), pixmap);
+}
+
+/*!
+ * Looks up a thumbnail in memory
+ */
+bool AvatarCache::findThumbnail(const QString &hash, QImage *image) const
+{
+    QImage *thumbnail = thumbnails.object(hash);
+    if(!thumbnail)
+        return false;
+    *image = *thumbnail;
+    return true;
+}
+
+/*!
+ * Requests the avatar of a hash
+ *
+ * The memory tier answers synchronously. Otherwise the avatar is read from disk, revalidated
+ * if it is older than the revalidation time, or downloaded. The answer is always given through
+ * avatarReady() or avatarUnavailable(), once for all the requests made in the meantime.
+ */
+void AvatarCache::request(const QString &hash)
+{
+    fetch(hash, false);
+}
+
+/*!
+ * Requests the thumbnail of a hash. The download, if needed, is queued after the explicit requests
+ */
+void AvatarCache::requestThumbnail(const QString &hash)
+{
+    fetch(hash, true);
+}
+
+/*!
+ * Requests the full avatar or the thumbnail of a hash
+ */
+void AvatarCache::fetch(const QString &hash, bool thumbnail)
+{
+    TRACE_FUNCTION();
+    if(!isValidHash(hash) || unavailable.contains(hash))
+    {
+        emit avatarUnavailable(hash);
+        return;
+    }
+
+    if(thumbnail)
+    {
+        QImage image;
+        if(findThumbnail(hash, &image))
+        {
+            emit thumbnailReady(hash, image);
+            return;
+        }
+        wantsThumbnail.insert(hash);
+    }
+    else
+    {
+        QPixmap pixmap;
+        if(findInMemory(hash, &pixmap))
+        {
+            emit avatarReady(hash, pixmap);
+            return;
+        }
+        wantsAvatar.insert(hash);
+    }
+
+    if(pending.contains(hash))
+    {
+        // Coalesced with the request in progress, which becomes urgent if it is still queued
+        if(!thumbnail)
+        {
+            for(int i = 0; i < downloadQueue.size(); i++)
+            {
+                if(downloadQueue.at(i).hash == hash)
+                {
+                    downloadQueue.prepend(downloadQueue.takeAt(i));
+                    break;
+                }
+            }
+        }
+        return;
+    }
+    pending.insert(hash);
+
+    QByteArray data, etag;
+    QDateTime validated;
+    if(readDisk(hash, &data, &etag, &validated))
+    {
+        touch(hash);
+        if(validated.secsTo(QDateTime::currentDateTimeUtc()) < revalidateAfter)
+        {
+            decode(hash, data);
+            return;
+        }
+    }
+
+    download(hash, etag, !thumbnail);
+}
+
+/*!
+ * Drops the thumbnail requests still waiting for a download. Requests of full avatars are kept
+ */
+void AvatarCache::cancelQueuedThumbnails()
+{
+    QList<QueuedDownload>::iterator it = downloadQueue.begin();
+    while(it != downloadQueue.end())
+    {
+        if(wantsAvatar.contains(it->hash))
+        {
+            ++it;
+            continue;
+        }
+        pending.remove(it->hash);
+        wantsThumbnail.remove(it->hash);
+        it = downloadQueue.erase(it);
+    }
+}
+
+/*!
+ * Sends a request for a hash to the server, conditional if the ETag is known.
+ * If all the slots are busy it is queued, before the prefetches if urgent.
+ */
+void AvatarCache::download(const QString &hash, const QByteArray &etag, bool urgent)
+{
+    QueuedDownload queued = {hash, etag};
+    if(urgent)
+        downloadQueue.prepend(queued);
+    else
+        downloadQueue.append(queued);
+    startQueuedDownloads();
+}
+
+/*!
+ * Starts queued downloads while there are free slots
+ */
+void AvatarCache::startQueuedDownloads()
+{
+    while(activeDownloads < maxConcurrentDownloads && !downloadQueue.isEmpty())
+    {
+        QueuedDownload queued = downloadQueue.takeFirst();
+
+        QUrl url = baseUrl.resolved(QUrl(queued.hash));
+        url.setQuery(QLatin1String("d=404"));
+
+        QNetworkRequest networkRequest(url);
+        networkRequest.setAttribute(QNetworkRequest::User, queued.hash);
+        networkRequest.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+        if(!queued.etag.isEmpty())
+            networkRequest.setRawHeader("If-None-Match", queued.etag);
+
+        activeDownloads++;
+        networkRequestCount++;
+        manager.get(networkRequest);
+    }
+}
+
+/*!
+ * Handles a finished download or revalidation
+ *
+ * 200 stores the new file, 304 keeps the cached one, 404 means the user has no avatar.
+ * On other errors the cached file is used if there is one.
+ */
+void AvatarCache::replyFinished(QNetworkReply *reply)
+{
+    TRACE_FUNCTION();
+    reply->deleteLater();
+    activeDownloads--;
+    startQueuedDownloads();
+
+    QString hash = reply->request().attribute(QNetworkRequest::User).toString();
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    if(reply->error() == QNetworkReply::ContentNotFoundError || status == 404)
+    {
+        unavailable.insert(hash);
+        finish(hash, DecodedImage());
+        return;
+    }
+
+    if(reply->error() == QNetworkReply::NoError && status == 200)
+    {
+        QByteArray data = reply->readAll();
+        writeDisk(hash, data, reply->rawHeader("ETag"));
+        decode(hash, data);
+        return;
+    }
+
+    if(reply->error() == QNetworkReply::NoError && status == 304)
+        writeDisk(hash, QByteArray(), reply->request().rawHeader("If-None-Match"));
+    else
+        qDebug() << "Error in" << reply->url() << ":" << reply->errorString();
+
+    QByteArray data;
+    if(readDisk(hash, &data, 0, 0))
+        decode(hash, data);
+    else
+        finish(hash, DecodedImage());
+}
+
+/*!
+ * Decodes image data and downscales it, called on a worker thread
+ */
+AvatarCache::DecodedImage AvatarCache::decodeImage(const QByteArray &data, int thumbnailSize)
+{
+    TRACE_FUNCTION();
+    DecodedImage decoded;
+    if(!decoded.image.loadFromData(data))
+        return decoded;
+    decoded.thumbnail = decoded.image.scaled(thumbnailSize, thumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    return decoded;
+}
+
+/*!
+ * Decodes image data on the thread pool and finishes the request of a hash
+ */
+void AvatarCache::decode(const QString &hash, const QByteArray &data)
+{
+    QFutureWatcher<DecodedImage> *watcher = new QFutureWatcher<DecodedImage>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, hash]() {
+        finish(hash, watcher->result());
+        watcher->deleteLater();
+    });
+    watcher->setFuture(QtConcurrent::run(&decodePool, &AvatarCache::decodeImage, data, thumbnailSize));
+}
+
+/*!
+ * Finishes the request of a hash, storing the images in memory and answering the requests made for it
+ */
+void AvatarCache::finish(const QString &hash, const DecodedImage &decoded)
+{
+    pending.remove(hash);
+    bool avatarWanted = wantsAvatar.remove(hash);
+    bool thumbnailWanted = wantsThumbnail.remove(hash);
+
+    if(decoded.image.isNull())
+    {
+        emit avatarUnavailable(hash);
+        return;
+    }
+
+    thumbnails.insert(hash, new QImage(decoded.thumbnail), decoded.thumbnail.byteCount());
+    if(thumbnailWanted)
+        emit thumbnailReady(hash, decoded.thumbnail);
+
+    if(avatarWanted)
+    {
+        QPixmap pixmap = QPixmap::fromImage(decoded.image);
+        QPixmapCache::insert(pixmapKey(hash), pixmap);
+        emit avatarReady(hash, pixmap);
+    }
+}
+
+/*!
+ * Returns the path of the image file of a hash
+ */
+QString AvatarCache::imagePath(const QString &hash) const
+{
+    return cacheDirectory + QLatin1Char('/') + hash;
+}
+
+/*!
+ * Returns the path of the metadata file of a hash
+ */
+QString AvatarCache::metaPath(const QString &hash) const
+{
+    return cacheDirectory + QLatin1Char('/') + hash + QLatin1String(".meta");
+}
+
+/*!
+ * Reads a disk entry. The metadata file holds the ETag and the last validation time
+ */
+bool AvatarCache::readDisk(const QString &hash, QByteArray *data, QByteArray *etag, QDateTime *validated)
+{
+    if(!diskIndex.contains(hash))
+        return false;
+
+    QFile imageFile(imagePath(hash));
+    if(!imageFile.open(QIODevice::ReadOnly))
+    {
+        diskBytes -= diskIndex.take(hash).size;
+        return false;
+    }
+    if(data)
+        *data = imageFile.readAll();
+
+    QFile metaFile(metaPath(hash));
+    QList<QByteArray> meta;
+    if(metaFile.open(QIODevice::ReadOnly))
+        meta = metaFile.readAll().split('\n');
+    if(etag)
+        *etag = meta.value(0);
+    if(validated)
+        *validated = QDateTime::fromMSecsSinceEpoch(meta.value(1).toLongLong(), Qt::UTC);
+
+    return true;
+}
+
+/*!
+ * Writes a disk entry and evicts old entries if needed
+ */
+void AvatarCache::writeDisk(const QString &hash, const QByteArray &data, const QByteArray &etag)
+{
+    if(!data.isEmpty())
+    {
+        QSaveFile imageFile(imagePath(hash));
+        if(!imageFile.open(QIODevice::WriteOnly) || imageFile.write(data) != data.size() || !imageFile.commit())
+        {
+            qWarning() << "Unable to write avatar" << imageFile.fileName();
+            return;
+        }
+        if(diskIndex.contains(hash))
+            diskBytes -= diskIndex.value(hash).size;
+        DiskEntry entry = {data.size(), QDateTime::currentMSecsSinceEpoch()};
+        diskIndex.insert(hash, entry);
+        diskBytes += entry.size;
+    }
+
+    QSaveFile metaFile(metaPath(hash));
+    if(metaFile.open(QIODevice::WriteOnly))
+    {
+        metaFile.write(etag + '\n' + QByteArray::number(QDateTime::currentMSecsSinceEpoch()));
+        metaFile.commit();
+    }
+
+    evict();
+}
+
+/*!
+ * Marks a disk entry as used now. The modification time of the file keeps the order across sessions
+ */
+void AvatarCache::touch(const QString &hash)
+{
+    QHash<QString, DiskEntry>::iterator it = diskIndex.find(hash);
+    if(it == diskIndex.end())
+        return;
+
+    QDateTime now = QDateTime::currentDateTime();
+    it->lastUse = now.toMSecsSinceEpoch();
+
+    QFile imageFile(imagePath(hash));
+    if(imageFile.open(QIODevice::ReadWrite))
+        imageFile.setFileTime(now, QFileDevice::FileModificationTime);
+}
+
+/*!
+ * Removes the least recently used entries until the cache fits its maximum size
+ */
+void AvatarCache::evict()
+{
+    while(diskBytes > maxDiskBytes && !diskIndex.isEmpty())
+    {
+        QHash<QString, DiskEntry>::const_iterator oldest = diskIndex.constBegin();
+        for(QHash<QString, DiskEntry>::const_iterator it = diskIndex.constBegin(); it != diskIndex.constEnd(); ++it)
+        {
+            if(it->lastUse < oldest->lastUse)
+                oldest = it;
+        }
+
+        QString hash = oldest.key();
+        diskBytes -= oldest->size;
+        diskIndex.remove(hash);
+        QFile::remove(imagePath(hash));
+        QFile::remove(metaPath(hash));
+    }
+}
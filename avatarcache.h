@@ -0,0 +1,320 @@
+#ifndef AVATARCACHE_H
+#define AVATARCACHE_H
+
+#include <QtCore>
+#include <QPixmap>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
+
+/*!
+ * \brief Two-tier cache of the Gravatar images of the users
+ *
+ * Avatars are keyed by the MD5 hash of the user email (User::getEmailHash()). Decoded avatars
+ * are kept in QPixmapCache and the downloaded files in an on-disk LRU directory, together with
+ * their ETag. Disk entries older than the revalidation time are revalidated with If-None-Match.
+ * All downloads share one network manager, at most a few of them run at once and the rest wait
+ * in a queue where explicit requests go before prefetches. Concurrent requests for the same hash
+ * are coalesced into one download. Images are decoded, and thumbnails downscaled, on a thread pool
+ * of the cache so the GUI thread never decodes.
+ */
+class AvatarCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    /*!
+     * \brief AvatarCache constructor
+     * \param parent parent object
+     */
+    explicit AvatarCache(QObject *parent = 0);
+    /*!
+     * \brief Sets the url the hashes are appended to (https://www.gravatar.com/avatar/ by default)
+     * \param url base url
+     */
+    void setBaseUrl(const QUrl &url) {baseUrl = url;}
+    /*!
+     * \brief Returns the url the hashes are appended to
+     * \return base url
+     */
+    QUrl getBaseUrl() const {return baseUrl;}
+    /*!
+     * \brief Sets the directory of the on-disk cache and loads its index
+     * \param path directory path
+     */
+    void setCacheDirectory(const QString &path);
+    /*!
+     * \brief Returns the directory of the on-disk cache
+     * \return directory path
+     */
+    QString getCacheDirectory() const {return cacheDirectory;}
+    /*!
+     * \brief Sets the maximum size of the on-disk cache. Least recently used files are evicted
+     * \param bytes maximum size in bytes
+     */
+    void setMaxDiskBytes(qint64 bytes);
+    /*!
+     * \brief Sets the age after which a disk entry is revalidated with the server
+     * \param seconds age in seconds
+     */
+    void setRevalidateAfter(int seconds) {revalidateAfter = seconds;}
+    /*!
+     * \brief Sets the maximum number of downloads running at once
+     * \param count number of downloads
+     */
+    void setMaxConcurrentDownloads(int count);
+    /*!
+     * \brief Sets the size of the square the thumbnails are downscaled to
+     * \param size side in pixels
+     */
+    void setThumbnailSize(int size) {thumbnailSize = size;}
+    /*!
+     * \brief Returns the size of the square the thumbnails are downscaled to
+     * \return side in pixels
+     */
+    int getThumbnailSize() const {return thumbnailSize;}
+    /*!
+     * \brief Returns the number of requests sent to the server
+     * \return number of requests
+     */
+    int getNetworkRequestCount() const {return networkRequestCount;}
+    /*!
+     * \brief Looks up an avatar in the memory tier only
+     * \param hash MD5 hash of the user email
+     * \param pixmap found avatar
+     * \return true if found
+     */
+    bool findInMemory(const QString &hash, QPixmap *pixmap);
+    /*!
+     * \brief Looks up a thumbnail in memory
+     * \param hash MD5 hash of the user email
+     * \param image found thumbnail
+     * \return true if found
+     */
+    bool findThumbnail(const QString &hash, QImage *image) const;
+
+public slots:
+    /*!
+     * \brief Requests the avatar of a hash. Emits avatarReady() or avatarUnavailable()
+     * \param hash MD5 hash of the user email
+     */
+    void request(const QString &hash);
+    /*!
+     * \brief Requests the thumbnail of a hash with low priority. Emits thumbnailReady() or avatarUnavailable()
+     * \param hash MD5 hash of the user email
+     */
+    void requestThumbnail(const QString &hash);
+    /*!
+     * \brief Drops the thumbnail requests still waiting for a download, e.g. rows scrolled out of view
+     */
+    void cancelQueuedThumbnails();
+
+signals:
+    /*!
+     * \brief An avatar has been loaded
+     * \param hash MD5 hash of the user email
+     * \param pixmap avatar
+     */
+    void avatarReady(const QString &hash, const QPixmap &pixmap);
+    /*!
+     * \brief A thumbnail has been loaded
+     * \param hash MD5 hash of the user email
+     * \param image thumbnail, downscaled off the GUI thread
+     */
+    void thumbnailReady(const QString &hash, const QImage &image);
+    /*!
+     * \brief The user has no avatar or it could not be loaded
+     * \param hash MD5 hash of the user email
+     */
+    void avatarUnavailable(const QString &hash);
+
+private slots:
+    /*!
+     * \brief Handles a finished download or revalidation
+     * \param reply network reply
+     */
+    void replyFinished(QNetworkReply *reply);
+
+private:
+    /*!
+     * \brief Entry of the on-disk index
+     */
+    struct DiskEntry
+    {
+        //! \brief Size of the image file in bytes
+        qint64 size;
+        //! \brief Last use in milliseconds since epoch
+        qint64 lastUse;
+    };
+
+    /*!
+     * \brief Download waiting for a free slot
+     */
+    struct QueuedDownload
+    {
+        //! \brief MD5 hash of the user email
+        QString hash;
+        //! \brief ETag of the cached file, empty if not cached
+        QByteArray etag;
+    };
+
+    /*!
+     * \brief Result of decoding an avatar
+     */
+    struct DecodedImage
+    {
+        //! \brief Image at full size
+        QImage image;
+        //! \brief Image downscaled to the thumbnail size
+        QImage thumbnail;
+    };
+
+    /*!
+     * \brief Decodes image data and downscales it, called on a worker thread
+     * \param data encoded image
+     * \param thumbnailSize side of the thumbnail in pixels
+     * \return decoded images, null if the data is not valid
+     */
+    static DecodedImage decodeImage(const QByteArray &data, int thumbnailSize);
+    /*!
+     * \brief Requests the full avatar or the thumbnail of a hash
+     * \param hash MD5 hash of the user email
+     * \param thumbnail true for the thumbnail
+     */
+    void fetch(const QString &hash, bool thumbnail);
+    /*!
+     * \brief Decodes image data on the thread pool and finishes the request of a hash
+     * \param hash MD5 hash of the user email
+     * \param data encoded image
+     */
+    void decode(const QString &hash, const QByteArray &data);
+    /*!
+     * \brief Finishes the request of a hash
+     * \param hash MD5 hash of the user email
+     * \param image decoded image, null if unavailable
+     */
+    void finish(const QString &hash, const DecodedImage &decoded);
+    /*!
+     * \brief Sends a request for a hash to the server, or queues it if all the slots are busy
+     * \param hash MD5 hash of the user email
+     * \param etag ETag of the cached file, empty if not cached
+     * \param urgent true to queue it before the prefetches
+     */
+    void download(const QString &hash, const QByteArray &etag, bool urgent);
+    /*!
+     * \brief Starts queued downloads while there are free slots
+     */
+    void startQueuedDownloads();
+    /*!
+     * \brief Returns the path of the image file of a hash
+     * \param hash MD5 hash of the user email
+     * \return file path
+     */
+    QString imagePath(const QString &hash) const;
+    /*!
+     * \brief Returns the path of the metadata file (ETag and validation time) of a hash
+     * \param hash MD5 hash of the user email
+     * \return file path
+     */
+    QString metaPath(const QString &hash) const;
+    /*!
+     * \brief Reads a disk entry
+     * \param hash MD5 hash of the user email
+     * \param data encoded image
+     * \param etag ETag given by the server
+     * \param validated last time the entry was validated with the server
+     * \return true if the entry exists
+     */
+    bool readDisk(const QString &hash, QByteArray *data, QByteArray *etag, QDateTime *validated);
+    /*!
+     * \brief Writes a disk entry and evicts old entries if needed
+     * \param hash MD5 hash of the user email
+     * \param data encoded image (empty to keep the current one)
+     * \param etag ETag given by the server
+     */
+    void writeDisk(const QString &hash, const QByteArray &data, const QByteArray &etag);
+    /*!
+     * \brief Marks a disk entry as used now
+     * \param hash MD5 hash of the user email
+     */
+    void touch(const QString &hash);
+    /*!
+     * \brief Removes the least recently used entries until the cache fits its maximum size
+     */
+    void evict();
+
+    /*!
+     * \brief Network manager shared by all the downloads
+     */
+    QNetworkAccessManager manager;
+    /*!
+     * \brief Threads decoding the images
+     */
+    QThreadPool decodePool;
+    /*!
+     * \brief Url the hashes are appended to
+     */
+    QUrl baseUrl;
+    /*!
+     * \brief Directory of the on-disk cache
+     */
+    QString cacheDirectory;
+    /*!
+     * \brief Maximum size of the on-disk cache in bytes
+     */
+    qint64 maxDiskBytes;
+    /*!
+     * \brief Current size of the on-disk cache in bytes
+     */
+    qint64 diskBytes;
+    /*!
+     * \brief Age in seconds after which a disk entry is revalidated
+     */
+    int revalidateAfter;
+    /*!
+     * \brief Number of requests sent to the server
+     */
+    int networkRequestCount;
+    /*!
+     * \brief Maximum number of downloads running at once
+     */
+    int maxConcurrentDownloads;
+    /*!
+     * \brief Number of downloads running
+     */
+    int activeDownloads;
+    /*!
+     * \brief Downloads waiting for a free slot
+     */
+    QList<QueuedDownload> downloadQueue;
+    /*!
+     * \brief Side of the thumbnails in pixels
+     */
+    int thumbnailSize;
+    /*!
+     * \brief Decoded thumbnails, the cost is their size in bytes
+     */
+    QCache<QString, QImage> thumbnails;
+    /*!
+     * \brief Index of the on-disk cache
+     */
+    QHash<QString, DiskEntry> diskIndex;
+    /*!
+     * \brief Hashes being downloaded or decoded. Further requests for them are coalesced
+     */
+    QSet<QString> pending;
+    /*!
+     * \brief Pending hashes whose full avatar has been requested
+     */
+    QSet<QString> wantsAvatar;
+    /*!
+     * \brief Pending hashes whose thumbnail has been requested
+     */
+    QSet<QString> wantsThumbnail;
+    /*!
+     * \brief Hashes without avatar in this session
+     */
+    QSet<QString> unavailable;
+};
+
+#endif // AVATARCACHE_H
@@ -0,0 +1,96 @@
+#include "avatarproxymodel.h"
+#include "dbclasses.h"
+#include "trace.h"
+
+/*!
+ * AvatarProxyModel constructor
+ *
+ * Prefetches 20 rows after the visible ones by default. Thumbnails arriving within 50 ms
+ * are shown with a single update of the view.
+ */
+AvatarProxyModel::AvatarProxyModel(AvatarCache *cache, int emailColumn, int decorationColumn, QObject *parent) :
+    QIdentityProxyModel(parent),
+    cache(cache),
+    emailColumn(emailColumn),
+    decorationColumn(decorationColumn),
+    lookAhead(20)
+{
+    updateTimer.setSingleShot(true);
+    updateTimer.setInterval(50);
+    connect(&updateTimer, &QTimer::timeout, this, &AvatarProxyModel::updateDecorations);
+    connect(cache, &AvatarCache::thumbnailReady, this, &AvatarProxyModel::thumbnailReady);
+}
+
+/*!
+ * Sets the columns of the source model. The proxy is kept by the users table and given a new
+ * source model on every reload.
+ */
+void AvatarProxyModel::setColumns(int emailColumn, int decorationColumn)
+{
+    this->emailColumn = emailColumn;
+    this->decorationColumn = decorationColumn;
+}
+
+/*!
+ * Returns the data of an item. The decoration of the decoration column is the thumbnail of the user
+ * if it is already in memory, nothing otherwise
+ */
+QVariant AvatarProxyModel::data(const QModelIndex &index, int role) const
+{
+    if(role != Qt::DecorationRole || index.column() != decorationColumn)
+        return QIdentityProxyModel::data(index, role);
+
+    QImage thumbnail;
+    if(cache->findThumbnail(hashOfRow(index.row()), &thumbnail))
+        return thumbnail;
+    return QVariant();
+}
+
+/*!
+ * Queues the thumbnails of a range of rows plus the look-ahead. Queued thumbnails of rows
+ * no longer visible are dropped so scrolling does not pile up downloads.
+ */
+void AvatarProxyModel::prefetch(int firstRow, int lastRow)
+{
+    TRACE_FUNCTION();
+    cache->cancelQueuedThumbnails();
+
+    if(firstRow < 0)
+        firstRow = 0;
+    lastRow = qMin(lastRow + lookAhead, rowCount() - 1);
+    for(int row = firstRow; row <= lastRow; row++)
+    {
+        QString hash = hashOfRow(row);
+        if(!hash.isEmpty())
+            cache->requestThumbnail(hash);
+    }
+}
+
+/*!
+ * Schedules a repaint of the decoration column once a thumbnail is ready
+ */
+void AvatarProxyModel::thumbnailReady()
+{
+    if(!updateTimer.isActive())
+        updateTimer.start();
+}
+
+/*!
+ * Notifies the views that the decorations changed, they only repaint the visible rows
+ */
+void AvatarProxyModel::updateDecorations()
+{
+    if(rowCount() == 0)
+        return;
+    emit dataChanged(index(0, decorationColumn), index(rowCount() - 1, decorationColumn),
+                     QVector<int>() << Qt::DecorationRole);
+}
+
+/*!
+ * Returns the email hash of the user of a row. User::emailHash() trims the email and turns it
+ * to lower case, so the hash is the one Gravatar and User::getEmailHash() give.
+ */
+QString AvatarProxyModel::hashOfRow(int row) const
+{
+    return User::emailHash(index(row, emailColumn).data().toString());
+}
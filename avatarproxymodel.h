@@ -0,0 +1,94 @@
+#ifndef AVATARPROXYMODEL_H
+#define AVATARPROXYMODEL_H
+
+#include <QIdentityProxyModel>
+#include <QTimer>
+#include "avatarcache.h"
+
+/*!
+ * \brief Proxy model which adds the gravatar thumbnails of the users as decoration of a column
+ *
+ * Thumbnails are only read from the memory of the AvatarCache, data() never downloads nor decodes.
+ * They are loaded in the background by prefetch() and shown once ready.
+ */
+class AvatarProxyModel : public QIdentityProxyModel
+{
+    Q_OBJECT
+
+public:
+    /*!
+     * \brief AvatarProxyModel constructor
+     * \param cache avatar cache providing the thumbnails
+     * \param emailColumn column of the source model holding the email
+     * \param decorationColumn column where the thumbnails are shown
+     * \param parent parent object
+     */
+    AvatarProxyModel(AvatarCache *cache, int emailColumn, int decorationColumn, QObject *parent = 0);
+    /*!
+     * \brief Returns the data of an item, the thumbnail of the user for the decoration role of the decoration column
+     * \param index item index
+     * \param role data role
+     * \return data
+     */
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    /*!
+     * \brief Sets the columns of the source model, e.g. before setting a new one
+     * \param emailColumn column of the source model holding the email
+     * \param decorationColumn column where the thumbnails are shown
+     */
+    void setColumns(int emailColumn, int decorationColumn);
+    /*!
+     * \brief Sets the number of rows after the visible ones which are also prefetched
+     * \param rows number of rows
+     */
+    void setLookAhead(int rows) {lookAhead = rows;}
+
+public slots:
+    /*!
+     * \brief Queues the thumbnails of a range of rows plus the look-ahead, dropping the previous queued ones
+     * \param firstRow first visible row
+     * \param lastRow last visible row
+     */
+    void prefetch(int firstRow, int lastRow);
+
+private slots:
+    /*!
+     * \brief Schedules a repaint of the decoration column once a thumbnail is ready
+     */
+    void thumbnailReady();
+    /*!
+     * \brief Notifies the views that the decorations changed
+     */
+    void updateDecorations();
+
+private:
+    /*!
+     * \brief Returns the email hash of the user of a row
+     * \param row row of the model
+     * \return MD5 hash of the email, trimmed and in lower case, see User::emailHash()
+     */
+    QString hashOfRow(int row) const;
+
+    /*!
+     * \brief Avatar cache providing the thumbnails
+     */
+    AvatarCache *cache;
+    /*!
+     * \brief Column of the source model holding the email
+     */
+    int emailColumn;
+    /*!
+     * \brief Column where the thumbnails are shown
+     */
+    int decorationColumn;
+    /*!
+     * \brief Number of rows after the visible ones which are also prefetched
+     */
+    int lookAhead;
+    /*!
+     * \brief Coalesces the repaints of thumbnails arriving close in time
+     */
+    QTimer updateTimer;
+};
+
+#endif // AVATARPROXYMODEL_H
@@ -0,0 +1,118 @@
+#include "balanceindex.h"
+
+#include <algorithm>
+
+/*!
+ * Empty BalanceIndex constructor
+ */
+BalanceIndex::BalanceIndex()
+{
+}
+
+/*!
+ * BalanceIndex constructor from a set of flows
+ *
+ * Flows are grouped per user and day first, so each tree is built only once.
+ */
+BalanceIndex::BalanceIndex(const QVector<Flow> &flows)
+{
+    QHash<int, QMap<qint64, double> > perUser;
+    foreach(const Flow &flow, flows)
+        perUser[flow.userId][flow.day] += flow.amount;
+
+    for(QHash<int, QMap<qint64, double> >::const_iterator it = perUser.constBegin(); it != perUser.constEnd(); ++it)
+    {
+        Series &s = series[it.key()];
+        s.days = it.value().keys().toVector();
+        s.values = it.value().values().toVector();
+        rebuild(s);
+    }
+}
+
+/*!
+ * Adds a flow of money to a user
+ *
+ * If the user already has a flow on that day, only the tree is updated. Otherwise the day
+ * is inserted in the sorted days of the user and the tree of that user is rebuilt.
+ */
+void BalanceIndex::add(int userId, qint64 day, double amount)
+{
+    Series &s = series[userId];
+    QVector<qint64>::iterator it = std::lower_bound(s.days.begin(), s.days.end(), day);
+    int pos = int(it - s.days.begin());
+
+    if(it != s.days.end() && *it == day)
+    {
+        s.values[pos] += amount;
+        for(int i = pos + 1; i < s.tree.size(); i += i & -i)
+            s.tree[i] += amount;
+    }
+    else
+    {
+        s.days.insert(pos, day);
+        s.values.insert(pos, amount);
+        rebuild(s);
+    }
+}
+
+/*!
+ * Returns the balance of a user including all the days up to a given one
+ */
+double BalanceIndex::balanceAsOf(int userId, qint64 day) const
+{
+    QHash<int, Series>::const_iterator it = series.constFind(userId);
+    if(it == series.constEnd())
+        return 0;
+
+    const Series &s = it.value();
+    int count = int(std::upper_bound(s.days.constBegin(), s.days.constEnd(), day) - s.days.constBegin());
+    return prefixSum(s, count);
+}
+
+/*!
+ * Returns the balance of a user over an interval of days
+ */
+double BalanceIndex::balanceBetween(int userId, qint64 fromDay, qint64 toDay) const
+{
+    if(toDay < fromDay)
+        return 0;
+    return balanceAsOf(userId, toDay) - balanceAsOf(userId, fromDay - 1);
+}
+
+/*!
+ * Returns the balances of all the users up to a given day
+ */
+QHash<int, double> BalanceIndex::balancesAsOf(qint64 day) const
+{
+    QHash<int, double> balances;
+    for(QHash<int, Series>::const_iterator it = series.constBegin(); it != series.constEnd(); ++it)
+        balances.insert(it.key(), balanceAsOf(it.key(), day));
+    return balances;
+}
+
+/*!
+ * Rebuilds the (1-based) Fenwick tree of a series from its values in O(n)
+ */
+void BalanceIndex::rebuild(Series &s)
+{
+    const int n = s.values.size();
+    s.tree.fill(0, n + 1);
+    for(int i = 1; i <= n; i++)
+    {
+        s.tree[i] += s.values[i - 1];
+        int parent = i + (i & -i);
+        if(parent <= n)
+            s.tree[parent] += s.tree[i];
+    }
+}
+
+/*!
+ * Returns the sum of the first values of a series in O(log n)
+ */
+double BalanceIndex::prefixSum(const Series &s, int count)
+{
+    double sum = 0;
+    for(int i = count; i > 0; i -= i & -i)
+        sum += s.tree[i];
+    return sum;
+}
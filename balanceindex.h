@@ -0,0 +1,98 @@
+#ifndef BALANCEINDEX_H
+#define BALANCEINDEX_H
+
+#include <QtCore>
+
+/*!
+ * \brief Point-in-time balances of the users of one event
+ *
+ * For each user the net flow per day (money given minus money received) is kept in a
+ * Fenwick tree over the sorted days in which the user has transactions. Balances as of a
+ * date or over an interval are answered in O(log n) and a transaction is added in O(log n),
+ * or O(n) for that user when it introduces a new day.
+ */
+class BalanceIndex
+{
+public:
+    //! \brief Flow of money of one user on one day
+    struct Flow
+    {
+        //! \brief User id
+        int userId;
+        //! \brief Julian day number
+        qint64 day;
+        //! \brief Amount given (positive) or received (negative)
+        double amount;
+    };
+
+    //! \brief Empty BalanceIndex constructor
+    BalanceIndex();
+    /*!
+     * \brief BalanceIndex constructor from a set of flows, built in O(n log n)
+     * \param flows flows of money, in any order
+     */
+    explicit BalanceIndex(const QVector<Flow> &flows);
+    /*!
+     * \brief Adds a flow of money to a user
+     * \param userId user id
+     * \param day Julian day number of the transaction
+     * \param amount amount given (positive) or received (negative)
+     */
+    void add(int userId, qint64 day, double amount);
+    /*!
+     * \brief Returns the balance of a user including all the days up to a given one
+     * \param userId user id
+     * \param day Julian day number (included)
+     * \return money given minus money received
+     */
+    double balanceAsOf(int userId, qint64 day) const;
+    /*!
+     * \brief Returns the balance of a user over an interval of days
+     * \param userId user id
+     * \param fromDay first Julian day number (included)
+     * \param toDay last Julian day number (included)
+     * \return money given minus money received
+     */
+    double balanceBetween(int userId, qint64 fromDay, qint64 toDay) const;
+    /*!
+     * \brief Returns the balances of all the users up to a given day
+     * \param day Julian day number (included)
+     * \return balance of each user id
+     */
+    QHash<int, double> balancesAsOf(qint64 day) const;
+    /*!
+     * \brief Returns the ids of the users with flows in the index
+     * \return user ids
+     */
+    QList<int> getUsers() const {return series.keys();}
+
+private:
+    /*!
+     * \brief Flows of one user: sorted days, amount of each day and Fenwick tree over them
+     */
+    struct Series
+    {
+        QVector<qint64> days;
+        QVector<double> values;
+        QVector<double> tree;
+    };
+    /*!
+     * \brief Rebuilds the Fenwick tree of a series from its values in O(n)
+     * \param s series
+     */
+    static void rebuild(Series &s);
+    /*!
+     * \brief Returns the sum of the first values of a series
+     * \param s series
+     * \param count number of values
+     * \return sum
+     */
+    static double prefixSum(const Series &s, int count);
+
+    /*!
+     * \brief Flows of each user id
+     */
+    QHash<int, Series> series;
+};
+
+#endif // BALANCEINDEX_H
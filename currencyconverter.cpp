@@ -0,0 +1,237 @@
+#include "currencyconverter.h"
+#include "trace.h"
+
+#include <algorithm>
+
+/*!
+ * CurrencyConverter constructor without rates
+ */
+CurrencyConverter::CurrencyConverter(const QString &base)
+{
+    this->base = base;
+}
+
+/*!
+ * Adds the rate of a currency on a day
+ */
+void CurrencyConverter::addRate(const QString &currency, qint64 day, double factor)
+{
+    rates[currency].insert(day, factor);
+}
+
+/*!
+ * Returns the factor converting one row: the rate of the last day up to the given one,
+ * or the first rate if there is none before
+ */
+double CurrencyConverter::factor(const QString &currency, qint64 day) const
+{
+    if(currency.isEmpty() || currency == base)
+        return 1;
+    QHash<QString, QMap<qint64, double> >::const_iterator dayRates = rates.constFind(currency);
+    if(dayRates == rates.constEnd())
+        return 0;
+    QMap<qint64, double>::const_iterator rate = dayRates.value().upperBound(day);
+    if(rate != dayRates.value().constBegin())
+        --rate;
+    return rate.value();
+}
+
+/*!
+ * Converts a batch of amounts to the base currency
+ *
+ * The rows not in the base currency are sorted by a key made of the index of their currency
+ * and their day, and their amounts gathered into a block in that order. The rates of each
+ * currency are then walked forward together with its rows, and every run of rows with the
+ * same key is multiplied by one factor. Finally the amounts are scattered back.
+ */
+int CurrencyConverter::convert(const QVector<QString> &currencies, const QVector<qint64> &days, QVector<double> &amounts) const
+{
+    TRACE_FUNCTION();
+    // Key of a row: index of its currency in the high 32 bits, day in the low ones
+    struct Row
+    {
+        quint64 key;
+        int index;
+    };
+    QVector<Row> rows;
+    rows.reserve(amounts.size());
+    QHash<QString, int> codes;
+    QVector<const QMap<qint64, double> *> codeRates;
+    QString lastCurrency;
+    int lastCode = -1;
+    for(int i = 0; i < amounts.size(); i++)
+    {
+        const QString &currency = currencies.at(i);
+        if(currency.isEmpty() || currency == base)
+            continue;
+        if(lastCode < 0 || currency != lastCurrency)
+        {
+            QHash<QString, int>::const_iterator code = codes.constFind(currency);
+            if(code == codes.constEnd())
+            {
+                QHash<QString, QMap<qint64, double> >::const_iterator dayRates = rates.constFind(currency);
+                codeRates.append(dayRates == rates.constEnd() ? nullptr : &dayRates.value());
+                code = codes.insert(currency, codeRates.size() - 1);
+            }
+            lastCurrency = currency;
+            lastCode = code.value();
+        }
+        Row row = {(quint64(lastCode) << 32) | quint32(qMax<qint64>(days.at(i), 0)), i};
+        rows.append(row);
+    }
+    std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {return a.key < b.key;});
+
+    // Gather
+    const int count = rows.size();
+    QVector<double> block(count);
+    double *values = block.data();
+    const double *source = amounts.constData();
+    for(int k = 0; k < count; k++)
+        values[k] = source[rows.at(k).index];
+
+    int missing = 0;
+    int j = 0;
+    while(j < count)
+    {
+        const quint64 code = rows.at(j).key >> 32;
+        int currencyEnd = j;
+        while(currencyEnd < count && rows.at(currencyEnd).key >> 32 == code)
+            currencyEnd++;
+
+        const QMap<qint64, double> *dayRates = codeRates.at(int(code));
+        if(!dayRates)
+        {
+            missing += currencyEnd - j;
+            j = currencyEnd;
+            continue;
+        }
+
+        QMap<qint64, double>::const_iterator rate = dayRates->constBegin();
+        QMap<qint64, double>::const_iterator next = rate;
+        ++next;
+        while(j < currencyEnd)
+        {
+            const quint64 key = rows.at(j).key;
+            const qint64 day = qint64(key & 0xffffffff);
+            while(next != dayRates->constEnd() && next.key() <= day)
+                rate = next++;
+
+            int runEnd = j;
+            while(runEnd < currencyEnd && rows.at(runEnd).key == key)
+                runEnd++;
+            const double factor = rate.value();
+            for(int k = j; k < runEnd; k++)
+                values[k] *= factor;
+            j = runEnd;
+        }
+    }
+
+    // Scatter
+    double *target = amounts.data();
+    for(int k = 0; k < count; k++)
+        target[rows.at(k).index] = values[k];
+    return missing;
+}
+
+/*!
+ * Reads exchange rates in CSV format: date,currency,base,rate
+ */
+QVector<CurrencyConverter::Rate> CurrencyConverter::readRates(QIODevice *device, QStringList *errors)
+{
+    TRACE_FUNCTION();
+    QVector<Rate> rates;
+    QTextStream in(device);
+    int lineNumber = 0;
+
+    while(!in.atEnd())
+    {
+        QString line = in.readLine();
+        lineNumber++;
+        if(line.trimmed().isEmpty())
+            continue;
+
+        QStringList fields = line.split(QLatin1Char(','));
+        if(lineNumber == 1 && fields.first().trimmed().compare(QLatin1String("date"), Qt::CaseInsensitive) == 0)
+            continue; // Header
+
+        Rate rate;
+        rate.date = QDate::fromString(fields.value(0).trimmed(), Qt::ISODate);
+        rate.currency = fields.value(1).trimmed().toUpper();
+        rate.base = fields.value(2).trimmed().toUpper();
+        bool isNumber = false;
+        rate.rate = fields.value(3).trimmed().toDouble(&isNumber);
+
+        QString problem;
+        if(fields.size() != 4)
+            problem = "Expected date,currency,base,rate";
+        else if(!rate.date.isValid())
+            problem = "The date is not valid";
+        else if(rate.currency.size() != 3 || rate.base.size() != 3)
+            problem = "The currencies must be given as three-letter codes";
+        else if(rate.currency == rate.base)
+            problem = "The currency and the base must differ";
+        else if(!isNumber || rate.rate <= 0)
+            problem = "The rate must be a positive number";
+
+        if(problem.isEmpty())
+            rates.append(rate);
+        else if(errors)
+            errors->append(QString("Line %1: %2").arg(lineNumber).arg(problem));
+    }
+
+    return rates;
+}
+
+/*!
+ * Times the batch conversion against a rate lookup per row
+ *
+ * Five currencies with a rate for every day of two years are converted to EUR. A sixth of
+ * the rows are in EUR and one in a hundred is undated.
+ */
+QString CurrencyConverter::benchmark(int rows)
+{
+    const QStringList codes = QStringList() << "EUR" << "PLN" << "USD" << "GBP" << "CHF" << "CZK";
+    const double levels[] = {1.0, 4.3, 1.1, 0.85, 1.08, 25.0};
+    const qint64 firstDay = QDate(2016, 1, 1).toJulianDay();
+    const int dayCount = 730;
+    QRandomGenerator random(1);
+
+    CurrencyConverter converter(codes.first());
+    for(int c = 1; c < codes.size(); c++)
+        for(int d = 0; d < dayCount; d++)
+            converter.addRate(codes.at(c), firstDay + d, 1 / (levels[c] * (0.95 + random.bounded(0.1))));
+
+    QVector<QString> currencies(rows);
+    QVector<qint64> days(rows);
+    QVector<double> amounts(rows);
+    for(int i = 0; i < rows; i++)
+    {
+        currencies[i] = codes.at(random.bounded(codes.size()));
+        days[i] = random.bounded(100) ? firstDay + random.bounded(dayCount) : 0;
+        amounts[i] = random.bounded(1, 10000) / 100.0;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QVector<double> reference(rows);
+    for(int i = 0; i < rows; i++)
+        reference[i] = amounts.at(i) * converter.factor(currencies.at(i), days.at(i));
+    qint64 referenceNs = timer.nsecsElapsed();
+
+    QVector<double> result = amounts;
+    timer.restart();
+    int missing = converter.convert(currencies, days, result);
+    qint64 batchNs = timer.nsecsElapsed();
+
+    double maxDifference = 0;
+    for(int i = 0; i < rows; i++)
+        maxDifference = qMax(maxDifference, qAbs(result.at(i) - reference.at(i)));
+
+    QString report;
+    QTextStream out(&report);
+    out << "Conversion of " << rows << " amounts in " << codes.size() << " currencies to " << converter.getBase() << "\n";
+    out << "    lookup per row     " << QString::number(referenceNs / 1e6, 'f', 1).rightJustified(10) << " ms\n";
+    out << "    batch              " << QString::number(batchNs / 1e6, 'f', 1).rightJustified(10) << " ms\n";
+    out << "    " << missing << " without rate, largest difference " << maxDifference << "\n";
+    return report;
+}
@@ -0,0 +1,98 @@
+#ifndef CURRENCYCONVERTER_H
+#define CURRENCYCONVERTER_H
+
+#include <QtCore>
+
+/*!
+ * \brief Conversion of amounts in several currencies to a base currency with dated rates
+ *
+ * A row uses the last rate known on its day, or the first rate of its currency if it is older
+ * than all of them or undated. Amounts are converted in batches: the rows are sorted by
+ * currency and day, gathered into one block, and each run of rows sharing currency and day
+ * is multiplied by the same factor in a tight loop, so the rates of a currency are walked
+ * once per batch instead of being looked up for every row.
+ */
+class CurrencyConverter
+{
+public:
+    //! \brief Exchange rate of one day
+    struct Rate
+    {
+        //! \brief Day of the rate
+        QDate date;
+        //! \brief ISO 4217 code of the converted currency
+        QString currency;
+        //! \brief ISO 4217 code of the base currency
+        QString base;
+        //! \brief Units of currency for one unit of base
+        double rate;
+    };
+
+    /*!
+     * \brief CurrencyConverter constructor without rates
+     * \param base ISO 4217 code of the currency the amounts are converted to
+     */
+    explicit CurrencyConverter(const QString &base = QString());
+    /*!
+     * \brief Returns the currency the amounts are converted to
+     * \return ISO 4217 code
+     */
+    QString getBase() const {return base;}
+    /*!
+     * \brief Adds the rate of a currency on a day, replacing the one of that day if any
+     * \param currency ISO 4217 code
+     * \param day Julian day number
+     * \param factor value in the base currency of one unit of currency
+     */
+    void addRate(const QString &currency, qint64 day, double factor);
+    /*!
+     * \brief Returns true if there is any rate for a currency
+     * \param currency ISO 4217 code
+     * \return true if it can be converted
+     */
+    bool hasRates(const QString &currency) const {return currency == base || rates.contains(currency);}
+    /*!
+     * \brief Returns the factor converting one row, looking its rate up
+     * \param currency ISO 4217 code, empty for the base currency
+     * \param day Julian day number, 0 if undated
+     * \return value in the base currency of one unit of currency, 0 if there is no rate
+     */
+    double factor(const QString &currency, qint64 day) const;
+    /*!
+     * \brief Converts a batch of amounts to the base currency
+     * \param currencies ISO 4217 code of each amount, empty for the base currency
+     * \param days Julian day number of each amount, 0 if undated
+     * \param amounts amounts, converted in place (those without a rate are left as they are)
+     * \return number of amounts without a rate
+     */
+    int convert(const QVector<QString> &currencies, const QVector<qint64> &days, QVector<double> &amounts) const;
+
+    /*!
+     * \brief Reads exchange rates in CSV format: date,currency,base,rate
+     *
+     * The date is given as yyyy-MM-dd and the rate as units of currency for one unit of base,
+     * e.g. "2016-09-01,PLN,EUR,4.33". A first line starting with "date" is taken as header.
+     * \param device opened device with the rates
+     * \param errors description of the skipped lines
+     * \return valid rates
+     */
+    static QVector<Rate> readRates(QIODevice *device, QStringList *errors);
+    /*!
+     * \brief Times the batch conversion against a rate lookup per row on random amounts
+     * \param rows number of amounts
+     * \return report
+     */
+    static QString benchmark(int rows);
+
+private:
+    /*!
+     * \brief Currency the amounts are converted to
+     */
+    QString base;
+    /*!
+     * \brief Factor of each day, by currency
+     */
+    QHash<QString, QMap<qint64, double> > rates;
+};
+
+#endif // CURRENCYCONVERTER_H
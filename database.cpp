@@ -1,11 +1,44 @@
 #include "database.h"
+#include "querystats.h"
+#include "startupprofile.h"
+#include "trace.h"
+
+#include <algorithm>
 
 /*!
  * Database constructor
+ *
+ * If initialize is false the database is not opened until init() is called, which allows
+ * showing the main window before touching the database file. With memoryPath() as path the
+ * database lives in memory only, see saveSnapshot() and loadSnapshot().
+ */
+DataBase::DataBase(bool initialize, const QString &path)
+{
+    // Every instance has its own connection, so several ledgers can be open at once
+    static QAtomicInt instances;
+    connectionName = QString("CheapyApp_%1").arg(instances.fetchAndAddRelaxed(1) + 1);
+
+    if(path.isEmpty())
+        dbPath = QDir::toNativeSeparators(QLatin1String("CheapyApp.db3"));
+    else
+        dbPath = path;
+    ownerThread = QThread::currentThread();
+    kittyId = -1;
+    userIndexLoaded = false;
+    statementsPrepared = 0;
+    DuplicateCheck noCheck = {DuplicateCheck::Off, 0, 0};
+    duplicateCheck = noCheck;
+    lastDuplicate = -1;
+    if(initialize)
+        lastError = init();
+}
+
+/*!
+ * Database destructor, closes the connection of the database and its clones
  */
-DataBase::DataBase()
+DataBase::~DataBase()
 {
-    lastError = init();
+    closeConnections();
 }
 
 /*!
@@ -13,15 +46,16 @@ DataBase::DataBase()
  */
 int DataBase::getKittyId(bool loadFromDb)
 {
+    TRACE_FUNCTION();
     if(loadFromDb)
     {
-        QSqlQueryModel *model = new QSqlQueryModel;
+        QSqlQueryModel model;
 
-        model->setQuery("SELECT id FROM users WHERE nickname = 'Kitty'");
+        QueryStats::setQuery(&model, "SELECT id FROM users WHERE nickname = 'Kitty'", Q_FUNC_INFO, db);
 
-        kittyId = model->data(model->index(0,0)).toInt();
+        kittyId = model.data(model.index(0,0)).toInt();
 
-        lastError = model->lastError();
+        lastError = model.lastError();
     }
     return kittyId;
 }
@@ -36,75 +70,588 @@ QSqlError DataBase::getLastError()
 
 /*!
  * Initializes the database
+ *
+ * Opens the connection of this instance and creates the tables if needed.
  */
 QSqlError DataBase::init()
 {
-    db = QSqlDatabase::addDatabase("QSQLITE");
+    TRACE_FUNCTION();
+    if (!openConnection())
+        return db.lastError();
+    StartupProfile::mark(StartupProfile::DbOpen);
 
-    QString path = getDbPath();
-    db.setDatabaseName(path);
+    QSqlError err = prepareSchema(db);
+    if (err.type() != QSqlError::NoError)
+        return err;
+    StartupProfile::mark(StartupProfile::SchemaCheck);
 
-    if (!db.open())
+    kittyId = getKittyId(true);
+    return QSqlError();
+}
+
+/*!
+ * Initializes the database from a file prepared by prepareFile() on a worker thread
+ *
+ * The schema has been created or migrated on the worker connection and the kitty id read
+ * there, so opening the connection of this instance is all that is left for its thread.
+ */
+QSqlError DataBase::init(const StartupState &state)
+{
+    TRACE_FUNCTION();
+    if (state.error.type() != QSqlError::NoError)
+        return state.error;
+    if (!openConnection())
         return db.lastError();
 
-    QStringList tables = db.tables();
+    kittyId = state.kittyId;
+    return QSqlError();
+}
+
+/*!
+ * Creates the tables and the kitty user if they are not present in the database
+ *
+ * Only uses the given connection, so it can run on a worker thread with its own connection.
+ */
+QSqlError DataBase::prepareSchema(QSqlDatabase database)
+{
+    TRACE_FUNCTION();
+    QStringList tables = database.tables();
     if (tables.contains("users", Qt::CaseInsensitive)
         && tables.contains("events", Qt::CaseInsensitive)
         && tables.contains("transactions", Qt::CaseInsensitive))
     {
-        qDebug() << "Database file present. Tables: " << db.tables();
+        qDebug() << "Database file present. Tables: " << tables;
+        return migrateSchema(database);
+    }
 
-        kittyId = getKittyId(true);
-        return QSqlError();
+    //! \todo erase database in case it is an old version, or check version/integrity
+    QSqlQuery q(database);
+
+    qDebug() << "No database file present. Creating tables...";
+
+    if (!QueryStats::exec(q, QLatin1String("create table users("
+                                                "id integer primary key, "
+                                                "name text, "
+                                                "nickname text not null unique, "
+                                                "email text not null unique, "
+                                                "passwordhash text not null, "
+                                                "passwordsalt text not null, "
+                                                "birthdate date"
+                                            ")"), Q_FUNC_INFO))
+        return q.lastError();
+    if (!QueryStats::exec(q, QLatin1String("create table events("
+                                                "id integer primary key, "
+                                                "name text not null, "
+                                                "creation date, "
+                                                "place text, "
+                                                "description text, "
+                                                "finished integer not null, "
+                                                "admin integer references users(id)"
+                                            ")"), Q_FUNC_INFO))
+        return q.lastError();
+    if (!QueryStats::exec(q, QLatin1String("create table transactions("
+                                                "id integer primary key, "
+                                                "usergives integer references users(id), "
+                                                "userreceives integer references users(id), "
+                                                "event integer references events(id), "
+                                                "amount real not null, "
+                                                "transactionDate date, "
+                                                "place text, "
+                                                "description text"
+                                            ")"), Q_FUNC_INFO))
+        return q.lastError();
+
+    if (!q.prepare(getInsertUserQuery()))
+        return q.lastError();
+
+    User kitty = User(QLatin1String("Kitty"), QLatin1String("Kitty"), QLatin1String("kitty@cheapyapp.com"), QString("password"), QDate(2000, 1, 1));
+    q.addBindValue(kitty.getName());
+    q.addBindValue(kitty.getNickname());
+    q.addBindValue(kitty.getEmail());
+    q.addBindValue(kitty.getPasswordHash());
+    q.addBindValue(kitty.getPasswordSalt());
+    q.addBindValue(dateToDay(kitty.getBirthdate()));
+    if (!QueryStats::exec(q, Q_FUNC_INFO))
+        return q.lastError();
+
+    return migrateSchema(database);
+}
+
+/*!
+ * Brings the schema of an existing database up to date
+ *
+ * The schema version is stored in PRAGMA user_version. Each missing version is applied in
+ * its own transaction, with the statements given by migrationSteps(). The fingerprints, which
+ * sql cannot compute, are then set on the transactions added without them.
+ */
+QSqlError DataBase::migrateSchema(QSqlDatabase database)
+{
+    TRACE_FUNCTION();
+    QSqlQuery q(database);
+    if (!QueryStats::exec(q, QLatin1String("PRAGMA user_version"), Q_FUNC_INFO))
+        return q.lastError();
+    int version = q.next() ? q.value(0).toInt() : 0;
+    q.finish();
+    const bool fullTextSearch = version < SchemaVersion && hasFullTextSearch(database);
+
+    while (version < SchemaVersion)
+    {
+        version++;
+        qDebug() << "Migrating database to schema version" << version;
+
+        database.transaction();
+        QStringList steps = migrationSteps(version, fullTextSearch);
+        steps.append(QString("PRAGMA user_version = %1").arg(version));
+        foreach (const QString &step, steps)
+        {
+            if (!QueryStats::exec(q, step, Q_FUNC_INFO))
+            {
+                QSqlError err = q.lastError();
+                database.rollback();
+                return err;
+            }
+        }
+        if (!database.commit())
+            return database.lastError();
     }
-    else
+
+    return fillFingerprints(database);
+}
+
+/*!
+ * Sets the fingerprint of the transactions added before schema version 11 or by other programs
+ */
+QSqlError DataBase::fillFingerprints(QSqlDatabase database)
+{
+    TRACE_FUNCTION();
+    QSqlQuery q(database);
+    q.setForwardOnly(true);
+    if (!QueryStats::exec(q, QLatin1String("SELECT id, coalesce(usergives, -1), coalesce(userreceives, -1), coalesce(event, -1), "
+                                           "coalesce(description, '') FROM transactions WHERE fingerprint IS NULL"), Q_FUNC_INFO))
+        return q.lastError();
+    QVariantList ids, fingerprints;
+    while (q.next())
     {
-        //! \todo erase database in case it is an old version, or check version/integrity
-        QSqlQuery q;
-
-        qDebug() << "No database file present. Creating tables...";
-
-        if (!q.exec(QLatin1String("create table users("
-                                      "id integer primary key, "
-                                      "name text, "
-                                      "nickname text not null unique, "
-                                      "email text not null unique, "
-                                      "passwordhash text not null, "
-                                      "passwordsalt text not null, "
-                                      "birthdate date"
-                                  ")")))
-            return q.lastError();
-        if (!q.exec(QLatin1String("create table events("
-                                      "id integer primary key, "
-                                      "name text not null, "
-                                      "creation date, "
-                                      "place text, "
-                                      "description text, "
-                                      "finished integer not null, "
-                                      "admin integer references users(id)"
-                                  ")")))
-            return q.lastError();
-        if (!q.exec(QLatin1String("create table transactions("
-                                      "id integer primary key, "
-                                      "usergives integer references users(id), "
-                                      "userreceives integer references users(id), "
-                                      "event integer references events(id), "
-                                      "amount real not null, "
-                                      "transactionDate date, "
-                                      "place text, "
-                                      "description text"
-                                  ")")))
-            return q.lastError();
-
-        if (!q.prepare(getInsertUserQuery()))
-            return q.lastError();
-
-        User kitty = User(QLatin1String("Kitty"), QLatin1String("Kitty"), QLatin1String("kitty@cheapyapp.com"), QString("password"), QDate(2000, 1, 1));
-        kitty.setId(addUser(q, kitty).toInt());
-
-        kittyId = kitty.getId();
+        ids << q.value(0);
+        fingerprints << transactionFingerprint(q.value(1).toInt(), q.value(2).toInt(), q.value(3).toInt(), q.value(4).toString());
+    }
+    q.finish();
+    if (ids.isEmpty())
         return QSqlError();
+
+    database.transaction();
+    q.prepare("UPDATE transactions SET fingerprint = ? WHERE id = ?");
+    q.addBindValue(fingerprints);
+    q.addBindValue(ids);
+    if (!QueryStats::execBatch(q, Q_FUNC_INFO))
+    {
+        QSqlError err = q.lastError();
+        database.rollback();
+        return err;
+    }
+    if (!database.commit())
+        return database.lastError();
+    return QSqlError();
+}
+
+/*!
+ * Returns the statements which migrate the schema from the previous version to the given one
+ */
+QStringList DataBase::migrationSteps(int version, bool fullTextSearch)
+{
+    QStringList steps;
+    switch (version)
+    {
+    case 1:
+        // Dates as integer Julian day numbers (QDate::toJulianDay) instead of ISO text.
+        // julianday() returns the number at midnight, so half a day is added before truncating.
+        steps << "UPDATE transactions SET transactionDate = CAST(julianday(transactionDate) + 0.5 AS INTEGER) "
+                     "WHERE typeof(transactionDate) = 'text'"
+              << "UPDATE events SET creation = CAST(julianday(creation) + 0.5 AS INTEGER) "
+                     "WHERE typeof(creation) = 'text'"
+              << "UPDATE users SET birthdate = CAST(julianday(birthdate) + 0.5 AS INTEGER) "
+                     "WHERE typeof(birthdate) = 'text'"
+              << "CREATE INDEX IF NOT EXISTS transactions_event_date ON transactions(event, transactionDate)"
+              << "CREATE INDEX IF NOT EXISTS transactions_date ON transactions(transactionDate)"
+              << "CREATE INDEX IF NOT EXISTS events_creation ON events(creation)";
+        break;
+    case 2:
+        // Per-event totals kept exact by triggers, see getEventSummary(). Only insert and delete are
+        // handled since transactions are never updated in place. The kitty is not a participant.
+        steps << "CREATE TABLE event_summary("
+                     "event integer primary key, "
+                     "kitty_in real not null default 0, "
+                     "kitty_out real not null default 0, "
+                     "volume real not null default 0, "
+                     "participants integer not null default 0, "
+                     "transactions integer not null default 0, "
+                     "last_date integer"
+                 ")"
+              << "CREATE TABLE event_participants("
+                     "event integer not null, "
+                     "user integer not null, "
+                     "transactions integer not null, "
+                     "PRIMARY KEY(event, user)"
+                 ") WITHOUT ROWID"
+              << "CREATE TRIGGER event_summary_insert AFTER INSERT ON transactions WHEN NEW.event IS NOT NULL "
+                 "BEGIN "
+                     "INSERT OR IGNORE INTO event_summary(event) VALUES (NEW.event); "
+                     "INSERT OR IGNORE INTO event_participants(event, user, transactions) "
+                         "SELECT NEW.event, user, 0 FROM (SELECT NEW.usergives AS user UNION SELECT NEW.userreceives) "
+                         "WHERE user IS NOT NULL AND user IS NOT (SELECT id FROM users WHERE nickname = 'Kitty'); "
+                     "UPDATE event_participants SET transactions = transactions + 1 "
+                         "WHERE event = NEW.event AND user IN (NEW.usergives, NEW.userreceives); "
+                     "UPDATE event_summary SET "
+                         "kitty_in = kitty_in + (CASE WHEN NEW.userreceives = (SELECT id FROM users WHERE nickname = 'Kitty') THEN NEW.amount ELSE 0 END), "
+                         "kitty_out = kitty_out + (CASE WHEN NEW.usergives = (SELECT id FROM users WHERE nickname = 'Kitty') THEN NEW.amount ELSE 0 END), "
+                         "volume = volume + NEW.amount, "
+                         "participants = (SELECT COUNT(*) FROM event_participants WHERE event = NEW.event), "
+                         "transactions = transactions + 1, "
+                         "last_date = max(coalesce(last_date, NEW.transactionDate), coalesce(NEW.transactionDate, last_date)) "
+                         "WHERE event = NEW.event; "
+                 "END"
+              << "CREATE TRIGGER event_summary_delete AFTER DELETE ON transactions WHEN OLD.event IS NOT NULL "
+                 "BEGIN "
+                     "UPDATE event_participants SET transactions = transactions - 1 "
+                         "WHERE event = OLD.event AND user IN (OLD.usergives, OLD.userreceives); "
+                     "DELETE FROM event_participants WHERE event = OLD.event AND transactions <= 0; "
+                     "UPDATE event_summary SET "
+                         "kitty_in = kitty_in - (CASE WHEN OLD.userreceives = (SELECT id FROM users WHERE nickname = 'Kitty') THEN OLD.amount ELSE 0 END), "
+                         "kitty_out = kitty_out - (CASE WHEN OLD.usergives = (SELECT id FROM users WHERE nickname = 'Kitty') THEN OLD.amount ELSE 0 END), "
+                         "volume = volume - OLD.amount, "
+                         "participants = (SELECT COUNT(*) FROM event_participants WHERE event = OLD.event), "
+                         "transactions = transactions - 1, "
+                         "last_date = CASE WHEN OLD.transactionDate IS last_date "
+                             "THEN (SELECT MAX(transactionDate) FROM transactions WHERE event = OLD.event) "
+                             "ELSE last_date END "
+                         "WHERE event = OLD.event; "
+                     "DELETE FROM event_summary WHERE event = OLD.event AND transactions <= 0; "
+                 "END";
+        steps << eventSummaryRebuildSteps();
+        break;
+    case 3:
+        // Money given to (inflow) and taken from (outflow) the kitty per event and day, see
+        // getKittyBalanceSeries(). Undated transactions are kept under day 0.
+        steps << "CREATE TABLE kitty_ledger("
+                     "event integer not null, "
+                     "day integer not null, "
+                     "inflow real not null default 0, "
+                     "outflow real not null default 0, "
+                     "transactions integer not null default 0, "
+                     "PRIMARY KEY(event, day)"
+                 ") WITHOUT ROWID"
+              << "CREATE TRIGGER kitty_ledger_insert AFTER INSERT ON transactions "
+                 "WHEN NEW.event IS NOT NULL AND (SELECT id FROM users WHERE nickname = 'Kitty') IN (NEW.usergives, NEW.userreceives) "
+                 "BEGIN "
+                     "INSERT OR IGNORE INTO kitty_ledger(event, day) VALUES (NEW.event, coalesce(NEW.transactionDate, 0)); "
+                     "UPDATE kitty_ledger SET "
+                         "inflow = inflow + (CASE WHEN NEW.userreceives = (SELECT id FROM users WHERE nickname = 'Kitty') THEN NEW.amount ELSE 0 END), "
+                         "outflow = outflow + (CASE WHEN NEW.usergives = (SELECT id FROM users WHERE nickname = 'Kitty') THEN NEW.amount ELSE 0 END), "
+                         "transactions = transactions + 1 "
+                         "WHERE event = NEW.event AND day = coalesce(NEW.transactionDate, 0); "
+                 "END"
+              << "CREATE TRIGGER kitty_ledger_delete AFTER DELETE ON transactions "
+                 "WHEN OLD.event IS NOT NULL AND (SELECT id FROM users WHERE nickname = 'Kitty') IN (OLD.usergives, OLD.userreceives) "
+                 "BEGIN "
+                     "UPDATE kitty_ledger SET "
+                         "inflow = inflow - (CASE WHEN OLD.userreceives = (SELECT id FROM users WHERE nickname = 'Kitty') THEN OLD.amount ELSE 0 END), "
+                         "outflow = outflow - (CASE WHEN OLD.usergives = (SELECT id FROM users WHERE nickname = 'Kitty') THEN OLD.amount ELSE 0 END), "
+                         "transactions = transactions - 1 "
+                         "WHERE event = OLD.event AND day = coalesce(OLD.transactionDate, 0); "
+                     "DELETE FROM kitty_ledger WHERE event = OLD.event AND day = coalesce(OLD.transactionDate, 0) AND transactions <= 0; "
+                 "END"
+              << kittyLedgerRebuildSteps();
+        break;
+    case 4:
+        // Frozen calculations of the finished events, see EventSnapshot. Any change to the
+        // transactions of an event, reopening it or deleting it drops its snapshot.
+        steps << "CREATE TABLE event_snapshots("
+                     "event integer primary key, "
+                     "created integer not null, "
+                     "data blob not null"
+                 ")"
+              << "CREATE TRIGGER event_snapshots_insert AFTER INSERT ON transactions WHEN NEW.event IS NOT NULL "
+                 "BEGIN DELETE FROM event_snapshots WHERE event = NEW.event; END"
+              << "CREATE TRIGGER event_snapshots_delete AFTER DELETE ON transactions WHEN OLD.event IS NOT NULL "
+                 "BEGIN DELETE FROM event_snapshots WHERE event = OLD.event; END"
+              << "CREATE TRIGGER event_snapshots_reopen AFTER UPDATE OF finished ON events WHEN NOT NEW.finished "
+                 "BEGIN DELETE FROM event_snapshots WHERE event = NEW.id; END"
+              << "CREATE TRIGGER event_snapshots_event_delete AFTER DELETE ON events "
+                 "BEGIN DELETE FROM event_snapshots WHERE event = OLD.id; END";
+        break;
+    case 5:
+        // Foreign keys looked up by the cascading deletes (transactions.event is covered
+        // by transactions_event_date)
+        steps << "CREATE INDEX IF NOT EXISTS transactions_usergives ON transactions(usergives)"
+              << "CREATE INDEX IF NOT EXISTS transactions_userreceives ON transactions(userreceives)"
+              << "CREATE INDEX IF NOT EXISTS events_admin ON events(admin)";
+        break;
+    case 6:
+        // Currencies: the amount of a transaction is in the currency of its event unless it has
+        // its own. Rates are units of currency for one unit of base on a day, see CurrencyConverter
+        steps << QString("ALTER TABLE events ADD COLUMN currency text not null default '%1'").arg(defaultCurrency())
+              << "ALTER TABLE transactions ADD COLUMN currency text"
+              << "CREATE TABLE exchange_rates("
+                     "base text not null, "
+                     "currency text not null, "
+                     "day integer not null, "
+                     "rate real not null, "
+                     "PRIMARY KEY(base, currency, day)"
+                 ") WITHOUT ROWID"
+              << "CREATE INDEX transactions_foreign_currency ON transactions(event) WHERE currency IS NOT NULL";
+        break;
+    case 7:
+        // Split expenses: one row per expense with the shares packed in a blob, see
+        // SplitExpense::packShares(). They are expanded into transactions when calculating
+        steps << "CREATE TABLE splits("
+                     "id integer primary key, "
+                     "payer integer references users(id), "
+                     "event integer references events(id), "
+                     "amount real not null, "
+                     "splitDate integer, "
+                     "place text, "
+                     "description text, "
+                     "currency text, "
+                     "shares blob not null"
+                 ")"
+              << "CREATE INDEX splits_event ON splits(event)"
+              << "CREATE INDEX splits_payer ON splits(payer)"
+              << "CREATE TRIGGER event_snapshots_split_insert AFTER INSERT ON splits WHEN NEW.event IS NOT NULL "
+                 "BEGIN DELETE FROM event_snapshots WHERE event = NEW.event; END"
+              << "CREATE TRIGGER event_snapshots_split_delete AFTER DELETE ON splits WHEN OLD.event IS NOT NULL "
+                 "BEGIN DELETE FROM event_snapshots WHERE event = OLD.event; END";
+        break;
+    case 8:
+        // Full-text index of the descriptions and places, see searchTransactions(). Without FTS5
+        // the search scans the transactions, rebuildSearchIndex() adds it later to existing files
+        if(fullTextSearch)
+            steps << searchIndexSteps();
+        break;
+    case 9:
+        // Money given (direction 0) and received (direction 1) per event, day and user, and spent
+        // per event and place, see getSpendingSeries(). Undated transactions are kept under day 0,
+        // those without place under ''. Like kitty_ledger they hold the amounts as they are
+        steps << "CREATE TABLE spending_rollup("
+                     "event integer not null, "
+                     "day integer not null, "
+                     "user integer not null, "
+                     "direction integer not null, "
+                     "amount real not null default 0, "
+                     "transactions integer not null default 0, "
+                     "PRIMARY KEY(event, day, user, direction)"
+                 ") WITHOUT ROWID"
+              << "CREATE TABLE place_rollup("
+                     "event integer not null, "
+                     "place text not null, "
+                     "amount real not null default 0, "
+                     "transactions integer not null default 0, "
+                     "PRIMARY KEY(event, place)"
+                 ") WITHOUT ROWID"
+              << "CREATE TRIGGER spending_rollup_insert AFTER INSERT ON transactions WHEN NEW.event IS NOT NULL "
+                 "BEGIN "
+                     "INSERT OR IGNORE INTO spending_rollup(event, day, user, direction) "
+                         "SELECT NEW.event, coalesce(NEW.transactionDate, 0), user, direction "
+                         "FROM (SELECT NEW.usergives AS user, 0 AS direction UNION ALL SELECT NEW.userreceives, 1) "
+                         "WHERE user IS NOT NULL; "
+                     "UPDATE spending_rollup SET amount = amount + NEW.amount, transactions = transactions + 1 "
+                         "WHERE event = NEW.event AND day = coalesce(NEW.transactionDate, 0) AND user = NEW.usergives AND direction = 0; "
+                     "UPDATE spending_rollup SET amount = amount + NEW.amount, transactions = transactions + 1 "
+                         "WHERE event = NEW.event AND day = coalesce(NEW.transactionDate, 0) AND user = NEW.userreceives AND direction = 1; "
+                     "INSERT OR IGNORE INTO place_rollup(event, place) VALUES (NEW.event, coalesce(NEW.place, '')); "
+                     "UPDATE place_rollup SET amount = amount + NEW.amount, transactions = transactions + 1 "
+                         "WHERE event = NEW.event AND place = coalesce(NEW.place, ''); "
+                 "END"
+              << "CREATE TRIGGER spending_rollup_delete AFTER DELETE ON transactions WHEN OLD.event IS NOT NULL "
+                 "BEGIN "
+                     "UPDATE spending_rollup SET amount = amount - OLD.amount, transactions = transactions - 1 "
+                         "WHERE event = OLD.event AND day = coalesce(OLD.transactionDate, 0) AND user = OLD.usergives AND direction = 0; "
+                     "UPDATE spending_rollup SET amount = amount - OLD.amount, transactions = transactions - 1 "
+                         "WHERE event = OLD.event AND day = coalesce(OLD.transactionDate, 0) AND user = OLD.userreceives AND direction = 1; "
+                     "DELETE FROM spending_rollup WHERE event = OLD.event AND day = coalesce(OLD.transactionDate, 0) "
+                         "AND user IN (OLD.usergives, OLD.userreceives) AND transactions <= 0; "
+                     "UPDATE place_rollup SET amount = amount - OLD.amount, transactions = transactions - 1 "
+                         "WHERE event = OLD.event AND place = coalesce(OLD.place, ''); "
+                     "DELETE FROM place_rollup WHERE event = OLD.event AND place = coalesce(OLD.place, '') AND transactions <= 0; "
+                 "END"
+              << spendingRollupRebuildSteps();
+        break;
+    case 10:
+        // Sketch of the amounts given per event and user, see getAmountSketch(). They are added to
+        // by addTransaction() and filled on first use, deleting a transaction drops those of its event
+        steps << "CREATE TABLE amount_sketches("
+                     "event integer not null, "
+                     "user integer not null, "
+                     "transactions integer not null, "
+                     "data blob not null, "
+                     "PRIMARY KEY(event, user)"
+                 ") WITHOUT ROWID"
+              << "CREATE TRIGGER amount_sketches_delete AFTER DELETE ON transactions WHEN OLD.event IS NOT NULL "
+                 "BEGIN DELETE FROM amount_sketches WHERE event = OLD.event; END";
+        break;
+    case 11:
+        // Fingerprint of the users, event and description, see transactionFingerprint(). Dates
+        // follow it in the index so the rows of a fingerprint are matched within a window of days.
+        // The existing rows get theirs after the migration, see fillFingerprints()
+        steps << "ALTER TABLE transactions ADD COLUMN fingerprint integer"
+              << "CREATE INDEX transactions_fingerprint ON transactions(fingerprint, transactionDate)";
+        break;
+    }
+    return steps;
+}
+
+/*!
+ * Returns the statements which create transactions_fts, its triggers and fill it
+ *
+ * The index is external content: it stores only the tokens and reads the text from
+ * transactions, so the triggers give the old text back when deleting it. Prefixes of
+ * two and three characters are indexed, so that short words typed in the search box
+ * are looked up instead of scanning the terms.
+ */
+QStringList DataBase::searchIndexSteps()
+{
+    return QStringList()
+        << "CREATE VIRTUAL TABLE IF NOT EXISTS transactions_fts USING fts5("
+               "description, place, content='transactions', content_rowid='id', prefix='2 3')"
+        << "CREATE TRIGGER IF NOT EXISTS transactions_fts_insert AFTER INSERT ON transactions "
+           "BEGIN "
+               "INSERT INTO transactions_fts(rowid, description, place) VALUES (NEW.id, NEW.description, NEW.place); "
+           "END"
+        << "CREATE TRIGGER IF NOT EXISTS transactions_fts_delete AFTER DELETE ON transactions "
+           "BEGIN "
+               "INSERT INTO transactions_fts(transactions_fts, rowid, description, place) VALUES ('delete', OLD.id, OLD.description, OLD.place); "
+           "END"
+        << "CREATE TRIGGER IF NOT EXISTS transactions_fts_update AFTER UPDATE OF description, place ON transactions "
+           "BEGIN "
+               "INSERT INTO transactions_fts(transactions_fts, rowid, description, place) VALUES ('delete', OLD.id, OLD.description, OLD.place); "
+               "INSERT INTO transactions_fts(rowid, description, place) VALUES (NEW.id, NEW.description, NEW.place); "
+           "END"
+        << "INSERT INTO transactions_fts(transactions_fts) VALUES ('rebuild')";
+}
+
+/*!
+ * Returns the statements which fill spending_rollup and place_rollup from the transactions
+ */
+QStringList DataBase::spendingRollupRebuildSteps()
+{
+    return QStringList()
+        << "DELETE FROM spending_rollup"
+        << "INSERT INTO spending_rollup(event, day, user, direction, amount, transactions) "
+               "SELECT event, day, user, direction, TOTAL(amount), COUNT(*) FROM ("
+                   "SELECT event, coalesce(transactionDate, 0) AS day, usergives AS user, 0 AS direction, amount "
+                       "FROM transactions WHERE event IS NOT NULL AND usergives IS NOT NULL "
+                   "UNION ALL "
+                   "SELECT event, coalesce(transactionDate, 0), userreceives, 1, amount "
+                       "FROM transactions WHERE event IS NOT NULL AND userreceives IS NOT NULL"
+               ") GROUP BY event, day, user, direction"
+        << "DELETE FROM place_rollup"
+        << "INSERT INTO place_rollup(event, place, amount, transactions) "
+               "SELECT event, coalesce(place, ''), TOTAL(amount), COUNT(*) FROM transactions "
+               "WHERE event IS NOT NULL GROUP BY event, coalesce(place, '')";
+}
+
+/*!
+ * Returns the statements which fill kitty_ledger from the transactions
+ */
+QStringList DataBase::kittyLedgerRebuildSteps()
+{
+    return QStringList()
+        << "DELETE FROM kitty_ledger"
+        << "INSERT INTO kitty_ledger(event, day, inflow, outflow, transactions) "
+               "SELECT event, coalesce(transactionDate, 0), "
+                   "TOTAL(CASE WHEN userreceives = (SELECT id FROM users WHERE nickname = 'Kitty') THEN amount END), "
+                   "TOTAL(CASE WHEN usergives = (SELECT id FROM users WHERE nickname = 'Kitty') THEN amount END), "
+                   "COUNT(*) "
+               "FROM transactions WHERE event IS NOT NULL "
+               "AND (SELECT id FROM users WHERE nickname = 'Kitty') IN (usergives, userreceives) "
+               "GROUP BY event, coalesce(transactionDate, 0)";
+}
+
+/*!
+ * Returns the statements which fill event_summary and event_participants from the transactions
+ */
+QStringList DataBase::eventSummaryRebuildSteps()
+{
+    return QStringList()
+        << "DELETE FROM event_participants"
+        << "INSERT INTO event_participants(event, user, transactions) "
+               "SELECT event, user, COUNT(*) FROM ("
+                   "SELECT id, event, usergives AS user FROM transactions "
+                   "UNION SELECT id, event, userreceives FROM transactions"
+               ") WHERE event IS NOT NULL AND user IS NOT NULL "
+               "AND user IS NOT (SELECT id FROM users WHERE nickname = 'Kitty') "
+               "GROUP BY event, user"
+        << "DELETE FROM event_summary"
+        << "INSERT INTO event_summary(event, kitty_in, kitty_out, volume, participants, transactions, last_date) "
+               "SELECT event, "
+                   "TOTAL(CASE WHEN userreceives = (SELECT id FROM users WHERE nickname = 'Kitty') THEN amount END), "
+                   "TOTAL(CASE WHEN usergives = (SELECT id FROM users WHERE nickname = 'Kitty') THEN amount END), "
+                   "TOTAL(amount), "
+                   "(SELECT COUNT(*) FROM event_participants p WHERE p.event = t.event), "
+                   "COUNT(*), MAX(transactionDate) "
+               "FROM transactions t WHERE event IS NOT NULL GROUP BY event";
+}
+
+/*!
+ * Converts a date to the day number stored in the database
+ */
+QVariant DataBase::dateToDay(const QDate &date)
+{
+    if (!date.isValid())
+        return QVariant(QVariant::LongLong);
+    return QVariant(date.toJulianDay());
+}
+
+/*!
+ * Converts a day number stored in the database to a date
+ */
+QDate DataBase::dayToDate(const QVariant &day)
+{
+    if (day.isNull())
+        return QDate();
+    return QDate::fromJulianDay(day.toLongLong());
+}
+
+/*!
+ * Prepares the database file on a worker thread
+ *
+ * Opens the file with a private connection, creates or migrates the tables, checks if the
+ * database is empty and reads the kitty id. Running this before init(const StartupState &)
+ * leaves only opening the connection to the GUI thread.
+ */
+DataBase::StartupState DataBase::prepareFile(const QString &path)
+{
+    TRACE_FUNCTION();
+    const QString connectionName = QLatin1String("CheapyApp_startup_") + path;
+    StartupState state;
+    state.empty = true;
+    state.kittyId = -1;
+
+    {
+        QSqlDatabase database = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        database.setDatabaseName(path);
+
+        if (!database.open())
+            state.error = database.lastError();
+        else
+        {
+            StartupProfile::mark(StartupProfile::DbOpen);
+            state.error = prepareSchema(database);
+            if (state.error.type() == QSqlError::NoError)
+            {
+                StartupProfile::mark(StartupProfile::SchemaCheck);
+                state.empty = isDatabaseEmpty(database);
+
+                QSqlQuery query(database);
+                QueryStats::exec(query, QLatin1String("SELECT id FROM users WHERE nickname = 'Kitty'"), Q_FUNC_INFO);
+                if (query.next())
+                    state.kittyId = query.value(0).toInt();
+            }
+            database.close();
+        }
     }
+    QSqlDatabase::removeDatabase(connectionName);
+
+    return state;
 }
 
 /*!
@@ -112,89 +659,326 @@ QSqlError DataBase::init()
  */
 bool DataBase::deleteDb()
 {
-    // Close database and remove connection
-    QString connection;
-    connection = db.connectionName();
-    db.close();
-    db = QSqlDatabase();
-    db.removeDatabase(connection);
+    TRACE_FUNCTION();
+    closeDb();
 
+    // The data of an in-memory database is gone with its connection
+    if(isInMemory())
+        return true;
     QString path = getDbPath();
     return QFile::remove(path);
 }
 
+/*!
+ * Closes the database and drops the data cached from it, the other ledgers are not touched
+ */
+void DataBase::closeDb()
+{
+    closeConnections();
+    balanceIndexes.clear();
+    expandedTransactions.clear();
+    converters.clear();
+    userIndex = UserIndex();
+    userIndexLoaded = false;
+}
+
+/*!
+ * Opens the connection of this instance
+ *
+ * An in-memory database is opened as a named shared-cache database, so the connections
+ * cloned for worker threads see the same data and each instance still has its own.
+ */
+bool DataBase::openConnection()
+{
+    if(db.isValid())
+        closeConnections();
+
+    db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    if(isInMemory())
+    {
+        db.setConnectOptions(QLatin1String("QSQLITE_OPEN_URI"));
+        db.setDatabaseName(QString("file:%1?mode=memory&cache=shared").arg(connectionName));
+    }
+    else
+        db.setDatabaseName(getDbPath());
+    ownerThread = QThread::currentThread();
+    return db.open();
+}
+
+/*!
+ * Closes and removes the connection of this instance and the ones cloned for worker threads
+ */
+void DataBase::closeConnections()
+{
+    idleStatements.clear();
+    if(db.isValid())
+    {
+        db.close();
+        db = QSqlDatabase();
+        QSqlDatabase::removeDatabase(connectionName);
+    }
+
+    QMutexLocker locker(&threadConnectionsMutex);
+    foreach (const QString &name, threadConnections)
+        QSqlDatabase::removeDatabase(name);
+    threadConnections.clear();
+}
+
+/*!
+ * Returns a connection to the database usable from the calling thread
+ *
+ * Qt connections can only be used from the thread which created them, so the first call
+ * from a worker thread clones the connection for that thread. Later calls reuse the clone.
+ */
+QSqlDatabase DataBase::threadConnection()
+{
+    if(QThread::currentThread() == ownerThread)
+        return db;
+
+    QString name = QString("%1_thread_%2").arg(connectionName).arg(quintptr(QThread::currentThreadId()));
+    if(QSqlDatabase::contains(name))
+        return QSqlDatabase::database(name);
+
+    QSqlDatabase clone = QSqlDatabase::addDatabase("QSQLITE", name);
+    clone.setConnectOptions(db.connectOptions());
+    clone.setDatabaseName(db.databaseName());
+    clone.open();
+
+    QMutexLocker locker(&threadConnectionsMutex);
+    threadConnections << name;
+    return clone;
+}
+
+/*!
+ * Returns the totals of the ledger, from the thread calling it
+ *
+ * Only uses threadConnection() and touches no member but the connections, so several
+ * ledgers can be summarized at once on worker threads.
+ */
+DataBase::LedgerStats DataBase::getLedgerStats()
+{
+    TRACE_FUNCTION();
+    LedgerStats stats;
+    stats.path = getDbPath();
+    stats.users = 0;
+    stats.events = 0;
+    stats.transactions = 0;
+    stats.volume = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+    QSqlQuery query(threadConnection());
+    QueryStats::exec(query, QLatin1String("SELECT (SELECT COUNT(*) FROM users WHERE nickname != 'Kitty'), "
+                                          "(SELECT COUNT(*) FROM events), "
+                                          "(SELECT COUNT(*) FROM transactions), "
+                                          "(SELECT TOTAL(amount) FROM transactions)"), Q_FUNC_INFO);
+    if(query.next())
+    {
+        stats.users = query.value(0).toInt();
+        stats.events = query.value(1).toInt();
+        stats.transactions = query.value(2).toInt();
+        stats.volume = query.value(3).toDouble();
+    }
+    stats.error = query.lastError();
+    stats.elapsedMs = timer.elapsed();
+    return stats;
+}
+
 /*!
  * Returns the path to the database file
  * \todo best path to store database?
  */
 QString DataBase::getDbPath()
 {
-    QString path;
-//    path.append(QDir::homePath()).append(QDir::separator());
-    path.append("CheapyApp.db3");
-    path = QDir::toNativeSeparators(path);
-    return path;
+    return dbPath;
 }
 
 /*!
- * Check if the database has any entries (besides the kitty user)
+ * Writes a consistent copy of the database to a file
+ *
+ * Uses VACUUM INTO (SQLite 3.27 or later), which copies the pages of the open database
+ * whatever its storage, so it also exports an in-memory database. The copy is written next to
+ * the file and renamed over it once complete, so a failed export leaves an existing file as it was.
  */
-bool DataBase::isDatabaseEmpty()
+QSqlError DataBase::saveSnapshot(const QString &path)
 {
-    QSqlQueryModel *model = new QSqlQueryModel;
+    TRACE_FUNCTION();
+    const QString partPath = path + QLatin1String(".part");
+    if(QFile::exists(partPath) && !QFile::remove(partPath))
+        return lastError = QSqlError(QString(), "Unable to replace " + partPath, QSqlError::UnknownError);
 
-    model->setQuery("SELECT COUNT(id) FROM users");
-    if(model->data(model->index(0,0)).toInt() != 1)
-        return false;
+    QSqlQuery q(db);
+    if(!execPrepared(q, "VACUUM INTO ?", QVariantList() << partPath, Q_FUNC_INFO))
+    {
+        lastError = q.lastError();
+        QFile::remove(partPath);
+        return lastError;
+    }
+    if((QFile::exists(path) && !QFile::remove(path)) || !QFile::rename(partPath, path))
+    {
+        QFile::remove(partPath);
+        return lastError = QSqlError(QString(), "Unable to replace " + path, QSqlError::UnknownError);
+    }
+    return lastError = QSqlError();
+}
 
-    model->setQuery("SELECT COUNT(id) FROM events");
-    if(model->data(model->index(0,0)).toInt() != 0)
-        return false;
+/*!
+ * Replaces the database with a file written by saveSnapshot() (or any database file of the app)
+ *
+ * A file database is replaced by a copy of the file. The copy is made next to the database
+ * before closing it, and the database is moved aside until the copy is in place, so on failure
+ * the database is put back and reopened. An in-memory database is reopened empty and the
+ * tables, with their indexes and triggers, copied from the attached file in one transaction.
+ * In both cases the schema is migrated if the file is older.
+ */
+QSqlError DataBase::loadSnapshot(const QString &path)
+{
+    TRACE_FUNCTION();
+    if(!QFile::exists(path))
+        return lastError = QSqlError(QString(), "File not found: " + path, QSqlError::UnknownError);
 
-    model->setQuery("SELECT COUNT(id) FROM transactions");
-    if(model->data(model->index(0,0)).toInt() != 0)
-        return false;
+    if(!isInMemory())
+    {
+        const QString livePath = getDbPath();
+        const QString copyPath = livePath + QLatin1String(".load");
+        const QString oldPath = livePath + QLatin1String(".old");
+        QFile::remove(copyPath);
+        QFile::remove(oldPath);
+        if(!QFile::copy(path, copyPath))
+            return lastError = QSqlError(QString(), "Unable to copy " + path + " to " + copyPath, QSqlError::UnknownError);
+
+        closeDb();
+        if(QFile::exists(livePath) && !QFile::rename(livePath, oldPath))
+        {
+            QFile::remove(copyPath);
+            init();
+            return lastError = QSqlError(QString(), "Unable to replace " + livePath, QSqlError::UnknownError);
+        }
+        if(!QFile::rename(copyPath, livePath))
+        {
+            QFile::remove(copyPath);
+            QFile::rename(oldPath, livePath);
+            init();
+            return lastError = QSqlError(QString(), "Unable to move " + copyPath + " to " + livePath, QSqlError::UnknownError);
+        }
+        QFile::remove(oldPath);
+        return lastError = init();
+    }
 
-    return true;
+    deleteDb();
+    if (!openConnection())
+        return lastError = db.lastError();
+
+    QSqlError err = copySnapshot(path);
+    QSqlError schemaErr = prepareSchema(db);
+    kittyId = getKittyId(true);
+    if(err.type() == QSqlError::NoError)
+        err = schemaErr;
+    return lastError = err;
 }
 
 /*!
- * Insert example data to the database
+ * Copies the schema and the rows of a database file into the empty open database
+ *
+ * Tables are created and filled first, the indexes and triggers created afterwards so they
+ * neither slow down nor fire during the copy. Virtual tables (the full-text index) are
+ * rebuilt from their content instead of copying their shadow tables, and left out if this
+ * SQLite lacks FTS5.
  */
-QSqlError DataBase::initExampleDatabase()
+QSqlError DataBase::copySnapshot(const QString &path)
 {
-    QSqlQuery q;
-    if (!q.prepare(getInsertUserQuery()))
+    TRACE_FUNCTION();
+    QSqlQuery q(db);
+    if(!execPrepared(q, "ATTACH DATABASE ? AS snapshot", QVariantList() << path, Q_FUNC_INFO))
         return q.lastError();
 
-    User kitty = getUser(kittyId);
-
-    User bruno = User(QLatin1String("Bruno Santamaria"), QLatin1String("Kowagunga"), QLatin1String("kowagunga@gmail.com"), QString("password"), QDate(1989, 2, 14));
-    User xavi = User(QLatin1String("Xavier Parareda"),  QLatin1String("X"), QLatin1String("xparareda@gmail.com"), QString("password"), QDate(1989, 7, 30));
-    User asustao = User(QLatin1String("Luis Lozano"),  QLatin1String("Asustao"), QLatin1String("lozanodelvalle@gmail.com"), QString("password"), QDate(1989, 12, 20));
-
-    bruno.setId(addUser(q, bruno).toInt());
-    xavi.setId(addUser(q, xavi).toInt());
-    asustao.setId(addUser(q, asustao).toInt());
+    const bool fullTextSearch = hasFullTextSearch(db);
+    QStringList steps, objects, virtualTables;
+    bool ok = execPrepared(q, "SELECT type, name, sql FROM snapshot.sqlite_master "
+                              "WHERE sql IS NOT NULL AND substr(name, 1, 7) != 'sqlite_' ORDER BY type != 'table', rowid",
+                           QVariantList(), Q_FUNC_INFO);
+    while(ok && q.next())
+    {
+        const QString name = q.value(1).toString();
+        const QString sql = q.value(2).toString();
+        // The shadow tables of a virtual table and its triggers are named after it
+        bool shadow = false;
+        foreach (const QString &table, virtualTables)
+            shadow = shadow || name.startsWith(table + QLatin1Char('_'));
+        if(shadow && (q.value(0).toString() == QLatin1String("table") || !fullTextSearch))
+            continue;
+
+        if(sql.startsWith(QLatin1String("CREATE VIRTUAL TABLE"), Qt::CaseInsensitive))
+        {
+            // Created empty, its shadow tables are filled by a rebuild at the end
+            virtualTables << name;
+            if(fullTextSearch)
+                steps << sql;
+        }
+        else if(q.value(0).toString() == QLatin1String("table"))
+            steps << sql
+                  << QString("INSERT INTO main.\"%1\" SELECT * FROM snapshot.\"%1\"").arg(name);
+        else
+            objects << sql;
+    }
+    ok = ok && execPrepared(q, "PRAGMA snapshot.user_version", QVariantList(), Q_FUNC_INFO) && q.next();
+    if(ok)
+    {
+        steps << objects << QString("PRAGMA main.user_version = %1").arg(q.value(0).toInt());
+        if(fullTextSearch)
+        {
+            foreach (const QString &table, virtualTables)
+                steps << QString("INSERT INTO main.\"%1\"(\"%1\") VALUES ('rebuild')").arg(table);
+        }
+    }
+    q.finish();
 
-    if (!q.prepare(getInsertEventQuery()))
-        return q.lastError();
+    QSqlError err;
+    if(ok)
+    {
+        db.transaction();
+        foreach (const QString &step, steps)
+        {
+            if(!(ok = execPrepared(q, step, QVariantList(), Q_FUNC_INFO)))
+                break;
+        }
+        if(ok)
+            ok = db.commit();
+        else
+            db.rollback();
+    }
+    if(!ok)
+        err = q.lastError().type() != QSqlError::NoError ? q.lastError() : db.lastError();
 
-    Event warsaw = Event(QLatin1String("Warsaw Trip"), QDate(2016, 9, 1), bruno, QLatin1String("Warsaw, Poland"), QLatin1String("Trip to Wasaw to destroy our livers"), 0);
-    warsaw.setId(addEvent(q, warsaw).toInt());
+    execPrepared(q, "DETACH DATABASE snapshot", QVariantList(), Q_FUNC_INFO);
+    return err;
+}
 
-    if (!q.prepare(getInsertTransactionQuery()))
-        return q.lastError();
+/*!
+ * Check if the database has any entries (besides the kitty user)
+ */
+bool DataBase::isDatabaseEmpty()
+{
+    TRACE_FUNCTION();
+    return isDatabaseEmpty(db);
+}
 
-    addTransaction(q, Transaction(bruno, asustao, warsaw.getId(), 60.0, QDate(2016,9,2), QLatin1String("Hamburg (Germany)"), QLatin1String("Airbnb 3 nights")));
-    addTransaction(q, Transaction(bruno, xavi, warsaw, 85.0, QDate(2016,9,2), QLatin1String("Hamburg (Germany)"), QLatin1String("Airbnb 4 nights")));
-    addTransaction(q, Transaction(xavi, kitty, warsaw, 30.0, QDate(2016,9,1), QLatin1String("Warsaw"), QLatin1String("Supermarket Friday")));
-    addTransaction(q, Transaction(xavi, kitty, warsaw, 13.0, QDate(2016,9,2), QLatin1String("Warsaw"), QLatin1String("Supermarket Saturday")));
-    addTransaction(q, Transaction(asustao, kitty, warsaw, 75.0, QDate(2016,9,2), QLatin1String("Warsaw"), QLatin1String("Cash Friday")));
-    addTransaction(q, Transaction(bruno, kitty, warsaw, 75.0, QDate(2016,9,3), QLatin1String("Warsaw"), QLatin1String("Cash Sunday")));
-    addTransaction(q, Transaction(kitty, bruno, warsaw, 38.0, QDate(2016,9,5), QLatin1String("Warsaw"), QLatin1String("Cash back Monday")));
+/*!
+ * Check if the database of a connection has any entries (besides the kitty user)
+ *
+ * Only probes the first rows of each table instead of counting them, so the cost doesn't
+ * grow with the size of the database.
+ */
+bool DataBase::isDatabaseEmpty(QSqlDatabase database)
+{
+    QSqlQuery query(database);
+    QueryStats::exec(query, QLatin1String("SELECT (SELECT COUNT(*) FROM (SELECT id FROM users LIMIT 2)), "
+                                          "EXISTS (SELECT 1 FROM events), "
+                                          "EXISTS (SELECT 1 FROM transactions)"), Q_FUNC_INFO);
+    if(!query.next())
+        return false;
 
-    return QSqlError();
+    return query.value(0).toInt() == 1 && !query.value(1).toBool() && !query.value(2).toBool();
 }
 
 QLatin1String DataBase::getInsertUserQuery()
@@ -204,27 +988,56 @@ QLatin1String DataBase::getInsertUserQuery()
 
 QLatin1String DataBase::getInsertEventQuery()
 {
-    return QLatin1String("insert into events(name, creation, place, description, finished, admin) values(?, ?, ?, ?, ?, ?)");
+    return QLatin1String("insert into events(name, creation, place, description, finished, admin, currency) values(?, ?, ?, ?, ?, ?, ?)");
 }
 
 QLatin1String DataBase::getInsertTransactionQuery()
 {
-    return QLatin1String("insert into transactions(usergives, userreceives, event, amount, transactionDate, place, description) values(?, ?, ?, ?, ?, ?, ?)");
+    return QLatin1String("insert into transactions(usergives, userreceives, event, amount, transactionDate, place, description, currency, fingerprint) values(?, ?, ?, ?, ?, ?, ?, ?, ?)");
 }
 
 /*!
- * Inserts new transaction into the database
+ * Inserts new transaction into the database, unless it is a duplicate to skip or its currency
+ * has no exchange rate to the one of the event
  */
 QVariant DataBase::addTransaction(QSqlQuery &q, Transaction newTransaction)
 {
+    TRACE_FUNCTION();
+    lastDuplicate = -1;
+    if(!isCurrencyConvertible(newTransaction.getEvent().getId(), newTransaction.getCurrency()))
+    {
+        lastError = QSqlError(QString(), "No exchange rate from " + newTransaction.getCurrency() + " to "
+                              + getEventCurrency(newTransaction.getEvent().getId()), QSqlError::StatementError);
+        return QVariant();
+    }
+    if(duplicateCheck.action != DuplicateCheck::Off)
+    {
+        lastDuplicate = findDuplicateTransaction(newTransaction);
+        if(lastDuplicate >= 0 && duplicateCheck.action == DuplicateCheck::Skip)
+        {
+            lastError = QSqlError();
+            return QVariant();
+        }
+    }
+
     q.addBindValue(QVariant(newTransaction.getUserGiving().getId()));
     q.addBindValue(QVariant(newTransaction.getUserReceiving().getId()));
     q.addBindValue(QVariant(newTransaction.getEvent().getId()));
     q.addBindValue(newTransaction.getAmount());
-    q.addBindValue(newTransaction.getDate());
+    q.addBindValue(dateToDay(newTransaction.getDate()));
     q.addBindValue(newTransaction.getPlace());
     q.addBindValue(newTransaction.getDescription());
-    q.exec();
+    if(newTransaction.getCurrency().isEmpty())
+        q.addBindValue(QVariant(QVariant::String));
+    else
+        q.addBindValue(newTransaction.getCurrency());
+    q.addBindValue(transactionFingerprint(newTransaction.getUserGiving().getId(), newTransaction.getUserReceiving().getId(),
+                                          newTransaction.getEvent().getId(), newTransaction.getDescription()));
+    if(QueryStats::exec(q, Q_FUNC_INFO))
+    {
+        updateBalanceIndex(newTransaction, 1);
+        updateAmountSketch(newTransaction);
+    }
     lastError = q.lastError();
     return q.lastInsertId();
 }
@@ -234,13 +1047,15 @@ QVariant DataBase::addTransaction(QSqlQuery &q, Transaction newTransaction)
  */
 QVariant DataBase::addEvent(QSqlQuery &q, Event newEvent)
 {
+    TRACE_FUNCTION();
     q.addBindValue(newEvent.getName());
-    q.addBindValue(newEvent.getCreationDate());
+    q.addBindValue(dateToDay(newEvent.getCreationDate()));
     q.addBindValue(newEvent.getPlace());
     q.addBindValue(newEvent.getDescription());
     q.addBindValue(newEvent.isFinished());
     q.addBindValue(QVariant(newEvent.getAdmin().getId()));
-    q.exec();
+    q.addBindValue(newEvent.getCurrency().isEmpty() ? defaultCurrency() : newEvent.getCurrency());
+    QueryStats::exec(q, Q_FUNC_INFO);
     lastError = q.lastError();
     return q.lastInsertId();
 }
@@ -250,110 +1065,1056 @@ QVariant DataBase::addEvent(QSqlQuery &q, Event newEvent)
  */
 QVariant DataBase::addUser(QSqlQuery &q, User newUser)
 {
+    TRACE_FUNCTION();
     q.addBindValue(newUser.getName());
     q.addBindValue(newUser.getNickname());
     q.addBindValue(newUser.getEmail());
     q.addBindValue(newUser.getPasswordHash());
     q.addBindValue(newUser.getPasswordSalt());
-    q.addBindValue(newUser.getBirthdate());
-    q.exec();
+    q.addBindValue(dateToDay(newUser.getBirthdate()));
+    QueryStats::exec(q, Q_FUNC_INFO);
     lastError = q.lastError();
+
+    if(userIndexLoaded && lastError.type() == QSqlError::NoError)
+    {
+        UserIndex::Record record = {q.lastInsertId().toInt(), newUser.getNickname(), newUser.getName(), newUser.getEmail()};
+        userIndex.insert(record);
+    }
     return q.lastInsertId();
 }
 
 /*!
- * Deletes transaction from the database
+ * Inserts new transaction into the database, reusing the insert statement
  */
-QSqlError DataBase::deleteTransaction(int transactionId)
+QVariant DataBase::addTransaction(const Transaction &newTransaction)
 {
-    QSqlQuery q;
-
-    if (!q.exec("DELETE FROM transactions where id = " + QString::number(transactionId)))
-        return q.lastError();
-    else
-        return QSqlError();
+    QSqlQuery q = acquireStatement(getInsertTransactionQuery());
+    QVariant id = addTransaction(q, newTransaction);
+    releaseStatement(q);
+    return id;
 }
 
 /*!
- * Deletes event from the database
+ * Inserts new event into the database, reusing the insert statement
  */
-QSqlError DataBase::deleteEvent(int eventId)
+QVariant DataBase::addEvent(const Event &newEvent)
 {
-    QSqlQuery q;
-
-    if (!q.exec("DELETE FROM events where id = " + QString::number(eventId)))
-        return q.lastError();
-    else
-        return QSqlError();
+    QSqlQuery q = acquireStatement(getInsertEventQuery());
+    QVariant id = addEvent(q, newEvent);
+    releaseStatement(q);
+    return id;
 }
 
 /*!
- * Deletes user from the database
+ * Inserts new user into the database, reusing the insert statement
  */
-QSqlError DataBase::deleteUser(int userId)
+QVariant DataBase::addUser(const User &newUser)
 {
-    QSqlQuery q;
-
-    if (!q.exec("DELETE FROM users where id = " + QString::number(userId)))
-        return q.lastError();
-    else
-        return QSqlError();
+    QSqlQuery q = acquireStatement(getInsertUserQuery());
+    QVariant id = addUser(q, newUser);
+    releaseStatement(q);
+    return id;
 }
 
 /*!
- * Returns transaction for an id from the database
+ * Adds users to the database with one batched insert in a single transaction.
+ * The nicknames and emails in use are read in the same transaction, and the users which would
+ * break their uniqueness are left out. Nothing is added if any other fails.
  */
-Transaction DataBase::getTransaction(int id)
+QSqlError DataBase::addUsers(const QVector<User> &users, QVector<int> *skipped)
 {
-    Transaction transaction;
-    QSqlQuery query(QString("SELECT * FROM transactions WHERE id = %1").arg(id));
+    TRACE_FUNCTION();
+    if(skipped)
+        skipped->clear();
+
+    QSqlQuery q(db);
+    db.transaction();
+    QSet<QString> usedNicknames, usedEmails;
+    if(!QueryStats::exec(q, QLatin1String("SELECT nickname, lower(email) FROM users"), Q_FUNC_INFO))
+    {
+        lastError = q.lastError();
+        db.rollback();
+        return lastError;
+    }
+    while(q.next())
+    {
+        usedNicknames.insert(q.value(0).toString());
+        usedEmails.insert(q.value(1).toString());
+    }
 
-    if(query.next())
+    QVariantList names, nicknames, emails, hashes, salts, birthdates;
+    for(int i = 0; i < users.size(); i++)
     {
-        transaction = Transaction(id, User(query.value(1).toInt()),
-            User(query.value(2).toInt()),
-            Event(query.value(3).toInt()),
-            query.value(4).toDouble(),
-            query.value(5).toDate(),
-            query.value(6).toString(),
-            query.value(7).toString());
+        const User &user = users.at(i);
+        const QString email = user.getEmail().toLower();
+        if(usedNicknames.contains(user.getNickname()) || usedEmails.contains(email))
+        {
+            if(skipped)
+                skipped->append(i);
+            continue;
+        }
+        usedNicknames.insert(user.getNickname());
+        usedEmails.insert(email);
+        names << user.getName();
+        nicknames << user.getNickname();
+        emails << user.getEmail();
+        hashes << user.getPasswordHash();
+        salts << user.getPasswordSalt();
+        birthdates << dateToDay(user.getBirthdate());
     }
 
-    lastError = query.lastError();
+    if (!q.prepare(getInsertUserQuery()))
+    {
+        lastError = q.lastError();
+        db.rollback();
+        return lastError;
+    }
+    q.addBindValue(names);
+    q.addBindValue(nicknames);
+    q.addBindValue(emails);
+    q.addBindValue(hashes);
+    q.addBindValue(salts);
+    q.addBindValue(birthdates);
+
+    if (!names.isEmpty() && !QueryStats::execBatch(q, Q_FUNC_INFO))
+    {
+        lastError = q.lastError();
+        db.rollback();
+        return lastError;
+    }
+    if (!db.commit())
+        return lastError = db.lastError();
 
-    return transaction;
+    // A bulk import touches most of the index, it is reloaded on next use
+    userIndexLoaded = false;
+    return lastError = QSqlError();
 }
 
 /*!
- * Returns event for an id from the database
+ * Looks for the oldest transaction with the same fingerprint within the window of days and amount
  */
-Event DataBase::getEvent(int id)
+int DataBase::findDuplicateTransaction(const Transaction &transaction)
 {
-    Event event;
-    QSqlQuery query(QString("SELECT * FROM events WHERE id = %1").arg(id));
-
-    if(query.next())
-    {
-        event = Event(id, query.value(1).toString(),
-            query.value(2).toDate(),
-            User(query.value(3).toInt()),
-            query.value(4).toString(),
-            query.value(5).toString(),
-            query.value(6).toBool());
-    }
-
+    TRACE_FUNCTION();
+    const QVariant day = dateToDay(transaction.getDate());
+    QSqlQuery query = acquireStatement("SELECT id FROM transactions WHERE fingerprint = ? "
+                                       "AND (transactionDate IS ? OR transactionDate BETWEEN ? AND ?) "
+                                       "AND abs(amount - ?) <= ? ORDER BY id LIMIT 1");
+    query.addBindValue(transactionFingerprint(transaction.getUserGiving().getId(), transaction.getUserReceiving().getId(),
+                                              transaction.getEvent().getId(), transaction.getDescription()));
+    query.addBindValue(day);
+    query.addBindValue(day.isNull() ? day : QVariant(day.toLongLong() - duplicateCheck.days));
+    query.addBindValue(day.isNull() ? day : QVariant(day.toLongLong() + duplicateCheck.days));
+    query.addBindValue(transaction.getAmount());
+    query.addBindValue(duplicateCheck.amount + 1e-9);
+    QueryStats::exec(query, Q_FUNC_INFO);
+    int id = query.next() ? query.value(0).toInt() : -1;
     lastError = query.lastError();
-
-    return event;
+    query.finish();
+    releaseStatement(query);
+    return id;
 }
 
 /*!
- * Returns user for an id from the database
+ * Inserts transactions with a batched insert, matching each one against the transactions of
+ * its event around its date and the previous ones of the batch
+ */
+QSqlError DataBase::importTransactions(const QVector<Transaction> &transactions, QVector<int> *duplicates)
+{
+    TRACE_FUNCTION();
+    // Transaction a new one is matched against
+    struct Candidate
+    {
+        bool dated;
+        qint64 day;
+        double amount;
+    };
+    auto matches = [this](const Candidate &a, const Candidate &b) {
+        if(a.dated != b.dated || (a.dated && qAbs(a.day - b.day) > duplicateCheck.days))
+            return false;
+        return qAbs(a.amount - b.amount) <= duplicateCheck.amount + 1e-9;
+    };
+    const bool check = duplicateCheck.action != DuplicateCheck::Off;
+    QMultiHash<qint64, Candidate> candidates;
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    db.transaction();
+
+    if(check)
+    {
+        // First and last day of the new transactions of each event, widened by the window
+        QHash<int, QPair<qint64, qint64> > ranges;
+        foreach (const Transaction &transaction, transactions)
+        {
+            QHash<int, QPair<qint64, qint64> >::iterator range = ranges.find(transaction.getEvent().getId());
+            if(range == ranges.end())
+                range = ranges.insert(transaction.getEvent().getId(), qMakePair(Q_INT64_C(1), Q_INT64_C(0)));
+            if(!transaction.getDate().isValid())
+                continue;
+            const qint64 day = transaction.getDate().toJulianDay();
+            if(range->first > range->second)
+                *range = qMakePair(day, day);
+            range->first = qMin(range->first, day - duplicateCheck.days);
+            range->second = qMax(range->second, day + duplicateCheck.days);
+        }
+        for(auto range = ranges.constBegin(); range != ranges.constEnd(); ++range)
+        {
+            if(!execPrepared(q, "SELECT fingerprint, transactionDate, amount FROM transactions "
+                                "WHERE event = ? AND (transactionDate IS NULL OR transactionDate BETWEEN ? AND ?)",
+                             QVariantList() << range.key() << range->first << range->second, Q_FUNC_INFO))
+            {
+                lastError = q.lastError();
+                db.rollback();
+                return lastError;
+            }
+            while(q.next())
+            {
+                Candidate existing = {!q.value(1).isNull(), q.value(1).toLongLong(), q.value(2).toDouble()};
+                candidates.insert(q.value(0).toLongLong(), existing);
+            }
+        }
+    }
+
+    QVariantList gives, receives, events, amounts, days, places, descriptions, currencies, fingerprints;
+    QSet<int> importedEvents;
+    for(int i = 0; i < transactions.size(); i++)
+    {
+        const Transaction &transaction = transactions.at(i);
+        const qint64 fingerprint = transactionFingerprint(transaction.getUserGiving().getId(), transaction.getUserReceiving().getId(),
+                                                          transaction.getEvent().getId(), transaction.getDescription());
+        if(check)
+        {
+            Candidate row = {transaction.getDate().isValid(), transaction.getDate().toJulianDay(), transaction.getAmount()};
+            bool duplicate = false;
+            for(auto candidate = candidates.constFind(fingerprint); !duplicate && candidate != candidates.constEnd()
+                    && candidate.key() == fingerprint; ++candidate)
+                duplicate = matches(row, candidate.value());
+            if(duplicate && duplicates)
+                duplicates->append(i);
+            if(duplicate && duplicateCheck.action == DuplicateCheck::Skip)
+                continue;
+            candidates.insert(fingerprint, row);
+        }
+
+        gives << transaction.getUserGiving().getId();
+        receives << transaction.getUserReceiving().getId();
+        events << transaction.getEvent().getId();
+        amounts << transaction.getAmount();
+        days << dateToDay(transaction.getDate());
+        places << transaction.getPlace();
+        descriptions << transaction.getDescription();
+        currencies << QVariant(QVariant::String);
+        fingerprints << fingerprint;
+        importedEvents.insert(transaction.getEvent().getId());
+    }
+
+    if(!gives.isEmpty())
+    {
+        q.prepare(getInsertTransactionQuery());
+        q.addBindValue(gives);
+        q.addBindValue(receives);
+        q.addBindValue(events);
+        q.addBindValue(amounts);
+        q.addBindValue(days);
+        q.addBindValue(places);
+        q.addBindValue(descriptions);
+        q.addBindValue(currencies);
+        q.addBindValue(fingerprints);
+        if(!QueryStats::execBatch(q, Q_FUNC_INFO))
+        {
+            lastError = q.lastError();
+            db.rollback();
+            return lastError;
+        }
+    }
+    if(!db.commit())
+        return lastError = db.lastError();
+
+    // The balance indexes of the events are rebuilt on next use
+    foreach (int event, importedEvents)
+    {
+        balanceIndexes.remove(event);
+        expandedTransactions.remove(event);
+    }
+    return lastError = QSqlError();
+}
+
+/*!
+ * Deletes transaction from the database
+ */
+QSqlError DataBase::deleteTransaction(int transactionId)
+{
+    TRACE_FUNCTION();
+    QSqlQuery q(db);
+
+    // The deleted flow is only needed if some balance index or expanded event is already built
+    Transaction deleted;
+    if(!balanceIndexes.isEmpty() || !expandedTransactions.isEmpty())
+        deleted = getTransaction(transactionId);
+
+    if (!execPrepared(q, "DELETE FROM transactions WHERE id = ?", QVariantList() << transactionId, Q_FUNC_INFO))
+        return q.lastError();
+    else
+    {
+        updateBalanceIndex(deleted, -1);
+        return QSqlError();
+    }
+}
+
+/*!
+ * Deletes a set of transactions in one transaction
+ *
+ * The ids are batch inserted in a temporary table and deleted with a single statement, so
+ * there is one commit instead of one per transaction. The triggers keep the event summaries.
+ */
+QSqlError DataBase::deleteTransactions(const QVector<int> &transactionIds)
+{
+    TRACE_FUNCTION();
+    if(transactionIds.isEmpty())
+        return lastError = QSqlError();
+
+    QVariantList ids;
+    foreach (int id, transactionIds)
+        ids << id;
+
+    QSqlQuery q(db);
+    db.transaction();
+    bool ok = fillIdTable(q, QLatin1String("cascade_ids"), ids);
+
+    // The balance indexes of the touched events are rebuilt on next use
+    ok = ok && execPrepared(q, "SELECT DISTINCT event FROM transactions WHERE id IN (SELECT id FROM temp.cascade_ids)",
+                            QVariantList(), Q_FUNC_INFO);
+    while(ok && q.next())
+    {
+        balanceIndexes.remove(q.value(0).toInt());
+        expandedTransactions.remove(q.value(0).toInt());
+    }
+
+    ok = ok && execPrepared(q, "DELETE FROM transactions WHERE id IN (SELECT id FROM temp.cascade_ids)",
+                            QVariantList(), Q_FUNC_INFO);
+    return finishCascade(q, ok);
+}
+
+/*!
+ * Deletes an event with all its transactions in one transaction
+ *
+ * The rows kept by triggers for the event are deleted with set-based statements, and the
+ * transactions without running the per-row triggers, see deleteCascadeEvents().
+ */
+QSqlError DataBase::deleteEventCascade(int eventId)
+{
+    TRACE_FUNCTION();
+    QSqlQuery q(db);
+    db.transaction();
+    bool ok = fillIdTable(q, QLatin1String("cascade_ids"), QVariantList() << eventId)
+            && deleteCascadeEvents(q);
+    balanceIndexes.remove(eventId);
+    expandedTransactions.remove(eventId);
+    return finishCascade(q, ok);
+}
+
+/*!
+ * Deletes a user with all its transactions and the events it administers in one transaction
+ *
+ * The events the user administers are deleted with all their transactions, like
+ * deleteEventCascade(). The transactions of the user in other events are deleted through
+ * the indexes on usergives and userreceives, with the triggers updating those events. The
+ * split expenses it pays are deleted, and its shares removed from those paid by others.
+ */
+QSqlError DataBase::deleteUserCascade(int userId)
+{
+    TRACE_FUNCTION();
+    QSqlQuery q(db);
+    db.transaction();
+    bool ok = execPrepared(q, "SELECT id FROM events WHERE admin = ?", QVariantList() << userId, Q_FUNC_INFO);
+    QVariantList events;
+    while(ok && q.next())
+        events << q.value(0);
+
+    ok = ok && fillIdTable(q, QLatin1String("cascade_ids"), events)
+            && deleteCascadeEvents(q)
+            && execPrepared(q, "DELETE FROM transactions WHERE usergives = ? OR userreceives = ?",
+                            QVariantList() << userId << userId, Q_FUNC_INFO)
+            && execPrepared(q, "DELETE FROM splits WHERE payer = ?", QVariantList() << userId, Q_FUNC_INFO)
+            && removeUserFromSplits(q, userId)
+            && execPrepared(q, "DELETE FROM users WHERE id = ?", QVariantList() << userId, Q_FUNC_INFO);
+
+    QSqlError err = finishCascade(q, ok);
+    if(err.type() == QSqlError::NoError)
+        userIndex.remove(userId);
+    balanceIndexes.clear();
+    expandedTransactions.clear();
+    return err;
+}
+
+/*!
+ * Returns the split expenses of other payers with a share of a user
+ *
+ * The packed shares are first matched against the bytes of the user id, then unpacked to
+ * drop the matches at other offsets.
+ */
+bool DataBase::getSplitsSharedWith(QSqlQuery &q, int userId, QVector<SplitExpense> *splits)
+{
+    QByteArray packedId;
+    QDataStream out(&packedId, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_6);
+    out << qint32(userId);
+
+    if(!execPrepared(q, "SELECT id, event, payer, shares FROM splits WHERE payer != ? AND instr(shares, ?) > 0",
+                     QVariantList() << userId << packedId, Q_FUNC_INFO))
+        return false;
+    while(q.next())
+    {
+        SplitExpense split(User(q.value(2).toInt()), Event(q.value(1).toInt()), 0, QDate());
+        split.setId(q.value(0).toInt());
+        split.unpackShares(q.value(3).toByteArray());
+        foreach(const SplitExpense::Share &share, split.getShares())
+        {
+            if(share.userId == userId)
+            {
+                splits->append(split);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+/*!
+ * Removes the share of a user from the split expenses paid by others, deleting those left
+ * without anyone owing the payer
+ *
+ * Shares are only changed by this cascade, so the snapshots of the events are dropped here
+ * rather than by a trigger.
+ */
+bool DataBase::removeUserFromSplits(QSqlQuery &q, int userId)
+{
+    QVector<SplitExpense> splits;
+    if(!getSplitsSharedWith(q, userId, &splits))
+        return false;
+
+    foreach(const SplitExpense &split, splits)
+    {
+        SplitExpense remaining(split.getPayer(), split.getEvent(), 0, QDate());
+        bool owed = false;
+        foreach(const SplitExpense::Share &share, split.getShares())
+        {
+            if(share.userId == userId)
+                continue;
+            remaining.addShare(share.userId, share.weight);
+            owed = owed || (share.userId != split.getPayer().getId() && share.weight > 0);
+        }
+
+        bool ok = owed
+                ? execPrepared(q, "UPDATE splits SET shares = ? WHERE id = ?",
+                               QVariantList() << remaining.packShares() << split.getId(), Q_FUNC_INFO)
+                  && execPrepared(q, "DELETE FROM event_snapshots WHERE event = ?",
+                                  QVariantList() << split.getEvent().getId(), Q_FUNC_INFO)
+                : execPrepared(q, "DELETE FROM splits WHERE id = ?", QVariantList() << split.getId(), Q_FUNC_INFO);
+        if(!ok)
+            return false;
+    }
+    return true;
+}
+
+/*!
+ * Adds an event with many transactions and times deleting it with deleteEventCascade()
+ *
+ * For comparison, a smaller event is deleted one transaction at a time with
+ * deleteTransaction(), each with its own commit, and the time is extrapolated.
+ */
+QString DataBase::benchmarkDeleteEvent(int transactions)
+{
+    QString report;
+    QTextStream out(&report);
+
+    QSqlQuery q(db);
+    QVector<int> users;
+    QueryStats::exec(q, QLatin1String("SELECT id FROM users LIMIT 16"), Q_FUNC_INFO);
+    while(q.next())
+        users << q.value(0).toInt();
+    if(users.isEmpty())
+        return "Error: no users in the database\n";
+
+    // Adds an event with a number of transactions among the users, returns its id
+    auto addBenchmarkEvent = [this, &q, &users](int count) {
+        q.prepare(getInsertEventQuery());
+        int eventId = addEvent(q, Event(QLatin1String("Delete benchmark"), QDate::currentDate(), User(users.first()))).toInt();
+        QVariantList gives, receives, events, amounts, days, places, descriptions, currencies, fingerprints;
+        for(int i = 0; i < count; i++)
+        {
+            gives << users.at(i % users.size());
+            receives << users.at((i + 1) % users.size());
+            events << eventId;
+            amounts << double(i % 100 + 1);
+            days << QDate::currentDate().toJulianDay() - i % 365;
+            places << QString();
+            descriptions << QString();
+            currencies << QVariant(QVariant::String);
+            fingerprints << transactionFingerprint(users.at(i % users.size()), users.at((i + 1) % users.size()), eventId, QString());
+        }
+        q.prepare(getInsertTransactionQuery());
+        q.addBindValue(gives);
+        q.addBindValue(receives);
+        q.addBindValue(events);
+        q.addBindValue(amounts);
+        q.addBindValue(days);
+        q.addBindValue(places);
+        q.addBindValue(descriptions);
+        q.addBindValue(currencies);
+        q.addBindValue(fingerprints);
+        db.transaction();
+        QueryStats::execBatch(q, Q_FUNC_INFO);
+        db.commit();
+        return eventId;
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+    int eventId = addBenchmarkEvent(transactions);
+    qint64 insertNs = timer.nsecsElapsed();
+
+    timer.restart();
+    QSqlError err = deleteEventCascade(eventId);
+    qint64 cascadeNs = timer.nsecsElapsed();
+    if(err.type() != QSqlError::NoError)
+        return "Error: " + err.text() + "\n";
+
+    int sample = qMin(transactions, 1000);
+    eventId = addBenchmarkEvent(sample);
+    QVector<int> ids;
+    q.prepare("SELECT id FROM transactions WHERE event = ?");
+    q.addBindValue(eventId);
+    QueryStats::exec(q, Q_FUNC_INFO);
+    while(q.next())
+        ids << q.value(0).toInt();
+    timer.restart();
+    foreach (int id, ids)
+        deleteTransaction(id);
+    qint64 oneByOneNs = timer.nsecsElapsed();
+    deleteEventCascade(eventId);
+
+    out << "Delete of an event with " << transactions << " transactions\n";
+    out << "    batched insert     " << QString::number(insertNs / 1e6, 'f', 1).rightJustified(10) << " ms\n";
+    out << "    cascade delete     " << QString::number(cascadeNs / 1e6, 'f', 1).rightJustified(10) << " ms\n";
+    out << "    one by one         " << QString::number(oneByOneNs / 1e6 * transactions / qMax(sample, 1), 'f', 1).rightJustified(10)
+        << " ms (extrapolated from " << sample << " deletes)\n";
+    return report;
+}
+
+/*!
+ * Records the same expenses as split expenses and as pairwise transactions and compares them
+ *
+ * Both are inserted with one batch in one transaction. The storage is measured as the pages
+ * in use the database grows by, and the event totals are then calculated from each.
+ */
+QString DataBase::benchmarkSplitExpenses(int expenses)
+{
+    QString report;
+    QTextStream out(&report);
+    const int groupSizes[] = {6, 30};
+
+    // Users of the groups, with a dummy password hash
+    QVector<User> newUsers;
+    for(int i = 0; i < groupSizes[1]; i++)
+    {
+        QString nickname = QString("split_benchmark_%1").arg(i);
+        newUsers << User(nickname, nickname, nickname + "@cheapyapp.com", QLatin1String("hash"), QLatin1String("salt"), QDate());
+    }
+    if(addUsers(newUsers).type() != QSqlError::NoError)
+        return "Error: " + lastError.text() + "\n";
+    QVector<int> users;
+    QSqlQuery q(db);
+    execPrepared(q, "SELECT id FROM users WHERE nickname LIKE 'split_benchmark_%' ORDER BY id", QVariantList(), Q_FUNC_INFO);
+    while(q.next())
+        users << q.value(0).toInt();
+
+    // Pages in use, the free ones left by the previous deletes excluded
+    auto usedBytes = [this, &q]() {
+        qint64 pages = 0, freePages = 0, pageSize = 0;
+        QueryStats::exec(q, QLatin1String("PRAGMA page_count"), Q_FUNC_INFO);
+        if(q.next())
+            pages = q.value(0).toLongLong();
+        QueryStats::exec(q, QLatin1String("PRAGMA freelist_count"), Q_FUNC_INFO);
+        if(q.next())
+            freePages = q.value(0).toLongLong();
+        QueryStats::exec(q, QLatin1String("PRAGMA page_size"), Q_FUNC_INFO);
+        if(q.next())
+            pageSize = q.value(0).toLongLong();
+        return (pages - freePages) * pageSize;
+    };
+
+    out << "Split expenses against pairwise transactions, " << expenses << " expenses per event\n";
+    for(int size = 0; size < 2; size++)
+    {
+        int groupSize = groupSizes[size];
+        QVector<int> group = users.mid(0, groupSize);
+        q.prepare(getInsertEventQuery());
+        int splitEventId = addEvent(q, Event(QLatin1String("Split benchmark"), QDate::currentDate(), User(group.first()))).toInt();
+        q.prepare(getInsertEventQuery());
+        int pairEventId = addEvent(q, Event(QLatin1String("Pairwise benchmark"), QDate::currentDate(), User(group.first()))).toInt();
+
+        SplitExpense shares;
+        foreach(int user, group)
+            shares.addShare(user);
+        QVariantList payers, events, amounts, days, places, descriptions, currencies, packedShares;
+        for(int i = 0; i < expenses; i++)
+        {
+            payers << group.at(i % groupSize);
+            events << splitEventId;
+            amounts << double(i % 100 + 1) * groupSize;
+            days << QDate::currentDate().toJulianDay() - i % 365;
+            places << QString();
+            descriptions << QString();
+            currencies << QVariant(QVariant::String);
+            packedShares << shares.packShares();
+        }
+
+        qint64 bytes = usedBytes();
+        QElapsedTimer timer;
+        timer.start();
+        q.prepare("insert into splits(payer, event, amount, splitDate, place, description, currency, shares) values(?, ?, ?, ?, ?, ?, ?, ?)");
+        q.addBindValue(payers);
+        q.addBindValue(events);
+        q.addBindValue(amounts);
+        q.addBindValue(days);
+        q.addBindValue(places);
+        q.addBindValue(descriptions);
+        q.addBindValue(currencies);
+        q.addBindValue(packedShares);
+        db.transaction();
+        QueryStats::execBatch(q, Q_FUNC_INFO);
+        db.commit();
+        qint64 splitInsertNs = timer.nsecsElapsed();
+        qint64 splitBytes = usedBytes() - bytes;
+
+        QVariantList gives, receives, pairEvents, pairAmounts, pairDays, pairPlaces, pairDescriptions, pairCurrencies, pairFingerprints;
+        for(int i = 0; i < expenses; i++)
+        {
+            int payer = group.at(i % groupSize);
+            foreach(int user, group)
+            {
+                if(user == payer)
+                    continue;
+                gives << payer;
+                receives << user;
+                pairEvents << pairEventId;
+                pairAmounts << double(i % 100 + 1);
+                pairDays << days.at(i);
+                pairPlaces << QString();
+                pairDescriptions << QString();
+                pairCurrencies << QVariant(QVariant::String);
+                pairFingerprints << transactionFingerprint(payer, user, pairEventId, QString());
+            }
+        }
+
+        bytes = usedBytes();
+        timer.restart();
+        q.prepare(getInsertTransactionQuery());
+        q.addBindValue(gives);
+        q.addBindValue(receives);
+        q.addBindValue(pairEvents);
+        q.addBindValue(pairAmounts);
+        q.addBindValue(pairDays);
+        q.addBindValue(pairPlaces);
+        q.addBindValue(pairDescriptions);
+        q.addBindValue(pairCurrencies);
+        q.addBindValue(pairFingerprints);
+        db.transaction();
+        QueryStats::execBatch(q, Q_FUNC_INFO);
+        db.commit();
+        qint64 pairInsertNs = timer.nsecsElapsed();
+        qint64 pairBytes = usedBytes() - bytes;
+
+        timer.restart();
+        EventSummary splitSummary = getEventSummary(splitEventId);
+        qint64 splitSummaryNs = timer.nsecsElapsed();
+        timer.restart();
+        QVector<Transaction> pairTransactions = getEventTransactions(pairEventId);
+        qint64 pairReadNs = timer.nsecsElapsed();
+
+        out << "  groups of " << groupSize << " (" << gives.size() << " pairwise rows)\n";
+        out << "    split insert       " << QString::number(splitInsertNs / 1e6, 'f', 1).rightJustified(10) << " ms "
+            << QString::number(splitBytes / 1024.0, 'f', 0).rightJustified(8) << " KiB\n";
+        out << "    pairwise insert    " << QString::number(pairInsertNs / 1e6, 'f', 1).rightJustified(10) << " ms "
+            << QString::number(pairBytes / 1024.0, 'f', 0).rightJustified(8) << " KiB\n";
+        out << "    split totals       " << QString::number(splitSummaryNs / 1e6, 'f', 1).rightJustified(10) << " ms (expanded on the fly, volume "
+            << splitSummary.volume << ")\n";
+        out << "    pairwise read      " << QString::number(pairReadNs / 1e6, 'f', 1).rightJustified(10) << " ms (" << pairTransactions.size() << " rows)\n";
+
+        deleteEventCascade(splitEventId);
+        deleteEventCascade(pairEventId);
+    }
+    return report;
+}
+
+/*!
+ * Imports generated transactions into two events, with the duplicate check off and set to skip
+ * within a window of two days, and times both
+ *
+ * Both events hold as many transactions beforehand, which the check reads and matches. One
+ * transaction in fifty repeats one of them, one repeats an earlier one of the import and one
+ * is a day later than an earlier one.
+ */
+QString DataBase::benchmarkTransactionImport(int transactions)
+{
+    QString report;
+    QTextStream out(&report);
+    const QStringList words = QStringList() << "Airbnb" << "Supermarket" << "Taxi" << "Dinner" << "Beers" << "Museum"
+                                            << "Train" << "Hotel" << "Pizza" << "Breakfast";
+
+    QSqlQuery q(db);
+    QVector<int> users;
+    QueryStats::exec(q, QLatin1String("SELECT id FROM users LIMIT 16"), Q_FUNC_INFO);
+    while(q.next())
+        users << q.value(0).toInt();
+    if(users.size() < 2)
+        return "Error: no users in the database\n";
+
+    // Transactions of an event, the receipt numbers starting at first
+    auto generate = [&users, &words, transactions](int eventId, int first) {
+        QRandomGenerator random(first + 1);
+        QVector<Transaction> generated;
+        for(int i = 0; i < transactions; i++)
+        {
+            const int giver = random.bounded(users.size());
+            generated.append(Transaction(User(users.at(giver)), User(users.at((giver + 1 + random.bounded(users.size() - 1)) % users.size())),
+                                         Event(eventId), double(random.bounded(1, 10000)) / 100,
+                                         QDate::currentDate().addDays(-random.bounded(365)), QString(),
+                                         QString("%1 receipt %2").arg(words.at(random.bounded(words.size()))).arg(first + i)));
+        }
+        return generated;
+    };
+
+    const DuplicateCheck savedCheck = duplicateCheck;
+    const DuplicateCheck checks[] = {{DuplicateCheck::Off, 2, 0}, {DuplicateCheck::Skip, 2, 0}};
+    qint64 elapsedNs[2];
+    int skipped = 0;
+    for(int run = 0; run < 2; run++)
+    {
+        q.prepare(getInsertEventQuery());
+        int eventId = addEvent(q, Event(QLatin1String("Import benchmark"), QDate::currentDate(), User(users.first()))).toInt();
+        QVector<Transaction> existing = generate(eventId, 0);
+        duplicateCheck = checks[0];
+        importTransactions(existing);
+
+        QVector<Transaction> imported = generate(eventId, transactions);
+        for(int i = 10; i < imported.size(); i += 50)
+        {
+            imported[i] = existing.at(i);
+            if(i + 10 < imported.size())
+                imported[i + 10] = imported.at(i - 5);
+            if(i + 20 < imported.size())
+            {
+                const Transaction &earlier = imported.at(i - 3);
+                imported[i + 20] = Transaction(earlier.getUserGiving(), earlier.getUserReceiving(), earlier.getEvent(), earlier.getAmount(),
+                                               earlier.getDate().addDays(1), earlier.getPlace(), earlier.getDescription());
+            }
+        }
+
+        duplicateCheck = checks[run];
+        QVector<int> duplicates;
+        QElapsedTimer timer;
+        timer.start();
+        importTransactions(imported, &duplicates);
+        elapsedNs[run] = timer.nsecsElapsed();
+        skipped = duplicates.size();
+        deleteEventCascade(eventId);
+    }
+    duplicateCheck = savedCheck;
+
+    auto line = [&out, transactions](const char *name, qint64 ns) {
+        out << "    " << QString(name).leftJustified(20) << QString::number(ns / 1e6, 'f', 1).rightJustified(10) << " ms"
+            << QString::number(transactions / qMax(ns / 1e9, 1e-9), 'f', 0).rightJustified(12) << " transactions/s\n";
+    };
+    out << "Import of " << transactions << " transactions into an event with " << transactions << "\n";
+    line("check off", elapsedNs[0]);
+    line("check on, skip", elapsedNs[1]);
+    out << "    " << skipped << " duplicates skipped, the check took "
+        << QString::number(100.0 * (elapsedNs[1] - elapsedNs[0]) / qMax<qint64>(elapsedNs[0], 1), 'f', 1) << "% longer\n";
+    return report;
+}
+
+/*!
+ * Adds an event with transactions described by two of twenty words, a place out of eight and
+ * a receipt number, and times some searches with the full-text index against a scan
+ */
+QString DataBase::benchmarkTransactionSearch(int transactions)
+{
+    QString report;
+    QTextStream out(&report);
+    const QStringList words = QStringList() << "Airbnb" << "Supermarket" << "Taxi" << "Dinner" << "Beers" << "Museum"
+                                            << "Train" << "Hotel" << "Pizza" << "Breakfast" << "Tickets" << "Ferry"
+                                            << "Souvenirs" << "Petrol" << "Parking" << "Pharmacy" << "Laundry" << "Coffee"
+                                            << "Kebab" << "Bakery";
+    const QStringList places = QStringList() << "Warsaw" << "Hamburg (Germany)" << "Krakow" << "Berlin"
+                                             << "Gdansk" << "Prague" << "Vienna" << "Budapest";
+
+    QSqlQuery q(db);
+    QVector<int> users;
+    QueryStats::exec(q, QLatin1String("SELECT id FROM users LIMIT 16"), Q_FUNC_INFO);
+    while(q.next())
+        users << q.value(0).toInt();
+    if(users.size() < 2)
+        return "Error: no users in the database\n";
+
+    q.prepare(getInsertEventQuery());
+    int eventId = addEvent(q, Event(QLatin1String("Search benchmark"), QDate::currentDate(), User(users.first()))).toInt();
+    QRandomGenerator random(1);
+    QVariantList gives, receives, events, amounts, days, descriptions, transactionPlaces, currencies, fingerprints;
+    for(int i = 0; i < transactions; i++)
+    {
+        gives << users.at(i % users.size());
+        receives << users.at((i + 1) % users.size());
+        events << eventId;
+        amounts << double(random.bounded(1, 10000)) / 100;
+        days << QDate::currentDate().toJulianDay() - i % 365;
+        descriptions << QString("%1 %2 receipt %3").arg(words.at(random.bounded(words.size())))
+                                                    .arg(words.at(random.bounded(words.size()))).arg(i);
+        transactionPlaces << places.at(random.bounded(places.size()));
+        currencies << QVariant(QVariant::String);
+        fingerprints << transactionFingerprint(users.at(i % users.size()), users.at((i + 1) % users.size()), eventId,
+                                               descriptions.last().toString());
+    }
+    q.prepare(getInsertTransactionQuery());
+    q.addBindValue(gives);
+    q.addBindValue(receives);
+    q.addBindValue(events);
+    q.addBindValue(amounts);
+    q.addBindValue(days);
+    q.addBindValue(transactionPlaces);
+    q.addBindValue(descriptions);
+    q.addBindValue(currencies);
+    q.addBindValue(fingerprints);
+    QElapsedTimer timer;
+    timer.start();
+    db.transaction();
+    QueryStats::execBatch(q, Q_FUNC_INFO);
+    db.commit();
+    qint64 insertNs = timer.nsecsElapsed();
+
+    const bool indexed = hasSearchIndex();
+    out << "Search of " << transactions << " transactions" << (indexed ? "" : " (no full-text index, FTS5 missing)") << "\n";
+    out << "    batched insert     " << QString::number(insertNs / 1e6, 'f', 1).rightJustified(10) << " ms\n";
+    if(indexed)
+    {
+        timer.restart();
+        QSqlError err = rebuildSearchIndex();
+        qint64 rebuildNs = timer.nsecsElapsed();
+        if(err.type() != QSqlError::NoError)
+            return "Error: " + err.text() + "\n";
+        out << "    index rebuild      " << QString::number(rebuildNs / 1e6, 'f', 1).rightJustified(10) << " ms\n";
+    }
+
+    const QStringList searches = QStringList() << QString("receipt %1").arg(transactions / 2) << "airbnb warsaw"
+                                               << "sup" << "kebab bakery";
+    foreach (const QString &search, searches)
+    {
+        QStringList searchWords = search.split(QLatin1Char(' '));
+        qint64 elapsedNs[2] = {-1, -1};
+        int matches[2] = {0, 0};
+        for(int useIndex = indexed ? 1 : 0; useIndex >= 0; useIndex--)
+        {
+            timer.restart();
+            fillSearchResults(q, searchWords, 1000, useIndex);
+            elapsedNs[useIndex] = timer.nsecsElapsed();
+            if(execPrepared(q, "SELECT COUNT(*) FROM temp.search_results", QVariantList(), Q_FUNC_INFO) && q.next())
+                matches[useIndex] = q.value(0).toInt();
+        }
+        out << "  \"" << search << "\", first 1000 matches\n";
+        if(indexed)
+            out << "    full-text index    " << QString::number(elapsedNs[1] / 1e6, 'f', 1).rightJustified(10) << " ms, "
+                << matches[1] << " found\n";
+        out << "    scan with LIKE     " << QString::number(elapsedNs[0] / 1e6, 'f', 1).rightJustified(10) << " ms, "
+            << matches[0] << " found\n";
+    }
+
+    deleteEventCascade(eventId);
+    return report;
+}
+
+/*!
+ * Prepares and executes a statement with the given values bound in order
+ */
+bool DataBase::execPrepared(QSqlQuery &q, const QString &statement, const QVariantList &values, const char *callSite)
+{
+    if(!q.prepare(statement))
+        return false;
+    foreach (const QVariant &value, values)
+        q.addBindValue(value);
+    return QueryStats::exec(q, callSite);
+}
+
+/*!
+ * Replaces the ids of a temporary table, created on first use, with a batch insert
+ */
+bool DataBase::fillIdTable(QSqlQuery &q, const QString &table, const QVariantList &ids)
+{
+    if(!execPrepared(q, "CREATE TEMP TABLE IF NOT EXISTS " + table + "(id integer primary key)", QVariantList(), Q_FUNC_INFO)
+            || !execPrepared(q, "DELETE FROM temp." + table, QVariantList(), Q_FUNC_INFO))
+        return false;
+    if(ids.isEmpty())
+        return true;
+    if(!q.prepare("INSERT OR IGNORE INTO temp." + table + "(id) VALUES (?)"))
+        return false;
+    q.addBindValue(ids);
+    return QueryStats::execBatch(q, Q_FUNC_INFO);
+}
+
+/*!
+ * Deletes the events whose ids are in the cascade_ids table, with their transactions
+ *
+ * The per-row triggers on transactions would only update the summary rows of these events,
+ * which are deleted anyway. They are dropped for the delete and created again from their
+ * stored sql in the same transaction, so the delete runs without them. Those of the full-text
+ * index are kept, it needs the text of each deleted row.
+ */
+bool DataBase::deleteCascadeEvents(QSqlQuery &q)
+{
+    QStringList triggerNames, triggerSql;
+    if(!execPrepared(q, "SELECT name, sql FROM sqlite_master WHERE type = 'trigger' AND tbl_name = 'transactions' "
+                        "AND substr(name, 1, 17) != 'transactions_fts_'",
+                     QVariantList(), Q_FUNC_INFO))
+        return false;
+    while(q.next())
+    {
+        triggerNames << q.value(0).toString();
+        triggerSql << q.value(1).toString();
+    }
+
+    QStringList steps;
+    steps << "DELETE FROM event_summary WHERE event IN (SELECT id FROM temp.cascade_ids)"
+          << "DELETE FROM event_participants WHERE event IN (SELECT id FROM temp.cascade_ids)"
+          << "DELETE FROM kitty_ledger WHERE event IN (SELECT id FROM temp.cascade_ids)"
+          << "DELETE FROM spending_rollup WHERE event IN (SELECT id FROM temp.cascade_ids)"
+          << "DELETE FROM place_rollup WHERE event IN (SELECT id FROM temp.cascade_ids)"
+          << "DELETE FROM amount_sketches WHERE event IN (SELECT id FROM temp.cascade_ids)";
+    foreach (const QString &name, triggerNames)
+        steps << "DROP TRIGGER " + name;
+    steps << "DELETE FROM transactions WHERE event IN (SELECT id FROM temp.cascade_ids)";
+    steps << triggerSql;
+    steps << "DELETE FROM splits WHERE event IN (SELECT id FROM temp.cascade_ids)";
+    steps << "DELETE FROM events WHERE id IN (SELECT id FROM temp.cascade_ids)";
+    foreach (const QString &step, steps)
+    {
+        if(!execPrepared(q, step, QVariantList(), Q_FUNC_INFO))
+            return false;
+    }
+    return true;
+}
+
+/*!
+ * Commits the transaction of a cascading delete, or rolls it back if a step failed
+ */
+QSqlError DataBase::finishCascade(QSqlQuery &q, bool ok)
+{
+    if(!ok)
+    {
+        lastError = q.lastError();
+        db.rollback();
+        return lastError;
+    }
+    if(!db.commit())
+        return lastError = db.lastError();
+    return lastError = QSqlError();
+}
+
+/*!
+ * Deletes event from the database
+ */
+QSqlError DataBase::deleteEvent(int eventId)
+{
+    TRACE_FUNCTION();
+    QSqlQuery q(db);
+
+    balanceIndexes.remove(eventId);
+    expandedTransactions.remove(eventId);
+
+    if (!execPrepared(q, "DELETE FROM events WHERE id = ?", QVariantList() << eventId, Q_FUNC_INFO))
+        return q.lastError();
+    else
+        return QSqlError();
+}
+
+/*!
+ * Deletes user from the database
+ */
+QSqlError DataBase::deleteUser(int userId)
+{
+    TRACE_FUNCTION();
+    QSqlQuery q(db);
+
+    if (!execPrepared(q, "DELETE FROM users WHERE id = ?", QVariantList() << userId, Q_FUNC_INFO))
+        return q.lastError();
+    else
+    {
+        userIndex.remove(userId);
+        return QSqlError();
+    }
+}
+
+/*!
+ * Returns transaction for an id from the database
+ */
+Transaction DataBase::getTransaction(int id)
+{
+    TRACE_FUNCTION();
+    Transaction transaction;
+    QSqlQuery query(db);
+    QueryStats::exec(query, QString("SELECT * FROM transactions WHERE id = %1").arg(id), Q_FUNC_INFO);
+
+    if(query.next())
+    {
+        transaction = Transaction(id, User(query.value(1).toInt()),
+            User(query.value(2).toInt()),
+            Event(query.value(3).toInt()),
+            query.value(4).toDouble(),
+            dayToDate(query.value(5)),
+            query.value(6).toString(),
+            query.value(7).toString());
+        transaction.setCurrency(query.value(8).toString());
+    }
+
+    lastError = query.lastError();
+
+    return transaction;
+}
+
+/*!
+ * Returns event for an id from the database
+ */
+Event DataBase::getEvent(int id)
+{
+    TRACE_FUNCTION();
+    Event event;
+    QSqlQuery query(db);
+    QueryStats::exec(query, QString("SELECT name, creation, admin, place, description, finished, currency FROM events WHERE id = %1").arg(id), Q_FUNC_INFO);
+
+    if(query.next())
+    {
+        event = Event(id, query.value(0).toString(),
+            dayToDate(query.value(1)),
+            User(query.value(2).toInt()),
+            query.value(3).toString(),
+            query.value(4).toString(),
+            query.value(5).toBool());
+        event.setCurrency(query.value(6).toString());
+    }
+
+    lastError = query.lastError();
+
+    return event;
+}
+
+/*!
+ * Returns user for an id from the database
  */
 User DataBase::getUser(int id)
 {
+    TRACE_FUNCTION();
     User user;
-    QSqlQuery query(QString("SELECT * FROM users WHERE id = %1").arg(id));
+    QSqlQuery query(db);
+    QueryStats::exec(query, QString("SELECT * FROM users WHERE id = %1").arg(id), Q_FUNC_INFO);
 
     if(query.next())
     {
@@ -362,7 +2123,7 @@ User DataBase::getUser(int id)
             query.value(3).toString(),
             query.value(4).toString(),
             query.value(5).toString(),
-            query.value(6).toDate());
+            dayToDate(query.value(6)));
     }
 
     lastError = query.lastError();
@@ -370,12 +2131,71 @@ User DataBase::getUser(int id)
     return user;
 }
 
+/*!
+ * Returns all the users from the database
+ */
+QVector<User> DataBase::getUsers()
+{
+    TRACE_FUNCTION();
+    QVector<User> users;
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    QueryStats::exec(query, QLatin1String("SELECT id, name, nickname, email, passwordhash, passwordsalt, birthdate FROM users ORDER BY id"), Q_FUNC_INFO);
+    while(query.next())
+    {
+        users.append(User(query.value(0).toInt(), query.value(1).toString(), query.value(2).toString(), query.value(3).toString(),
+                          query.value(4).toString(), query.value(5).toString(), dayToDate(query.value(6))));
+    }
+    lastError = query.lastError();
+    return users;
+}
+
+/*!
+ * Returns all the events from the database
+ */
+QVector<Event> DataBase::getEvents()
+{
+    return selectEvents(QString());
+}
+
+/*!
+ * Returns the events with transactions or split expenses, the ones the calculations can be shown for
+ */
+QVector<Event> DataBase::getEventsWithTransactions()
+{
+    return selectEvents(QLatin1String("id IN (SELECT event FROM transactions UNION SELECT event FROM splits)"));
+}
+
+/*!
+ * Reads the events matching a condition, ordered by name and id
+ */
+QVector<Event> DataBase::selectEvents(const QString &condition)
+{
+    TRACE_FUNCTION();
+    QVector<Event> events;
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    QueryStats::exec(query, "SELECT id, name, creation, admin, place, description, finished, currency FROM events"
+                     + (condition.isEmpty() ? QString() : " WHERE " + condition) + " ORDER BY name, id", Q_FUNC_INFO);
+    while(query.next())
+    {
+        Event event(query.value(0).toInt(), query.value(1).toString(), dayToDate(query.value(2)), User(query.value(3).toInt()),
+                    query.value(4).toString(), query.value(5).toString(), query.value(6).toBool());
+        event.setCurrency(query.value(7).toString());
+        events.append(event);
+    }
+    lastError = query.lastError();
+    return events;
+}
+
 /*!
  * Returns how many events a user is taking part in
  */
 int DataBase::getNumEventsOfUser(int userId)
 {
-    QSqlQuery query(QString("SELECT name FROM events WHERE events.admin = %1").arg(userId));
+    TRACE_FUNCTION();
+    QSqlQuery query(db);
+    QueryStats::exec(query, QString("SELECT name FROM events WHERE events.admin = %1").arg(userId), Q_FUNC_INFO);
     lastError = query.lastError();
     return qSqlQueryNumRows(query);
 }
@@ -385,19 +2205,22 @@ int DataBase::getNumEventsOfUser(int userId)
  */
 int DataBase::getNumTransactions(int userId, int eventId)
 {
+    TRACE_FUNCTION();
     if(userId == -1 && eventId == -1)//! \todo return total number of transactions if no user nor event
         return 0;
 
+    if(userId == -1)
+        return getEventSummary(eventId).transactions;
+
     QString strQuery = "SELECT id FROM transactions";
     if(eventId == -1)
         strQuery.append(QString(" WHERE transactions.userreceives = %1 OR transactions.usergives = %2")
                 .arg(userId).arg(userId));
-    else if(userId == -1)
-        strQuery.append(QString(" WHERE transactions.event = %1").arg(eventId));
     else
-        strQuery.append(QString(" WHERE transactions.event = %1 AND (transactions.userreceives = %2 OR transactions.usergives = %3")
+        strQuery.append(QString(" WHERE transactions.event = %1 AND (transactions.userreceives = %2 OR transactions.usergives = %3)")
                 .arg(eventId).arg(userId).arg(userId));
-    QSqlQuery query(strQuery);
+    QSqlQuery query(db);
+    QueryStats::exec(query, strQuery, Q_FUNC_INFO);
     query.next();
 
     lastError = query.lastError();
@@ -406,34 +2229,1481 @@ int DataBase::getNumTransactions(int userId, int eventId)
 }
 
 /*!
- * Calculates the total amount of the Kitty for an event
+ * Calculates the money in the Kitty of an event, read from the event summary
  *
- * \todo this would return the maximum. if someone took from kitty, we should substract it
+ * The money given to the kitty minus the money taken from it.
  */
 double DataBase::calcAmountKitty(int eventId)
 {
-    QSqlQuery query(QString("SELECT SUM(amount) FROM transactions WHERE transactions.event = %1 AND transactions.userreceives = %2")
-                    .arg(eventId).arg(kittyId));
-    bool valid = query.next();
-    lastError = query.lastError();
-    if(valid)
-        return query.value(0).toDouble();
-    else
+    TRACE_FUNCTION();
+    EventSummary summary = getEventSummary(eventId);
+    if(lastError.type() != QSqlError::NoError)
         return -1;
+    return summary.kittyIn - summary.kittyOut;
 }
 
 /*!
- * Returns the number of users with transactions in an event
+ * Returns the amount of money given from one user to another in an event
+ *
+ * Summed by SQLite unless the event has transactions in other currencies or split expenses.
  */
-int DataBase::calcNumUsers(int eventId)
+double DataBase::getAmountBetween(int eventId, int userGivingId, int userReceivingId)
+{
+    TRACE_FUNCTION();
+    if(!needsExpansion(eventId))
+    {
+        QSqlQuery query = acquireStatement("SELECT TOTAL(amount) FROM transactions WHERE event = ? AND usergives = ? AND userreceives = ?");
+        query.addBindValue(eventId);
+        query.addBindValue(userGivingId);
+        query.addBindValue(userReceivingId);
+        QueryStats::exec(query, Q_FUNC_INFO);
+        double amount = query.next() ? query.value(0).toDouble() : 0;
+        lastError = query.lastError();
+        query.finish();
+        releaseStatement(query);
+        return amount;
+    }
+
+    double amount = 0;
+    foreach(const Transaction &transaction, getExpandedTransactions(eventId))
+    {
+        if(transaction.getUserGiving().getId() == userGivingId && transaction.getUserReceiving().getId() == userReceivingId)
+            amount += transaction.getAmount();
+    }
+    return amount;
+}
+
+/*!
+ * Returns the users giving money in the transactions of an event
+ */
+QList<int> DataBase::getUsersGiving(int eventId)
 {
-    QSqlQuery query(QString("SELECT nickname FROM users WHERE users.id IS NOT %1 AND ("
-                                "users.id IN (SELECT usergives FROM transactions WHERE transactions.event = %2)"
-                                " OR users.id IN (SELECT userreceives FROM transactions WHERE transactions.event = %3)"
-                            ")")
-                    .arg(kittyId).arg(eventId).arg(eventId));
+    TRACE_FUNCTION();
+    QList<int> users;
+    QSqlQuery query = acquireStatement("SELECT DISTINCT usergives FROM transactions WHERE event = ?");
+    query.addBindValue(eventId);
+    QueryStats::exec(query, Q_FUNC_INFO);
+    while(query.next())
+        users << query.value(0).toInt();
     lastError = query.lastError();
-    return qSqlQueryNumRows(query);
+    query.finish();
+    releaseStatement(query);
+    return users;
+}
+
+/*!
+ * Returns the users receiving money from a user in the transactions of an event
+ */
+QList<int> DataBase::getUsersReceiving(int eventId, int userGivingId)
+{
+    TRACE_FUNCTION();
+    QList<int> users;
+    QSqlQuery query = acquireStatement("SELECT DISTINCT userreceives FROM transactions WHERE event = ? AND usergives = ?");
+    query.addBindValue(eventId);
+    query.addBindValue(userGivingId);
+    QueryStats::exec(query, Q_FUNC_INFO);
+    while(query.next())
+        users << query.value(0).toInt();
+    lastError = query.lastError();
+    query.finish();
+    releaseStatement(query);
+    return users;
+}
+
+/*!
+ * Returns the currency of an event
+ */
+QString DataBase::getEventCurrency(int eventId)
+{
+    QSqlQuery query = acquireStatement("SELECT currency FROM events WHERE id = ?");
+    query.addBindValue(eventId);
+    QueryStats::exec(query, Q_FUNC_INFO);
+    QString currency = query.next() ? query.value(0).toString() : QString();
+    lastError = query.lastError();
+    query.finish();
+    releaseStatement(query);
+    return currency.isEmpty() ? defaultCurrency() : currency;
+}
+
+/*!
+ * Returns true if an event has transactions with their own currency, looked up in the
+ * partial index transactions_foreign_currency, or split expenses
+ */
+bool DataBase::needsExpansion(int eventId)
+{
+    if(expandedTransactions.contains(eventId))
+        return true;
+
+    QSqlQuery query = acquireStatement("SELECT EXISTS(SELECT 1 FROM transactions WHERE event = ? AND currency IS NOT NULL) "
+                                       "OR EXISTS(SELECT 1 FROM splits WHERE event = ?)");
+    query.addBindValue(eventId);
+    query.addBindValue(eventId);
+    QueryStats::exec(query, Q_FUNC_INFO);
+    bool foreign = query.next() && query.value(0).toBool();
+    lastError = query.lastError();
+    query.finish();
+    releaseStatement(query);
+    return foreign;
+}
+
+/*!
+ * Returns the transactions of an event needing expansion, reading them with
+ * getEventTransactions() the first time
+ */
+const QVector<Transaction> &DataBase::getExpandedTransactions(int eventId)
+{
+    QHash<int, QVector<Transaction> >::const_iterator it = expandedTransactions.constFind(eventId);
+    if(it != expandedTransactions.constEnd())
+        return it.value();
+
+    TRACE_FUNCTION();
+    QVector<Transaction> transactions = getEventTransactions(eventId);
+    // Not kept on error, so it is read again on next use
+    if(lastError.type() != QSqlError::NoError)
+    {
+        static const QVector<Transaction> none;
+        return none;
+    }
+    return expandedTransactions.insert(eventId, transactions).value();
+}
+
+/*!
+ * Returns the transactions of an event ordered by date and id, with its split expenses expanded
+ * and the amounts converted to the currency of the event in one batch
+ */
+QVector<Transaction> DataBase::getEventTransactions(int eventId)
+{
+    TRACE_FUNCTION();
+    QVector<Transaction> transactions;
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    q.prepare("SELECT id, usergives, userreceives, amount, transactionDate, place, description, currency FROM transactions "
+              "WHERE event = ? ORDER BY transactionDate, id");
+    q.addBindValue(eventId);
+    QueryStats::exec(q, Q_FUNC_INFO);
+    while(q.next())
+    {
+        transactions.append(Transaction(q.value(0).toInt(), User(q.value(1).toInt()),
+            User(q.value(2).toInt()),
+            Event(eventId),
+            q.value(3).toDouble(),
+            dayToDate(q.value(4)),
+            q.value(5).toString(),
+            q.value(6).toString()));
+        transactions.last().setCurrency(q.value(7).toString());
+    }
+    lastError = q.lastError();
+    if(lastError.type() != QSqlError::NoError)
+        return transactions;
+
+    QVector<SplitExpense> splits = getEventSplits(eventId);
+    if(!splits.isEmpty())
+    {
+        foreach(const SplitExpense &split, splits)
+            transactions += split.expand();
+        // Undated first, the order of the transactions kept within a day
+        std::stable_sort(transactions.begin(), transactions.end(), [](const Transaction &a, const Transaction &b) {
+            return a.getDate() < b.getDate();
+        });
+    }
+
+    QVector<QString> currencies(transactions.size());
+    QVector<qint64> days(transactions.size());
+    QVector<double> amounts(transactions.size());
+    bool foreign = false;
+    for(int i = 0; i < transactions.size(); i++)
+    {
+        const Transaction &transaction = transactions.at(i);
+        currencies[i] = transaction.getCurrency();
+        days[i] = transaction.getDate().isValid() ? transaction.getDate().toJulianDay() : 0;
+        amounts[i] = transaction.getAmount();
+        foreign = foreign || !currencies.at(i).isEmpty();
+    }
+    if(!foreign)
+        return transactions;
+
+    QString base = getEventCurrency(eventId);
+    int missing = getCurrencyConverter(base).convert(currencies, days, amounts);
+    if(missing)
+        qWarning() << missing << "transactions of event" << eventId << "have no exchange rate to" << base;
+    for(int i = 0; i < transactions.size(); i++)
+        transactions[i].setAmount(amounts.at(i));
+    return transactions;
+}
+
+/*!
+ * Adds a split expense, its shares packed in one blob, unless its currency has no exchange
+ * rate to the one of the event
+ */
+QVariant DataBase::addSplit(const SplitExpense &split)
+{
+    TRACE_FUNCTION();
+    if(!isCurrencyConvertible(split.getEvent().getId(), split.getCurrency()))
+    {
+        lastError = QSqlError(QString(), "No exchange rate from " + split.getCurrency() + " to "
+                              + getEventCurrency(split.getEvent().getId()), QSqlError::StatementError);
+        return QVariant();
+    }
+    QSqlQuery q = acquireStatement("insert into splits(payer, event, amount, splitDate, place, description, currency, shares) "
+                                   "values(?, ?, ?, ?, ?, ?, ?, ?)");
+    q.addBindValue(split.getPayer().getId());
+    q.addBindValue(split.getEvent().getId());
+    q.addBindValue(split.getAmount());
+    q.addBindValue(dateToDay(split.getDate()));
+    q.addBindValue(split.getPlace());
+    q.addBindValue(split.getDescription());
+    if(split.getCurrency().isEmpty())
+        q.addBindValue(QVariant(QVariant::String));
+    else
+        q.addBindValue(split.getCurrency());
+    q.addBindValue(split.packShares());
+    QueryStats::exec(q, Q_FUNC_INFO);
+    lastError = q.lastError();
+    QVariant id = q.lastInsertId();
+    releaseStatement(q);
+
+    // The balance index of the event is rebuilt with the expanded shares on next use
+    balanceIndexes.remove(split.getEvent().getId());
+    expandedTransactions.remove(split.getEvent().getId());
+    return id;
+}
+
+/*!
+ * Deletes a split expense
+ */
+QSqlError DataBase::deleteSplit(int splitId)
+{
+    TRACE_FUNCTION();
+    QSqlQuery q(db);
+    if(execPrepared(q, "SELECT event FROM splits WHERE id = ?", QVariantList() << splitId, Q_FUNC_INFO) && q.next())
+    {
+        balanceIndexes.remove(q.value(0).toInt());
+        expandedTransactions.remove(q.value(0).toInt());
+    }
+    execPrepared(q, "DELETE FROM splits WHERE id = ?", QVariantList() << splitId, Q_FUNC_INFO);
+    return lastError = q.lastError();
+}
+
+/*!
+ * Returns the split expenses of an event, read through the index on splits(event)
+ */
+QVector<SplitExpense> DataBase::getEventSplits(int eventId)
+{
+    TRACE_FUNCTION();
+    QVector<SplitExpense> splits;
+    QSqlQuery query = acquireStatement("SELECT id, payer, amount, splitDate, place, description, currency, shares FROM splits "
+                                       "WHERE event = ? ORDER BY splitDate, id");
+    query.addBindValue(eventId);
+    QueryStats::exec(query, Q_FUNC_INFO);
+    while(query.next())
+    {
+        SplitExpense split(User(query.value(1).toInt()), Event(eventId), query.value(2).toDouble(),
+                           dayToDate(query.value(3)), query.value(4).toString(), query.value(5).toString());
+        split.setId(query.value(0).toInt());
+        split.setCurrency(query.value(6).toString());
+        if(!split.unpackShares(query.value(7).toByteArray()))
+            qWarning() << "Split expense" << split.getId() << "has invalid shares";
+        splits.append(split);
+    }
+    lastError = query.lastError();
+    query.finish();
+    releaseStatement(query);
+    return splits;
+}
+
+/*!
+ * Returns the number of split expenses of an event, or of all the events
+ */
+int DataBase::getNumSplits(int eventId)
+{
+    TRACE_FUNCTION();
+    QSqlQuery query(db);
+    if(eventId == -1)
+        execPrepared(query, "SELECT COUNT(*) FROM splits", QVariantList(), Q_FUNC_INFO);
+    else
+        execPrepared(query, "SELECT COUNT(*) FROM splits WHERE event = ?", QVariantList() << eventId, Q_FUNC_INFO);
+    int count = query.next() ? query.value(0).toInt() : 0;
+    lastError = query.lastError();
+    return count;
+}
+
+/*!
+ * Returns how many split expenses a user pays or has a share of
+ */
+int DataBase::getNumSplitsOfUser(int userId)
+{
+    TRACE_FUNCTION();
+    QSqlQuery query(db);
+    int count = 0;
+    if(execPrepared(query, "SELECT COUNT(*) FROM splits WHERE payer = ?", QVariantList() << userId, Q_FUNC_INFO) && query.next())
+        count = query.value(0).toInt();
+    QVector<SplitExpense> shared;
+    if(getSplitsSharedWith(query, userId, &shared))
+        count += shared.size();
+    lastError = query.lastError();
+    return count;
+}
+
+/*!
+ * Returns the converter to a currency, loading its rates the first time
+ *
+ * Rates given from the base are used as they are and rates given to the base inverted.
+ * When both exist for a day, the one given from the base wins.
+ */
+const CurrencyConverter &DataBase::getCurrencyConverter(const QString &base)
+{
+    QHash<QString, CurrencyConverter>::const_iterator it = converters.constFind(base);
+    if(it != converters.constEnd())
+        return it.value();
+
+    TRACE_FUNCTION();
+    CurrencyConverter converter(base);
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT base, day, rate FROM exchange_rates WHERE currency = ?");
+    query.addBindValue(base);
+    QueryStats::exec(query, Q_FUNC_INFO);
+    while(query.next())
+        converter.addRate(query.value(0).toString(), query.value(1).toLongLong(), query.value(2).toDouble());
+    query.prepare("SELECT currency, day, 1.0 / rate FROM exchange_rates WHERE base = ?");
+    query.addBindValue(base);
+    QueryStats::exec(query, Q_FUNC_INFO);
+    while(query.next())
+        converter.addRate(query.value(0).toString(), query.value(1).toLongLong(), query.value(2).toDouble());
+    lastError = query.lastError();
+
+    return converters.insert(base, converter).value();
+}
+
+/*!
+ * Returns true if amounts in a currency can be converted to the currency of an event
+ */
+bool DataBase::isCurrencyConvertible(int eventId, const QString &currency)
+{
+    if(currency.isEmpty())
+        return true;
+    return getCurrencyConverter(getEventCurrency(eventId)).hasRates(currency);
+}
+
+/*!
+ * Adds exchange rates with one batched insert in a single transaction, replacing the rates
+ * of the same day. Nothing is added if any of them fails.
+ */
+QSqlError DataBase::importExchangeRates(const QVector<CurrencyConverter::Rate> &rates)
+{
+    TRACE_FUNCTION();
+    QVariantList bases, currencies, days, values;
+    foreach (const CurrencyConverter::Rate &rate, rates)
+    {
+        bases << rate.base;
+        currencies << rate.currency;
+        days << dateToDay(rate.date);
+        values << rate.rate;
+    }
+
+    QSqlQuery q(db);
+    if (!q.prepare("INSERT OR REPLACE INTO exchange_rates(base, currency, day, rate) VALUES (?, ?, ?, ?)"))
+        return lastError = q.lastError();
+    q.addBindValue(bases);
+    q.addBindValue(currencies);
+    q.addBindValue(days);
+    q.addBindValue(values);
+
+    db.transaction();
+    if (!QueryStats::execBatch(q, Q_FUNC_INFO))
+    {
+        lastError = q.lastError();
+        db.rollback();
+        return lastError;
+    }
+    if (!db.commit())
+        return lastError = db.lastError();
+
+    // Converted amounts change with the rates. The snapshots of the finished events stay frozen
+    converters.clear();
+    balanceIndexes.clear();
+    expandedTransactions.clear();
+    return lastError = QSqlError();
+}
+
+/*!
+ * Returns true if the SQLite of a connection was built with FTS5
+ */
+bool DataBase::hasFullTextSearch(QSqlDatabase database)
+{
+    QSqlQuery q(database);
+    if (!QueryStats::exec(q, QLatin1String("SELECT sqlite_compileoption_used('ENABLE_FTS5')"), Q_FUNC_INFO) || !q.next())
+        return false;
+    return q.value(0).toBool();
+}
+
+/*!
+ * Returns true if the database has the full-text index of the transactions
+ */
+bool DataBase::hasSearchIndex()
+{
+    QSqlQuery q(db);
+    if (!QueryStats::exec(q, QLatin1String("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'transactions_fts'"), Q_FUNC_INFO))
+        return false;
+    return q.next();
+}
+
+/*!
+ * Creates the full-text index of the transactions and its triggers if they are missing, e.g. in
+ * a file migrated by a build without FTS5, and rebuilds the index from the transactions in one
+ * transaction
+ */
+QSqlError DataBase::rebuildSearchIndex()
+{
+    TRACE_FUNCTION();
+    if(!hasFullTextSearch(db))
+        return lastError = QSqlError(QString(), "This SQLite has no full-text search (FTS5)", QSqlError::UnknownError);
+
+    QSqlQuery q(db);
+    db.transaction();
+    foreach (const QString &step, searchIndexSteps())
+    {
+        if (!QueryStats::exec(q, step, Q_FUNC_INFO))
+        {
+            lastError = q.lastError();
+            db.rollback();
+            return lastError;
+        }
+    }
+    if (!db.commit())
+        return lastError = db.lastError();
+    return lastError = QSqlError();
+}
+
+/*!
+ * Searches the description and the place of the transactions with the full-text index, or
+ * with a scan if the database has none
+ */
+int DataBase::searchTransactions(const QString &text, int limit)
+{
+    TRACE_FUNCTION();
+    static const QRegularExpression separators("[^\\p{L}\\p{N}]+", QRegularExpression::UseUnicodePropertiesOption);
+    QStringList words = text.split(separators, QString::SkipEmptyParts);
+
+    QSqlQuery q(db);
+    if(!fillSearchResults(q, words, limit, hasSearchIndex()))
+    {
+        lastError = q.lastError();
+        return -1;
+    }
+    lastError = QSqlError();
+    return execPrepared(q, "SELECT COUNT(*) FROM temp.search_results", QVariantList(), Q_FUNC_INFO) && q.next() ? q.value(0).toInt() : -1;
+}
+
+/*!
+ * Replaces the rows of search_results with the ids of the matches, the best first. Their
+ * position is the rowid given in insertion order, which follows the ORDER BY of the select.
+ *
+ * With the index each word becomes a prefix query ("word"*) and the words are ANDed, so the
+ * text typed is never parsed as FTS5 syntax. The scan matches the words anywhere, also
+ * inside other words.
+ */
+bool DataBase::fillSearchResults(QSqlQuery &q, const QStringList &words, int limit, bool useIndex)
+{
+    if(!execPrepared(q, "CREATE TEMP TABLE IF NOT EXISTS search_results(position integer primary key, id integer not null)", QVariantList(), Q_FUNC_INFO)
+            || !execPrepared(q, "DELETE FROM temp.search_results", QVariantList(), Q_FUNC_INFO))
+        return false;
+    if(words.isEmpty())
+        return true;
+
+    QVariantList values;
+    if(useIndex)
+    {
+        QStringList terms;
+        foreach (const QString &word, words)
+            terms << QLatin1Char('"') + word + QLatin1String("\"*");
+        values << terms.join(QLatin1Char(' ')) << limit;
+        return execPrepared(q, "INSERT INTO temp.search_results(id) "
+                               "SELECT rowid FROM transactions_fts WHERE transactions_fts MATCH ? ORDER BY rank LIMIT ?",
+                            values, Q_FUNC_INFO);
+    }
+
+    QStringList conditions;
+    foreach (const QString &word, words)
+    {
+        const QString pattern = QLatin1Char('%') + word + QLatin1Char('%');
+        conditions << QLatin1String("(description LIKE ? OR place LIKE ?)");
+        values << pattern << pattern;
+    }
+    values << limit;
+    return execPrepared(q, "INSERT INTO temp.search_results(id) SELECT id FROM transactions WHERE "
+                           + conditions.join(QLatin1String(" AND ")) + " ORDER BY id DESC LIMIT ?",
+                        values, Q_FUNC_INFO);
+}
+
+/*!
+ * Returns the balance of the Kitty of an event day by day
+ *
+ * Reads one kitty_ledger row per day, kept by triggers on transactions, and accumulates them.
+ */
+QVector<DataBase::KittyBalancePoint> DataBase::getKittyBalanceSeries(int eventId)
+{
+    TRACE_FUNCTION();
+    // kitty_ledger adds up the amounts as they are, the days are summed in the event currency
+    if(needsExpansion(eventId))
+        return kittyBalanceSeriesOf(getExpandedTransactions(eventId), kittyId);
+
+    QVector<KittyBalancePoint> series;
+
+    QSqlQuery query = acquireStatement("SELECT day, inflow, outflow FROM kitty_ledger WHERE event = ? ORDER BY day");
+    query.addBindValue(eventId);
+    QueryStats::exec(query, Q_FUNC_INFO);
+
+    double balance = 0;
+    while(query.next())
+    {
+        KittyBalancePoint point;
+        qint64 day = query.value(0).toLongLong();
+        point.date = day ? QDate::fromJulianDay(day) : QDate();
+        point.inflow = query.value(1).toDouble();
+        point.outflow = query.value(2).toDouble();
+        balance += point.inflow - point.outflow;
+        point.balance = balance;
+        series.append(point);
+    }
+    lastError = query.lastError();
+    query.finish();
+    releaseStatement(query);
+
+    return series;
+}
+
+/*!
+ * Returns the money given in an event day by day
+ *
+ * Reads the spending_rollup rows of the event with money given, one per day and user, and
+ * adds up the users of each day.
+ */
+QVector<LedgerStore::SpendingPoint> DataBase::getSpendingSeries(int eventId, int userId)
+{
+    TRACE_FUNCTION();
+    // The rollup adds up the amounts as they are, the days are summed in the event currency
+    if(needsExpansion(eventId))
+        return spendingSeriesOf(getExpandedTransactions(eventId), userId);
+
+    QVector<SpendingPoint> series;
+
+    QSqlQuery query = acquireStatement("SELECT day, TOTAL(amount), SUM(transactions) FROM spending_rollup "
+                                       "WHERE event = ? AND direction = 0 AND (? = -1 OR user = ?) GROUP BY day ORDER BY day");
+    query.addBindValue(eventId);
+    query.addBindValue(userId);
+    query.addBindValue(userId);
+    QueryStats::exec(query, Q_FUNC_INFO);
+
+    while(query.next())
+    {
+        SpendingPoint point;
+        qint64 day = query.value(0).toLongLong();
+        point.date = day ? QDate::fromJulianDay(day) : QDate();
+        point.amount = query.value(1).toDouble();
+        point.transactions = query.value(2).toInt();
+        series.append(point);
+    }
+    lastError = query.lastError();
+    query.finish();
+    releaseStatement(query);
+
+    return series;
+}
+
+/*!
+ * Returns the users who gave the most money in an event, adding up their spending_rollup rows
+ */
+QVector<LedgerStore::SpenderTotal> DataBase::getTopSpenders(int eventId, int limit)
+{
+    TRACE_FUNCTION();
+    if(needsExpansion(eventId))
+        return topSpendersOf(getExpandedTransactions(eventId), kittyId, limit);
+
+    QVector<SpenderTotal> spenders;
+
+    QSqlQuery query = acquireStatement("SELECT user, TOTAL(CASE WHEN direction = 0 THEN amount END) AS given, "
+                                       "TOTAL(CASE WHEN direction = 1 THEN amount END), SUM(transactions) "
+                                       "FROM spending_rollup WHERE event = ? AND user != ? "
+                                       "GROUP BY user ORDER BY given DESC, user LIMIT ?");
+    query.addBindValue(eventId);
+    query.addBindValue(kittyId);
+    query.addBindValue(limit);
+    QueryStats::exec(query, Q_FUNC_INFO);
+
+    while(query.next())
+    {
+        SpenderTotal spender;
+        spender.userId = query.value(0).toInt();
+        spender.given = query.value(1).toDouble();
+        spender.received = query.value(2).toDouble();
+        spender.transactions = query.value(3).toInt();
+        spenders.append(spender);
+    }
+    lastError = query.lastError();
+    query.finish();
+    releaseStatement(query);
+
+    return spenders;
+}
+
+/*!
+ * Returns the places where the most money was spent in an event, from its place_rollup rows
+ */
+QVector<LedgerStore::PlaceTotal> DataBase::getTopPlaces(int eventId, int limit)
+{
+    TRACE_FUNCTION();
+    if(needsExpansion(eventId))
+        return topPlacesOf(getExpandedTransactions(eventId), limit);
+
+    QVector<PlaceTotal> places;
+
+    QSqlQuery query = acquireStatement("SELECT place, amount, transactions FROM place_rollup "
+                                       "WHERE event = ? AND place != '' ORDER BY amount DESC, place LIMIT ?");
+    query.addBindValue(eventId);
+    query.addBindValue(limit);
+    QueryStats::exec(query, Q_FUNC_INFO);
+
+    while(query.next())
+    {
+        PlaceTotal place;
+        place.place = query.value(0).toString();
+        place.amount = query.value(1).toDouble();
+        place.transactions = query.value(2).toInt();
+        places.append(place);
+    }
+    lastError = query.lastError();
+    query.finish();
+    releaseStatement(query);
+
+    return places;
+}
+
+/*!
+ * Returns the transactions between two dates (both included), ordered by date
+ *
+ * Uses the indexes on the day numbers (event, transactionDate) and (transactionDate).
+ */
+QVector<Transaction> DataBase::getTransactionsBetween(QDate from, QDate to, int eventId)
+{
+    TRACE_FUNCTION();
+    QVector<Transaction> transactions;
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if(eventId == -1)
+        query.prepare("SELECT id, usergives, userreceives, event, amount, transactionDate, place, description, currency FROM transactions "
+                      "WHERE transactionDate BETWEEN ? AND ? ORDER BY transactionDate, id");
+    else
+    {
+        query.prepare("SELECT id, usergives, userreceives, event, amount, transactionDate, place, description, currency FROM transactions "
+                      "WHERE event = ? AND transactionDate BETWEEN ? AND ? ORDER BY transactionDate, id");
+        query.addBindValue(eventId);
+    }
+    query.addBindValue(dateToDay(from));
+    query.addBindValue(dateToDay(to));
+    QueryStats::exec(query, Q_FUNC_INFO);
+
+    while(query.next())
+    {
+        transactions.append(Transaction(query.value(0).toInt(), User(query.value(1).toInt()),
+            User(query.value(2).toInt()),
+            Event(query.value(3).toInt()),
+            query.value(4).toDouble(),
+            dayToDate(query.value(5)),
+            query.value(6).toString(),
+            query.value(7).toString()));
+        transactions.last().setCurrency(query.value(8).toString());
+    }
+
+    lastError = query.lastError();
+
+    return transactions;
+}
+
+/*!
+ * Returns the total amount of the transactions between two dates (both included)
+ */
+double DataBase::sumBetween(QDate from, QDate to, int eventId)
+{
+    TRACE_FUNCTION();
+    QSqlQuery query(db);
+    if(eventId == -1)
+        query.prepare("SELECT TOTAL(amount) FROM transactions WHERE transactionDate BETWEEN ? AND ?");
+    else
+    {
+        query.prepare("SELECT TOTAL(amount) FROM transactions WHERE event = ? AND transactionDate BETWEEN ? AND ?");
+        query.addBindValue(eventId);
+    }
+    query.addBindValue(dateToDay(from));
+    query.addBindValue(dateToDay(to));
+    QueryStats::exec(query, Q_FUNC_INFO);
+
+    bool valid = query.next();
+    lastError = query.lastError();
+    if(valid)
+        return query.value(0).toDouble();
+    else
+        return -1;
+}
+
+/*!
+ * Adds an event with transactions over three years and sums 30-day windows of it with
+ * sumBetween(), against the same sums on a copy of the transactions with their dates as ISO
+ * text, as they were stored before the day numbers. The copy gets the same (event, date) index
+ * as the transactions, so the timings compare the date representations only.
+ */
+QString DataBase::benchmarkDateRange(int transactions)
+{
+    QString report;
+    QTextStream out(&report);
+    const int windows = 200;
+    const int windowDays = 30;
+    const QDate first = QDate::currentDate().addYears(-3);
+    const int span = first.daysTo(QDate::currentDate());
+
+    QSqlQuery q(db);
+    QVector<int> users;
+    QueryStats::exec(q, QLatin1String("SELECT id FROM users LIMIT 16"), Q_FUNC_INFO);
+    while(q.next())
+        users << q.value(0).toInt();
+    if(users.size() < 2)
+        return "Error: no users in the database\n";
+
+    q.prepare(getInsertEventQuery());
+    int eventId = addEvent(q, Event(QLatin1String("Date range benchmark"), QDate::currentDate(), User(users.first()))).toInt();
+    QRandomGenerator random(1);
+    QVariantList gives, receives, events, amounts, days, places, descriptions, currencies, fingerprints;
+    for(int i = 0; i < transactions; i++)
+    {
+        gives << users.at(i % users.size());
+        receives << users.at((i + 1) % users.size());
+        events << eventId;
+        amounts << double(random.bounded(1, 10000)) / 100;
+        days << first.toJulianDay() + random.bounded(span + 1);
+        places << QString();
+        descriptions << QString();
+        currencies << QVariant(QVariant::String);
+        fingerprints << transactionFingerprint(users.at(i % users.size()), users.at((i + 1) % users.size()), eventId, QString());
+    }
+    q.prepare(getInsertTransactionQuery());
+    q.addBindValue(gives);
+    q.addBindValue(receives);
+    q.addBindValue(events);
+    q.addBindValue(amounts);
+    q.addBindValue(days);
+    q.addBindValue(places);
+    q.addBindValue(descriptions);
+    q.addBindValue(currencies);
+    q.addBindValue(fingerprints);
+    db.transaction();
+    bool ok = QueryStats::execBatch(q, Q_FUNC_INFO);
+    db.commit();
+
+    // SQLite julian days start at noon, QDate day numbers at midnight
+    ok = ok && QueryStats::exec(q, QLatin1String("CREATE TEMP TABLE iso_dates(id integer primary key, event integer, "
+                                                 "amount real, transactionDate text)"), Q_FUNC_INFO)
+            && execPrepared(q, "INSERT INTO temp.iso_dates SELECT id, event, amount, date(transactionDate - 0.5) "
+                               "FROM transactions WHERE event = ?", QVariantList() << eventId, Q_FUNC_INFO)
+            && QueryStats::exec(q, QLatin1String("CREATE INDEX temp.iso_dates_event_date ON iso_dates(event, transactionDate)"), Q_FUNC_INFO);
+    if(!ok)
+    {
+        QString error = q.lastError().text();
+        QueryStats::exec(q, QLatin1String("DROP TABLE IF EXISTS temp.iso_dates"), Q_FUNC_INFO);
+        deleteEventCascade(eventId);
+        return "Error: " + error + "\n";
+    }
+
+    QVector<QDate> starts;
+    for(int i = 0; i < windows; i++)
+        starts << first.addDays(random.bounded(span - windowDays + 1));
+
+    double isoTotal = 0;
+    QElapsedTimer timer;
+    timer.start();
+    q.prepare("SELECT TOTAL(amount) FROM temp.iso_dates WHERE event = ? AND transactionDate BETWEEN ? AND ?");
+    foreach(const QDate &start, starts)
+    {
+        q.addBindValue(eventId);
+        q.addBindValue(start.toString(Qt::ISODate));
+        q.addBindValue(start.addDays(windowDays - 1).toString(Qt::ISODate));
+        QueryStats::exec(q, Q_FUNC_INFO);
+        if(q.next())
+            isoTotal += q.value(0).toDouble();
+    }
+    qint64 isoNs = timer.nsecsElapsed();
+
+    double dayTotal = 0;
+    timer.restart();
+    foreach(const QDate &start, starts)
+        dayTotal += sumBetween(start, start.addDays(windowDays - 1), eventId);
+    qint64 dayNs = timer.nsecsElapsed();
+
+    QueryStats::exec(q, QLatin1String("DROP TABLE temp.iso_dates"), Q_FUNC_INFO);
+    deleteEventCascade(eventId);
+
+    auto line = [&out, windows](const char *name, qint64 ns) {
+        out << "    " << QString(name).leftJustified(22) << QString::number(ns / 1e6, 'f', 1).rightJustified(10) << " ms"
+            << QString::number(ns / 1e3 / windows, 'f', 1).rightJustified(10) << " us/query\n";
+    };
+    out << "Sum of " << windows << " windows of " << windowDays << " days over " << transactions << " transactions\n";
+    line("indexed ISO text", isoNs);
+    line("indexed day numbers", dayNs);
+    out << "    totals " << (qAbs(isoTotal - dayTotal) < 0.005 ? "match" : "DIFFER") << " ("
+        << QString::number(dayTotal, 'f', 2) << ")\n";
+    return report;
+}
+
+/*!
+ * Returns the balance of a user in an event up to a date (included)
+ *
+ * The balance is the money given minus the money received, so a positive balance is owed to the user.
+ */
+double DataBase::getBalanceAsOf(int eventId, int userId, QDate date)
+{
+    TRACE_FUNCTION();
+    return getBalanceIndex(eventId).balanceAsOf(userId, date.toJulianDay());
+}
+
+/*!
+ * Returns the balance of a user in an event between two dates (both included)
+ */
+double DataBase::getBalanceBetween(int eventId, int userId, QDate from, QDate to)
+{
+    TRACE_FUNCTION();
+    return getBalanceIndex(eventId).balanceBetween(userId, from.toJulianDay(), to.toJulianDay());
+}
+
+/*!
+ * Returns the balances of all the users of an event up to a date (included)
+ */
+QHash<int, double> DataBase::getBalancesAsOf(int eventId, QDate date)
+{
+    TRACE_FUNCTION();
+    return getBalanceIndex(eventId).balancesAsOf(date.toJulianDay());
+}
+
+/*!
+ * Returns the balances of the users of a set of events
+ *
+ * The ids go through the temporary balance_ids table, so any number of events is selected with
+ * one join. The events needing expansion are looked up first and left out of it, their
+ * transactions are read on this thread through getExpandedTransactions(), which keeps them
+ * for the next settlement.
+ */
+QVector<Settlement::EventBalances> DataBase::getEventBalances(const QVector<int> &eventIds)
+{
+    TRACE_FUNCTION();
+    QVector<Settlement::EventBalances> events;
+    QVariantList ids;
+    foreach (int eventId, eventIds)
+        ids << eventId;
+
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    QSet<int> expanded;
+    bool ok = fillIdTable(q, QLatin1String("balance_ids"), ids)
+            && execPrepared(q, "SELECT id FROM temp.balance_ids c "
+                               "WHERE EXISTS(SELECT 1 FROM transactions WHERE event = c.id AND currency IS NOT NULL) "
+                               "OR EXISTS(SELECT 1 FROM splits WHERE event = c.id)",
+                            QVariantList(), Q_FUNC_INFO);
+    while(ok && q.next())
+        expanded.insert(q.value(0).toInt());
+
+    ok = ok && execPrepared(q, "SELECT r.event, coalesce(nullif(e.currency, ''), ?), r.user, "
+                               "TOTAL(CASE r.direction WHEN 0 THEN r.amount ELSE -r.amount END) "
+                               "FROM temp.balance_ids c JOIN spending_rollup r ON r.event = c.id JOIN events e ON e.id = c.id "
+                               "GROUP BY r.event, r.user ORDER BY r.event",
+                            QVariantList() << defaultCurrency(), Q_FUNC_INFO);
+    while(ok && q.next())
+    {
+        int eventId = q.value(0).toInt();
+        if(expanded.contains(eventId))
+            continue;
+        if(events.isEmpty() || events.last().eventId != eventId)
+        {
+            Settlement::EventBalances event;
+            event.eventId = eventId;
+            event.currency = q.value(1).toString();
+            events.append(event);
+        }
+        events.last().balances.insert(q.value(2).toInt(), q.value(3).toDouble());
+    }
+    lastError = q.lastError();
+    if(!ok)
+        return events;
+
+    QList<int> sortedExpanded = expanded.toList();
+    std::sort(sortedExpanded.begin(), sortedExpanded.end());
+    foreach (int eventId, sortedExpanded)
+    {
+        Settlement::EventBalances event;
+        event.eventId = eventId;
+        event.currency = getEventCurrency(eventId);
+        foreach (const Transaction &transaction, getExpandedTransactions(eventId))
+        {
+            event.balances[transaction.getUserGiving().getId()] += transaction.getAmount();
+            event.balances[transaction.getUserReceiving().getId()] -= transaction.getAmount();
+        }
+        events.append(event);
+    }
+    return events;
+}
+
+/*!
+ * Returns the balance index of an event, loading it from the transactions the first time
+ *
+ * Transactions without a date are not part of the index.
+ */
+BalanceIndex &DataBase::getBalanceIndex(int eventId)
+{
+    QHash<int, BalanceIndex>::iterator it = balanceIndexes.find(eventId);
+    if(it != balanceIndexes.end())
+        return it.value();
+
+    TRACE_FUNCTION();
+    QVector<BalanceIndex::Flow> flows;
+    if(needsExpansion(eventId))
+    {
+        foreach(const Transaction &transaction, getExpandedTransactions(eventId))
+        {
+            if(!transaction.getDate().isValid())
+                continue;
+            qint64 day = transaction.getDate().toJulianDay();
+            BalanceIndex::Flow gives = {transaction.getUserGiving().getId(), day, transaction.getAmount()};
+            BalanceIndex::Flow receives = {transaction.getUserReceiving().getId(), day, -transaction.getAmount()};
+            flows << gives << receives;
+        }
+        return balanceIndexes.insert(eventId, BalanceIndex(flows)).value();
+    }
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT usergives, userreceives, amount, transactionDate FROM transactions "
+                  "WHERE event = ? AND transactionDate IS NOT NULL");
+    query.addBindValue(eventId);
+    QueryStats::exec(query, Q_FUNC_INFO);
+    while(query.next())
+    {
+        qint64 day = query.value(3).toLongLong();
+        double amount = query.value(2).toDouble();
+        BalanceIndex::Flow gives = {query.value(0).toInt(), day, amount};
+        BalanceIndex::Flow receives = {query.value(1).toInt(), day, -amount};
+        flows << gives << receives;
+    }
+    lastError = query.lastError();
+
+    return balanceIndexes.insert(eventId, BalanceIndex(flows)).value();
+}
+
+/*!
+ * Returns the prefix search index of the users, loading it from the database on first use
+ */
+const UserIndex &DataBase::getUserIndex()
+{
+    if(userIndexLoaded)
+        return userIndex;
+
+    TRACE_FUNCTION();
+    QVector<UserIndex::Record> records;
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    QueryStats::exec(query, QLatin1String("SELECT id, nickname, name, email FROM users"), Q_FUNC_INFO);
+    while(query.next())
+    {
+        UserIndex::Record record = {query.value(0).toInt(), query.value(1).toString(), query.value(2).toString(), query.value(3).toString()};
+        records.append(record);
+    }
+    lastError = query.lastError();
+
+    userIndex = UserIndex(records);
+    userIndexLoaded = true;
+    return userIndex;
+}
+
+/*!
+ * Returns a prepared query for a statement, reusing an idle one if any
+ */
+QSqlQuery DataBase::acquireStatement(const QString &statement)
+{
+    QHash<QString, QList<QSqlQuery> >::iterator it = idleStatements.find(statement);
+    if(it != idleStatements.end() && !it->isEmpty())
+        return it->takeLast();
+
+    QSqlQuery query(db);
+    query.prepare(statement);
+    statementsPrepared++;
+    return query;
+}
+
+/*!
+ * Gives back a query so it can be reused. Its result set is released first
+ */
+void DataBase::releaseStatement(QSqlQuery query)
+{
+    if(query.lastError().type() != QSqlError::NoError || !db.isOpen())
+        return;
+
+    query.finish();
+    idleStatements[query.lastQuery()].append(query);
+}
+
+/*!
+ * Adds (sign 1) or removes (sign -1) a transaction from the balance index of its event, if already built
+ */
+void DataBase::updateBalanceIndex(const Transaction &transaction, int sign)
+{
+    // The expanded transactions are read again on next use
+    expandedTransactions.remove(transaction.getEvent().getId());
+    if(!transaction.getDate().isValid())
+        return;
+
+    QHash<int, BalanceIndex>::iterator it = balanceIndexes.find(transaction.getEvent().getId());
+    if(it == balanceIndexes.end())
+        return;
+
+    // The index holds converted amounts, it is rebuilt on next use
+    if(!transaction.getCurrency().isEmpty())
+    {
+        balanceIndexes.erase(it);
+        return;
+    }
+
+    qint64 day = transaction.getDate().toJulianDay();
+    it->add(transaction.getUserGiving().getId(), day, sign * transaction.getAmount());
+    it->add(transaction.getUserReceiving().getId(), day, -sign * transaction.getAmount());
+}
+
+/*!
+ * Adds the amount of a new transaction to the sketch of its event and giver
+ *
+ * The sketch is only written if those of the event counted every other transaction. Otherwise
+ * they are left behind, and refreshAmountSketches() rebuilds them from the transactions.
+ */
+void DataBase::updateAmountSketch(const Transaction &transaction)
+{
+    const int eventId = transaction.getEvent().getId();
+    const int userId = transaction.getUserGiving().getId();
+    if(eventId < 0)
+        return;
+
+    QSqlQuery query = acquireStatement("SELECT (SELECT transactions FROM event_summary WHERE event = ?) "
+                                       "- (SELECT TOTAL(transactions) FROM amount_sketches WHERE event = ?), "
+                                       "(SELECT data FROM amount_sketches WHERE event = ? AND user = ?)");
+    query.addBindValue(eventId);
+    query.addBindValue(eventId);
+    query.addBindValue(eventId);
+    query.addBindValue(userId);
+    QueryStats::exec(query, Q_FUNC_INFO);
+    const bool upToDate = query.next() && query.value(0).toInt() == 1;
+    const QByteArray data = query.value(1).toByteArray();
+    query.finish();
+    releaseStatement(query);
+    if(!upToDate)
+        return;
+
+    bool ok = true;
+    AmountSketch sketch = data.isEmpty() ? AmountSketch() : AmountSketch::fromByteArray(data, &ok);
+    if(!ok)
+        return;
+    sketch.add(transaction.getAmount());
+
+    query = acquireStatement("INSERT OR REPLACE INTO amount_sketches(event, user, transactions, data) VALUES (?, ?, ?, ?)");
+    query.addBindValue(eventId);
+    query.addBindValue(userId);
+    query.addBindValue(sketch.getCount());
+    query.addBindValue(sketch.toByteArray());
+    QueryStats::exec(query, Q_FUNC_INFO);
+    releaseStatement(query);
+}
+
+/*!
+ * Rebuilds the sketches of the events changed by batch inserts, deletes or snapshots
+ *
+ * The sketches of an event are up to date when they count as many transactions as its
+ * summary. Those of the other events are deleted and built again from their transactions.
+ */
+bool DataBase::refreshAmountSketches(int eventId)
+{
+    TRACE_FUNCTION();
+    QSqlQuery q(db);
+    if(!execPrepared(q, "SELECT summary.event FROM event_summary summary LEFT JOIN "
+                        "(SELECT event, SUM(transactions) AS transactions FROM amount_sketches GROUP BY event) sketches "
+                        "ON sketches.event = summary.event "
+                        "WHERE summary.transactions != coalesce(sketches.transactions, 0) AND (? = -1 OR summary.event = ?)",
+                     QVariantList() << eventId << eventId, Q_FUNC_INFO))
+    {
+        lastError = q.lastError();
+        return false;
+    }
+    QVariantList events;
+    while(q.next())
+        events << q.value(0);
+    if(events.isEmpty())
+        return true;
+
+    db.transaction();
+    bool ok = true;
+    foreach (const QVariant &event, events)
+    {
+        QMap<int, AmountSketch> sketches;
+        ok = ok && execPrepared(q, "SELECT coalesce(usergives, 0), amount FROM transactions WHERE event = ?",
+                                QVariantList() << event, Q_FUNC_INFO);
+        while(ok && q.next())
+            sketches[q.value(0).toInt()].add(q.value(1).toDouble());
+
+        ok = ok && execPrepared(q, "DELETE FROM amount_sketches WHERE event = ?", QVariantList() << event, Q_FUNC_INFO);
+        for(auto sketch = sketches.constBegin(); ok && sketch != sketches.constEnd(); ++sketch)
+            ok = execPrepared(q, "INSERT INTO amount_sketches(event, user, transactions, data) VALUES (?, ?, ?, ?)",
+                              QVariantList() << event << sketch.key() << sketch->getCount() << sketch->toByteArray(), Q_FUNC_INFO);
+    }
+    lastError = q.lastError();
+    if(!ok)
+    {
+        db.rollback();
+        return false;
+    }
+    if(!db.commit())
+    {
+        lastError = db.lastError();
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * Returns the distribution of the amounts given, merging the sketches of the matching events and users
+ */
+AmountSketch DataBase::getAmountSketch(int eventId, int userId)
+{
+    TRACE_FUNCTION();
+    AmountSketch sketch;
+    if(!refreshAmountSketches(eventId))
+        return sketch;
+
+    QSqlQuery query = acquireStatement("SELECT data FROM amount_sketches WHERE (? = -1 OR event = ?) AND (? = -1 OR user = ?)");
+    query.addBindValue(eventId);
+    query.addBindValue(eventId);
+    query.addBindValue(userId);
+    query.addBindValue(userId);
+    QueryStats::exec(query, Q_FUNC_INFO);
+    while(query.next())
+    {
+        bool ok = false;
+        AmountSketch rows = AmountSketch::fromByteArray(query.value(0).toByteArray(), &ok);
+        if(ok)
+            sketch.merge(rows);
+    }
+    lastError = query.lastError();
+    query.finish();
+    releaseStatement(query);
+
+    return sketch;
+}
+
+/*!
+ * Returns the number of users with transactions in an event, read from the event summary
+ */
+int DataBase::calcNumUsers(int eventId)
+{
+    TRACE_FUNCTION();
+    return getEventSummary(eventId).participants;
+}
+
+/*!
+ * Returns the totals of an event
+ *
+ * A single primary key lookup, the event_summary row is kept up to date by the triggers
+ * on transactions (see migrationSteps()).
+ */
+DataBase::EventSummary DataBase::getEventSummary(int eventId)
+{
+    TRACE_FUNCTION();
+    EventSummary summary;
+    summary.kittyIn = 0;
+    summary.kittyOut = 0;
+    summary.volume = 0;
+    summary.participants = 0;
+    summary.transactions = 0;
+
+    QSqlQuery query = acquireStatement("SELECT kitty_in, kitty_out, volume, participants, transactions, last_date "
+                                       "FROM event_summary WHERE event = ?");
+    query.addBindValue(eventId);
+    QueryStats::exec(query, Q_FUNC_INFO);
+    if(query.next())
+    {
+        summary.kittyIn = query.value(0).toDouble();
+        summary.kittyOut = query.value(1).toDouble();
+        summary.volume = query.value(2).toDouble();
+        summary.participants = query.value(3).toInt();
+        summary.transactions = query.value(4).toInt();
+        summary.lastDate = dayToDate(query.value(5));
+    }
+    lastError = query.lastError();
+    query.finish();
+    releaseStatement(query);
+
+    // event_summary adds up the transactions as they are, the totals are redone in the event
+    // currency with the split expenses expanded
+    if(lastError.type() == QSqlError::NoError && needsExpansion(eventId))
+        summary = summaryOf(getExpandedTransactions(eventId), kittyId);
+
+    return summary;
+}
+
+/*!
+ * Marks an event as finished and stores the snapshot of its calculations
+ *
+ * The transactions are read once to build the snapshot. Both changes are done in one
+ * transaction, so a finished event always has its snapshot.
+ */
+QSqlError DataBase::finishEvent(int eventId)
+{
+    TRACE_FUNCTION();
+    QVector<Transaction> transactions = getEventTransactions(eventId);
+    if(lastError.type() != QSqlError::NoError)
+        return lastError;
+
+    EventSnapshot snapshot = EventSnapshot::build(eventId, transactions, kittyId);
+
+    QSqlQuery q(db);
+    db.transaction();
+    q.prepare("UPDATE events SET finished = 1 WHERE id = ?");
+    q.addBindValue(eventId);
+    bool ok = QueryStats::exec(q, Q_FUNC_INFO);
+    if(ok)
+    {
+        q.prepare("INSERT OR REPLACE INTO event_snapshots(event, created, data) VALUES (?, ?, ?)");
+        q.addBindValue(eventId);
+        q.addBindValue(snapshot.getCreated().toMSecsSinceEpoch());
+        q.addBindValue(snapshot.toByteArray());
+        ok = QueryStats::exec(q, Q_FUNC_INFO);
+    }
+    if(!ok)
+    {
+        lastError = q.lastError();
+        db.rollback();
+        return lastError;
+    }
+    if(!db.commit())
+        return lastError = db.lastError();
+    return lastError = QSqlError();
+}
+
+/*!
+ * Marks an event as ongoing again. A trigger drops its snapshot
+ */
+QSqlError DataBase::reopenEvent(int eventId)
+{
+    TRACE_FUNCTION();
+    QSqlQuery q(db);
+    q.prepare("UPDATE events SET finished = 0 WHERE id = ?");
+    q.addBindValue(eventId);
+    QueryStats::exec(q, Q_FUNC_INFO);
+    return lastError = q.lastError();
+}
+
+/*!
+ * Returns the snapshot of a finished event
+ *
+ * Events finished before snapshots existed get theirs built and stored on first use.
+ */
+bool DataBase::getEventSnapshot(int eventId, EventSnapshot *snapshot)
+{
+    TRACE_FUNCTION();
+    for(int attempt = 0; attempt < 2; attempt++)
+    {
+        QSqlQuery query = acquireStatement("SELECT events.finished, event_snapshots.data FROM events "
+                                           "LEFT JOIN event_snapshots ON event_snapshots.event = events.id WHERE events.id = ?");
+        query.addBindValue(eventId);
+        QueryStats::exec(query, Q_FUNC_INFO);
+        bool finished = false;
+        QByteArray data;
+        if(query.next())
+        {
+            finished = query.value(0).toBool();
+            data = query.value(1).toByteArray();
+        }
+        lastError = query.lastError();
+        query.finish();
+        releaseStatement(query);
+
+        if(!finished)
+            return false;
+
+        *snapshot = EventSnapshot::fromByteArray(data);
+        if(snapshot->isValid())
+            return true;
+
+        // Missing or written by another version
+        if(attempt == 0 && finishEvent(eventId).type() != QSqlError::NoError)
+            return false;
+    }
+    return false;
+}
+
+/*!
+ * Compares the event summaries and the kitty ledger with totals computed from the transactions
+ *
+ * The tables are rebuilt inside a transaction and the rows before and after are compared.
+ * The transaction is committed only if rebuild is true and something differs, otherwise it
+ * is rolled back. Amounts are compared with a relative tolerance, since the triggers add and
+ * subtract them one by one and the rebuild sums them in a different order.
+ */
+QStringList DataBase::checkEventSummaries(bool rebuild)
+{
+    TRACE_FUNCTION();
+    QStringList differences;
+    QSqlQuery q(db);
+
+    auto loadSummaries = [&q](QMap<int, EventSummary> *summaries) {
+        if(!QueryStats::exec(q, QLatin1String("SELECT event, kitty_in, kitty_out, volume, participants, transactions, last_date "
+                                              "FROM event_summary"), Q_FUNC_INFO))
+            return false;
+        while(q.next())
+        {
+            EventSummary &summary = (*summaries)[q.value(0).toInt()];
+            summary.kittyIn = q.value(1).toDouble();
+            summary.kittyOut = q.value(2).toDouble();
+            summary.volume = q.value(3).toDouble();
+            summary.participants = q.value(4).toInt();
+            summary.transactions = q.value(5).toInt();
+            summary.lastDate = dayToDate(q.value(6));
+        }
+        return true;
+    };
+    auto loadParticipants = [&q](QMap<QPair<int, int>, int> *participants) {
+        if(!QueryStats::exec(q, QLatin1String("SELECT event, user, transactions FROM event_participants"), Q_FUNC_INFO))
+            return false;
+        while(q.next())
+            participants->insert(qMakePair(q.value(0).toInt(), q.value(1).toInt()), q.value(2).toInt());
+        return true;
+    };
+    auto loadLedger = [&q](QMap<QPair<int, qint64>, QPair<double, double> > *ledger) {
+        if(!QueryStats::exec(q, QLatin1String("SELECT event, day, inflow, outflow FROM kitty_ledger"), Q_FUNC_INFO))
+            return false;
+        while(q.next())
+            ledger->insert(qMakePair(q.value(0).toInt(), q.value(1).toLongLong()),
+                           qMakePair(q.value(2).toDouble(), q.value(3).toDouble()));
+        return true;
+    };
+    // Rows of a rollup by the text of their key columns, with the amount and the number of transactions last
+    auto loadRollup = [&q](const QString &statement, QMap<QStringList, QPair<double, int> > *rollup) {
+        if(!QueryStats::exec(q, statement, Q_FUNC_INFO))
+            return false;
+        const int keyColumns = q.record().count() - 2;
+        while(q.next())
+        {
+            QStringList key;
+            for(int i = 0; i < keyColumns; i++)
+                key << q.value(i).toString();
+            rollup->insert(key, qMakePair(q.value(keyColumns).toDouble(), q.value(keyColumns + 1).toInt()));
+        }
+        return true;
+    };
+    const QString spendingStatement = QLatin1String("SELECT event, day, user, direction, amount, transactions FROM spending_rollup");
+    const QString placeStatement = QLatin1String("SELECT event, place, amount, transactions FROM place_rollup");
+    auto differ = [](double stored, double expected) {
+        return qAbs(stored - expected) > 1e-6 * qMax(1.0, qAbs(expected));
+    };
+
+    QMap<int, EventSummary> storedSummaries, expectedSummaries;
+    QMap<QPair<int, int>, int> storedParticipants, expectedParticipants;
+    QMap<QPair<int, qint64>, QPair<double, double> > storedLedger, expectedLedger;
+    QMap<QStringList, QPair<double, int> > storedSpending, expectedSpending, storedPlaces, expectedPlaces;
+
+    db.transaction();
+    bool ok = loadSummaries(&storedSummaries) && loadParticipants(&storedParticipants) && loadLedger(&storedLedger)
+            && loadRollup(spendingStatement, &storedSpending) && loadRollup(placeStatement, &storedPlaces);
+    foreach (const QString &step, eventSummaryRebuildSteps() + kittyLedgerRebuildSteps() + spendingRollupRebuildSteps())
+        ok = ok && QueryStats::exec(q, step, Q_FUNC_INFO);
+    ok = ok && loadSummaries(&expectedSummaries) && loadParticipants(&expectedParticipants) && loadLedger(&expectedLedger)
+            && loadRollup(spendingStatement, &expectedSpending) && loadRollup(placeStatement, &expectedPlaces);
+    lastError = q.lastError();
+    if(!ok)
+    {
+        db.rollback();
+        return differences << "Error: " + lastError.text();
+    }
+
+    QSet<int> events = QSet<int>::fromList(storedSummaries.keys()) + QSet<int>::fromList(expectedSummaries.keys());
+    QList<int> sortedEvents = events.toList();
+    std::sort(sortedEvents.begin(), sortedEvents.end());
+    foreach (int event, sortedEvents)
+    {
+        if(!storedSummaries.contains(event))
+            differences << QString("Event %1: summary missing").arg(event);
+        else if(!expectedSummaries.contains(event))
+            differences << QString("Event %1: summary of an event without transactions").arg(event);
+        else
+        {
+            const EventSummary &stored = storedSummaries[event];
+            const EventSummary &expected = expectedSummaries[event];
+            if(differ(stored.kittyIn, expected.kittyIn) || differ(stored.kittyOut, expected.kittyOut)
+                    || differ(stored.volume, expected.volume) || stored.participants != expected.participants
+                    || stored.transactions != expected.transactions || stored.lastDate != expected.lastDate)
+                differences << QString("Event %1: stored kitty %2/%3, volume %4, %5 participants, %6 transactions, last %7; "
+                                       "expected kitty %8/%9, volume %10, %11 participants, %12 transactions, last %13")
+                               .arg(event)
+                               .arg(stored.kittyIn).arg(stored.kittyOut).arg(stored.volume)
+                               .arg(stored.participants).arg(stored.transactions).arg(stored.lastDate.toString(Qt::ISODate))
+                               .arg(expected.kittyIn).arg(expected.kittyOut).arg(expected.volume)
+                               .arg(expected.participants).arg(expected.transactions).arg(expected.lastDate.toString(Qt::ISODate));
+        }
+    }
+    if(storedParticipants != expectedParticipants)
+    {
+        QMap<QPair<int, int>, int> all = storedParticipants;
+        all.unite(expectedParticipants);
+        for(auto it = all.constBegin(); it != all.constEnd(); ++it)
+        {
+            int stored = storedParticipants.value(it.key(), 0);
+            int expected = expectedParticipants.value(it.key(), 0);
+            if(stored != expected)
+                differences << QString("Event %1, user %2: %3 transactions stored, %4 expected")
+                               .arg(it.key().first).arg(it.key().second).arg(stored).arg(expected);
+        }
+    }
+
+    QMap<QPair<int, qint64>, QPair<double, double> > allLedger = storedLedger;
+    allLedger.unite(expectedLedger);
+    for(auto it = allLedger.constBegin(); it != allLedger.constEnd(); ++it)
+    {
+        QPair<double, double> stored = storedLedger.value(it.key(), qMakePair(0.0, 0.0));
+        QPair<double, double> expected = expectedLedger.value(it.key(), qMakePair(0.0, 0.0));
+        if(storedLedger.contains(it.key()) != expectedLedger.contains(it.key())
+                || differ(stored.first, expected.first) || differ(stored.second, expected.second))
+            differences << QString("Event %1, day %2: kitty ledger %3/%4 stored, %5/%6 expected")
+                           .arg(it.key().first).arg(it.key().second)
+                           .arg(stored.first).arg(stored.second).arg(expected.first).arg(expected.second);
+    }
+
+    auto compareRollups = [&differences, &differ](const QString &name, const QMap<QStringList, QPair<double, int> > &stored,
+                                                  const QMap<QStringList, QPair<double, int> > &expected) {
+        QMap<QStringList, QPair<double, int> > all = stored;
+        all.unite(expected);
+        for(auto it = all.constBegin(); it != all.constEnd(); ++it)
+        {
+            QPair<double, int> storedRow = stored.value(it.key(), qMakePair(0.0, 0));
+            QPair<double, int> expectedRow = expected.value(it.key(), qMakePair(0.0, 0));
+            if(stored.contains(it.key()) != expected.contains(it.key())
+                    || differ(storedRow.first, expectedRow.first) || storedRow.second != expectedRow.second)
+                differences << QString("%1 %2: %3 in %4 transactions stored, %5 in %6 expected")
+                               .arg(name).arg(it.key().join(QLatin1Char('/')))
+                               .arg(storedRow.first).arg(storedRow.second).arg(expectedRow.first).arg(expectedRow.second);
+        }
+    };
+    compareRollups("Spending rollup (event/day/user/direction)", storedSpending, expectedSpending);
+    compareRollups("Place rollup (event/place)", storedPlaces, expectedPlaces);
+
+    if(rebuild && !differences.isEmpty())
+    {
+        if(!db.commit())
+            lastError = db.lastError();
+    }
+    else
+        db.rollback();
+
+    return differences;
 }
 
 /*!
@@ -3,14 +3,96 @@
 
 #include <QtSql>
 
+#include "amountsketch.h"
+#include "balanceindex.h"
+#include "currencyconverter.h"
 #include "dbclasses.h"
+#include "eventsnapshot.h"
+#include "ledgerstore.h"
+#include "userindex.h"
 
-//! \brief Database class
-class DataBase
+/*!
+ * \brief Database class
+ *
+ * SQLite implementation of LedgerStore, which also provides the sql tables the views are built on.
+ */
+class DataBase : public LedgerStore
 {
 public:
-    //! \brief Database constructor
-    DataBase();
+    /*!
+     * \brief Result of preparing the database file on a worker thread
+     */
+    struct StartupState
+    {
+        //! \brief Error opening or preparing the file
+        QSqlError error;
+        //! \brief True if the database has no entries (besides the kitty user)
+        bool empty;
+        //! \brief Id of the kitty, -1 if not read
+        int kittyId;
+    };
+
+    /*!
+     * \brief Totals of a ledger, see getLedgerStats()
+     */
+    struct LedgerStats
+    {
+        //! \brief Path to the database file
+        QString path;
+        //! \brief Number of users, the kitty excluded
+        int users;
+        //! \brief Number of events
+        int events;
+        //! \brief Number of transactions
+        int transactions;
+        //! \brief Total amount of the transactions
+        double volume;
+        //! \brief Time spent reading the totals
+        qint64 elapsedMs;
+        //! \brief Error reading the totals
+        QSqlError error;
+    };
+
+    /*!
+     * \brief Database constructor
+     * \param initialize if false, the database is not opened until init() is called
+     * \param path path to the database file, CheapyApp.db3 if empty, or memoryPath() for an in-memory database
+     */
+    explicit DataBase(bool initialize = true, const QString &path = QString());
+    /*!
+     * \brief Database destructor, closes the connection of the database
+     */
+    ~DataBase();
+    /*!
+     * \brief Returns the path selecting an in-memory database, which is never written to disk
+     * \return path
+     */
+    static QString memoryPath() {return QLatin1String(":memory:");}
+    /*!
+     * \brief Returns true if the database lives in memory only
+     * \return true if in memory
+     */
+    bool isInMemory() const {return dbPath == memoryPath();}
+    /*!
+     * \brief Returns the connection of the database, only usable from the thread which opened it
+     * \return database connection
+     */
+    QSqlDatabase getConnection() const {return db;}
+    /*!
+     * \brief Returns a connection to the database usable from the calling thread
+     * \return database connection, cloned the first time it is asked from a worker thread
+     */
+    QSqlDatabase threadConnection();
+    /*!
+     * \brief Returns the totals of the ledger, safe to call from any thread
+     * \return totals
+     */
+    LedgerStats getLedgerStats();
+    /*!
+     * \brief Returns a short name of the backend, for reports
+     * \return name
+     */
+    QString getBackendName() const {return isInMemory() ? QLatin1String("SQLite in memory") : QLatin1String("SQLite");}
     /*!
      * \brief Returns the id of the kitty
      * \param loadFromDb if true, use a sql query to load it from the database.
@@ -27,16 +109,63 @@ public:
      * \return Sql error
      */
     QSqlError init();
+    /*!
+     * \brief Initializes the database from a file already prepared by prepareFile()
+     *
+     * Only opens the connection of this instance, the tables are not checked again.
+     * \param state result of prepareFile()
+     * \return Sql error, the one of the state if preparing failed
+     */
+    QSqlError init(const StartupState &state);
+    /*!
+     * \brief Creates the tables and the kitty user if they are not present in the database
+     * \param database database connection
+     * \return Sql error
+     */
+    static QSqlError prepareSchema(QSqlDatabase database);
+    /*!
+     * \brief Opens the database file with a private connection and prepares its tables
+     *
+     * Meant to run on a worker thread before init(const StartupState &), see MainWindow deferred loading.
+     * \param path path to the database file
+     * \return state of the database
+     */
+    static StartupState prepareFile(const QString &path);
+    /*!
+     * \brief Brings the schema of an existing database up to the current version
+     * \param database database connection
+     * \return Sql error
+     */
+    static QSqlError migrateSchema(QSqlDatabase database);
+    /*!
+     * \brief Converts a date to the day number stored in the database
+     * \param date date
+     * \return Julian day number, or null if the date is not valid
+     */
+    static QVariant dateToDay(const QDate &date);
+    /*!
+     * \brief Converts a day number stored in the database to a date
+     * \param day Julian day number
+     * \return date, not valid if the day is null
+     */
+    static QDate dayToDate(const QVariant &day);
     /*!
      * \brief Deletes the database
      * \return true if success
      */
     bool deleteDb();
     /*!
-     * \brief Insert example data to the database
-     * \return database error of last query
+     * \brief Writes a consistent copy of the database to a file, also for an in-memory database
+     * \param path path to the file, replaced if it exists
+     * \return Sql error
      */
-    QSqlError initExampleDatabase();
+    QSqlError saveSnapshot(const QString &path);
+    /*!
+     * \brief Replaces the data of the database with a file written by saveSnapshot()
+     * \param path path to the file
+     * \return Sql error, the database is left as it was if the file could not be copied in
+     */
+    QSqlError loadSnapshot(const QString &path);
     /*!
      * \brief Returns the path to the database file
      * \return path to the database file
@@ -47,12 +176,18 @@ public:
      * \return true if neither of the tables has any entry (but the kitty user)
      */
     bool isDatabaseEmpty();
+    /*!
+     * \brief Check if the database of a connection has any entries (besides the kitty user)
+     * \param database database connection
+     * \return true if neither of the tables has any entry (but the kitty user)
+     */
+    static bool isDatabaseEmpty(QSqlDatabase database);
     /*!
      * \brief Adds transaction object to database
      * \param q New transaction query
      * \param newTransaction New transaction object
-     * \return Id of added transaction
-     * \sa Transaction()
+     * \return Id of added transaction, not valid if skipped as a duplicate
+     * \sa Transaction(), setDuplicateCheck()
      */
     QVariant addTransaction(QSqlQuery &q, Transaction newTransaction);
     /*!
@@ -71,12 +206,112 @@ public:
      * \sa User()
      */
     QVariant addUser(QSqlQuery &q, User newUser);
+    /*!
+     * \brief Adds transaction object to database with a pooled insert statement
+     * \param newTransaction New transaction object
+     * \return Id of added transaction, not valid if skipped as a duplicate
+     */
+    QVariant addTransaction(const Transaction &newTransaction);
+    /*!
+     * \brief Adds event object to database with a pooled insert statement
+     * \param newEvent New event object
+     * \return Id of added event
+     */
+    QVariant addEvent(const Event &newEvent);
+    /*!
+     * \brief Adds user object to database with a pooled insert statement
+     * \param newUser New user object
+     * \return Id of added user
+     */
+    QVariant addUser(const User &newUser);
+    /*!
+     * \brief Adds user objects to database with one batched insert in a single transaction
+     *
+     * Users whose nickname or email is already used, in the database or by an earlier user of
+     * the batch, are left out instead of failing the whole insert.
+     * \param users New user objects, with their password already hashed
+     * \param skipped if not null, set to the positions in users of those left out
+     * \return Sql error
+     * \sa UserImport
+     */
+    QSqlError addUsers(const QVector<User> &users, QVector<int> *skipped = 0);
+    /*!
+     * \brief Sets how addTransaction() and importTransactions() handle duplicates
+     * \param check action and window of the matches, off by default
+     */
+    void setDuplicateCheck(const DuplicateCheck &check) {duplicateCheck = check;}
+    /*!
+     * \brief Returns how addTransaction() and importTransactions() handle duplicates
+     * \return action and window of the matches
+     */
+    DuplicateCheck getDuplicateCheck() const {return duplicateCheck;}
+    /*!
+     * \brief Returns the transaction matched by the last addTransaction() with the duplicate check on
+     * \return transaction id, -1 if none
+     */
+    int getLastDuplicate() const {return lastDuplicate;}
+    /*!
+     * \brief Looks for a transaction matching a new one, within the window of getDuplicateCheck()
+     *
+     * Answered from the index on the fingerprint, whatever the action set.
+     * \param transaction new transaction
+     * \return id of the oldest matching transaction, -1 if none
+     */
+    int findDuplicateTransaction(const Transaction &transaction);
+    /*!
+     * \brief Adds transactions with one batched insert in a single transaction, handling duplicates as set with setDuplicateCheck()
+     *
+     * The fingerprints of the transactions of the same events and dates are read once, so each
+     * row is matched against them and against the rows before it in constant time.
+     * \param transactions New transactions in the currency of their event
+     * \param duplicates set to the positions of the transactions matching an existing or previous one
+     * \return Sql error
+     */
+    QSqlError importTransactions(const QVector<Transaction> &transactions, QVector<int> *duplicates = 0);
     /*!
      * \brief Deletes transaction from database
      * \param transactionId Transaction to be deleted
      * \return Sql error
      */
     QSqlError deleteTransaction(int transactionId);
+    /*!
+     * \brief Deletes a set of transactions from database in one transaction
+     * \param transactionIds Transactions to be deleted
+     * \return Sql error
+     */
+    QSqlError deleteTransactions(const QVector<int> &transactionIds);
+    /*!
+     * \brief Deletes event and all its transactions from database in one transaction
+     * \param eventId event to be deleted
+     * \return Sql error
+     */
+    QSqlError deleteEventCascade(int eventId);
+    /*!
+     * \brief Deletes user, its transactions and the events it administers from database in one transaction
+     *
+     * The split expenses it pays are deleted and its shares removed from the others.
+     * \param userId user to be deleted
+     * \return Sql error
+     */
+    QSqlError deleteUserCascade(int userId);
+    /*!
+     * \brief Adds an event with many transactions and times deleting it with deleteEventCascade()
+     * \param transactions number of transactions of the event
+     * \return report
+     */
+    QString benchmarkDeleteEvent(int transactions);
+    /*!
+     * \brief Times and sizes split expenses against the pairwise transactions they stand for
+     * \param expenses number of expenses of each group size
+     * \return report
+     */
+    QString benchmarkSplitExpenses(int expenses);
+    /*!
+     * \brief Times importing transactions with the duplicate check off and on
+     * \param transactions number of transactions imported each time
+     * \return report
+     */
+    QString benchmarkTransactionImport(int transactions);
     /*!
      * \brief Deletes event from database
      * \param eventId event to be deleted
@@ -107,6 +342,21 @@ public:
      * \return User object
      */
     User getUser(int id);
+    /*!
+     * \brief Returns all the users of the database
+     * \return users, the kitty included, ordered by id
+     */
+    QVector<User> getUsers();
+    /*!
+     * \brief Returns all the events of the database
+     * \return events, ordered by name and id
+     */
+    QVector<Event> getEvents();
+    /*!
+     * \brief Returns the events with rows in the transactions or the splits table
+     * \return events, ordered by name and id
+     */
+    QVector<Event> getEventsWithTransactions();
     /*!
      * \brief Returns how many events a user is taking part in
      * \param userId User id
@@ -121,36 +371,320 @@ public:
      */
     int getNumTransactions(int userId = -1, int eventId = -1);
     /*!
-     * \brief Calculates the total amount of the Kitty for an event
+     * \brief Calculates the money in the Kitty of an event: inflows minus withdrawals
      * \param eventId Event id
-     * \return Amount of money
+     * \return Amount of money, -1 on error
      */
     double calcAmountKitty(int eventId);
+    /*!
+     * \brief Returns the amount of money given from one user to another in an event
+     * \param eventId Event id
+     * \param userGivingId User giving the money
+     * \param userReceivingId User receiving the money
+     * \return Amount of money, in the currency of the event
+     */
+    double getAmountBetween(int eventId, int userGivingId, int userReceivingId);
+    /*!
+     * \brief Returns the users giving money in the transactions of an event, the split expenses left out
+     * \param eventId Event id
+     * \return user ids
+     */
+    QList<int> getUsersGiving(int eventId);
+    /*!
+     * \brief Returns the users receiving money from a user in the transactions of an event
+     * \param eventId Event id
+     * \param userGivingId User giving the money
+     * \return user ids
+     */
+    QList<int> getUsersReceiving(int eventId, int userGivingId);
+    /*!
+     * \brief Returns the currency of an event
+     * \param eventId Event id
+     * \return ISO 4217 code, defaultCurrency() if not found
+     */
+    QString getEventCurrency(int eventId);
+    /*!
+     * \brief Returns the transactions of an event with their amounts in the currency of the event
+     *
+     * The split expenses are expanded with SplitExpense::expand(). The amounts in other currencies
+     * are converted with getCurrencyConverter(), the ones without a rate are left as they are.
+     * \param eventId Event id
+     * \return transactions, ordered by date (undated first) and id, the expanded ones without id
+     */
+    QVector<Transaction> getEventTransactions(int eventId);
+    /*!
+     * \brief Adds a split expense, stored as one row with its shares packed
+     * \param split New split expense, with its shares
+     * \return Id of added split expense, not valid on error
+     */
+    QVariant addSplit(const SplitExpense &split);
+    /*!
+     * \brief Deletes a split expense
+     * \param splitId split expense to be deleted
+     * \return Sql error
+     */
+    QSqlError deleteSplit(int splitId);
+    /*!
+     * \brief Returns the split expenses of an event
+     * \param eventId Event id
+     * \return split expenses with their shares, ordered by date and id
+     */
+    QVector<SplitExpense> getEventSplits(int eventId);
+    /*!
+     * \brief Returns how many split expenses an event has
+     * \param eventId Event id (-1 or not given to match any event)
+     * \return Number of split expenses
+     */
+    int getNumSplits(int eventId = -1);
+    /*!
+     * \brief Returns how many split expenses a user pays or has a share of, see deleteUserCascade()
+     * \param userId User id
+     * \return Number of split expenses
+     */
+    int getNumSplitsOfUser(int userId);
+    /*!
+     * \brief Returns the converter to a currency, loaded from exchange_rates on first use
+     * \param base ISO 4217 code
+     * \return converter, valid until the rates are imported again
+     */
+    const CurrencyConverter &getCurrencyConverter(const QString &base);
+    /*!
+     * \brief Returns true if amounts in a currency can be converted to the currency of an event
+     * \param eventId Event id
+     * \param currency ISO 4217 code, empty for the currency of the event
+     * \return true if it is the currency of the event or has exchange rates to it
+     */
+    bool isCurrencyConvertible(int eventId, const QString &currency);
+    /*!
+     * \brief Adds exchange rates with one batched insert in a single transaction
+     * \param rates rates, replacing those of the same currencies and day
+     * \return Sql error
+     * \sa CurrencyConverter::readRates()
+     */
+    QSqlError importExchangeRates(const QVector<CurrencyConverter::Rate> &rates);
+    /*!
+     * \brief Returns true if the SQLite of a connection has the FTS5 full-text search extension
+     * \param database database connection
+     * \return true if FTS5 is available
+     */
+    static bool hasFullTextSearch(QSqlDatabase database);
+    /*!
+     * \brief Returns true if the database has the full-text index of the transactions
+     * \return true if transactions_fts exists
+     */
+    bool hasSearchIndex();
+    /*!
+     * \brief Creates the full-text index of the transactions if missing and fills it from scratch
+     * \return Sql error, also if FTS5 is not available
+     */
+    QSqlError rebuildSearchIndex();
+    /*!
+     * \brief Searches the description and the place of the transactions
+     *
+     * Every word of the text must appear as a word, or the start of one, in the description or
+     * the place. The matches are ranked with bm25 by the full-text index, or taken newest first
+     * with a scan if there is no index. They replace the rows of the temporary search_results
+     * table, see searchResultsQuery() and searchRankOrder().
+     * \param text words to look for
+     * \param limit maximum number of matches kept
+     * \return number of matches kept, -1 on error
+     */
+    int searchTransactions(const QString &text, int limit = 1000);
+    /*!
+     * \brief Returns the sql selecting the ids of the transactions found by searchTransactions()
+     * \return sql query
+     */
+    static QLatin1String searchResultsQuery() {return QLatin1String("SELECT id FROM temp.search_results");}
+    /*!
+     * \brief Returns the sql ordering the transactions by the rank given by searchTransactions()
+     * \return sql order by clause
+     */
+    static QLatin1String searchRankOrder() {return QLatin1String("ORDER BY (SELECT position FROM temp.search_results WHERE search_results.id = transactions.id)");}
+    /*!
+     * \brief Times searching transactions with the full-text index against a scan with LIKE
+     * \param transactions number of transactions searched
+     * \return report
+     */
+    QString benchmarkTransactionSearch(int transactions);
+    /*!
+     * \brief Returns the balance of the Kitty of an event day by day, e.g. for charts
+     * \param eventId Event id
+     * \return one point per day with kitty transactions, ordered by date (undated transactions first)
+     */
+    QVector<KittyBalancePoint> getKittyBalanceSeries(int eventId);
+    /*!
+     * \brief Returns the money given in an event day by day, from the spending_rollup table
+     * \param eventId Event id
+     * \param userId User giving the money (-1 or not given to match any user)
+     * \return one point per day with transactions, ordered by date (undated transactions first)
+     */
+    QVector<SpendingPoint> getSpendingSeries(int eventId, int userId = -1);
+    /*!
+     * \brief Returns the users who gave the most money in an event, from the spending_rollup table
+     * \param eventId Event id
+     * \param limit maximum number of users
+     * \return totals of the users, the kitty excluded, the largest given first
+     */
+    QVector<SpenderTotal> getTopSpenders(int eventId, int limit = 10);
+    /*!
+     * \brief Returns the places where the most money was spent in an event, from the place_rollup table
+     * \param eventId Event id
+     * \param limit maximum number of places
+     * \return totals of the places, the transactions without place excluded, the largest first
+     */
+    QVector<PlaceTotal> getTopPlaces(int eventId, int limit = 10);
+    /*!
+     * \brief Returns the distribution of the amounts given, merged from the sketches of each event and user
+     *
+     * The sketches of the events changed without addTransaction() are rebuilt first, see refreshAmountSketches().
+     * \param eventId Event id (-1 or not given to match any event)
+     * \param userId User giving the money (-1 or not given to match any user)
+     * \return sketch of the amounts as recorded, not converted to the currency of the event and without the split expenses
+     */
+    AmountSketch getAmountSketch(int eventId = -1, int userId = -1);
+    /*!
+     * \brief Returns the transactions between two dates, ordered by date
+     * \param from first date (included)
+     * \param to last date (included)
+     * \param eventId Event id (-1 or not given to match any event)
+     * \return transactions
+     */
+    QVector<Transaction> getTransactionsBetween(QDate from, QDate to, int eventId = -1);
+    /*!
+     * \brief Returns the total amount of the transactions between two dates
+     * \param from first date (included)
+     * \param to last date (included)
+     * \param eventId Event id (-1 or not given to match any event)
+     * \return Amount of money
+     */
+    double sumBetween(QDate from, QDate to, int eventId = -1);
+    /*!
+     * \brief Times the range query of sumBetween() against the same query on dates stored as ISO text
+     * \param transactions number of transactions of the generated event
+     * \return report
+     */
+    QString benchmarkDateRange(int transactions);
+    /*!
+     * \brief Returns the balance of a user in an event up to a date
+     *
+     * The balance is the money given minus the money received (positive if the user is owed money).
+     * Answered in O(log n) from a per-event index which is built on first use.
+     * \param eventId Event id
+     * \param userId User id
+     * \param date last date (included)
+     * \return balance
+     */
+    double getBalanceAsOf(int eventId, int userId, QDate date);
+    /*!
+     * \brief Returns the balance of a user in an event between two dates
+     * \param eventId Event id
+     * \param userId User id
+     * \param from first date (included)
+     * \param to last date (included)
+     * \return balance
+     * \sa getBalanceAsOf()
+     */
+    double getBalanceBetween(int eventId, int userId, QDate from, QDate to);
+    /*!
+     * \brief Returns the balances of all the users of an event up to a date
+     * \param eventId Event id
+     * \param date last date (included)
+     * \return balance of each user id
+     * \sa getBalanceAsOf()
+     */
+    QHash<int, double> getBalancesAsOf(int eventId, QDate date);
+    /*!
+     * \brief Returns the balances of the users of a set of events, to settle them together with Settlement::net()
+     *
+     * Read in one query from the spending_rollup table, besides the events with transactions in
+     * a currency of their own or split expenses, which are read one by one from their expanded
+     * transactions. Everything is read on the calling thread, before Settlement::net().
+     * \param eventIds Event ids
+     * \return balances of each event with transactions, in the currency of the event
+     */
+    QVector<Settlement::EventBalances> getEventBalances(const QVector<int> &eventIds);
+    /*!
+     * \brief Returns the prefix search index of the users, loading it from the database on first use
+     * \return user index, kept up to date on user add and delete
+     */
+    const UserIndex &getUserIndex();
+    /*!
+     * \brief Returns a prepared query for a statement, reusing an idle one prepared before if any
+     *
+     * Statements of the same text share one prepared plan. The query is owned by the caller until
+     * it is given back with releaseStatement(), so it can back a model while it is alive.
+     * \param statement sql statement with '?' placeholders
+     * \return prepared query, check lastError() if not valid
+     * \sa SqlFilter
+     */
+    QSqlQuery acquireStatement(const QString &statement);
+    /*!
+     * \brief Gives back a query obtained with acquireStatement() so it can be reused
+     * \param query prepared query
+     */
+    void releaseStatement(QSqlQuery query);
+    /*!
+     * \brief Returns the number of statements prepared by acquireStatement()
+     * \return number of statements
+     */
+    int getStatementsPrepared() const {return statementsPrepared;}
     /*!
      * \brief Returns the number of users with transactions in an event
      * \param eventId Event id
      * \return Number of users
      */
     int calcNumUsers(int eventId);
+    /*!
+     * \brief Returns the totals of an event from the event_summary table
+     * \param eventId Event id
+     * \return summary, all zero if the event has no transactions
+     */
+    EventSummary getEventSummary(int eventId);
+    /*!
+     * \brief Marks an event as finished and stores the snapshot of its calculations
+     * \param eventId Event id
+     * \return Sql error
+     * \sa EventSnapshot
+     */
+    QSqlError finishEvent(int eventId);
+    /*!
+     * \brief Marks a finished event as ongoing again, dropping its snapshot
+     * \param eventId Event id
+     * \return Sql error
+     */
+    QSqlError reopenEvent(int eventId);
+    /*!
+     * \brief Returns the snapshot of a finished event, building it if missing
+     * \param eventId Event id
+     * \param snapshot snapshot of the event
+     * \return true if the event is finished and the snapshot could be read
+     */
+    bool getEventSnapshot(int eventId, EventSnapshot *snapshot);
+    /*!
+     * \brief Compares event_summary, event_participants, kitty_ledger and the spending rollups with totals computed from the transactions
+     * \param rebuild if true and they differ, the tables are rebuilt from scratch
+     * \return description of each difference found, empty if consistent
+     */
+    QStringList checkEventSummaries(bool rebuild = true);
 
     /*!
      * \brief Returns sql query to insert a user in the database
      * \return sql query
      * \todo this should be private
      */
-    QLatin1String getInsertUserQuery();
+    static QLatin1String getInsertUserQuery();
     /*!
      * \brief Returns sql query to insert an event in the database
      * \return sql query
      * \todo this should be private
      */
-    QLatin1String getInsertEventQuery();
+    static QLatin1String getInsertEventQuery();
     /*!
      * \brief Returns sql query to insert a transaction in the database
      * \return sql query
      * \todo this should be private
      */
-    QLatin1String getInsertTransactionQuery();
+    static QLatin1String getInsertTransactionQuery();
     /*!
      * \brief Returns the number of rows of a QSqlQuery
      * \param query QSqlQuery object with the results
@@ -158,10 +692,86 @@ public:
      */
     int qSqlQueryNumRows(QSqlQuery query);
 private:
+    /*!
+     * \brief Current version of the schema, see migrateSchema()
+     */
+    static const int SchemaVersion = 11;
+    /*!
+     * \brief Returns the statements which migrate the schema to a version
+     * \param version schema version
+     * \param fullTextSearch true if FTS5 is available, see hasFullTextSearch()
+     * \return sql statements
+     */
+    static QStringList migrationSteps(int version, bool fullTextSearch);
+    /*!
+     * \brief Returns the statements which create the full-text index of the transactions and its triggers
+     * \return sql statements
+     */
+    static QStringList searchIndexSteps();
+    /*!
+     * \brief Returns the statements which fill event_summary and event_participants from the transactions
+     * \return sql statements
+     */
+    static QStringList eventSummaryRebuildSteps();
+    /*!
+     * \brief Returns the statements which fill kitty_ledger from the transactions
+     * \return sql statements
+     */
+    static QStringList kittyLedgerRebuildSteps();
+    /*!
+     * \brief Returns the statements which fill spending_rollup and place_rollup from the transactions
+     * \return sql statements
+     */
+    static QStringList spendingRollupRebuildSteps();
+    /*!
+     * \brief Sets the fingerprint of the transactions without one, see transactionFingerprint()
+     * \param database database connection
+     * \return Sql error
+     */
+    static QSqlError fillFingerprints(QSqlDatabase database);
     /*!
      * \brief Database
      */
     QSqlDatabase db;
+    /*!
+     * \brief Name of the connection of this instance
+     */
+    QString connectionName;
+    /*!
+     * \brief Thread which opened the connection
+     */
+    QThread *ownerThread;
+    /*!
+     * \brief Names of the connections cloned for worker threads
+     */
+    QStringList threadConnections;
+    /*!
+     * \brief Guards threadConnections
+     */
+    QMutex threadConnectionsMutex;
+    /*!
+     * \brief Opens the connection of this instance, closing it first if open
+     * \return true if success
+     */
+    bool openConnection();
+    /*!
+     * \brief Closes and removes the connection of this instance and its clones
+     */
+    void closeConnections();
+    /*!
+     * \brief Closes the connections and drops the indexes, expanded events, converters and users cached
+     */
+    void closeDb();
+    /*!
+     * \brief Path to the database file, or memoryPath()
+     */
+    QString dbPath;
+    /*!
+     * \brief Copies the tables, indexes and triggers of a database file into the empty database
+     * \param path path to the file
+     * \return Sql error
+     */
+    QSqlError copySnapshot(const QString &path);
     /*!
      * \brief Id of the kitty
      */
@@ -170,6 +780,143 @@ private:
      * \brief Last sql error
      */
     QSqlError lastError;
+    /*!
+     * \brief Balance index of each event id, built on first use
+     */
+    QHash<int, BalanceIndex> balanceIndexes;
+    /*!
+     * \brief Returns the balance index of an event, loading it from the database if needed
+     * \param eventId Event id
+     * \return balance index
+     */
+    BalanceIndex &getBalanceIndex(int eventId);
+    /*!
+     * \brief Converter of each base currency, loaded on first use
+     */
+    QHash<QString, CurrencyConverter> converters;
+    /*!
+     * \brief Transactions of the events needing expansion, expanded and converted, by event
+     *
+     * Dropped together with the balance index of the event, and all of them with the converters.
+     */
+    QHash<int, QVector<Transaction> > expandedTransactions;
+    /*!
+     * \brief Returns true if the summary tables do not hold the totals of an event as they are
+     * \param eventId Event id
+     * \return true if it has transactions in a currency of their own or split expenses
+     * \sa getEventTransactions()
+     */
+    bool needsExpansion(int eventId);
+    /*!
+     * \brief Reads the events matching a condition
+     * \param condition sql condition on the columns of events, all the events if empty
+     * \return events, ordered by name and id
+     */
+    QVector<Event> selectEvents(const QString &condition);
+    /*!
+     * \brief Returns the transactions of an event needing expansion, read on first use
+     * \param eventId Event id
+     * \return cached result of getEventTransactions(), empty on error
+     */
+    const QVector<Transaction> &getExpandedTransactions(int eventId);
+    /*!
+     * \brief Prepares and executes a statement
+     * \param q query
+     * \param statement sql statement with '?' placeholders
+     * \param values values bound in order
+     * \param callSite function name recorded in QueryStats
+     * \return true if success
+     */
+    bool execPrepared(QSqlQuery &q, const QString &statement, const QVariantList &values, const char *callSite);
+    /*!
+     * \brief Replaces the rows of the temporary search_results table with the transactions matching some words
+     * \param q query
+     * \param words words to look for, each of them matching as a prefix
+     * \param limit maximum number of matches kept
+     * \param useIndex if true, matches and ranks with transactions_fts, otherwise scans with LIKE
+     * \return true if success
+     */
+    bool fillSearchResults(QSqlQuery &q, const QStringList &words, int limit, bool useIndex);
+    /*!
+     * \brief Fills a temporary table of ids, such as cascade_ids, with a set of ids
+     * \param q query
+     * \param table name of the temporary table
+     * \param ids ids
+     * \return true if success
+     */
+    bool fillIdTable(QSqlQuery &q, const QString &table, const QVariantList &ids);
+    /*!
+     * \brief Deletes the events in the cascade_ids table with their transactions and summaries
+     * \param q query
+     * \return true if success
+     */
+    bool deleteCascadeEvents(QSqlQuery &q);
+    /*!
+     * \brief Returns the split expenses paid by other users in which a user has a share
+     * \param q query
+     * \param userId User id
+     * \param splits set to the split expenses, with their ids, events and shares only
+     * \return true if success
+     */
+    bool getSplitsSharedWith(QSqlQuery &q, int userId, QVector<SplitExpense> *splits);
+    /*!
+     * \brief Removes the share of a user from the split expenses paid by others
+     *
+     * The other shares keep their weights, so the amount is split among them. The expenses left
+     * without a share of a user other than the payer are deleted.
+     * \param q query
+     * \param userId User id
+     * \return true if success
+     */
+    bool removeUserFromSplits(QSqlQuery &q, int userId);
+    /*!
+     * \brief Commits the transaction of a cascading delete, or rolls it back
+     * \param q query of the last step
+     * \param ok false if a step failed
+     * \return Sql error
+     */
+    QSqlError finishCascade(QSqlQuery &q, bool ok);
+    /*!
+     * \brief Updates the balance index of the event of a transaction, if already built, and drops its expanded transactions
+     * \param transaction added or deleted transaction
+     * \param sign 1 if added, -1 if deleted
+     */
+    void updateBalanceIndex(const Transaction &transaction, int sign);
+    /*!
+     * \brief Adds the amount of a new transaction to the sketch of its event and giver, if the sketches of the event are up to date
+     * \param transaction added transaction
+     */
+    void updateAmountSketch(const Transaction &transaction);
+    /*!
+     * \brief Rebuilds the sketches of the events whose sketches do not count all their transactions
+     * \param eventId Event id (-1 to check every event)
+     * \return true if success
+     */
+    bool refreshAmountSketches(int eventId);
+    /*!
+     * \brief Prefix search index of the users
+     */
+    UserIndex userIndex;
+    /*!
+     * \brief True once the user index has been loaded from the database
+     */
+    bool userIndexLoaded;
+    /*!
+     * \brief Prepared queries not in use, by statement
+     */
+    QHash<QString, QList<QSqlQuery> > idleStatements;
+    /*!
+     * \brief Number of statements prepared by acquireStatement()
+     */
+    int statementsPrepared;
+    /*!
+     * \brief How duplicates are handled, see setDuplicateCheck()
+     */
+    DuplicateCheck duplicateCheck;
+    /*!
+     * \brief Transaction matched by the last addTransaction(), -1 if none
+     */
+    int lastDuplicate;
 };
 
 #endif // DATABASE_H
@@ -0,0 +1,19 @@
+#include "daynumberdelegate.h"
+#include "database.h"
+
+/*!
+ * DayNumberDelegate constructor
+ */
+DayNumberDelegate::DayNumberDelegate(QObject *parent) :
+    QStyledItemDelegate(parent)
+{
+}
+
+/*!
+ * Returns the date of a day number as text, with the same format used in the dialogs
+ */
+QString DayNumberDelegate::displayText(const QVariant &value, const QLocale &locale) const
+{
+    Q_UNUSED(locale);
+    return DataBase::dayToDate(value).toString("dd.MM.yyyy");
+}
@@ -0,0 +1,26 @@
+#ifndef DAYNUMBERDELEGATE_H
+#define DAYNUMBERDELEGATE_H
+
+#include <QStyledItemDelegate>
+
+//! \brief Item delegate which shows the day numbers stored in the database as dates
+class DayNumberDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    /*!
+     * \brief DayNumberDelegate constructor
+     * \param parent parent object
+     */
+    explicit DayNumberDelegate(QObject *parent = 0);
+    /*!
+     * \brief Returns the text shown for a day number
+     * \param value Julian day number
+     * \param locale locale of the view
+     * \return date as text
+     */
+    QString displayText(const QVariant &value, const QLocale &locale) const;
+};
+
+#endif // DAYNUMBERDELEGATE_H
@@ -1,5 +1,8 @@
 #include "dbclasses.h"
+#include "emailvalidator.h"
+
 #include <QCryptographicHash>
+#include <QRandomGenerator>
 
 /*!
  * Empty User constructor
@@ -67,21 +70,12 @@ User::User(QString name, QString nickname, QString email, QString password, QDat
 /*!
  * Validates an email address
  *
- * Checks if it's a valid email address and if it has an intermediate address
+ * The address is trimmed and taken in low-case before checking it.
+ * \sa EmailValidator
  */
 bool User::validateEmail()
 {
-    const QRegExp m_validMailRegExp = QRegExp("[a-z0-9._%+-]+@[a-z0-9.-]+\\.[a-z]{2,4}");
-    const QRegExp m_intermediateMailRegExp = QRegExp("[a-z0-9._%+-]*@?[a-z0-9.-]*\\.?[a-z]*");
-
-    QString text = email.trimmed().toLower();
-
-    if (m_validMailRegExp.exactMatch(text))
-        return true;
-    if (m_intermediateMailRegExp.exactMatch(text))
-        return false;
-
-    return false;
+    return EmailValidator::isValid(email);
 }
 
 /*!
@@ -91,10 +85,22 @@ bool User::validateEmail()
  */
 QString User::getEmailHash()
 {
-    if(email.isEmpty())
+    return emailHash(email);
+}
+
+/*!
+ * Returns the MD5 hash of an email, used to request its gravatar
+ *
+ * Gravatar hashes the address trimmed and in lower case, so "Alice@Example.com " gets the
+ * avatar of "alice@example.com".
+ */
+QString User::emailHash(const QString &email)
+{
+    QString normalized = email.trimmed().toLower();
+    if(normalized.isEmpty())
         return QString();
 
-    return QString(QCryptographicHash::hash(email.toUtf8(),QCryptographicHash::Md5).toHex());
+    return QString(QCryptographicHash::hash(normalized.toUtf8(),QCryptographicHash::Md5).toHex());
 }
 
 /*!
@@ -150,6 +156,8 @@ int User::getAge()
 
 /*!
  * Generates a 16 character string out of random digits, low- and uppercase letters
+ *
+ * The characters come from the system CSPRNG, which is safe to use from several threads.
  */
 QString User::generatePwdSalt()
 {
@@ -159,7 +167,7 @@ QString User::generatePwdSalt()
     QString randomString;
     for(int i=0; i<randomStringLength; ++i)
     {
-        int index = qrand() % possibleCharacters.length();
+        int index = QRandomGenerator::system()->bounded(possibleCharacters.length());
         QChar nextChar = possibleCharacters.at(index);
         randomString.append(nextChar);
     }
@@ -262,3 +270,98 @@ Transaction::Transaction(User userGiving, User userReceiving, Event event, doubl
     this->place = place;
     this->description = description;
 }
+
+/*!
+ * Empty SplitExpense constructor
+ */
+SplitExpense::SplitExpense()
+{
+    this->id = -1;
+    this->amount = 0;
+}
+
+/*!
+ * SplitExpense constructor without an id.
+ *
+ * The shares are added with \sa SplitExpense::addShare(). After inserting in the database, the
+ * resulting id can be set with \sa SplitExpense::setId(int id)
+ */
+SplitExpense::SplitExpense(User payer, Event event, double amount, QDate date, QString place, QString description)
+{
+    this->id = -1;
+    this->payer = payer;
+    this->event = event;
+    this->amount = amount;
+    this->date = date;
+    this->place = place;
+    this->description = description;
+}
+
+/*!
+ * Adds the share of a user
+ */
+void SplitExpense::addShare(int userId, double weight)
+{
+    Share share = {userId, weight};
+    shares.append(share);
+}
+
+/*!
+ * Expands the expense into one transaction from the payer to each other user
+ */
+QVector<Transaction> SplitExpense::expand() const
+{
+    QVector<Transaction> transactions;
+    double totalWeight = 0;
+    foreach(const Share &share, shares)
+        totalWeight += share.weight;
+    if(totalWeight <= 0)
+        return transactions;
+
+    transactions.reserve(shares.size());
+    foreach(const Share &share, shares)
+    {
+        if(share.userId == payer.getId())
+            continue;
+        Transaction transaction(payer, User(share.userId), event, amount * share.weight / totalWeight, date, place, description);
+        transaction.setCurrency(currency);
+        transactions.append(transaction);
+    }
+    return transactions;
+}
+
+/*!
+ * Packs the shares as a 32-bit user id and a 64-bit weight each
+ */
+QByteArray SplitExpense::packShares() const
+{
+    QByteArray data;
+    data.reserve(shares.size() * 12);
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_6);
+    foreach(const Share &share, shares)
+        out << qint32(share.userId) << share.weight;
+    return data;
+}
+
+/*!
+ * Replaces the shares with those of a packed list
+ */
+bool SplitExpense::unpackShares(const QByteArray &data)
+{
+    shares.clear();
+    if(data.size() % 12)
+        return false;
+
+    shares.reserve(data.size() / 12);
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_5_6);
+    while(!in.atEnd())
+    {
+        qint32 userId;
+        double weight;
+        in >> userId >> weight;
+        addShare(userId, weight);
+    }
+    return in.status() == QDataStream::Ok;
+}
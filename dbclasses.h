@@ -74,6 +74,12 @@ public:
      * \return hash MD5 hash of user email
      */
     QString getEmailHash();
+    /*!
+     * \brief Get the gravatar hash of an email
+     * \param email email address, hashed trimmed and in lower case
+     * \return hash MD5 hash of the email, empty if there is no email
+     */
+    static QString emailHash(const QString &email);
     /*!
      * \brief Returns the hash of the user password
      * \return passwordHash
@@ -233,6 +239,16 @@ public:
      * \param finished
      */
     void setFinished(bool finished = true) {this->finished = finished;}
+    /*!
+     * \brief Returns the currency of the Event, which its totals are given in
+     * \return ISO 4217 code, empty for the default currency
+     */
+    QString getCurrency() const {return currency;}
+    /*!
+     * \brief Sets the currency of the Event
+     * \param currency ISO 4217 code, empty for the default currency
+     */
+    void setCurrency(QString currency) {this->currency = currency;}
 
     /*!
      * \brief Converts Event to QString
@@ -280,6 +296,10 @@ private:
      * \brief Event finished state
      */
     bool finished;
+    /*!
+     * \brief Event currency
+     */
+    QString currency;
 };
 
 //! \brief The Transaction class
@@ -357,6 +377,21 @@ public:
      * \return
      */
     QString getDescription() const {return description;}
+    /*!
+     * \brief Sets the amount of money for this Transaction
+     * \param amount
+     */
+    void setAmount(double amount) {this->amount = amount;}
+    /*!
+     * \brief Returns the currency of the amount
+     * \return ISO 4217 code, empty if it is the currency of the event
+     */
+    QString getCurrency() const {return currency;}
+    /*!
+     * \brief Sets the currency of the amount
+     * \param currency ISO 4217 code, empty if it is the currency of the event
+     */
+    void setCurrency(QString currency) {this->currency = currency;}
 
     /*!
      * \brief Converts Transaction to QString
@@ -417,6 +452,154 @@ private:
      * \brief Transaction description
      */
     QString description;
+    /*!
+     * \brief Transaction currency
+     */
+    QString currency;
+};
+
+//! \brief The SplitExpense class, an expense paid by one user and shared among several
+class SplitExpense
+{
+public:
+    //! \brief Share of a user in the expense
+    struct Share
+    {
+        //! \brief User id
+        int userId;
+        //! \brief Weight of the share, relative to the sum of all the weights
+        double weight;
+    };
+
+    //! \brief Empty SplitExpense constructor
+    SplitExpense();
+    /*!
+     * \brief SplitExpense constructor without an id and without shares
+     * \param payer user who pays the whole amount
+     * \param event related event of this expense
+     * \param amount amount of money payed
+     * \param date
+     * \param place
+     * \param description
+     */
+    SplitExpense(User payer, Event event, double amount, QDate date, QString place = QString(), QString description = QString());
+    /*!
+     * \brief Returns id of the SplitExpense
+     * \return id
+     */
+    int getId() const {return id;}
+    /*!
+     * \brief Sets id for the SplitExpense
+     * \param id
+     */
+    void setId(int id){this->id = id;}
+    /*!
+     * \brief Returns the User who pays the expense
+     * \return payer
+     */
+    User getPayer() const {return payer;}
+    /*!
+     * \brief Returns the event which this SplitExpense belongs to
+     * \return event
+     */
+    Event getEvent() const {return event;}
+    /*!
+     * \brief Returns the amount of money of the whole expense
+     * \return amount
+     */
+    double getAmount() const {return amount;}
+    /*!
+     * \brief Returns the date of the SplitExpense
+     * \return date
+     */
+    QDate getDate() const {return date;}
+    /*!
+     * \brief Returns the place of the SplitExpense
+     * \return place
+     */
+    QString getPlace() const {return place;}
+    /*!
+     * \brief Returns the description of the SplitExpense
+     * \return description
+     */
+    QString getDescription() const {return description;}
+    /*!
+     * \brief Returns the currency of the amount
+     * \return ISO 4217 code, empty if it is the currency of the event
+     */
+    QString getCurrency() const {return currency;}
+    /*!
+     * \brief Sets the currency of the amount
+     * \param currency ISO 4217 code, empty if it is the currency of the event
+     */
+    void setCurrency(QString currency) {this->currency = currency;}
+    /*!
+     * \brief Returns the shares of the users in the expense
+     * \return shares, the payer included if it has one
+     */
+    QVector<Share> getShares() const {return shares;}
+    /*!
+     * \brief Adds the share of a user, which may be the payer
+     * \param userId User id
+     * \param weight Weight of the share, 1 for equal parts
+     */
+    void addShare(int userId, double weight = 1);
+    /*!
+     * \brief Expands the expense into the transactions it stands for
+     *
+     * The payer gives each other user its part of the amount. The part of the payer stays with it.
+     * \return one transaction per share but the one of the payer, without id
+     */
+    QVector<Transaction> expand() const;
+    /*!
+     * \brief Packs the shares in the compact format stored in the database
+     * \return 12 bytes per share: user id and weight
+     */
+    QByteArray packShares() const;
+    /*!
+     * \brief Replaces the shares with those of a list packed by packShares()
+     * \param data packed shares
+     * \return false if the data is not valid
+     */
+    bool unpackShares(const QByteArray &data);
+
+private:
+    /*!
+     * \brief SplitExpense id
+     */
+    int id;
+    /*!
+     * \brief User paying the expense
+     */
+    User payer;
+    /*!
+     * \brief Event which this SplitExpense belongs to
+     */
+    Event event;
+    /*!
+     * \brief SplitExpense amount of money
+     */
+    double amount;
+    /*!
+     * \brief SplitExpense date
+     */
+    QDate date;
+    /*!
+     * \brief SplitExpense place
+     */
+    QString place;
+    /*!
+     * \brief SplitExpense description
+     */
+    QString description;
+    /*!
+     * \brief SplitExpense currency
+     */
+    QString currency;
+    /*!
+     * \brief Shares of the users
+     */
+    QVector<Share> shares;
 };
 
 #endif // DBCLASSES_H
@@ -0,0 +1,126 @@
+#include "emailvalidator.h"
+
+namespace {
+
+//! Classes of the characters, columns of the transition table
+enum CharClass {
+    Letter,         // a-z
+    DigitOrHyphen,  // 0-9 -
+    Dot,            // .
+    LocalOnly,      // _ % +
+    At,             // @
+    Other,
+    NumClasses
+};
+
+//! States of the DFA, rows of the transition table
+enum State {
+    Start,          // Nothing read
+    Local,          // Local part
+    AfterAt,        // '@' read
+    Domain,         // Domain with no valid ending yet
+    DomainDot,      // '.' with something before it in the domain
+    Tld1,           // 1 letter after the last dot
+    Tld2,           // 2 letters after the last dot (accepting)
+    Tld3,           // 3 letters after the last dot (accepting)
+    Tld4,           // 4 letters after the last dot (accepting)
+    Reject,
+    NumStates
+};
+
+/*!
+ * Transitions of the DFA
+ *
+ * After the '@' the domain has to end with a dot and 2 to 4 letters, with at least one
+ * character before that dot. A fifth letter, a digit or a hyphen starts over in Domain,
+ * since a later dot may still end the address correctly.
+ */
+const quint8 transitions[NumStates][NumClasses] = {
+    //               Letter  DigitOrHyphen  Dot        LocalOnly  At       Other
+    /* Start     */ {Local,  Local,         Local,     Local,     Reject,  Reject},
+    /* Local     */ {Local,  Local,         Local,     Local,     AfterAt, Reject},
+    /* AfterAt   */ {Domain, Domain,        Domain,    Reject,    Reject,  Reject},
+    /* Domain    */ {Domain, Domain,        DomainDot, Reject,    Reject,  Reject},
+    /* DomainDot */ {Tld1,   Domain,        DomainDot, Reject,    Reject,  Reject},
+    /* Tld1      */ {Tld2,   Domain,        DomainDot, Reject,    Reject,  Reject},
+    /* Tld2      */ {Tld3,   Domain,        DomainDot, Reject,    Reject,  Reject},
+    /* Tld3      */ {Tld4,   Domain,        DomainDot, Reject,    Reject,  Reject},
+    /* Tld4      */ {Domain, Domain,        DomainDot, Reject,    Reject,  Reject},
+    /* Reject    */ {Reject, Reject,        Reject,    Reject,    Reject,  Reject}
+};
+
+/*!
+ * Class of each ASCII character, upper-case letters are classed as their low-case
+ */
+struct AsciiClasses
+{
+    AsciiClasses()
+    {
+        for(int c = 0; c < 128; c++)
+            classes[c] = Other;
+        for(int c = 'a'; c <= 'z'; c++)
+            classes[c] = classes[c - 'a' + 'A'] = Letter;
+        for(int c = '0'; c <= '9'; c++)
+            classes[c] = DigitOrHyphen;
+        classes['-'] = DigitOrHyphen;
+        classes['.'] = Dot;
+        classes['_'] = classes['%'] = classes['+'] = LocalOnly;
+        classes['@'] = At;
+    }
+
+    quint8 classes[128];
+};
+
+const AsciiClasses asciiClasses;
+
+/*!
+ * Returns the class of a code unit as it would be after QString::toLower()
+ *
+ * The only non-ASCII code unit whose low-case is ASCII is the Kelvin sign (to 'k'). U+0130 is
+ * excluded because QString::toLower() turns it into 'i' plus a combining dot, which is rejected.
+ */
+inline int charClass(ushort c)
+{
+    if(c < 128)
+        return asciiClasses.classes[c];
+    if(c == 0x130)
+        return Other;
+    ushort lower = QChar::toLower(c);
+    return lower < 128 ? asciiClasses.classes[lower] : Other;
+}
+
+}
+
+/*!
+ * Validates an email address given as UTF-16 code units, skipping the whitespace that
+ * QString::trimmed() would remove
+ */
+bool EmailValidator::isValid(const QChar *data, int size)
+{
+    int begin = 0;
+    int end = size;
+    while(begin < end && data[begin].isSpace())
+        begin++;
+    while(end > begin && data[end - 1].isSpace())
+        end--;
+
+    int state = Start;
+    for(int i = begin; i < end && state != Reject; i++)
+        state = transitions[state][charClass(data[i].unicode())];
+
+    return state == Tld2 || state == Tld3 || state == Tld4;
+}
+
+/*!
+ * Validates a batch of email addresses
+ */
+QBitArray EmailValidator::validate(const QStringList &emails)
+{
+    QBitArray result(emails.size());
+    for(int i = 0; i < emails.size(); i++)
+    {
+        if(isValid(emails.at(i)))
+            result.setBit(i);
+    }
+    return result;
+}
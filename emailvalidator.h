@@ -0,0 +1,37 @@
+#ifndef EMAILVALIDATOR_H
+#define EMAILVALIDATOR_H
+
+#include <QtCore>
+
+/*!
+ * \brief Single-pass email validator
+ *
+ * Accepts exactly the addresses accepted by User::validateEmail() before it used this class:
+ * the trimmed, low-case text must match [a-z0-9._%+-]+@[a-z0-9.-]+\.[a-z]{2,4}. The text is
+ * scanned once with a table-driven DFA over its UTF-16 code units, without any allocation.
+ */
+class EmailValidator
+{
+public:
+    /*!
+     * \brief Validates an email address
+     * \param email email address, surrounding whitespace and upper-case letters are accepted
+     * \return true if valid
+     */
+    static bool isValid(const QString &email) {return isValid(email.constData(), email.size());}
+    /*!
+     * \brief Validates an email address given as UTF-16 code units
+     * \param data first code unit
+     * \param size number of code units
+     * \return true if valid
+     */
+    static bool isValid(const QChar *data, int size);
+    /*!
+     * \brief Validates a batch of email addresses
+     * \param emails email addresses
+     * \return bit i set if emails[i] is valid
+     */
+    static QBitArray validate(const QStringList &emails);
+};
+
+#endif // EMAILVALIDATOR_H
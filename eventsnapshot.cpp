@@ -0,0 +1,166 @@
+#include "eventsnapshot.h"
+
+#include <algorithm>
+
+namespace {
+
+//! Marks the start of a snapshot blob
+const quint32 SnapshotMagic = 0x43534e50;
+
+}
+
+/*!
+ * Empty EventSnapshot constructor
+ */
+EventSnapshot::EventSnapshot()
+{
+    eventId = -1;
+    kittyIn = 0;
+    kittyOut = 0;
+    numUsers = 0;
+}
+
+/*!
+ * Computes the snapshot of an event in one pass over its transactions
+ */
+EventSnapshot EventSnapshot::build(int eventId, const QVector<Transaction> &transactions, int kittyId)
+{
+    EventSnapshot snapshot;
+    snapshot.eventId = eventId;
+    snapshot.created = QDateTime::currentDateTimeUtc();
+    snapshot.transactions = transactions;
+
+    QSet<int> users;
+    foreach(const Transaction &transaction, transactions)
+    {
+        int giving = transaction.getUserGiving().getId();
+        int receiving = transaction.getUserReceiving().getId();
+        double amount = transaction.getAmount();
+
+        snapshot.balances[giving] += amount;
+        snapshot.balances[receiving] -= amount;
+        snapshot.given[giving] += amount;
+        snapshot.received[receiving] += amount;
+        snapshot.pairs[qMakePair(giving, receiving)] += amount;
+        if(receiving == kittyId)
+            snapshot.kittyIn += amount;
+        if(giving == kittyId)
+            snapshot.kittyOut += amount;
+        users << giving << receiving;
+    }
+    users.remove(kittyId);
+    snapshot.numUsers = users.size();
+    snapshot.settlement = Settlement::plan(snapshot.balances);
+
+    return snapshot;
+}
+
+/*!
+ * Serializes the snapshot to a compressed blob
+ *
+ * The transactions are written field by field, with the users as ids only.
+ */
+QByteArray EventSnapshot::toByteArray() const
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_6);
+
+    out << SnapshotMagic << FormatVersion << qint32(eventId) << created << kittyIn << kittyOut << qint32(numUsers)
+        << balances << given << received << pairs << settlement;
+
+    out << qint32(transactions.size());
+    foreach(const Transaction &transaction, transactions)
+    {
+        out << qint32(transaction.getId())
+            << qint32(transaction.getUserGiving().getId())
+            << qint32(transaction.getUserReceiving().getId())
+            << transaction.getAmount()
+            << qint64(transaction.getDate().isValid() ? transaction.getDate().toJulianDay() : 0)
+            << transaction.getPlace()
+            << transaction.getDescription();
+    }
+
+    return qCompress(data);
+}
+
+/*!
+ * Deserializes a snapshot from a blob written by toByteArray()
+ */
+EventSnapshot EventSnapshot::fromByteArray(const QByteArray &data)
+{
+    if(data.isEmpty())
+        return EventSnapshot();
+
+    EventSnapshot snapshot;
+    QByteArray bytes = qUncompress(data);
+    QDataStream in(bytes);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic;
+    quint16 version;
+    in >> magic >> version;
+    if(magic != SnapshotMagic || version != FormatVersion)
+        return EventSnapshot();
+
+    qint32 id, users, count;
+    in >> id >> snapshot.created >> snapshot.kittyIn >> snapshot.kittyOut >> users
+       >> snapshot.balances >> snapshot.given >> snapshot.received >> snapshot.pairs >> snapshot.settlement
+       >> count;
+    if(in.status() != QDataStream::Ok || count < 0)
+        return EventSnapshot();
+
+    snapshot.transactions.reserve(count);
+    for(int i = 0; i < count && in.status() == QDataStream::Ok; i++)
+    {
+        qint32 transactionId, giving, receiving;
+        double amount;
+        qint64 day;
+        QString place, description;
+        in >> transactionId >> giving >> receiving >> amount >> day >> place >> description;
+        snapshot.transactions.append(Transaction(transactionId, User(giving), User(receiving), Event(id), amount,
+                                                 day ? QDate::fromJulianDay(day) : QDate(), place, description));
+    }
+    if(in.status() != QDataStream::Ok)
+        return EventSnapshot();
+
+    snapshot.eventId = id;
+    snapshot.numUsers = users;
+    return snapshot;
+}
+
+/*!
+ * Returns the total amount given from one user to another
+ */
+double EventSnapshot::getAmountBetween(int userGivingId, int userReceivingId) const
+{
+    return pairs.value(qMakePair(userGivingId, userReceivingId));
+}
+
+/*!
+ * Returns the users who gave money to someone
+ */
+QList<int> EventSnapshot::getUsersGiving() const
+{
+    QSet<int> users;
+    for(QHash<QPair<int, int>, double>::const_iterator it = pairs.constBegin(); it != pairs.constEnd(); ++it)
+        users.insert(it.key().first);
+    QList<int> result = users.toList();
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+/*!
+ * Returns the users who received money from a user
+ */
+QList<int> EventSnapshot::getUsersReceiving(int userGivingId) const
+{
+    QList<int> result;
+    for(QHash<QPair<int, int>, double>::const_iterator it = pairs.constBegin(); it != pairs.constEnd(); ++it)
+    {
+        if(it.key().first == userGivingId)
+            result.append(it.key().second);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
@@ -0,0 +1,146 @@
+#ifndef EVENTSNAPSHOT_H
+#define EVENTSNAPSHOT_H
+
+#include <QtCore>
+
+#include "dbclasses.h"
+#include "settlement.h"
+
+/*!
+ * \brief Frozen calculations of a finished event
+ *
+ * Built once when the event is finished and stored as a compressed QDataStream blob in the
+ * event_snapshots table. A finished event accepts no more transactions, so the views can be
+ * served from the snapshot without scanning the transactions again. The snapshot is dropped
+ * by triggers if the event is reopened or its transactions change anyway.
+ */
+class EventSnapshot
+{
+public:
+    //! \brief Empty, not valid, EventSnapshot constructor
+    EventSnapshot();
+    /*!
+     * \brief Computes the snapshot of an event
+     * \param eventId Event id
+     * \param transactions all the transactions of the event
+     * \param kittyId id of the kitty
+     * \return snapshot
+     */
+    static EventSnapshot build(int eventId, const QVector<Transaction> &transactions, int kittyId);
+    /*!
+     * \brief Serializes the snapshot to a compressed blob
+     * \return blob
+     */
+    QByteArray toByteArray() const;
+    /*!
+     * \brief Deserializes a snapshot from a blob written by toByteArray()
+     * \param data blob
+     * \return snapshot, not valid if the blob is corrupt or of another version
+     */
+    static EventSnapshot fromByteArray(const QByteArray &data);
+
+    /*!
+     * \brief Returns true if the snapshot has been built or read correctly
+     * \return valid
+     */
+    bool isValid() const {return eventId != -1;}
+    /*!
+     * \brief Returns the id of the event
+     * \return Event id
+     */
+    int getEventId() const {return eventId;}
+    /*!
+     * \brief Returns when the snapshot was built
+     * \return date and time
+     */
+    QDateTime getCreated() const {return created;}
+    /*!
+     * \brief Returns the money in the kitty: inflows minus withdrawals
+     * \return Amount of money
+     */
+    double getAmountKitty() const {return kittyIn - kittyOut;}
+    /*!
+     * \brief Returns the number of users with transactions, the kitty excluded
+     * \return Number of users
+     */
+    int getNumUsers() const {return numUsers;}
+    /*!
+     * \brief Returns the number of transactions
+     * \return Number of transactions
+     */
+    int getNumTransactions() const {return transactions.size();}
+    /*!
+     * \brief Returns the balances of the users, money given minus money received
+     * \return balance of each user id
+     */
+    QHash<int, double> getBalances() const {return balances;}
+    /*!
+     * \brief Returns the money given by each user
+     * \return amount of each user id
+     */
+    QHash<int, double> getTotalsGiven() const {return given;}
+    /*!
+     * \brief Returns the money received by each user
+     * \return amount of each user id
+     */
+    QHash<int, double> getTotalsReceived() const {return received;}
+    /*!
+     * \brief Returns the payments which settle the event
+     * \return payments
+     */
+    QVector<Settlement::Payment> getSettlement() const {return settlement;}
+    /*!
+     * \brief Returns the transactions of the event, ordered by date
+     * \return transactions
+     */
+    QVector<Transaction> getTransactions() const {return transactions;}
+    /*!
+     * \brief Returns the total amount given from one user to another
+     * \param userGivingId User giving
+     * \param userReceivingId User receiving
+     * \return Amount of money
+     */
+    double getAmountBetween(int userGivingId, int userReceivingId) const;
+    /*!
+     * \brief Returns the users who gave money to someone
+     * \return sorted user ids
+     */
+    QList<int> getUsersGiving() const;
+    /*!
+     * \brief Returns the users who received money from a user
+     * \param userGivingId User giving
+     * \return sorted user ids
+     */
+    QList<int> getUsersReceiving(int userGivingId) const;
+
+private:
+    /*!
+     * \brief Format version of the blob, increased when the layout changes
+     */
+    static const quint16 FormatVersion = 1;
+
+    //! \brief Event id, -1 if not valid
+    int eventId;
+    //! \brief When the snapshot was built
+    QDateTime created;
+    //! \brief Money given to the kitty
+    double kittyIn;
+    //! \brief Money taken from the kitty
+    double kittyOut;
+    //! \brief Number of users with transactions, the kitty excluded
+    int numUsers;
+    //! \brief Balance of each user id
+    QHash<int, double> balances;
+    //! \brief Money given by each user id
+    QHash<int, double> given;
+    //! \brief Money received by each user id
+    QHash<int, double> received;
+    //! \brief Total amount of each (user giving, user receiving) pair
+    QHash<QPair<int, int>, double> pairs;
+    //! \brief Payments which settle the event
+    QVector<Settlement::Payment> settlement;
+    //! \brief Transactions of the event
+    QVector<Transaction> transactions;
+};
+
+#endif // EVENTSNAPSHOT_H
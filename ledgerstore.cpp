@@ -0,0 +1,362 @@
+#include "ledgerstore.h"
+
+#include <algorithm>
+
+/*!
+ * Times the adds, the aggregates and the deletes of an event with many transactions
+ *
+ * Every operation goes through the interface one call at a time, as the application does.
+ */
+QString LedgerStore::benchmark(LedgerStore &store, int transactions)
+{
+    QString report;
+    QTextStream out(&report);
+    int kittyId = store.getKittyId();
+
+    QVector<int> users;
+    for(int i = 0; i < 16; i++)
+    {
+        QString nickname = QString("benchmark%1_%2").arg(QDateTime::currentMSecsSinceEpoch()).arg(i);
+        users << store.addUser(User(nickname, nickname, nickname + "@example.com", QLatin1String("hash"),
+                                    QLatin1String("salt"), QDate())).toInt();
+    }
+    users << kittyId;
+    if(store.getLastError().type() != QSqlError::NoError)
+        return "Error: " + store.getLastError().text() + "\n";
+
+    QDate today = QDate::currentDate();
+    int eventId = store.addEvent(Event(QLatin1String("Store benchmark"), today, User(users.first()))).toInt();
+
+    QElapsedTimer timer;
+    timer.start();
+    QVector<int> ids;
+    ids.reserve(transactions);
+    for(int i = 0; i < transactions; i++)
+    {
+        ids << store.addTransaction(Transaction(User(users.at(i % users.size())), User(users.at((i + 1) % users.size())),
+                                                Event(eventId), double(i % 100 + 1), today.addDays(-(i % 365)))).toInt();
+    }
+    qint64 addNs = timer.nsecsElapsed();
+
+    const int lookups = 1000;
+    double sink = 0;
+    timer.restart();
+    for(int i = 0; i < lookups; i++)
+        sink += store.getTransaction(ids.at(i % qMax(ids.size(), 1))).getAmount();
+    qint64 getNs = timer.nsecsElapsed();
+
+    timer.restart();
+    for(int i = 0; i < lookups; i++)
+        sink += store.calcAmountKitty(eventId) + store.calcNumUsers(eventId);
+    qint64 summaryNs = timer.nsecsElapsed();
+
+    timer.restart();
+    for(int i = 0; i < lookups; i++)
+        sink += store.getBalanceAsOf(eventId, users.at(i % users.size()), today.addDays(-(i % 365)));
+    qint64 balanceNs = timer.nsecsElapsed();
+
+    timer.restart();
+    sink += store.sumBetween(today.addDays(-30), today, eventId);
+    sink += store.getTransactionsBetween(today.addDays(-30), today, eventId).size();
+    qint64 rangeNs = timer.nsecsElapsed();
+
+    int sample = qMin(ids.size(), 1000);
+    timer.restart();
+    store.deleteTransactions(ids.mid(0, sample));
+    qint64 deleteNs = timer.nsecsElapsed();
+
+    timer.restart();
+    QSqlError err = store.deleteEventCascade(eventId);
+    qint64 cascadeNs = timer.nsecsElapsed();
+    foreach (int userId, users)
+    {
+        if(userId != kittyId)
+            store.deleteUser(userId);
+    }
+    if(err.type() != QSqlError::NoError)
+        return "Error: " + err.text() + "\n";
+
+    auto ms = [](qint64 ns) {
+        return QString::number(ns / 1e6, 'f', 1).rightJustified(10);
+    };
+    out << store.getBackendName() << " store, event with " << transactions << " transactions (checksum " << sink << ")\n";
+    out << "    add one by one     " << ms(addNs) << " ms\n";
+    out << "    get by id          " << ms(getNs) << " ms for " << lookups << " lookups\n";
+    out << "    event summary      " << ms(summaryNs) << " ms for " << lookups << " lookups\n";
+    out << "    balance as of      " << ms(balanceNs) << " ms for " << lookups << " lookups\n";
+    out << "    last 30 days       " << ms(rangeNs) << " ms\n";
+    out << "    delete " << QString::number(sample).leftJustified(12) << ms(deleteNs) << " ms\n";
+    out << "    cascade delete     " << ms(cascadeNs) << " ms\n";
+    return report;
+}
+
+/*!
+ * Returns the 64-bit FNV-1a hash of the ids and the normalized description of a transaction
+ *
+ * The hash is computed here rather than with qHash(), whose seed changes from one run to another.
+ */
+qint64 LedgerStore::transactionFingerprint(int giverId, int receiverId, int eventId, const QString &description)
+{
+    const QByteArray key = QByteArray::number(giverId) + '\x1f' + QByteArray::number(receiverId) + '\x1f'
+            + QByteArray::number(eventId) + '\x1f' + description.simplified().toCaseFolded().toUtf8();
+    quint64 hash = Q_UINT64_C(14695981039346656037);
+    for(int i = 0; i < key.size(); i++)
+    {
+        hash ^= uchar(key.at(i));
+        hash *= Q_UINT64_C(1099511628211);
+    }
+    return qint64(hash);
+}
+
+/*!
+ * Reads transactions in CSV format: date,giver,receiver,amount[,place[,description]]
+ *
+ * The description is the rest of the line, so it may contain commas.
+ */
+QVector<Transaction> LedgerStore::readTransactions(QIODevice *device, int eventId, QStringList *errors)
+{
+    QHash<QString, int> userIds;
+    foreach (const User &user, getUsers())
+        userIds.insert(user.getNickname(), user.getId());
+
+    QVector<Transaction> transactions;
+    QTextStream in(device);
+    int lineNumber = 0;
+
+    while(!in.atEnd())
+    {
+        QString line = in.readLine();
+        lineNumber++;
+        if(line.trimmed().isEmpty())
+            continue;
+
+        QStringList fields = line.split(QLatin1Char(','));
+        if(lineNumber == 1 && fields.first().trimmed().compare(QLatin1String("date"), Qt::CaseInsensitive) == 0)
+            continue; // Header
+
+        const QString dateText = fields.value(0).trimmed();
+        QDate date = QDate::fromString(dateText, Qt::ISODate);
+        int giverId = userIds.value(fields.value(1).trimmed(), -1);
+        int receiverId = userIds.value(fields.value(2).trimmed(), -1);
+        bool isNumber = false;
+        double amount = fields.value(3).trimmed().toDouble(&isNumber);
+
+        QString problem;
+        if(fields.size() < 4)
+            problem = "Expected date,giver,receiver,amount[,place[,description]]";
+        else if(!dateText.isEmpty() && !date.isValid())
+            problem = "The date is not valid";
+        else if(giverId < 0 || receiverId < 0)
+            problem = "Users giving and receiving must be existing users";
+        else if(giverId == receiverId)
+            problem = "User giving must be different from user receiving";
+        else if(!isNumber || amount < 0)
+            problem = "The amount must be a positive number";
+
+        if(problem.isEmpty())
+            transactions.append(Transaction(User(giverId), User(receiverId), Event(eventId), amount, date,
+                                            fields.value(4).trimmed(), QStringList(fields.mid(5)).join(QLatin1Char(',')).trimmed()));
+        else if(errors)
+            errors->append(QString("Line %1: %2").arg(lineNumber).arg(problem));
+    }
+
+    return transactions;
+}
+
+/*!
+ * Adds the example users, the Warsaw trip with its zloty rates and its transactions
+ */
+QSqlError LedgerStore::initExampleDatabase()
+{
+    User kitty = getUser(getKittyId());
+
+    User bruno = User(QLatin1String("Bruno Santamaria"), QLatin1String("Kowagunga"), QLatin1String("kowagunga@gmail.com"), QString("password"), QDate(1989, 2, 14));
+    User xavi = User(QLatin1String("Xavier Parareda"),  QLatin1String("X"), QLatin1String("xparareda@gmail.com"), QString("password"), QDate(1989, 7, 30));
+    User asustao = User(QLatin1String("Luis Lozano"),  QLatin1String("Asustao"), QLatin1String("lozanodelvalle@gmail.com"), QString("password"), QDate(1989, 12, 20));
+
+    bruno.setId(addUser(bruno).toInt());
+    xavi.setId(addUser(xavi).toInt());
+    asustao.setId(addUser(asustao).toInt());
+    if(getLastError().type() != QSqlError::NoError)
+        return getLastError();
+
+    Event warsaw = Event(QLatin1String("Warsaw Trip"), QDate(2016, 9, 1), bruno, QLatin1String("Warsaw, Poland"), QLatin1String("Trip to Wasaw to destroy our livers"), 0);
+    warsaw.setId(addEvent(warsaw).toInt());
+    if(getLastError().type() != QSqlError::NoError)
+        return getLastError();
+
+    // Rates first, the transactions in zlotys are only accepted with them
+    QVector<CurrencyConverter::Rate> rates;
+    CurrencyConverter::Rate friday = {QDate(2016,9,1), QLatin1String("PLN"), QLatin1String("EUR"), 4.30};
+    CurrencyConverter::Rate saturday = {QDate(2016,9,2), QLatin1String("PLN"), QLatin1String("EUR"), 4.25};
+    rates << friday << saturday;
+    QSqlError err = importExchangeRates(rates);
+    if(err.type() != QSqlError::NoError)
+        return err;
+
+    addTransaction(Transaction(bruno, asustao, warsaw.getId(), 60.0, QDate(2016,9,2), QLatin1String("Hamburg (Germany)"), QLatin1String("Airbnb 3 nights")));
+    addTransaction(Transaction(bruno, xavi, warsaw, 85.0, QDate(2016,9,2), QLatin1String("Hamburg (Germany)"), QLatin1String("Airbnb 4 nights")));
+    // Paid in zlotys, 30 and 13 euros with the rates above
+    Transaction supermarketFriday(xavi, kitty, warsaw, 129.0, QDate(2016,9,1), QLatin1String("Warsaw"), QLatin1String("Supermarket Friday"));
+    supermarketFriday.setCurrency(QLatin1String("PLN"));
+    addTransaction(supermarketFriday);
+    Transaction supermarketSaturday(xavi, kitty, warsaw, 55.25, QDate(2016,9,2), QLatin1String("Warsaw"), QLatin1String("Supermarket Saturday"));
+    supermarketSaturday.setCurrency(QLatin1String("PLN"));
+    addTransaction(supermarketSaturday);
+    addTransaction(Transaction(asustao, kitty, warsaw, 75.0, QDate(2016,9,2), QLatin1String("Warsaw"), QLatin1String("Cash Friday")));
+    addTransaction(Transaction(bruno, kitty, warsaw, 75.0, QDate(2016,9,3), QLatin1String("Warsaw"), QLatin1String("Cash Sunday")));
+    addTransaction(Transaction(kitty, bruno, warsaw, 38.0, QDate(2016,9,5), QLatin1String("Warsaw"), QLatin1String("Cash back Monday")));
+
+    return getLastError();
+}
+
+/*!
+ * Adds up the totals of an event from its transactions, like the event_summary triggers of DataBase
+ */
+LedgerStore::EventSummary LedgerStore::summaryOf(const QVector<Transaction> &transactions, int kittyId)
+{
+    EventSummary summary = {0, 0, 0, 0, 0, QDate()};
+    QSet<int> participants;
+    foreach (const Transaction &transaction, transactions)
+    {
+        int giving = transaction.getUserGiving().getId();
+        int receiving = transaction.getUserReceiving().getId();
+        if(receiving == kittyId)
+            summary.kittyIn += transaction.getAmount();
+        if(giving == kittyId)
+            summary.kittyOut += transaction.getAmount();
+        summary.volume += transaction.getAmount();
+        summary.transactions++;
+        participants << giving << receiving;
+        if(transaction.getDate() > summary.lastDate)
+            summary.lastDate = transaction.getDate();
+    }
+    participants.remove(kittyId);
+    summary.participants = participants.size();
+    return summary;
+}
+
+/*!
+ * Adds up the movements of the kitty day by day, the undated ones under day 0 like the kitty_ledger table
+ */
+QVector<LedgerStore::KittyBalancePoint> LedgerStore::kittyBalanceSeriesOf(const QVector<Transaction> &transactions, int kittyId)
+{
+    QMap<qint64, KittyBalancePoint> days;
+    foreach (const Transaction &transaction, transactions)
+    {
+        bool in = transaction.getUserReceiving().getId() == kittyId;
+        bool out = transaction.getUserGiving().getId() == kittyId;
+        if(!in && !out)
+            continue;
+        qint64 day = transaction.getDate().isValid() ? transaction.getDate().toJulianDay() : 0;
+        QMap<qint64, KittyBalancePoint>::iterator point = days.find(day);
+        if(point == days.end())
+        {
+            KittyBalancePoint empty = {transaction.getDate(), 0, 0, 0};
+            point = days.insert(day, empty);
+        }
+        if(in)
+            point->inflow += transaction.getAmount();
+        if(out)
+            point->outflow += transaction.getAmount();
+    }
+
+    QVector<KittyBalancePoint> series;
+    double balance = 0;
+    foreach (KittyBalancePoint point, days)
+    {
+        balance += point.inflow - point.outflow;
+        point.balance = balance;
+        series.append(point);
+    }
+    return series;
+}
+
+/*!
+ * Adds up the money given day by day, the undated transactions under day 0 like the spending_rollup table
+ */
+QVector<LedgerStore::SpendingPoint> LedgerStore::spendingSeriesOf(const QVector<Transaction> &transactions, int userId)
+{
+    QMap<qint64, SpendingPoint> days;
+    foreach (const Transaction &transaction, transactions)
+    {
+        if(userId != -1 && transaction.getUserGiving().getId() != userId)
+            continue;
+        qint64 day = transaction.getDate().isValid() ? transaction.getDate().toJulianDay() : 0;
+        QMap<qint64, SpendingPoint>::iterator point = days.find(day);
+        if(point == days.end())
+        {
+            SpendingPoint empty = {transaction.getDate(), 0, 0};
+            point = days.insert(day, empty);
+        }
+        point->amount += transaction.getAmount();
+        point->transactions++;
+    }
+
+    QVector<SpendingPoint> series;
+    foreach (const SpendingPoint &point, days)
+        series.append(point);
+    return series;
+}
+
+/*!
+ * Adds up the money given and received by each user, the kitty excluded, largest given first
+ */
+QVector<LedgerStore::SpenderTotal> LedgerStore::topSpendersOf(const QVector<Transaction> &transactions, int kittyId, int limit)
+{
+    QHash<int, SpenderTotal> users;
+    foreach (const Transaction &transaction, transactions)
+    {
+        const int ids[] = {transaction.getUserGiving().getId(), transaction.getUserReceiving().getId()};
+        for(int direction = 0; direction < 2; direction++)
+        {
+            if(ids[direction] == kittyId)
+                continue;
+            QHash<int, SpenderTotal>::iterator user = users.find(ids[direction]);
+            if(user == users.end())
+            {
+                SpenderTotal empty = {ids[direction], 0, 0, 0};
+                user = users.insert(ids[direction], empty);
+            }
+            (direction ? user->received : user->given) += transaction.getAmount();
+            user->transactions++;
+        }
+    }
+
+    QVector<SpenderTotal> spenders = users.values().toVector();
+    std::sort(spenders.begin(), spenders.end(), [](const SpenderTotal &a, const SpenderTotal &b) {
+        return a.given > b.given || (a.given == b.given && a.userId < b.userId);
+    });
+    if(spenders.size() > limit)
+        spenders.resize(limit);
+    return spenders;
+}
+
+/*!
+ * Adds up the money spent at each place, the transactions without place excluded, largest first
+ */
+QVector<LedgerStore::PlaceTotal> LedgerStore::topPlacesOf(const QVector<Transaction> &transactions, int limit)
+{
+    QHash<QString, PlaceTotal> totals;
+    foreach (const Transaction &transaction, transactions)
+    {
+        if(transaction.getPlace().isEmpty())
+            continue;
+        QHash<QString, PlaceTotal>::iterator place = totals.find(transaction.getPlace());
+        if(place == totals.end())
+        {
+            PlaceTotal empty = {transaction.getPlace(), 0, 0};
+            place = totals.insert(transaction.getPlace(), empty);
+        }
+        place->amount += transaction.getAmount();
+        place->transactions++;
+    }
+
+    QVector<PlaceTotal> places = totals.values().toVector();
+    std::sort(places.begin(), places.end(), [](const PlaceTotal &a, const PlaceTotal &b) {
+        return a.amount > b.amount || (a.amount == b.amount && a.place < b.place);
+    });
+    if(places.size() > limit)
+        places.resize(limit);
+    return places;
+}
@@ -0,0 +1,579 @@
+#ifndef LEDGERSTORE_H
+#define LEDGERSTORE_H
+
+#include <QtCore>
+#include <QSqlError>
+
+#include "amountsketch.h"
+#include "currencyconverter.h"
+#include "dbclasses.h"
+#include "eventsnapshot.h"
+#include "settlement.h"
+#include "userindex.h"
+
+/*!
+ * \brief Storage of the users, events and transactions
+ *
+ * The add, get, delete and aggregate operations the application needs, independent of where the
+ * data is kept. Implemented by DataBase on SQLite and by MemoryLedgerStore on plain containers,
+ * both run through the same conformance tests (tests/tst_ledgerstore) so either can be chosen
+ * per deployment.
+ * Errors are reported like in DataBase: as a QSqlError returned or kept in getLastError().
+ */
+class LedgerStore
+{
+public:
+    /*!
+     * \brief Totals of an event
+     */
+    struct EventSummary
+    {
+        //! \brief Money given to the kitty
+        double kittyIn;
+        //! \brief Money taken from the kitty
+        double kittyOut;
+        //! \brief Total amount of the transactions
+        double volume;
+        //! \brief Number of users with transactions, the kitty excluded
+        int participants;
+        //! \brief Number of transactions
+        int transactions;
+        //! \brief Date of the last transaction, not valid if none
+        QDate lastDate;
+    };
+
+    /*!
+     * \brief Movements of the kitty of an event in one day, see getKittyBalanceSeries()
+     */
+    struct KittyBalancePoint
+    {
+        //! \brief Day, not valid for the transactions without date
+        QDate date;
+        //! \brief Money given to the kitty that day
+        double inflow;
+        //! \brief Money taken from the kitty that day
+        double outflow;
+        //! \brief Money in the kitty at the end of the day
+        double balance;
+    };
+
+    /*!
+     * \brief Money spent in an event in one day, see getSpendingSeries()
+     */
+    struct SpendingPoint
+    {
+        //! \brief Day, not valid for the transactions without date
+        QDate date;
+        //! \brief Money given that day
+        double amount;
+        //! \brief Number of transactions that day
+        int transactions;
+    };
+
+    /*!
+     * \brief Money given and received by a user in an event, see getTopSpenders()
+     */
+    struct SpenderTotal
+    {
+        //! \brief User id
+        int userId;
+        //! \brief Money given by the user
+        double given;
+        //! \brief Money received by the user
+        double received;
+        //! \brief Number of transactions of the user
+        int transactions;
+    };
+
+    /*!
+     * \brief Money spent at a place in an event, see getTopPlaces()
+     */
+    struct PlaceTotal
+    {
+        //! \brief Place
+        QString place;
+        //! \brief Money spent there
+        double amount;
+        //! \brief Number of transactions there
+        int transactions;
+    };
+
+    /*!
+     * \brief How new transactions matching existing ones are handled, see setDuplicateCheck()
+     *
+     * A transaction matches another one with the same fingerprint, see transactionFingerprint(),
+     * whose date is at most days away and whose amount differs by at most amount. Undated
+     * transactions only match undated ones.
+     */
+    struct DuplicateCheck
+    {
+        //! \brief What is done with a transaction matching an existing one
+        enum Action
+        {
+            Off,  //!< Not looked for
+            Flag, //!< Added, the match is given by getLastDuplicate()
+            Skip  //!< Not added
+        };
+        //! \brief What is done with a duplicate
+        Action action;
+        //! \brief Days between the dates of two matching transactions
+        int days;
+        //! \brief Difference between the amounts of two matching transactions
+        double amount;
+    };
+
+    virtual ~LedgerStore() {}
+
+    /*!
+     * \brief Returns the currency of the events created without one
+     * \return ISO 4217 code
+     */
+    static QString defaultCurrency() {return QLatin1String("EUR");}
+    /*!
+     * \brief Returns the fingerprint of a transaction, a 64-bit hash of its users, its event and its description
+     *
+     * The description is compared without case and with its spaces simplified. The amount and the
+     * date are left out, so that the rows of a fingerprint can be matched within a window of them.
+     * \param giverId User giving the money
+     * \param receiverId User receiving the money
+     * \param eventId Event id
+     * \param description description of the transaction
+     * \return fingerprint
+     */
+    static qint64 transactionFingerprint(int giverId, int receiverId, int eventId, const QString &description);
+
+    /*!
+     * \brief Returns a short name of the backend, for reports
+     * \return name
+     */
+    virtual QString getBackendName() const = 0;
+    /*!
+     * \brief Returns the id of the kitty
+     * \param loadFromDb if true, load it again from the storage
+     * \return kitty id
+     */
+    virtual int getKittyId(bool loadFromDb = false) = 0;
+    /*!
+     * \brief Returns the last occurred error
+     * \return error of the last operation
+     */
+    virtual QSqlError getLastError() = 0;
+    /*!
+     * \brief Check if the storage has any entries (besides the kitty user)
+     * \return true if there are no users (but the kitty), events nor transactions
+     */
+    virtual bool isDatabaseEmpty() = 0;
+    /*!
+     * \brief Adds a user
+     * \param newUser New user object, with its password already hashed
+     * \return Id of added user, not valid on error
+     */
+    virtual QVariant addUser(const User &newUser) = 0;
+    /*!
+     * \brief Adds users at once
+     *
+     * Users whose nickname or email (without case) is already used, in the store or by an
+     * earlier user of the batch, are left out instead of failing the whole batch.
+     * \param users New user objects, with their password already hashed
+     * \param skipped if not null, set to the positions in users of those left out
+     * \return Sql error
+     * \sa UserImport
+     */
+    virtual QSqlError addUsers(const QVector<User> &users, QVector<int> *skipped = 0) = 0;
+    /*!
+     * \brief Adds an event
+     * \param newEvent New event object
+     * \return Id of added event, not valid on error
+     */
+    virtual QVariant addEvent(const Event &newEvent) = 0;
+    /*!
+     * \brief Adds a transaction
+     * \param newTransaction New transaction object
+     * \return Id of added transaction, not valid on error
+     */
+    virtual QVariant addTransaction(const Transaction &newTransaction) = 0;
+    /*!
+     * \brief Sets how addTransaction() and importTransactions() handle duplicates
+     * \param check action and window of the matches, off by default
+     */
+    virtual void setDuplicateCheck(const DuplicateCheck &check) = 0;
+    /*!
+     * \brief Returns how addTransaction() and importTransactions() handle duplicates
+     * \return action and window of the matches
+     */
+    virtual DuplicateCheck getDuplicateCheck() const = 0;
+    /*!
+     * \brief Returns the transaction matched by the last addTransaction() with the duplicate check on
+     * \return transaction id, -1 if none
+     */
+    virtual int getLastDuplicate() const = 0;
+    /*!
+     * \brief Looks for a transaction matching a new one, within the window of getDuplicateCheck()
+     * \param transaction new transaction
+     * \return id of the oldest matching transaction, -1 if none
+     */
+    virtual int findDuplicateTransaction(const Transaction &transaction) = 0;
+    /*!
+     * \brief Adds transactions at once, handling duplicates as set with setDuplicateCheck()
+     *
+     * Each transaction is matched against the existing ones and the ones before it.
+     * \param transactions New transactions in the currency of their event
+     * \param duplicates set to the positions of the transactions matching an existing or previous one
+     * \return Sql error
+     */
+    virtual QSqlError importTransactions(const QVector<Transaction> &transactions, QVector<int> *duplicates = 0) = 0;
+    /*!
+     * \brief Reads transactions of an event in CSV format: date,giver,receiver,amount[,place[,description]]
+     *
+     * The users are given by nickname and the date as yyyy-MM-dd, or empty. A first line starting
+     * with "date" is taken as header. Lines which would not pass the checks of the new transaction
+     * dialog are skipped.
+     * \param device opened device with the transactions
+     * \param eventId Event of the transactions
+     * \param errors description of the skipped lines
+     * \return valid transactions
+     */
+    QVector<Transaction> readTransactions(QIODevice *device, int eventId, QStringList *errors);
+    /*!
+     * \brief Adds example users, an event with its exchange rates and transactions
+     * \return error of the last add
+     */
+    QSqlError initExampleDatabase();
+    /*!
+     * \brief Deletes a transaction
+     * \param transactionId Transaction to be deleted
+     * \return Sql error
+     */
+    virtual QSqlError deleteTransaction(int transactionId) = 0;
+    /*!
+     * \brief Deletes a set of transactions at once
+     * \param transactionIds Transactions to be deleted
+     * \return Sql error
+     */
+    virtual QSqlError deleteTransactions(const QVector<int> &transactionIds) = 0;
+    /*!
+     * \brief Deletes an event, keeping its transactions
+     * \param eventId event to be deleted
+     * \return Sql error
+     */
+    virtual QSqlError deleteEvent(int eventId) = 0;
+    /*!
+     * \brief Deletes an event and all its transactions and split expenses
+     * \param eventId event to be deleted
+     * \return Sql error
+     */
+    virtual QSqlError deleteEventCascade(int eventId) = 0;
+    /*!
+     * \brief Deletes a user, keeping its transactions
+     * \param userId user to be deleted
+     * \return Sql error
+     */
+    virtual QSqlError deleteUser(int userId) = 0;
+    /*!
+     * \brief Deletes a user, its transactions and the events it administers
+     *
+     * The split expenses it pays are deleted, and its share removed from the others.
+     * \param userId user to be deleted
+     * \return Sql error
+     */
+    virtual QSqlError deleteUserCascade(int userId) = 0;
+    /*!
+     * \brief Returns transaction with that id
+     * \param id Transaction id
+     * \return Transaction object, with id -1 if not found
+     */
+    virtual Transaction getTransaction(int id) = 0;
+    /*!
+     * \brief Returns event with that id
+     * \param id Event id
+     * \return Event object, with id -1 if not found
+     */
+    virtual Event getEvent(int id) = 0;
+    /*!
+     * \brief Returns user with that id
+     * \param id User id
+     * \return User object, with id -1 if not found
+     */
+    virtual User getUser(int id) = 0;
+    /*!
+     * \brief Returns all the users
+     * \return users, the kitty included, ordered by id
+     */
+    virtual QVector<User> getUsers() = 0;
+    /*!
+     * \brief Returns all the events
+     * \return events, ordered by name and id
+     */
+    virtual QVector<Event> getEvents() = 0;
+    /*!
+     * \brief Returns the events with transactions or split expenses
+     * \return events, ordered by name and id
+     */
+    virtual QVector<Event> getEventsWithTransactions() = 0;
+    /*!
+     * \brief Returns the prefix search index of the users
+     * \return user index, kept up to date on user add and delete
+     */
+    virtual const UserIndex &getUserIndex() = 0;
+    /*!
+     * \brief Returns how many events a user administers
+     * \param userId User id
+     * \return Number of events
+     */
+    virtual int getNumEventsOfUser(int userId) = 0;
+    /*!
+     * \brief Returns how many transactions does a user and/or an event have
+     * \param userId User id (-1 or not given to match any user)
+     * \param eventId Event id (-1 or not given to match any event)
+     * \return Number of transactions, 0 if neither is given
+     */
+    virtual int getNumTransactions(int userId = -1, int eventId = -1) = 0;
+    /*!
+     * \brief Calculates the money in the Kitty of an event: inflows minus withdrawals
+     * \param eventId Event id
+     * \return Amount of money, -1 on error
+     */
+    virtual double calcAmountKitty(int eventId) = 0;
+    /*!
+     * \brief Returns the amount of money given from one user to another in an event
+     * \param eventId Event id
+     * \param userGivingId User giving the money
+     * \param userReceivingId User receiving the money
+     * \return Amount of money, in the currency of the event
+     */
+    virtual double getAmountBetween(int eventId, int userGivingId, int userReceivingId) = 0;
+    /*!
+     * \brief Returns the users giving money in the transactions of an event, the split expenses left out
+     * \param eventId Event id
+     * \return user ids
+     */
+    virtual QList<int> getUsersGiving(int eventId) = 0;
+    /*!
+     * \brief Returns the users receiving money from a user in the transactions of an event
+     * \param eventId Event id
+     * \param userGivingId User giving the money
+     * \return user ids
+     */
+    virtual QList<int> getUsersReceiving(int eventId, int userGivingId) = 0;
+    /*!
+     * \brief Returns the number of users with transactions in an event, the kitty excluded
+     * \param eventId Event id
+     * \return Number of users
+     */
+    virtual int calcNumUsers(int eventId) = 0;
+    /*!
+     * \brief Returns the totals of an event
+     * \param eventId Event id
+     * \return summary, all zero if the event has no transactions
+     */
+    virtual EventSummary getEventSummary(int eventId) = 0;
+    /*!
+     * \brief Returns the balance of the Kitty of an event day by day, e.g. for charts
+     * \param eventId Event id
+     * \return one point per day with kitty transactions, ordered by date (undated transactions first)
+     */
+    virtual QVector<KittyBalancePoint> getKittyBalanceSeries(int eventId) = 0;
+    /*!
+     * \brief Returns the money given in an event day by day
+     * \param eventId Event id
+     * \param userId User giving the money (-1 or not given to match any user)
+     * \return one point per day with transactions, ordered by date (undated transactions first)
+     */
+    virtual QVector<SpendingPoint> getSpendingSeries(int eventId, int userId = -1) = 0;
+    /*!
+     * \brief Returns the users who gave the most money in an event
+     * \param eventId Event id
+     * \param limit maximum number of users
+     * \return totals of the users, the kitty excluded, the largest given first
+     */
+    virtual QVector<SpenderTotal> getTopSpenders(int eventId, int limit = 10) = 0;
+    /*!
+     * \brief Returns the places where the most money was spent in an event
+     * \param eventId Event id
+     * \param limit maximum number of places
+     * \return totals of the places, the transactions without place excluded, the largest first
+     */
+    virtual QVector<PlaceTotal> getTopPlaces(int eventId, int limit = 10) = 0;
+    /*!
+     * \brief Returns the distribution of the amounts given
+     * \param eventId Event id (-1 or not given to match any event)
+     * \param userId User giving the money (-1 or not given to match any user)
+     * \return sketch of the amounts as recorded, not converted to the currency of the event and without the split expenses
+     */
+    virtual AmountSketch getAmountSketch(int eventId = -1, int userId = -1) = 0;
+    /*!
+     * \brief Returns the transactions between two dates, ordered by date and id
+     * \param from first date (included)
+     * \param to last date (included)
+     * \param eventId Event id (-1 or not given to match any event)
+     * \return transactions, the undated ones excluded
+     */
+    virtual QVector<Transaction> getTransactionsBetween(QDate from, QDate to, int eventId = -1) = 0;
+    /*!
+     * \brief Returns the total amount of the transactions between two dates
+     * \param from first date (included)
+     * \param to last date (included)
+     * \param eventId Event id (-1 or not given to match any event)
+     * \return Amount of money
+     */
+    virtual double sumBetween(QDate from, QDate to, int eventId = -1) = 0;
+    /*!
+     * \brief Returns the balance of a user in an event up to a date
+     *
+     * The balance is the money given minus the money received (positive if the user is owed money).
+     * Undated transactions are not counted.
+     * \param eventId Event id
+     * \param userId User id
+     * \param date last date (included)
+     * \return balance
+     */
+    virtual double getBalanceAsOf(int eventId, int userId, QDate date) = 0;
+    /*!
+     * \brief Returns the balances of all the users of an event up to a date
+     * \param eventId Event id
+     * \param date last date (included)
+     * \return balance of each user id
+     * \sa getBalanceAsOf()
+     */
+    virtual QHash<int, double> getBalancesAsOf(int eventId, QDate date) = 0;
+    /*!
+     * \brief Returns the balances of the users of a set of events, to settle them together with Settlement::net()
+     * \param eventIds Event ids
+     * \return balances of each event with transactions, in the currency of the event
+     */
+    virtual QVector<Settlement::EventBalances> getEventBalances(const QVector<int> &eventIds) = 0;
+    /*!
+     * \brief Marks an event as finished and keeps the snapshot of its calculations
+     * \param eventId Event id
+     * \return Sql error
+     * \sa EventSnapshot
+     */
+    virtual QSqlError finishEvent(int eventId) = 0;
+    /*!
+     * \brief Marks a finished event as ongoing again, dropping its snapshot
+     * \param eventId Event id
+     * \return Sql error
+     */
+    virtual QSqlError reopenEvent(int eventId) = 0;
+    /*!
+     * \brief Returns the snapshot of a finished event, building it if missing
+     *
+     * Adding or deleting transactions or split expenses of the event drops its snapshot.
+     * \param eventId Event id
+     * \param snapshot snapshot of the event
+     * \return true if the event is finished and the snapshot could be read
+     */
+    virtual bool getEventSnapshot(int eventId, EventSnapshot *snapshot) = 0;
+    /*!
+     * \brief Returns the currency of an event
+     * \param eventId Event id
+     * \return ISO 4217 code, defaultCurrency() if not found
+     */
+    virtual QString getEventCurrency(int eventId) = 0;
+    /*!
+     * \brief Returns true if amounts in a currency can be converted to the currency of an event
+     *
+     * addTransaction() rejects the transactions in a currency which cannot be converted.
+     * \param eventId Event id
+     * \param currency ISO 4217 code, empty for the currency of the event
+     * \return true if it is the currency of the event or has exchange rates to it
+     */
+    virtual bool isCurrencyConvertible(int eventId, const QString &currency) = 0;
+    /*!
+     * \brief Adds exchange rates, the totals are given with them from then on
+     * \param rates rates, replacing those of the same currencies and day
+     * \return Sql error
+     * \sa CurrencyConverter::readRates()
+     */
+    virtual QSqlError importExchangeRates(const QVector<CurrencyConverter::Rate> &rates) = 0;
+    /*!
+     * \brief Returns the transactions of an event with their amounts in the currency of the event
+     *
+     * The split expenses are expanded with SplitExpense::expand().
+     * \param eventId Event id
+     * \return transactions, ordered by date (undated first) and id, the expanded ones without id
+     */
+    virtual QVector<Transaction> getEventTransactions(int eventId) = 0;
+    /*!
+     * \brief Adds a split expense, unless its currency cannot be converted like addTransaction()
+     *
+     * The totals and balances of its event count the transactions it expands to.
+     * \param split New split expense, with its shares
+     * \return Id of added split expense, not valid on error
+     */
+    virtual QVariant addSplit(const SplitExpense &split) = 0;
+    /*!
+     * \brief Deletes a split expense
+     * \param splitId split expense to be deleted
+     * \return Sql error
+     */
+    virtual QSqlError deleteSplit(int splitId) = 0;
+    /*!
+     * \brief Returns the split expenses of an event
+     * \param eventId Event id
+     * \return split expenses with their shares, ordered by date and id
+     */
+    virtual QVector<SplitExpense> getEventSplits(int eventId) = 0;
+    /*!
+     * \brief Returns how many split expenses an event has
+     * \param eventId Event id (-1 or not given to match any event)
+     * \return Number of split expenses
+     */
+    virtual int getNumSplits(int eventId = -1) = 0;
+    /*!
+     * \brief Returns how many split expenses a user pays or has a share of
+     *
+     * deleteUserCascade() deletes those it pays and removes its share from the others.
+     * \param userId User id
+     * \return Number of split expenses
+     */
+    virtual int getNumSplitsOfUser(int userId) = 0;
+
+    /*!
+     * \brief Times the adds, the aggregates and the deletes of an event with many transactions
+     * \param store store, with the kitty only or empty
+     * \param transactions number of transactions of the event
+     * \return report
+     */
+    static QString benchmark(LedgerStore &store, int transactions);
+
+protected:
+    /*!
+     * \brief Adds up the totals of an event from its transactions
+     * \param transactions transactions of the event, e.g. from getEventTransactions()
+     * \param kittyId id of the kitty
+     * \return totals
+     */
+    static EventSummary summaryOf(const QVector<Transaction> &transactions, int kittyId);
+    /*!
+     * \brief Adds up the movements of the kitty day by day
+     * \param transactions transactions of the event, e.g. from getEventTransactions()
+     * \param kittyId id of the kitty
+     * \return see getKittyBalanceSeries()
+     */
+    static QVector<KittyBalancePoint> kittyBalanceSeriesOf(const QVector<Transaction> &transactions, int kittyId);
+    /*!
+     * \brief Adds up the money given day by day
+     * \param transactions transactions of the event, e.g. from getEventTransactions()
+     * \param userId User giving the money, -1 to match any user
+     * \return see getSpendingSeries()
+     */
+    static QVector<SpendingPoint> spendingSeriesOf(const QVector<Transaction> &transactions, int userId);
+    /*!
+     * \brief Adds up the money given and received by each user
+     * \param transactions transactions of the event, e.g. from getEventTransactions()
+     * \param kittyId id of the kitty
+     * \param limit maximum number of users
+     * \return see getTopSpenders()
+     */
+    static QVector<SpenderTotal> topSpendersOf(const QVector<Transaction> &transactions, int kittyId, int limit);
+    /*!
+     * \brief Adds up the money spent at each place
+     * \param transactions transactions of the event, e.g. from getEventTransactions()
+     * \param limit maximum number of places
+     * \return see getTopPlaces()
+     */
+    static QVector<PlaceTotal> topPlacesOf(const QVector<Transaction> &transactions, int limit);
+};
+
+#endif // LEDGERSTORE_H
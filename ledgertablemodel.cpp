@@ -0,0 +1,157 @@
+#include "ledgertablemodel.h"
+
+namespace {
+
+/*!
+ * Returns a date as the day number stored in the sql tables, null if the date is not set
+ */
+QVariant dayNumber(const QDate &date)
+{
+    return date.isValid() ? QVariant(date.toJulianDay()) : QVariant();
+}
+
+/*!
+ * Returns a text as stored in the sql tables, null if empty
+ */
+QVariant textOrNull(const QString &text)
+{
+    return text.isEmpty() ? QVariant() : QVariant(text);
+}
+
+}
+
+/*!
+ * LedgerTableModel constructor
+ */
+LedgerTableModel::LedgerTableModel(LedgerStore *store, QObject *parent) :
+    QStandardItemModel(parent),
+    store(store)
+{
+}
+
+/*!
+ * Sets the table read on the next select(). The columns follow the sql schema of DataBase,
+ * the shares of the split expenses left out.
+ */
+void LedgerTableModel::setTable(const QString &tableName)
+{
+    table = tableName;
+    if(table == QLatin1String("users"))
+        fields = QStringList() << "id" << "name" << "nickname" << "email" << "passwordhash" << "passwordsalt" << "birthdate";
+    else if(table == QLatin1String("events"))
+        fields = QStringList() << "id" << "name" << "creation" << "place" << "description" << "finished" << "admin" << "currency";
+    else if(table == QLatin1String("transactions"))
+        fields = QStringList() << "id" << "usergives" << "userreceives" << "event" << "amount" << "transactionDate" << "place" << "description" << "currency";
+    else if(table == QLatin1String("splits"))
+        fields = QStringList() << "id" << "payer" << "event" << "amount" << "splitDate" << "place" << "description" << "currency";
+    else
+        fields.clear();
+
+    clear();
+    setColumnCount(fields.size());
+    setHorizontalHeaderLabels(fields);
+}
+
+/*!
+ * Populates the model with the rows matching the filter. The transactions and split expenses
+ * are read event by event, in the order of the events.
+ */
+bool LedgerTableModel::select()
+{
+    // The header captions set since setTable() are kept
+    removeRows(0, rowCount());
+    if(fields.isEmpty())
+    {
+        error = QSqlError("Unknown table", table, QSqlError::StatementError);
+        return false;
+    }
+
+    QHash<int, QString> nicknames;
+    QVector<User> users = store->getUsers();
+    foreach(const User &user, users)
+        nicknames.insert(user.getId(), user.getNickname());
+    QHash<int, QString> eventNames;
+    QVector<Event> events = store->getEvents();
+    foreach(const Event &event, events)
+        eventNames.insert(event.getId(), event.getName());
+
+    QHash<QString, QHash<int, QString> > names;
+    names.insert("admin", nicknames);
+    names.insert("payer", nicknames);
+    names.insert("usergives", nicknames);
+    names.insert("userreceives", nicknames);
+    names.insert("event", eventNames);
+
+    if(table == QLatin1String("users"))
+    {
+        foreach(const User &user, users)
+        {
+            appendRecord(QVariantList() << user.getId() << textOrNull(user.getName()) << user.getNickname() << user.getEmail()
+                                        << user.getPasswordHash() << user.getPasswordSalt() << dayNumber(user.getBirthdate()), names);
+        }
+    }
+    else if(table == QLatin1String("events"))
+    {
+        foreach(const Event &event, events)
+        {
+            appendRecord(QVariantList() << event.getId() << event.getName() << dayNumber(event.getCreationDate())
+                                        << textOrNull(event.getPlace()) << textOrNull(event.getDescription())
+                                        << (event.isFinished() ? 1 : 0) << event.getAdmin().getId()
+                                        << store->getEventCurrency(event.getId()), names);
+        }
+    }
+    else if(table == QLatin1String("transactions"))
+    {
+        foreach(const Event &event, events)
+        {
+            foreach(const Transaction &transaction, store->getEventTransactions(event.getId()))
+            {
+                appendRecord(QVariantList() << transaction.getId() << transaction.getUserGiving().getId()
+                                            << transaction.getUserReceiving().getId() << event.getId() << transaction.getAmount()
+                                            << dayNumber(transaction.getDate()) << textOrNull(transaction.getPlace())
+                                            << textOrNull(transaction.getDescription()) << textOrNull(transaction.getCurrency()), names);
+            }
+        }
+    }
+    else
+    {
+        foreach(const Event &event, events)
+        {
+            foreach(const SplitExpense &split, store->getEventSplits(event.getId()))
+            {
+                appendRecord(QVariantList() << split.getId() << split.getPayer().getId() << event.getId() << split.getAmount()
+                                            << dayNumber(split.getDate()) << textOrNull(split.getPlace())
+                                            << textOrNull(split.getDescription()) << textOrNull(split.getCurrency()), names);
+            }
+        }
+    }
+
+    error = store->getLastError();
+    return error.type() == QSqlError::NoError;
+}
+
+/*!
+ * Appends a row if it matches the filter. The filter sees the ids, the view the names.
+ */
+void LedgerTableModel::appendRecord(const QVariantList &values, const QHash<QString, QHash<int, QString> > &names)
+{
+    QVariantHash row;
+    for(int column = 0; column < fields.size(); column++)
+        row.insert(fields.at(column), values.at(column));
+    if(!sqlFilter.matches(row))
+        return;
+
+    QList<QStandardItem *> items;
+    for(int column = 0; column < fields.size(); column++)
+    {
+        QStandardItem *item = new QStandardItem();
+        QHash<QString, QHash<int, QString> >::const_iterator relation = names.constFind(fields.at(column));
+        if(relation != names.constEnd())
+            item->setData(relation->value(values.at(column).toInt()), Qt::DisplayRole);
+        else
+            item->setData(values.at(column), Qt::DisplayRole);
+        item->setEditable(false);
+        items << item;
+    }
+    appendRow(items);
+}
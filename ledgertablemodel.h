@@ -0,0 +1,74 @@
+#ifndef LEDGERTABLEMODEL_H
+#define LEDGERTABLEMODEL_H
+
+#include <QStandardItemModel>
+#include "ledgerstore.h"
+#include "sqlfilter.h"
+
+/*!
+ * \brief Read-only table of the users, events, transactions or split expenses of a LedgerStore
+ *
+ * Stands for SqlFilterTableModel when the ledger is not an sql database. The columns are the
+ * ones of the sql table of the same name, in the same order, and the rows are matched against
+ * an SqlFilter with SqlFilter::matches(). The users and events referenced by id are shown by
+ * their nickname and name, as the relations set on the sql models do.
+ */
+class LedgerTableModel : public QStandardItemModel
+{
+    Q_OBJECT
+
+public:
+    /*!
+     * \brief LedgerTableModel constructor
+     * \param store store the rows are read from
+     * \param parent parent object
+     */
+    LedgerTableModel(LedgerStore *store, QObject *parent = 0);
+    /*!
+     * \brief Sets the table read on the next select(), with its columns as header captions
+     * \param tableName "users", "events", "transactions" or "splits"
+     */
+    void setTable(const QString &tableName);
+    /*!
+     * \brief Sets the filter applied on the next select()
+     * \param filter filter expression, InSelect comparisons never match
+     */
+    void setSqlFilter(const SqlFilter &filter) {sqlFilter = filter;}
+    /*!
+     * \brief Returns the column of a field of the table
+     * \param fieldName column name in the sql table
+     * \return column, -1 if not found
+     */
+    int fieldIndex(const QString &fieldName) const {return fields.indexOf(fieldName);}
+    /*!
+     * \brief Populates the model with the rows matching the filter
+     * \return true if success, false if the table is unknown or the store failed
+     */
+    bool select();
+    /*!
+     * \brief Returns the error of the last select()
+     * \return error of the store, or of an unknown table
+     */
+    QSqlError lastError() const {return error;}
+
+private:
+    /*!
+     * \brief Appends a row if it matches the filter
+     * \param values value of each column, the ids of related records included
+     * \param names shown name of the related records of each column, by id
+     */
+    void appendRecord(const QVariantList &values, const QHash<QString, QHash<int, QString> > &names);
+
+    //! \brief Store the rows are read from
+    LedgerStore *store;
+    //! \brief Table set with setTable()
+    QString table;
+    //! \brief Columns of the table, in order
+    QStringList fields;
+    //! \brief Filter applied on select()
+    SqlFilter sqlFilter;
+    //! \brief Error of the last select()
+    QSqlError error;
+};
+
+#endif // LEDGERTABLEMODEL_H
@@ -1,4 +1,12 @@
 #include "mainwindow.h"
+#include "currencyconverter.h"
+#include "memoryledgerstore.h"
+#include "querystats.h"
+#include "settlement.h"
+#include "sqlfilter.h"
+#include "startupprofile.h"
+#include "trace.h"
+#include "userimport.h"
 #include <QApplication>
 
 /*!
@@ -9,9 +17,142 @@
  */
 int main(int argc, char *argv[])
 {
+    Trace::init(); // CHEAPYAPP_TRACE=<file.json> writes a Chrome trace-event file on exit
+
     QApplication a(argc, argv);
-    MainWindow w;
+    QApplication::setApplicationName("CheapyApp");
+    QApplication::setApplicationVersion(QString("%1.%2.%3").arg(VERSION_MAJOR).arg(VERSION_MINOR).arg(VERSION_BUILD));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Managing economic transactions among users for events");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption queryStatsOption("query-stats", "Print the statistics of the executed sql statements on exit.");
+    parser.addOption(queryStatsOption);
+    QCommandLineOption slowQueryOption("slow-query-ms", "Log statements slower than <ms> milliseconds, with their query plan.", "ms");
+    parser.addOption(slowQueryOption);
+    QCommandLineOption inMemoryOption("in-memory", "Keep the database in memory only. Use Export to save it to a file.");
+    parser.addOption(inMemoryOption);
+    QCommandLineOption memoryStoreOption("memory-store", "Keep the ledger in a MemoryLedgerStore instead of an sql database. Nothing is saved, and database files, ledgers and search are not available.");
+    parser.addOption(memoryStoreOption);
+    QCommandLineOption deferredLoadOption("deferred-load", "Show the window before opening the database, which is prepared on a background thread.");
+    parser.addOption(deferredLoadOption);
+    QCommandLineOption startupTimingsOption("startup-timings", "Print the timings of the startup phases on exit.");
+    parser.addOption(startupTimingsOption);
+    QCommandLineOption benchmarkImportOption("benchmark-user-import", "Print the password hashing throughput of a bulk import of <count> users for a growing number of threads, and exit.", "count");
+    parser.addOption(benchmarkImportOption);
+    QCommandLineOption benchmarkFilterOption("benchmark-filter-refresh", "Compare <count> refreshes of a filtered table of a generated in-memory ledger with spliced literals against the cached filter statement, and exit.", "count");
+    parser.addOption(benchmarkFilterOption);
+    QCommandLineOption benchmarkDateRangeOption("benchmark-date-range", "Add an event with <count> transactions, time summing date ranges on indexed day numbers against ISO text dates, and exit.", "count");
+    parser.addOption(benchmarkDateRangeOption);
+    QCommandLineOption benchmarkDeleteOption("benchmark-delete-event", "Add an event with <count> transactions, time its cascading delete against deleting the transactions one by one, and exit.", "count");
+    parser.addOption(benchmarkDeleteOption);
+    QCommandLineOption benchmarkSplitsOption("benchmark-split-expenses", "Record <count> expenses for groups of 6 and 30 users as split expenses and as pairwise transactions, compare their insert time, storage and totals, and exit.", "count");
+    parser.addOption(benchmarkSplitsOption);
+    QCommandLineOption benchmarkSearchOption("benchmark-transaction-search", "Add <count> transactions, time searching their descriptions and places with the full-text index against a scan, and exit.", "count");
+    parser.addOption(benchmarkSearchOption);
+    QCommandLineOption benchmarkImportTransactionsOption("benchmark-transaction-import", "Import <count> transactions into an event with as many, with the duplicate check off and on, print the timings, and exit.", "count");
+    parser.addOption(benchmarkImportTransactionsOption);
+    QCommandLineOption benchmarkStoresOption("benchmark-ledger-stores", "Time the operations of every storage backend on an event with <count> transactions, and exit.", "count");
+    parser.addOption(benchmarkStoresOption);
+    QCommandLineOption benchmarkCurrencyOption("benchmark-currency-conversion", "Convert <count> amounts in mixed currencies with the batch kernel and with a rate lookup per row, print the timings, and exit.", "count");
+    parser.addOption(benchmarkCurrencyOption);
+    QCommandLineOption benchmarkNettingOption("benchmark-global-settlement", "Net the balances of <count> generated events on one thread and on the thread pool, print the timings and the payments saved, and exit.", "count");
+    parser.addOption(benchmarkNettingOption);
+    parser.process(a);
+
+    if(parser.isSet(benchmarkImportOption))
+    {
+        QTextStream(stdout) << UserImport::benchmark(parser.value(benchmarkImportOption).toInt());
+        return 0;
+    }
+    if(parser.isSet(benchmarkFilterOption))
+    {
+        DataBase db(true, DataBase::memoryPath());
+        db.initExampleDatabase();
+        QTextStream(stdout) << SqlFilter::benchmark(db, parser.value(benchmarkFilterOption).toInt());
+        return 0;
+    }
+    if(parser.isSet(benchmarkDateRangeOption))
+    {
+        DataBase db(true, DataBase::memoryPath());
+        db.initExampleDatabase();
+        QTextStream(stdout) << db.benchmarkDateRange(parser.value(benchmarkDateRangeOption).toInt());
+        return 0;
+    }
+    if(parser.isSet(benchmarkDeleteOption))
+    {
+        DataBase db(true, DataBase::memoryPath());
+        db.initExampleDatabase();
+        QTextStream(stdout) << db.benchmarkDeleteEvent(parser.value(benchmarkDeleteOption).toInt());
+        return 0;
+    }
+    if(parser.isSet(benchmarkCurrencyOption))
+    {
+        QTextStream(stdout) << CurrencyConverter::benchmark(parser.value(benchmarkCurrencyOption).toInt());
+        return 0;
+    }
+    if(parser.isSet(benchmarkNettingOption))
+    {
+        QTextStream(stdout) << Settlement::benchmark(parser.value(benchmarkNettingOption).toInt());
+        return 0;
+    }
+    if(parser.isSet(benchmarkSplitsOption))
+    {
+        DataBase db(true, DataBase::memoryPath());
+        QTextStream(stdout) << db.benchmarkSplitExpenses(parser.value(benchmarkSplitsOption).toInt());
+        return 0;
+    }
+    if(parser.isSet(benchmarkSearchOption))
+    {
+        DataBase db(true, DataBase::memoryPath());
+        db.initExampleDatabase();
+        QTextStream(stdout) << db.benchmarkTransactionSearch(parser.value(benchmarkSearchOption).toInt());
+        return 0;
+    }
+    if(parser.isSet(benchmarkImportTransactionsOption))
+    {
+        DataBase db(true, DataBase::memoryPath());
+        db.initExampleDatabase();
+        QTextStream(stdout) << db.benchmarkTransactionImport(parser.value(benchmarkImportTransactionsOption).toInt());
+        return 0;
+    }
+    if(parser.isSet(benchmarkStoresOption))
+    {
+        DataBase db(true, DataBase::memoryPath());
+        MemoryLedgerStore memory;
+        QList<LedgerStore *> stores;
+        stores << &db << &memory;
+
+        QTextStream out(stdout);
+        foreach (LedgerStore *store, stores)
+            out << LedgerStore::benchmark(*store, parser.value(benchmarkStoresOption).toInt());
+        return 0;
+    }
+
+    if(parser.isSet(slowQueryOption))
+        QueryStats::instance().setSlowQueryThreshold(parser.value(slowQueryOption).toInt());
+
+    // The window owns the store. An in-memory database is opened right away, there is no file to prepare
+    bool inMemory = parser.isSet(inMemoryOption);
+    bool deferredLoad = parser.isSet(deferredLoadOption) && !inMemory;
+    LedgerStore *store;
+    if(parser.isSet(memoryStoreOption))
+        store = new MemoryLedgerStore();
+    else
+        store = new DataBase(!deferredLoad, inMemory ? DataBase::memoryPath() : QString());
+
+    MainWindow w(store, 0, deferredLoad);
     w.show();
 
-    return a.exec();
+    int result = a.exec();
+
+    if(parser.isSet(startupTimingsOption))
+        QTextStream(stdout) << StartupProfile::report();
+    if(parser.isSet(queryStatsOption))
+        QTextStream(stdout) << QueryStats::instance().report();
+
+    Trace::write();
+
+    return result;
 }
@@ -1,29 +1,52 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "daynumberdelegate.h"
+#include "ledgertablemodel.h"
+#include "querystats.h"
+#include "sqlfiltertablemodel.h"
+#include "startupprofile.h"
+#include "trace.h"
+#include "userimport.h"
+#include "userpicker.h"
 
 #include <QtSql>
 #include <QtDebug>
+#include <QtConcurrent>
 
 /*!
  * MainWindow constructor
  *
- * Initializes the UI, the database and connects signals with slots
+ * Initializes the UI with the given store and connects signals with slots. A database is the
+ * first open ledger, any other store is the only one and has no ledger files.
  */
-MainWindow::MainWindow(QWidget *parent) :
+MainWindow::MainWindow(LedgerStore *ledgerStore, QWidget *parent, bool deferredLoad) :
     QMainWindow(parent),
-    ui(new Ui::MainWindow)
+    ui(new Ui::MainWindow),
+    db(dynamic_cast<DataBase *>(ledgerStore)),
+    store(ledgerStore),
+    avatarModel(0),
+    initialDataLoaded(false),
+    globalModel(0)
 {
     ui->setupUi(this);
 
-    QString windowTitle = QString("CheapyApp");
-    this->setWindowTitle(windowTitle);
+    // Kept by the users table, only its source model is replaced on every reload
+    avatarModel = new AvatarProxyModel(&avatarCache, -1, -1, ui->tvTable);
+
+    if(db)
+        ledgers << db;
+    ledgerActions = new QActionGroup(this);
+    updateLedgerMenu();
+
+    // Only a database file is prepared on a worker thread
+    deferredLoad = deferredLoad && db;
 
-    if (!QSqlDatabase::drivers().contains("QSQLITE"))
+    if (db && !QSqlDatabase::drivers().contains("QSQLITE"))
         QMessageBox::critical(this, "Unable to load database", "This demo needs the SQLITE driver");
 
     // initialize the database
-    if(db.getLastError().type() != QSqlError::NoError) {
-        showError(db.getLastError());
+    if(!deferredLoad && store->getLastError().type() != QSqlError::NoError) {
+        showError(store->getLastError());
         return;
     }
 
@@ -31,6 +54,14 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->rbUsers,SIGNAL(clicked(bool)),this,SLOT(showTable()));
     connect(ui->rbKittyTransactions,SIGNAL(clicked(bool)),this,SLOT(showTable()));
     connect(ui->rbPersonalTransactions,SIGNAL(clicked(bool)),this,SLOT(showTable()));
+    connect(ui->rbSplitExpenses,SIGNAL(clicked(bool)),this,SLOT(showTable()));
+
+    searchTimer = new QTimer(this);
+    searchTimer->setSingleShot(true);
+    searchTimer->setInterval(250);
+    connect(ui->leSearch, SIGNAL(textChanged(QString)), searchTimer, SLOT(start()));
+    connect(ui->leSearch, &QLineEdit::returnPressed, this, &MainWindow::searchTransactions);
+    connect(searchTimer, &QTimer::timeout, this, &MainWindow::searchTransactions);
 
     connect(ui->tabWidget,SIGNAL(currentChanged(int)),this, SLOT(tabSelected(int)));
 
@@ -41,22 +72,97 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->actionAddEvent, &QAction::triggered, this, &MainWindow::newEvent);
     connect(ui->actionAddUser, &QAction::triggered, this, &MainWindow::newUser);
     connect(ui->actionAddTransaction, &QAction::triggered, this, &MainWindow::newTransaction);
+    connect(ui->actionAddSplitExpense, &QAction::triggered, this, &MainWindow::newSplitExpense);
     connect(ui->actionDeleteEvent, &QAction::triggered, this, &MainWindow::deleteEvent);
     connect(ui->actionDeleteUser, &QAction::triggered, this, &MainWindow::deleteUser);
     connect(ui->actionDeleteTransaction, &QAction::triggered, this, &MainWindow::deleteTransaction);
+    connect(ui->actionDeleteSplitExpense, &QAction::triggered, this, &MainWindow::deleteSplitExpense);
+    connect(ui->actionFinishEvent, &QAction::triggered, this, &MainWindow::finishEvent);
+    connect(ui->actionReopenEvent, &QAction::triggered, this, &MainWindow::reopenEvent);
+    connect(ui->actionSpendingAnalytics, &QAction::triggered, this, &MainWindow::showSpendingAnalytics);
+    connect(ui->actionGlobalSettlement, &QAction::triggered, this, &MainWindow::showGlobalSettlement);
 
     connect(ui->actionDeleteDatabase, &QAction::triggered, this, &MainWindow::deleteDatabase);
     connect(ui->actionExampleDatabase, &QAction::triggered, this, &MainWindow::initExampleDatabase);
     connect(ui->actionImportDatabase, &QAction::triggered, this, &MainWindow::importDatabase);
     connect(ui->actionExportDatabase, &QAction::triggered, this, &MainWindow::exportDatabase);
+    connect(ui->actionImportUsers, &QAction::triggered, this, &MainWindow::importUsers);
+    connect(ui->actionImportTransactions, &QAction::triggered, this, &MainWindow::importTransactions);
+    connect(ui->actionImportExchangeRates, &QAction::triggered, this, &MainWindow::importExchangeRates);
+    connect(ui->actionRebuildSearchIndex, &QAction::triggered, this, &MainWindow::rebuildSearchIndex);
+
+    connect(ui->actionOpenLedger, &QAction::triggered, this, &MainWindow::openLedger);
+    connect(ui->actionCloseLedger, &QAction::triggered, this, &MainWindow::closeLedger);
+    connect(ui->actionCompareLedgers, &QAction::triggered, this, &MainWindow::compareLedgers);
 
     connect(ui->actionAbout, &QAction::triggered, this, &MainWindow::showAboutDialog);
+    connect(ui->actionDiagnostics, &QAction::triggered, this, &MainWindow::showDiagnosticsDialog);
 
     connect(ui->tvEventTransactions, SIGNAL(doubleClicked(QModelIndex)), this, SLOT(selectTransaction(QModelIndex)));
 
     connect(ui->tvTable, SIGNAL(doubleClicked(QModelIndex)), this, SLOT(showUser(QModelIndex)));
+    connect(&avatarCache, &AvatarCache::avatarReady, this, &MainWindow::showAvatar);
+    connect(ui->tvTable->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(prefetchAvatars()));
+
+    if(deferredLoad)
+    {
+        // Show the window first and prepare the database file on a worker thread
+        ui->centralWidget->setEnabled(false);
+        ui->menuBar->setEnabled(false);
+        ui->statusBar->showMessage("Opening database...");
+
+        QFutureWatcher<DataBase::StartupState> *watcher = new QFutureWatcher<DataBase::StartupState>(this);
+        connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher]() {
+            finishDeferredLoad(watcher->result());
+            watcher->deleteLater();
+        });
+        watcher->setFuture(QtConcurrent::run(&DataBase::prepareFile, db->getDbPath()));
+        return;
+    }
 
     checkDatabaseActions(); // Depending on the loaded database, some actions are disabled
+    tabSelected(ui->tabWidget->currentIndex());
+    initialDataLoaded = true; // FirstData is marked when the window is painted with it
+}
+
+/*!
+ * Finishes the deferred loading once the database file has been prepared
+ *
+ * The worker connection has already created or migrated the schema, checked if the database
+ * is empty and read the kitty id. Only the connection used by the GUI is opened here, in the
+ * GUI thread, since Qt connections cannot be shared among threads; the initial tab is then
+ * read through it.
+ */
+void MainWindow::finishDeferredLoad(const DataBase::StartupState &state)
+{
+    TRACE_FUNCTION();
+    ui->statusBar->clearMessage();
+
+    QSqlError err = db->init(state);
+    if(err.type() != QSqlError::NoError) {
+        showError(err);
+        return;
+    }
+
+    ui->centralWidget->setEnabled(true);
+    ui->menuBar->setEnabled(true);
+
+    checkDatabaseActions(state.empty); // Depending on the loaded database, some actions are disabled
+    tabSelected(ui->tabWidget->currentIndex());
+    initialDataLoaded = true;
+    update(); // FirstData is marked when the window is painted with it
+}
+
+/*!
+ * Records the first paint of the window in the startup profile, and the first one once the
+ * initial tab has been loaded
+ */
+void MainWindow::paintEvent(QPaintEvent *event)
+{
+    QMainWindow::paintEvent(event);
+    StartupProfile::mark(StartupProfile::FirstPaint);
+    if(initialDataLoaded)
+        StartupProfile::mark(StartupProfile::FirstData);
 }
 
 /*!
@@ -67,7 +173,16 @@ MainWindow::MainWindow(QWidget *parent) :
  */
 void MainWindow::checkDatabaseActions()
 {
-    if(db.isDatabaseEmpty())
+    checkDatabaseActions(store->isDatabaseEmpty());
+}
+
+/*!
+ * Check if database actions are enabled or disabled, the emptiness of the database being known
+ */
+void MainWindow::checkDatabaseActions(bool empty)
+{
+    TRACE_FUNCTION();
+    if(empty)
     {
         ui->actionExampleDatabase->setEnabled(true);
         ui->actionDeleteDatabase->setEnabled(false);
@@ -81,6 +196,15 @@ void MainWindow::checkDatabaseActions()
         ui->actionImportDatabase->setEnabled(false);
         ui->actionExportDatabase->setEnabled(true);
     }
+    if(!db)
+    {
+        // Database files and the full-text search are there only for a database
+        ui->actionDeleteDatabase->setEnabled(false);
+        ui->actionImportDatabase->setEnabled(false);
+        ui->actionExportDatabase->setEnabled(false);
+    }
+    ui->actionRebuildSearchIndex->setEnabled(db && DataBase::hasFullTextSearch(db->getConnection()));
+    ui->leSearch->setEnabled(db != 0);
 }
 
 /*!
@@ -98,6 +222,11 @@ void MainWindow::showError(const QSqlError &err)
 MainWindow::~MainWindow()
 {
     delete ui;
+    // The views and their models go before the connections they read from
+    delete centralWidget();
+    qDeleteAll(ledgers);
+    if(!db)
+        delete store;
 }
 
 // _____Tab Tables_____
@@ -106,12 +235,19 @@ MainWindow::~MainWindow()
  */
 void MainWindow::showTable()
 {
+    TRACE_FUNCTION();
+    // A table chosen by the user replaces the search results
+    bool oldState = ui->leSearch->blockSignals(true);
+    ui->leSearch->clear();
+    ui->leSearch->blockSignals(oldState);
+    searchTimer->stop();
+
     if(sender() == ui->rbEvents)
     {
         loadEventsToTable(ui->tvTable);
 
         ui->tvTable->setEditTriggers(0);
-        ui->tvTable->setColumnHidden(globalModel->fieldIndex("id"), true);
+        ui->tvTable->setColumnHidden(fieldIndex("id"), true);
         ui->tvTable->setSelectionMode(QAbstractItemView::SingleSelection);
     }
     else if(sender() == ui->rbUsers)
@@ -119,8 +255,11 @@ void MainWindow::showTable()
         loadUsersToTable(ui->tvTable);
 
         ui->tvTable->setEditTriggers(0);
-        ui->tvTable->setColumnHidden(globalModel->fieldIndex("id"), true);
+        ui->tvTable->setColumnHidden(fieldIndex("id"), true);
         ui->tvTable->setSelectionMode(QAbstractItemView::SingleSelection);
+
+        // Rows are laid out once back in the event loop
+        QTimer::singleShot(0, this, SLOT(prefetchAvatars()));
     }
     else if(sender() == ui->rbKittyTransactions)
     {
@@ -138,6 +277,13 @@ void MainWindow::showTable()
         ui->tvTable->setSelectionMode(QAbstractItemView::SingleSelection);
         ui->tvTable->setColumnHidden(2, false);
     }
+    else if(sender() == ui->rbSplitExpenses)
+    {
+        loadSplitsToTable(ui->tvTable);
+
+        ui->tvTable->setEditTriggers(0);
+        ui->tvTable->setSelectionMode(QAbstractItemView::SingleSelection);
+    }
 }
 
 //_____Tab Calculations_____
@@ -146,16 +292,12 @@ void MainWindow::showTable()
  */
 void MainWindow::loadTransactions()
 {
-    // Create the data model
-    QSqlQueryModel *model = new QSqlQueryModel;
-    model->setQuery("SELECT name, id FROM events WHERE events.id IN (SELECT event FROM transactions) GROUP BY name");
-
-    if(model->rowCount() == 0)
-        return;
-
+    TRACE_FUNCTION();
     bool oldState = ui->cmbEvent->blockSignals(true);
-    ui->cmbEvent->setModel(model);
+    bool noEvents = loadEventsToCmb(ui->cmbEvent, store->getEventsWithTransactions());
     ui->cmbEvent->blockSignals(oldState);
+    if(noEvents)
+        return;
 
     updateTransactionUserGiving();
 }
@@ -165,22 +307,32 @@ void MainWindow::loadTransactions()
  */
 void MainWindow::updateTransactionUserGiving()
 {
+    TRACE_FUNCTION();
     int eventId = getIdFromCmb(ui->cmbEvent);
 
-    // Create the data model
-    QSqlQueryModel *model = new QSqlQueryModel;
-    model->setQuery("SELECT nickname, id FROM users WHERE users.id IN "
-                                "(SELECT usergives FROM transactions WHERE transactions.event = " + QString::number(eventId) +
-                                ") GROUP BY nickname");
+    // Finished events are served from their snapshot, ongoing ones with split expenses from
+    // one built on the fly with the shares expanded
+    if(!store->getEventSnapshot(eventId, &eventSnapshot))
+    {
+        if(store->getNumSplits(eventId))
+            eventSnapshot = EventSnapshot::build(eventId, store->getEventTransactions(eventId), store->getKittyId());
+        else
+            eventSnapshot = EventSnapshot();
+    }
 
-    if(model->rowCount() == 0)
-        return;
+    // Amounts of the event are shown in its currency
+    QString currency = " " + store->getEventCurrency(eventId);
+    ui->dsbAmount->setSuffix(currency);
+    ui->dsbAmountKitty->setSuffix(currency);
 
     bool oldState = ui->cmbUserGives->blockSignals(true);
-    ui->cmbUserGives->setModel(model);
+    bool noUsers = loadUserIdsToCmb(ui->cmbUserGives, eventSnapshot.isValid() ? eventSnapshot.getUsersGiving()
+                                                                              : store->getUsersGiving(eventId));
     ui->cmbUserGives->blockSignals(oldState);
+    if(noUsers)
+        return;
 
-    bool noTransactions = loadTransactionsToTable(ui->tvEventTransactions, true, true, QString("event = " + QString::number(eventId)));
+    bool noTransactions = loadTransactionsToTable(ui->tvEventTransactions, true, true, SqlFilter("event", SqlFilter::Equal, eventId));
 
     if(noTransactions)
     {
@@ -191,7 +343,7 @@ void MainWindow::updateTransactionUserGiving()
         return;
     }
 
-    ui->tvEventTransactions->setColumnHidden(globalModel->fieldIndex("Event Name"), true);
+    ui->tvEventTransactions->setColumnHidden(fieldIndex("Event Name"), true);
     ui->tvEventTransactions->setSelectionMode(QAbstractItemView::SingleSelection);
     ui->tvEventTransactions->setSelectionBehavior(QAbstractItemView::SelectRows);
 
@@ -201,8 +353,40 @@ void MainWindow::updateTransactionUserGiving()
             c, QHeaderView::Stretch);
     }
 
-    ui->sbNumUsers->setValue(db.calcNumUsers(eventId));
-    ui->dsbAmountKitty->setValue(db.calcAmountKitty(eventId));
+    if(eventSnapshot.isValid())
+    {
+        ui->sbNumUsers->setValue(eventSnapshot.getNumUsers());
+        ui->dsbAmountKitty->setValue(eventSnapshot.getAmountKitty());
+
+        // Payments which settle the finished event
+        QStringList payments;
+        foreach(const Settlement::Payment &payment, eventSnapshot.getSettlement())
+        {
+            payments << QString("%1 pays %2: %3")
+                        .arg(store->getUserIndex().getRecord(payment.from).nickname)
+                        .arg(store->getUserIndex().getRecord(payment.to).nickname)
+                        .arg(payment.amount, 0, 'f', 2);
+        }
+        ui->sbNumUsers->setToolTip(payments.isEmpty() ? QString("Settled") : "Settlement:\n" + payments.join("\n"));
+    }
+    else
+    {
+        ui->sbNumUsers->setValue(store->calcNumUsers(eventId));
+        ui->dsbAmountKitty->setValue(store->calcAmountKitty(eventId));
+        ui->sbNumUsers->setToolTip(QString());
+    }
+
+    // Kitty balance over the last days of the event
+    QVector<LedgerStore::KittyBalancePoint> kittySeries = store->getKittyBalanceSeries(eventId);
+    QStringList kittyDays;
+    for(int i = qMax(0, kittySeries.size() - 10); i < kittySeries.size(); i++)
+    {
+        const LedgerStore::KittyBalancePoint &point = kittySeries.at(i);
+        kittyDays << QString("%1: +%2 -%3 = %4")
+                     .arg(point.date.isValid() ? point.date.toString(Qt::ISODate) : QString("no date"))
+                     .arg(point.inflow, 0, 'f', 2).arg(point.outflow, 0, 'f', 2).arg(point.balance, 0, 'f', 2);
+    }
+    ui->dsbAmountKitty->setToolTip(kittyDays.join("\n"));
 
     updateTransactionUserReceiving();
 }
@@ -212,21 +396,17 @@ void MainWindow::updateTransactionUserGiving()
  */
 void MainWindow::updateTransactionUserReceiving()
 {
+    TRACE_FUNCTION();
     int eventId = getIdFromCmb(ui->cmbEvent);
     int userGivingId = getIdFromCmb(ui->cmbUserGives);
 
-    // Create the data model
-    QSqlQueryModel *model = new QSqlQueryModel;
-    model->setQuery("SELECT nickname, id FROM users WHERE users.id IN "
-                                "(SELECT userreceives FROM transactions WHERE transactions.usergives = " + QString::number(userGivingId) +
-                                " AND transactions.event = " + QString::number(eventId) + ") GROUP BY nickname");
-
-    if(model->rowCount() == 0)
-        return;
-
     bool oldState = ui->cmbUserReceives->blockSignals(true);
-    ui->cmbUserReceives->setModel(model);
+    bool noUsers = loadUserIdsToCmb(ui->cmbUserReceives, eventSnapshot.isValid() && eventSnapshot.getEventId() == eventId
+                                    ? eventSnapshot.getUsersReceiving(userGivingId)
+                                    : store->getUsersReceiving(eventId, userGivingId));
     ui->cmbUserReceives->blockSignals(oldState);
+    if(noUsers)
+        return;
 
     updateTransactionAmount();
 }
@@ -237,22 +417,24 @@ void MainWindow::updateTransactionUserReceiving()
  */
 void MainWindow::updateTransactionAmount()
 {
+    TRACE_FUNCTION();
     int eventId = getIdFromCmb(ui->cmbEvent);
     int userGivingId = getIdFromCmb(ui->cmbUserGives);
     int userReceivingId = getIdFromCmb(ui->cmbUserReceives);
     double value = 0;
 
-    QSqlQuery query(QString("SELECT SUM(amount) FROM transactions WHERE transactions.event = %1"
-                            " AND transactions.usergives = %2 AND transactions.userreceives = %3")
-                    .arg(eventId).arg(userGivingId).arg(userReceivingId));
-    if(query.next())
-        value = query.value(0).toDouble();
+    if(eventSnapshot.isValid() && eventSnapshot.getEventId() == eventId)
+    {
+        value = eventSnapshot.getAmountBetween(userGivingId, userReceivingId)
+              - eventSnapshot.getAmountBetween(userReceivingId, userGivingId);
+        ui->dsbAmount->setValue(value);
+        selectRowInTransactionTable(ui->tvEventTransactions, ui->cmbUserGives->currentText(), ui->cmbUserReceives->currentText());
+        return;
+    }
 
-    QSqlQuery query2(QString("SELECT SUM(amount) FROM transactions WHERE transactions.event = %1"
-                                " AND transactions.usergives = %2 AND transactions.userreceives = %3")
-                        .arg(eventId).arg(userReceivingId).arg(userGivingId));
-    if(query2.next())
-        value -= query2.value(0).toDouble();
+    // Converted to the currency of the event
+    value = store->getAmountBetween(eventId, userGivingId, userReceivingId)
+          - store->getAmountBetween(eventId, userReceivingId, userGivingId);
 
     ui->dsbAmount->setValue(value);
 
@@ -330,12 +512,10 @@ void MainWindow::newUser()
         if(problem.isEmpty())
         {
             // save User
-            QSqlQuery query;
-            query.prepare(db.getInsertUserQuery());
-            db.addUser(query,userToAdd);
+            store->addUser(userToAdd);
 
-            if(db.getLastError().type() != QSqlError::NoError) {
-                showError(db.getLastError());
+            if(store->getLastError().type() != QSqlError::NoError) {
+                showError(store->getLastError());
                 return;
             }
             else
@@ -381,9 +561,13 @@ void MainWindow::newEvent()
     QLineEdit *leDescription = new QLineEdit(&dialog);
     leDescription->setMaxLength(50);
     form.addRow("Description:", leDescription);
-    QComboBox *cmbAdmin = new QComboBox(&dialog);
-    bool noUsers = loadUsersToCmb(cmbAdmin,false,QString());
-    form.addRow("Admin:", cmbAdmin);
+    QLineEdit *leCurrency = new QLineEdit(LedgerStore::defaultCurrency(), &dialog);
+    leCurrency->setInputMask(">AAA");
+    leCurrency->setToolTip("Three-letter code of the currency the totals of the event are given in");
+    form.addRow("Currency*:", leCurrency);
+    UserPicker *upAdmin = new UserPicker(store, false, &dialog);
+    bool noUsers = store->getUserIndex().search(QString(), 1, store->getKittyId()).isEmpty();
+    form.addRow("Admin*:", upAdmin);
 
     if(noUsers)
     {
@@ -412,15 +596,19 @@ void MainWindow::newEvent()
         QString problem = QString();
         if(leName->text().isEmpty())
             problem = "The field 'Name' cannot be empty";
+        else if(upAdmin->getUserId() < 0)
+            problem = "The admin must be one of the existing users";
+        else if(!leCurrency->hasAcceptableInput())
+            problem = "The currency must be given as a three-letter code";
 
         if(problem.isEmpty())
         {
             // save Event
-            QSqlQuery query;
-            query.prepare(db.getInsertEventQuery());
-            db.addEvent(query, Event(leName->text(), QDateTime::currentDateTime().date(), User(getIdFromCmb(cmbAdmin)), lePlace->text(), leDescription->text(), 0));
-            if(db.getLastError().type() != QSqlError::NoError) {
-                showError(db.getLastError());
+            Event event(leName->text(), QDateTime::currentDateTime().date(), User(upAdmin->getUserId()), lePlace->text(), leDescription->text(), 0);
+            event.setCurrency(leCurrency->text());
+            store->addEvent(event);
+            if(store->getLastError().type() != QSqlError::NoError) {
+                showError(store->getLastError());
                 return;
             }
             else
@@ -458,20 +646,30 @@ void MainWindow::newTransaction()
     dialog.setWindowTitle("Create new transaction");
 
     QComboBox *cmbEvents = new QComboBox(&dialog);
-    bool noEvents = loadEventsToCmb(cmbEvents,QString());
+    bool noEvents = loadEventsToCmb(cmbEvents, SqlFilter("finished", SqlFilter::Equal, 0));
     form.addRow("Event:", cmbEvents);
-    QComboBox *cmbUserGives = new QComboBox(&dialog);
-    bool noUsers = loadUsersToCmb(cmbUserGives,true,QString());
-    form.addRow("User giving:", cmbUserGives);
-    QComboBox *cmbUserReceives = new QComboBox(&dialog);
-    loadUsersToCmb(cmbUserReceives,true,QString());
-    form.addRow("User receiving:", cmbUserReceives);
+    UserPicker *upUserGives = new UserPicker(store, true, &dialog);
+    bool noUsers = store->getUserIndex().size() == 0;
+    form.addRow("User giving*:", upUserGives);
+    UserPicker *upUserReceives = new UserPicker(store, true, &dialog);
+    form.addRow("User receiving*:", upUserReceives);
     QDoubleSpinBox *dsbAmount = new QDoubleSpinBox(&dialog);
     form.addRow("Amount:", dsbAmount);
     dsbAmount->setDecimals(2);
     dsbAmount->setMinimum(0.00);
     dsbAmount->setMaximum(100000.00);
-    dsbAmount->setSuffix(" " + QString(QChar(8364)));
+    QLineEdit *leCurrency = new QLineEdit(&dialog);
+    leCurrency->setInputMask(">aaa");
+    leCurrency->setToolTip("Three-letter code of the currency paid in, if not the one of the event");
+    form.addRow("Currency:", leCurrency);
+    // The amount is shown in the currency it is paid in
+    auto updateCurrency = [this, cmbEvents, leCurrency, dsbAmount]() {
+        QString currency = leCurrency->text().isEmpty() ? store->getEventCurrency(getIdFromCmb(cmbEvents)) : leCurrency->text();
+        dsbAmount->setSuffix(" " + currency);
+    };
+    QObject::connect(cmbEvents, QOverload<int>::of(&QComboBox::currentIndexChanged), updateCurrency);
+    QObject::connect(leCurrency, &QLineEdit::textChanged, updateCurrency);
+    updateCurrency();
     QDateEdit *deTransactionDate = new QDateEdit(&dialog);
     deTransactionDate->setDate(QDateTime::currentDateTime().date());
     deTransactionDate->setDisplayFormat("dd.MM.yyyy");
@@ -487,7 +685,7 @@ void MainWindow::newTransaction()
     if(noEvents)
     {
         QMessageBox msgBox;
-        msgBox.setText("There are no events in the database. A transaction needs a related event.");
+        msgBox.setText("There are no ongoing events in the database. A transaction needs a related event.");
         msgBox.setIcon(QMessageBox::Information);
         msgBox.exec();
         return;
@@ -517,18 +715,31 @@ void MainWindow::newTransaction()
         leDescription->setText(leDescription->text().trimmed());
 
         QString problem = QString();
-        if(getIdFromCmb(cmbUserGives)==getIdFromCmb(cmbUserReceives))
+        if(upUserGives->getUserId() < 0 || upUserReceives->getUserId() < 0)
+            problem = "Users giving and receiving must be existing users";
+        else if(upUserGives->getUserId()==upUserReceives->getUserId())
             problem = "User giving must be different from user receiving";
+        else if(!leCurrency->text().isEmpty() && leCurrency->text().size() != 3)
+            problem = "The currency must be given as a three-letter code";
+        else if(!store->isCurrencyConvertible(getIdFromCmb(cmbEvents), leCurrency->text()))
+            problem = "There are no exchange rates from " + leCurrency->text() + " to the currency of the event";
 
         if(problem.isEmpty())
         {
-            // save Transaction
-            QSqlQuery query;
-            query.prepare(db.getInsertTransactionQuery());
-            db.addTransaction(query, Transaction(User(getIdFromCmb(cmbUserGives)), User(getIdFromCmb(cmbUserReceives)), Event(getIdFromCmb(cmbEvents)),
-                           dsbAmount->value(), deTransactionDate->date(), lePlace->text(), leDescription->text()));
-            if(db.getLastError().type() != QSqlError::NoError) {
-                showError(db.getLastError());
+            // save Transaction, in the currency of the event unless another one is given
+            int eventId = getIdFromCmb(cmbEvents);
+            Transaction transaction(User(upUserGives->getUserId()), User(upUserReceives->getUserId()), Event(eventId),
+                                    dsbAmount->value(), deTransactionDate->date(), lePlace->text(), leDescription->text());
+            if(leCurrency->text() != store->getEventCurrency(eventId))
+                transaction.setCurrency(leCurrency->text());
+            if(store->findDuplicateTransaction(transaction) >= 0
+                    && QMessageBox::question(this, "Duplicate transaction",
+                                             "A transaction with the same users, event and description, a close date and amount already exists.\n"
+                                             "Create it anyway?") != QMessageBox::Yes)
+                return;
+            store->addTransaction(transaction);
+            if(store->getLastError().type() != QSqlError::NoError) {
+                showError(store->getLastError());
                 return;
             }
             else
@@ -555,6 +766,156 @@ void MainWindow::newTransaction()
     }
 }
 
+/*!
+ * Create a new split expense with the information introduced in a dialog
+ *
+ * The payer pays the whole amount and each checked user owes its share, in proportion to its weight.
+ */
+void MainWindow::newSplitExpense()
+{
+    QDialog dialog(this);
+    // Use a layout allowing to have a label next to each field
+    QFormLayout form(&dialog);
+
+    dialog.setWindowFlags(Qt::Dialog|Qt::WindowTitleHint|Qt::WindowSystemMenuHint|Qt::WindowCloseButtonHint);
+    dialog.setWindowTitle("Create new split expense");
+
+    QComboBox *cmbEvents = new QComboBox(&dialog);
+    bool noEvents = loadEventsToCmb(cmbEvents, SqlFilter("finished", SqlFilter::Equal, 0));
+    form.addRow("Event:", cmbEvents);
+    UserPicker *upPayer = new UserPicker(store, true, &dialog);
+    form.addRow("Paid by*:", upPayer);
+    QDoubleSpinBox *dsbAmount = new QDoubleSpinBox(&dialog);
+    form.addRow("Amount:", dsbAmount);
+    dsbAmount->setDecimals(2);
+    dsbAmount->setMinimum(0.00);
+    dsbAmount->setMaximum(1000000.00);
+    QLineEdit *leCurrency = new QLineEdit(&dialog);
+    leCurrency->setInputMask(">aaa");
+    leCurrency->setToolTip("Three-letter code of the currency paid in, if not the one of the event");
+    form.addRow("Currency:", leCurrency);
+    QDateEdit *deDate = new QDateEdit(&dialog);
+    deDate->setDate(QDateTime::currentDateTime().date());
+    deDate->setDisplayFormat("dd.MM.yyyy");
+    deDate->setMaximumDate(QDateTime::currentDateTime().date());
+    form.addRow("Date:", deDate);
+    QLineEdit *lePlace = new QLineEdit(&dialog);
+    lePlace->setMaxLength(30);
+    form.addRow("Place:", lePlace);
+    QLineEdit *leDescription = new QLineEdit(&dialog);
+    leDescription->setMaxLength(50);
+    form.addRow("Description:", leDescription);
+
+    // One row per user: checked if it shares the expense, with the weight of its share
+    QVector<int> userIds = store->getUserIndex().search(QString(), store->getUserIndex().size(), store->getKittyId());
+    QTableWidget *twShares = new QTableWidget(userIds.size(), 2, &dialog);
+    twShares->setHorizontalHeaderLabels(QStringList() << "Shared by" << "Weight");
+    twShares->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+    twShares->verticalHeader()->hide();
+    for(int row = 0; row < userIds.size(); row++)
+    {
+        QTableWidgetItem *user = new QTableWidgetItem(store->getUserIndex().getRecord(userIds.at(row)).nickname);
+        user->setFlags(Qt::ItemIsEnabled | Qt::ItemIsUserCheckable);
+        user->setCheckState(Qt::Checked);
+        user->setData(Qt::UserRole, userIds.at(row));
+        twShares->setItem(row, 0, user);
+        twShares->setItem(row, 1, new QTableWidgetItem("1"));
+    }
+    form.addRow(twShares);
+
+    auto updateCurrency = [this, cmbEvents, leCurrency, dsbAmount]() {
+        QString currency = leCurrency->text().isEmpty() ? store->getEventCurrency(getIdFromCmb(cmbEvents)) : leCurrency->text();
+        dsbAmount->setSuffix(" " + currency);
+    };
+    QObject::connect(cmbEvents, QOverload<int>::of(&QComboBox::currentIndexChanged), updateCurrency);
+    QObject::connect(leCurrency, &QLineEdit::textChanged, updateCurrency);
+    updateCurrency();
+
+    if(noEvents)
+    {
+        QMessageBox msgBox;
+        msgBox.setText("There are no ongoing events in the database. A split expense needs a related event.");
+        msgBox.setIcon(QMessageBox::Information);
+        msgBox.exec();
+        return;
+    }
+
+    if(userIds.size() < 2)
+    {
+        QMessageBox msgBox;
+        msgBox.setText("There are not enough users in the database. An expense is split among two users at least.");
+        msgBox.setIcon(QMessageBox::Information);
+        msgBox.exec();
+        return;
+    }
+
+    // Add some standard buttons (Cancel/Ok) at the bottom of the dialog
+    QDialogButtonBox buttonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel,
+                               Qt::Horizontal, &dialog);
+    form.addRow(&buttonBox);
+    QObject::connect(&buttonBox, SIGNAL(accepted()), &dialog, SLOT(accept()));
+    QObject::connect(&buttonBox, SIGNAL(rejected()), &dialog, SLOT(reject()));
+
+    // Show the dialog as modal
+    if (dialog.exec() == QDialog::Accepted) {
+        lePlace->setText(lePlace->text().trimmed());
+        leDescription->setText(leDescription->text().trimmed());
+
+        int eventId = getIdFromCmb(cmbEvents);
+        SplitExpense split(User(upPayer->getUserId()), Event(eventId), dsbAmount->value(), deDate->date(), lePlace->text(), leDescription->text());
+        if(leCurrency->text() != store->getEventCurrency(eventId))
+            split.setCurrency(leCurrency->text());
+
+        QString problem = QString();
+        if(upPayer->getUserId() < 0)
+            problem = "The payer must be one of the existing users";
+        else if(!leCurrency->text().isEmpty() && leCurrency->text().size() != 3)
+            problem = "The currency must be given as a three-letter code";
+        else if(!store->isCurrencyConvertible(eventId, leCurrency->text()))
+            problem = "There are no exchange rates from " + leCurrency->text() + " to the currency of the event";
+        for(int row = 0; row < twShares->rowCount() && problem.isEmpty(); row++)
+        {
+            if(twShares->item(row, 0)->checkState() != Qt::Checked)
+                continue;
+            bool isNumber = false;
+            double weight = twShares->item(row, 1)->text().toDouble(&isNumber);
+            if(!isNumber || weight <= 0)
+                problem = QString("The weight of %1 must be a positive number").arg(twShares->item(row, 0)->text());
+            else
+                split.addShare(twShares->item(row, 0)->data(Qt::UserRole).toInt(), weight);
+        }
+        if(problem.isEmpty() && split.expand().isEmpty())
+            problem = "The expense must be shared by some user other than the payer";
+
+        if(problem.isEmpty())
+        {
+            // save SplitExpense
+            store->addSplit(split);
+            if(store->getLastError().type() != QSqlError::NoError) {
+                showError(store->getLastError());
+                return;
+            }
+            else
+            {
+                QMessageBox msgBox;
+                msgBox.setText(QString("Split expense created successfully."));
+                msgBox.setIcon(QMessageBox::Information);
+                msgBox.exec();
+                tabSelected(ui->tabWidget->currentIndex()); // Reload information
+            }
+
+            checkDatabaseActions();
+        }
+        else
+        {
+            QMessageBox msgBox;
+            msgBox.setText(problem);
+            msgBox.setIcon(QMessageBox::Warning);
+            msgBox.exec();
+        }
+    }
+}
+
 /*!
  * Delete an existing user chosen in a dialog
  */
@@ -568,7 +929,7 @@ void MainWindow::deleteUser()
     dialog.setWindowTitle("Delete existing user");
 
     QComboBox *cmbUser = new QComboBox(&dialog);
-    bool noUsers = loadUsersToCmb(cmbUser,false,QString());
+    bool noUsers = loadUsersToCmb(cmbUser,false);
 
     if(noUsers)
     {
@@ -595,32 +956,39 @@ void MainWindow::deleteUser()
 
     // Show the dialog as modal
     if (dialog.exec() == QDialog::Accepted) {
-        int transactions, events;
-        User userToDelete = db.getUser(getIdFromCmb(cmbUser));
-        if((transactions = db.getNumTransactions(getIdFromCmb(cmbUser))))
-        {
-            QMessageBox msgBox;
-            msgBox.setText("The user has " + QString::number(transactions) + " transactions. Delete them first");
-            msgBox.setIcon(QMessageBox::Warning);
-            msgBox.exec();
-        }
-        else if((events = db.getNumEventsOfUser(getIdFromCmb(cmbUser))))
+        int transactions = store->getNumTransactions(getIdFromCmb(cmbUser));
+        int events = store->getNumEventsOfUser(getIdFromCmb(cmbUser));
+        int splits = store->getNumSplitsOfUser(getIdFromCmb(cmbUser));
+        User userToDelete = store->getUser(getIdFromCmb(cmbUser));
+        if(userToDelete.checkPassword(lePassword->text()) == false)
         {
             QMessageBox msgBox;
-            msgBox.setText("The user is admin of " + QString::number(events) + " events. Delete them first");
+            msgBox.setText("The password is incorrect.");
             msgBox.setIcon(QMessageBox::Warning);
             msgBox.exec();
         }
-        else if(userToDelete.checkPassword(lePassword->text()) == false)
+        else if(transactions || events || splits)
         {
             QMessageBox msgBox;
-            msgBox.setText("The password is incorrect.");
+            msgBox.setText("The user has " + QString::number(transactions) + " transactions, takes part in "
+                           + QString::number(splits) + " split expenses and is admin of "
+                           + QString::number(events) + " events. Delete them as well, with all the transactions of those events?"
+                           + " Split expenses paid by others keep the remaining shares.");
             msgBox.setIcon(QMessageBox::Warning);
-            msgBox.exec();
+            msgBox.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
+            msgBox.setDefaultButton(QMessageBox::No);
+            if(msgBox.exec() == QMessageBox::Yes)
+            {
+                QSqlError err = store->deleteUserCascade(getIdFromCmb(cmbUser));
+                if(err.type() != QSqlError::NoError)
+                    QMessageBox::critical(this, "Unable to delete user", "Error deleting user: " + err.text());
+                tabSelected(ui->tabWidget->currentIndex()); // Reload information
+                checkDatabaseActions();
+            }
         }
         else
         {
-            db.deleteUser(getIdFromCmb(cmbUser));
+            store->deleteUser(getIdFromCmb(cmbUser));
             tabSelected(ui->tabWidget->currentIndex()); // Reload information
             checkDatabaseActions();
         }
@@ -640,7 +1008,7 @@ void MainWindow::deleteEvent()
     dialog.setWindowTitle("Delete existing event");
 
     QComboBox *cmbEvent = new QComboBox(&dialog);
-    bool noEvents = loadEventsToCmb(cmbEvent,QString());
+    bool noEvents = loadEventsToCmb(cmbEvent);
 
     if(noEvents)
     {
@@ -663,16 +1031,25 @@ void MainWindow::deleteEvent()
     // Show the dialog as modal
     if (dialog.exec() == QDialog::Accepted) {
         int transactions;
-        if((transactions = db.getNumTransactions(-1,getIdFromCmb(cmbEvent))))
+        if((transactions = store->getNumTransactions(-1,getIdFromCmb(cmbEvent))))
         {
             QMessageBox msgBox;
-            msgBox.setText("The event has " + QString::number(transactions) + " transactions. Delete them first");
+            msgBox.setText("The event has " + QString::number(transactions) + " transactions. Delete them as well?");
             msgBox.setIcon(QMessageBox::Warning);
-            msgBox.exec();
+            msgBox.setStandardButtons(QMessageBox::Yes | QMessageBox::No);
+            msgBox.setDefaultButton(QMessageBox::No);
+            if(msgBox.exec() == QMessageBox::Yes)
+            {
+                QSqlError err = store->deleteEventCascade(getIdFromCmb(cmbEvent));
+                if(err.type() != QSqlError::NoError)
+                    QMessageBox::critical(this, "Unable to delete event", "Error deleting event: " + err.text());
+                tabSelected(ui->tabWidget->currentIndex()); // Reload information
+                checkDatabaseActions();
+            }
         }
         else
         {
-            db.deleteEvent(getIdFromCmb(cmbEvent));
+            store->deleteEvent(getIdFromCmb(cmbEvent));
             tabSelected(ui->tabWidget->currentIndex()); // Reload information
             checkDatabaseActions();
         }
@@ -703,7 +1080,7 @@ void MainWindow::deleteTransaction()
         return;
     }
 
-    tvTransactions->setSelectionMode(QAbstractItemView::SingleSelection);
+    tvTransactions->setSelectionMode(QAbstractItemView::ExtendedSelection);
     tvTransactions->setSelectionBehavior(QAbstractItemView::SelectRows);
     tvTransactions->setEditTriggers(0);
     form.addRow(tvTransactions);
@@ -718,161 +1095,1000 @@ void MainWindow::deleteTransaction()
 
     // Show the dialog as modal
     if (dialog.exec() == QDialog::Accepted) {
-        int idTransaction = globalModel->data(globalModel->index(tvTransactions->currentIndex().row(),0)).toInt();
-        db.deleteTransaction(idTransaction);
+        // All the selected rows are deleted at once
+        QVector<int> idTransactions;
+        foreach(const QModelIndex &index, tvTransactions->selectionModel()->selectedRows())
+            idTransactions.append(globalModel->data(globalModel->index(index.row(),0)).toInt());
+        QSqlError err = store->deleteTransactions(idTransactions);
+        if(err.type() != QSqlError::NoError)
+            QMessageBox::critical(this, "Unable to delete transactions", "Error deleting transactions: " + err.text());
         tabSelected(ui->tabWidget->currentIndex()); // Reload information
         checkDatabaseActions();
     }
 }
 
 /*!
- * Show About Dialog with information about this application (e.g. Version, Date, Author, License)
+ * Delete an existing split expense chosen in a dialog
  */
-void MainWindow::showAboutDialog()
+void MainWindow::deleteSplitExpense()
 {
     QDialog dialog(this);
-    QVBoxLayout layout(&dialog);
+    // Use a layout allowing to have a label next to each field
+    QFormLayout form(&dialog);
 
     dialog.setWindowFlags(Qt::Dialog|Qt::WindowTitleHint|Qt::WindowSystemMenuHint|Qt::WindowCloseButtonHint);
-    dialog.setWindowTitle("About CheapyApp");
-
-    QString title = QString("CheapyApp Version ") + QString("%1.%2.%3").arg(VERSION_MAJOR).arg(VERSION_MINOR).arg(VERSION_BUILD);
-    QLabel *lblTitleAndVersion = new QLabel(title);
-    lblTitleAndVersion->setStyleSheet("QLabel { font-weight: bold }");
-    layout.addWidget(lblTitleAndVersion);
-
-    QString buildDate = QString::fromLocal8Bit(BUILDDATE);
-    QLabel *lblBuildDate = new QLabel("Built on: " + buildDate);
-    layout.addWidget(lblBuildDate);
+    dialog.setWindowTitle("Delete existing split expense");
 
-    QLabel *lblAuthor = new QLabel("Created by Kowagunga");
-    layout.addWidget(lblAuthor);
+    QTableView *tvSplits = new QTableView(&dialog);
+    bool noSplits = loadSplitsToTable(tvSplits);
 
-    QLabel *lblLicense = new QLabel("Licensed under GNU General Public License v3.0");
-    layout.addWidget(lblLicense);
+    if(noSplits)
+    {
+        QMessageBox msgBox;
+        msgBox.setText("There are no split expenses in the database.");
+        msgBox.setIcon(QMessageBox::Information);
+        msgBox.exec();
+        return;
+    }
 
-    QLabel *lblGithub = new QLabel("Available at <a href=\"https://github.com/Kowagunga/CheapyApp_Desktop/\">Github</a>");
-    lblGithub->setTextFormat(Qt::RichText);
-    lblGithub->setTextInteractionFlags(Qt::TextBrowserInteraction);
-    lblGithub->setOpenExternalLinks(true);
-    layout.addWidget(lblGithub);
+    tvSplits->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    tvSplits->setSelectionBehavior(QAbstractItemView::SelectRows);
+    tvSplits->setEditTriggers(0);
+    form.addRow(tvSplits);
 
     // Add some standard buttons (Cancel/Ok) at the bottom of the dialog
-    QDialogButtonBox buttonBox(QDialogButtonBox::Ok,
+    QDialogButtonBox buttonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel,
                                Qt::Horizontal, &dialog);
-    layout.addWidget(&buttonBox);
-
+    form.addRow(&buttonBox);
     QObject::connect(&buttonBox, SIGNAL(accepted()), &dialog, SLOT(accept()));
+    QObject::connect(&buttonBox, SIGNAL(rejected()), &dialog, SLOT(reject()));
+    QObject::connect(tvSplits, SIGNAL(doubleClicked(QModelIndex)), &dialog, SLOT(accept()));
 
     // Show the dialog as modal
     if (dialog.exec() == QDialog::Accepted) {
-
+        // The ids are read before the first deletion refreshes the model
+        QVector<int> idSplits;
+        foreach(const QModelIndex &index, tvSplits->selectionModel()->selectedRows())
+            idSplits.append(globalModel->data(globalModel->index(index.row(), fieldIndex("id"))).toInt());
+        foreach(int idSplit, idSplits)
+        {
+            QSqlError err = store->deleteSplit(idSplit);
+            if(err.type() != QSqlError::NoError)
+            {
+                QMessageBox::critical(this, "Unable to delete split expenses", "Error deleting split expenses: " + err.text());
+                break;
+            }
+        }
+        tabSelected(ui->tabWidget->currentIndex()); // Reload information
+        checkDatabaseActions();
     }
 }
 
 /*!
- * Delete database with all queries and initialize tables
+ * Mark an ongoing event chosen in a dialog as finished
+ *
+ * The calculations of the event are frozen in a snapshot, see DataBase::finishEvent().
  */
-void MainWindow::deleteDatabase()
+void MainWindow::finishEvent()
 {
-    QMessageBox msgBox;
-    msgBox.setText("This action will delete all the data in the database.");
-    msgBox.setInformativeText("Do you want to continue?");
-    msgBox.setIcon(QMessageBox::Question);
-    msgBox.setStandardButtons(QMessageBox::Ok | QMessageBox::Cancel);
-    msgBox.setDefaultButton(QMessageBox::Ok);
-    int answer = msgBox.exec();
-
-    if(answer == QMessageBox::Ok)
-    {
-        db.deleteDb();
-        db.init();
+    int eventId = chooseEvent("Finish event", SqlFilter("finished", SqlFilter::Equal, 0));
+    if(eventId == -1)
+        return;
 
-        if(db.getLastError().type() != QSqlError::NoError) {
-            showError(db.getLastError());
-            return;
-        }
-        else
-        {
-            QMessageBox msgBox;
-            msgBox.setText("Database deleted.");
-            msgBox.setIcon(QMessageBox::Information);
-            msgBox.exec();
-        }
-        checkDatabaseActions();
-        tabSelected(ui->tabWidget->currentIndex()); // Reload information
-    }
+    QSqlError err = store->finishEvent(eventId);
+    if(err.type() != QSqlError::NoError)
+        QMessageBox::critical(this, "Unable to finish event", "Error finishing event: " + err.text());
+    tabSelected(ui->tabWidget->currentIndex()); // Reload information
 }
 
 /*!
- * Trigger example data insertion to the database
+ * Mark a finished event chosen in a dialog as ongoing again
  */
-void MainWindow::initExampleDatabase()
+void MainWindow::reopenEvent()
 {
-    db.initExampleDatabase();
-    if(db.getLastError().type() != QSqlError::NoError) {
-        showError(db.getLastError());
+    int eventId = chooseEvent("Reopen event", SqlFilter("finished", SqlFilter::NotEqual, 0));
+    if(eventId == -1)
         return;
-    }
-
-    QMessageBox msgBox;
-    msgBox.setText("Example data inserted to the database");
-    msgBox.setIcon(QMessageBox::Information);
-    msgBox.exec();
 
-    checkDatabaseActions();
+    QSqlError err = store->reopenEvent(eventId);
+    if(err.type() != QSqlError::NoError)
+        QMessageBox::critical(this, "Unable to reopen event", "Error reopening event: " + err.text());
     tabSelected(ui->tabWidget->currentIndex()); // Reload information
 }
 
 /*!
- * Import database from file
+ * Shows the spending of an event chosen in the dialog: money given day by day, the users who gave
+ * the most, the places where the most was spent and the distribution of the amounts as recorded,
+ * each with a bar relative to the largest
  *
- * Opens a db file given by user, deletes the database, copies the database file to the
- * default path and initializes the database class.
+ * Everything is read from the rollup tables kept by triggers and the amount sketches, so changing
+ * the event is fast whatever the number of transactions.
+ */
+void MainWindow::showSpendingAnalytics()
+{
+    TRACE_FUNCTION();
+    QDialog dialog(this);
+    QVBoxLayout layout(&dialog);
+
+    dialog.setWindowFlags(Qt::Dialog|Qt::WindowTitleHint|Qt::WindowSystemMenuHint|Qt::WindowCloseButtonHint);
+    dialog.setWindowTitle("Spending analytics");
+    dialog.resize(600, 450);
+
+    QComboBox *cmbEvent = new QComboBox(&dialog);
+    if(loadEventsToCmb(cmbEvent))
+    {
+        QMessageBox msgBox;
+        msgBox.setText("There are no events in the database.");
+        msgBox.setIcon(QMessageBox::Information);
+        msgBox.exec();
+        return;
+    }
+    QFormLayout *form = new QFormLayout;
+    form->addRow("Event:", cmbEvent);
+    layout.addLayout(form);
+
+    QTabWidget *tabs = new QTabWidget(&dialog);
+    QTableWidget *twDays = new QTableWidget(0, 4, &dialog);
+    twDays->setHorizontalHeaderLabels(QStringList() << "Day" << "Amount" << "Transactions" << "");
+    QTableWidget *twSpenders = new QTableWidget(0, 5, &dialog);
+    twSpenders->setHorizontalHeaderLabels(QStringList() << "User" << "Given" << "Received" << "Transactions" << "");
+    QTableWidget *twPlaces = new QTableWidget(0, 4, &dialog);
+    twPlaces->setHorizontalHeaderLabels(QStringList() << "Place" << "Amount" << "Transactions" << "");
+    tabs->addTab(twDays, "By day");
+    tabs->addTab(twSpenders, "Top spenders");
+    QWidget *amountsPage = new QWidget(&dialog);
+    QVBoxLayout *amountsLayout = new QVBoxLayout(amountsPage);
+    QLabel *lblAmounts = new QLabel(amountsPage);
+    QTableWidget *twAmounts = new QTableWidget(0, 3, amountsPage);
+    twAmounts->setHorizontalHeaderLabels(QStringList() << "Amounts" << "Transactions" << "");
+    amountsLayout->addWidget(lblAmounts);
+    amountsLayout->addWidget(twAmounts);
+    tabs->addTab(twPlaces, "Top places");
+    tabs->addTab(amountsPage, "Amounts as recorded");
+    layout.addWidget(tabs);
+    foreach (QTableWidget *table, QList<QTableWidget *>() << twDays << twSpenders << twPlaces << twAmounts)
+    {
+        table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        table->setSelectionBehavior(QAbstractItemView::SelectRows);
+        table->verticalHeader()->hide();
+        table->horizontalHeader()->setStretchLastSection(true);
+    }
+
+    // Writes a row: its cells, then a bar of the amount relative to the largest one
+    auto setRow = [](QTableWidget *table, int row, const QStringList &cells, double amount, double largest) {
+        for(int column = 0; column < cells.size(); column++)
+            table->setItem(row, column, new QTableWidgetItem(cells.at(column)));
+        QProgressBar *bar = new QProgressBar(table);
+        bar->setTextVisible(false);
+        bar->setRange(0, 1000);
+        bar->setValue(largest > 0 ? qRound(1000 * amount / largest) : 0);
+        table->setCellWidget(row, cells.size(), bar);
+    };
+
+    auto loadEvent = [&]() {
+        int eventId = getIdFromCmb(cmbEvent);
+        QString currency = store->getEventCurrency(eventId);
+        auto money = [&currency](double amount) {return QString::number(amount, 'f', 2) + " " + currency;};
+
+        QVector<LedgerStore::SpendingPoint> series = store->getSpendingSeries(eventId);
+        double largest = 0;
+        foreach (const LedgerStore::SpendingPoint &point, series)
+            largest = qMax(largest, point.amount);
+        twDays->setRowCount(series.size());
+        for(int row = 0; row < series.size(); row++)
+        {
+            const LedgerStore::SpendingPoint &point = series.at(row);
+            setRow(twDays, row, QStringList() << (point.date.isValid() ? point.date.toString(Qt::ISODate) : QString("No date"))
+                                              << money(point.amount) << QString::number(point.transactions),
+                   point.amount, largest);
+        }
+
+        QVector<LedgerStore::SpenderTotal> spenders = store->getTopSpenders(eventId);
+        largest = spenders.isEmpty() ? 0 : spenders.first().given;
+        twSpenders->setRowCount(spenders.size());
+        for(int row = 0; row < spenders.size(); row++)
+        {
+            const LedgerStore::SpenderTotal &spender = spenders.at(row);
+            setRow(twSpenders, row, QStringList() << store->getUser(spender.userId).getNickname() << money(spender.given)
+                                                  << money(spender.received) << QString::number(spender.transactions),
+                   spender.given, largest);
+        }
+
+        QVector<LedgerStore::PlaceTotal> places = store->getTopPlaces(eventId);
+        largest = places.isEmpty() ? 0 : places.first().amount;
+        twPlaces->setRowCount(places.size());
+        for(int row = 0; row < places.size(); row++)
+        {
+            const LedgerStore::PlaceTotal &place = places.at(row);
+            setRow(twPlaces, row, QStringList() << place.place << money(place.amount) << QString::number(place.transactions),
+                   place.amount, largest);
+        }
+
+        // Amounts as recorded: those in another currency are not converted and split expenses
+        // are left out, so they are shown without the currency of the event
+        auto amount = [](double value) {return QString::number(value, 'f', 2);};
+        AmountSketch sketch = store->getAmountSketch(eventId);
+        lblAmounts->setText(QString("%1 transactions, median %2, 95th percentile %3, 99th percentile %4, largest %5\n"
+                                    "Amounts in their own currency, split expenses not included")
+                            .arg(sketch.getCount()).arg(amount(sketch.quantile(0.5))).arg(amount(sketch.quantile(0.95)))
+                            .arg(amount(sketch.quantile(0.99))).arg(amount(sketch.getMax())));
+        QVector<AmountSketch::HistogramBin> bins = sketch.histogram(20);
+        qint64 most = 0;
+        foreach (const AmountSketch::HistogramBin &bin, bins)
+            most = qMax(most, bin.count);
+        twAmounts->setRowCount(bins.size());
+        for(int row = 0; row < bins.size(); row++)
+        {
+            const AmountSketch::HistogramBin &bin = bins.at(row);
+            setRow(twAmounts, row, QStringList() << amount(bin.lower) + " - " + amount(bin.upper) << QString::number(bin.count),
+                   bin.count, most);
+        }
+
+        foreach (QTableWidget *table, QList<QTableWidget *>() << twDays << twSpenders << twPlaces << twAmounts)
+            table->resizeColumnsToContents();
+    };
+    loadEvent();
+    QObject::connect(cmbEvent, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), &dialog, loadEvent);
+
+    QDialogButtonBox buttonBox(QDialogButtonBox::Ok, Qt::Horizontal, &dialog);
+    layout.addWidget(&buttonBox);
+    QObject::connect(&buttonBox, SIGNAL(accepted()), &dialog, SLOT(accept()));
+
+    dialog.exec();
+}
+
+/*!
+ * Shows one plan of payments settling the events checked in the dialog together, the ongoing
+ * ones at first
+ *
+ * The balances of each user are added up across the events, so the debts going round among
+ * users in different events cancel out. The plan is made again when the checked events change.
+ */
+void MainWindow::showGlobalSettlement()
+{
+    TRACE_FUNCTION();
+    QDialog dialog(this);
+    QVBoxLayout layout(&dialog);
+
+    dialog.setWindowFlags(Qt::Dialog|Qt::WindowTitleHint|Qt::WindowSystemMenuHint|Qt::WindowCloseButtonHint);
+    dialog.setWindowTitle("Settle events together");
+    dialog.resize(600, 500);
+
+    QListWidget *lwEvents = new QListWidget(&dialog);
+    foreach (const Event &event, store->getEventsWithTransactions())
+    {
+        QListWidgetItem *item = new QListWidgetItem(event.getName(), lwEvents);
+        item->setData(Qt::UserRole, event.getId());
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+        item->setCheckState(event.isFinished() ? Qt::Unchecked : Qt::Checked);
+    }
+    if(lwEvents->count() == 0)
+    {
+        QMessageBox msgBox;
+        msgBox.setText("There are no events with transactions in the database.");
+        msgBox.setIcon(QMessageBox::Information);
+        msgBox.exec();
+        return;
+    }
+    layout.addWidget(new QLabel("Events:", &dialog));
+    layout.addWidget(lwEvents);
+
+    QLabel *lblSummary = new QLabel(&dialog);
+    layout.addWidget(lblSummary);
+    QTableWidget *twPayments = new QTableWidget(0, 3, &dialog);
+    twPayments->setHorizontalHeaderLabels(QStringList() << "From" << "To" << "Amount");
+    twPayments->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    twPayments->setSelectionBehavior(QAbstractItemView::SelectRows);
+    twPayments->verticalHeader()->hide();
+    twPayments->horizontalHeader()->setStretchLastSection(true);
+    layout.addWidget(twPayments);
+
+    auto settle = [&]() {
+        QVector<int> eventIds;
+        for(int row = 0; row < lwEvents->count(); row++)
+        {
+            if(lwEvents->item(row)->checkState() == Qt::Checked)
+                eventIds << lwEvents->item(row)->data(Qt::UserRole).toInt();
+        }
+
+        QApplication::setOverrideCursor(Qt::WaitCursor);
+        Settlement::Netting netting = Settlement::net(store->getEventBalances(eventIds));
+        QApplication::restoreOverrideCursor();
+
+        int payments = 0;
+        foreach (const QVector<Settlement::Payment> &plan, netting.plans)
+            payments += plan.size();
+        twPayments->setRowCount(payments);
+        int row = 0;
+        for(auto plan = netting.plans.constBegin(); plan != netting.plans.constEnd(); ++plan)
+        {
+            foreach (const Settlement::Payment &payment, plan.value())
+            {
+                twPayments->setItem(row, 0, new QTableWidgetItem(store->getUser(payment.from).getNickname()));
+                twPayments->setItem(row, 1, new QTableWidgetItem(store->getUser(payment.to).getNickname()));
+                twPayments->setItem(row, 2, new QTableWidgetItem(QString::number(payment.amount, 'f', 2) + " " + plan.key()));
+                row++;
+            }
+        }
+        twPayments->resizeColumnsToContents();
+        lblSummary->setText(QString("%1 events settled with %2 payments, instead of %3 settling each event on its own.")
+                            .arg(netting.events).arg(payments).arg(netting.separatePayments));
+    };
+    settle();
+    QObject::connect(lwEvents, &QListWidget::itemChanged, &dialog, settle);
+
+    QDialogButtonBox buttonBox(QDialogButtonBox::Ok, Qt::Horizontal, &dialog);
+    layout.addWidget(&buttonBox);
+    QObject::connect(&buttonBox, SIGNAL(accepted()), &dialog, SLOT(accept()));
+
+    dialog.exec();
+}
+
+/*!
+ * Asks for an event in a dialog
+ */
+int MainWindow::chooseEvent(const QString &title, const SqlFilter &filter)
+{
+    QDialog dialog(this);
+    // Use a layout allowing to have a label next to each field
+    QFormLayout form(&dialog);
+
+    dialog.setWindowFlags(Qt::Dialog|Qt::WindowTitleHint|Qt::WindowSystemMenuHint|Qt::WindowCloseButtonHint);
+    dialog.setWindowTitle(title);
+
+    QComboBox *cmbEvent = new QComboBox(&dialog);
+    bool noEvents = loadEventsToCmb(cmbEvent, filter);
+
+    if(noEvents)
+    {
+        QMessageBox msgBox;
+        msgBox.setText("There are no matching events in the database.");
+        msgBox.setIcon(QMessageBox::Information);
+        msgBox.exec();
+        return -1;
+    }
+
+    form.addRow("Event:", cmbEvent);
+
+    // Add some standard buttons (Cancel/Ok) at the bottom of the dialog
+    QDialogButtonBox buttonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel,
+                               Qt::Horizontal, &dialog);
+    form.addRow(&buttonBox);
+    QObject::connect(&buttonBox, SIGNAL(accepted()), &dialog, SLOT(accept()));
+    QObject::connect(&buttonBox, SIGNAL(rejected()), &dialog, SLOT(reject()));
+
+    // Show the dialog as modal
+    if (dialog.exec() != QDialog::Accepted)
+        return -1;
+    return getIdFromCmb(cmbEvent);
+}
+
+/*!
+ * Show About Dialog with information about this application (e.g. Version, Date, Author, License)
+ */
+void MainWindow::showAboutDialog()
+{
+    QDialog dialog(this);
+    QVBoxLayout layout(&dialog);
+
+    dialog.setWindowFlags(Qt::Dialog|Qt::WindowTitleHint|Qt::WindowSystemMenuHint|Qt::WindowCloseButtonHint);
+    dialog.setWindowTitle("About CheapyApp");
+
+    QString title = QString("CheapyApp Version ") + QString("%1.%2.%3").arg(VERSION_MAJOR).arg(VERSION_MINOR).arg(VERSION_BUILD);
+    QLabel *lblTitleAndVersion = new QLabel(title);
+    lblTitleAndVersion->setStyleSheet("QLabel { font-weight: bold }");
+    layout.addWidget(lblTitleAndVersion);
+
+    QString buildDate = QString::fromLocal8Bit(BUILDDATE);
+    QLabel *lblBuildDate = new QLabel("Built on: " + buildDate);
+    layout.addWidget(lblBuildDate);
+
+    QLabel *lblAuthor = new QLabel("Created by Kowagunga");
+    layout.addWidget(lblAuthor);
+
+    QLabel *lblLicense = new QLabel("Licensed under GNU General Public License v3.0");
+    layout.addWidget(lblLicense);
+
+    QLabel *lblGithub = new QLabel("Available at <a href=\"https://github.com/Kowagunga/CheapyApp_Desktop/\">Github</a>");
+    lblGithub->setTextFormat(Qt::RichText);
+    lblGithub->setTextInteractionFlags(Qt::TextBrowserInteraction);
+    lblGithub->setOpenExternalLinks(true);
+    layout.addWidget(lblGithub);
+
+    // Add some standard buttons (Cancel/Ok) at the bottom of the dialog
+    QDialogButtonBox buttonBox(QDialogButtonBox::Ok,
+                               Qt::Horizontal, &dialog);
+    layout.addWidget(&buttonBox);
+
+    QObject::connect(&buttonBox, SIGNAL(accepted()), &dialog, SLOT(accept()));
+
+    // Show the dialog as modal
+    if (dialog.exec() == QDialog::Accepted) {
+
+    }
+}
+
+/*!
+ * Show Diagnostics Dialog with the aggregated statistics of the executed sql statements
+ */
+void MainWindow::showDiagnosticsDialog()
+{
+    QDialog dialog(this);
+    QVBoxLayout layout(&dialog);
+
+    dialog.setWindowFlags(Qt::Dialog|Qt::WindowTitleHint|Qt::WindowSystemMenuHint|Qt::WindowCloseButtonHint);
+    dialog.setWindowTitle("Diagnostics");
+    dialog.resize(800, 500);
+
+    QPlainTextEdit *teReport = new QPlainTextEdit(&dialog);
+    teReport->setReadOnly(true);
+    teReport->setLineWrapMode(QPlainTextEdit::NoWrap);
+    teReport->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    teReport->setPlainText(StartupProfile::report() + "\n" + QueryStats::instance().report());
+    layout.addWidget(teReport);
+
+    // Add some standard buttons (Reset/Ok) at the bottom of the dialog
+    QDialogButtonBox buttonBox(QDialogButtonBox::Ok | QDialogButtonBox::Reset,
+                               Qt::Horizontal, &dialog);
+    layout.addWidget(&buttonBox);
+
+    QObject::connect(&buttonBox, SIGNAL(accepted()), &dialog, SLOT(accept()));
+    QObject::connect(buttonBox.button(QDialogButtonBox::Reset), &QPushButton::clicked, [teReport]() {
+        QueryStats::instance().reset();
+        teReport->setPlainText(StartupProfile::report() + "\n" + QueryStats::instance().report());
+    });
+    // Rebuild the event summaries and show how they differed from the stored ones
+    if(db)
+    {
+        QPushButton *pbCheckSummaries = buttonBox.addButton("Check event summaries", QDialogButtonBox::ActionRole);
+        QObject::connect(pbCheckSummaries, &QPushButton::clicked, [this, teReport]() {
+            QStringList differences = db->checkEventSummaries(true);
+            if(differences.isEmpty())
+                teReport->appendPlainText("\nEvent summaries are consistent with the transactions");
+            else
+                teReport->appendPlainText("\nEvent summaries rebuilt, differences found:\n    " + differences.join("\n    "));
+        });
+    }
+
+    // Show the dialog as modal
+    dialog.exec();
+}
+
+/*!
+ * Delete database with all queries and initialize tables
+ */
+void MainWindow::deleteDatabase()
+{
+    QMessageBox msgBox;
+    msgBox.setText("This action will delete all the data in the database.");
+    msgBox.setInformativeText("Do you want to continue?");
+    msgBox.setIcon(QMessageBox::Question);
+    msgBox.setStandardButtons(QMessageBox::Ok | QMessageBox::Cancel);
+    msgBox.setDefaultButton(QMessageBox::Ok);
+    int answer = msgBox.exec();
+
+    if(answer == QMessageBox::Ok)
+    {
+        db->deleteDb();
+        db->init();
+
+        if(db->getLastError().type() != QSqlError::NoError) {
+            showError(db->getLastError());
+            return;
+        }
+        else
+        {
+            QMessageBox msgBox;
+            msgBox.setText("Database deleted.");
+            msgBox.setIcon(QMessageBox::Information);
+            msgBox.exec();
+        }
+        checkDatabaseActions();
+        tabSelected(ui->tabWidget->currentIndex()); // Reload information
+    }
+}
+
+/*!
+ * Trigger example data insertion to the database
+ */
+void MainWindow::initExampleDatabase()
+{
+    QSqlError err = store->initExampleDatabase();
+    if(err.type() != QSqlError::NoError) {
+        showError(err);
+        return;
+    }
+
+    QMessageBox msgBox;
+    msgBox.setText("Example data inserted to the database");
+    msgBox.setIcon(QMessageBox::Information);
+    msgBox.exec();
+
+    checkDatabaseActions();
+    tabSelected(ui->tabWidget->currentIndex()); // Reload information
+}
+
+/*!
+ * Import database from file
+ *
+ * Opens a db file given by user and replaces the database with it, see DataBase::loadSnapshot().
  */
 void MainWindow::importDatabase()
 {
     QString fileName = QFileDialog::getOpenFileName(this,
-        tr("Import database file"), QDir::rootPath(), tr("SQlite Database Files (*.db3)"));
+        tr("Import database file"), QDir::rootPath(), tr("SQlite Database Files (*.db3)"));
+
+    if(!fileName.isEmpty())
+    {
+        QSqlError err = db->loadSnapshot(fileName);
+        if(err.type() != QSqlError::NoError) {
+            showError(err);
+            return;
+        }
+
+        QMessageBox msgBox;
+        msgBox.setText("Database imported from:");
+        msgBox.setInformativeText(fileName);
+        msgBox.setIcon(QMessageBox::Information);
+        msgBox.exec();
+
+        checkDatabaseActions();
+        tabSelected(ui->tabWidget->currentIndex()); // Reload information
+    }
+}
+
+/*!
+ * Export database to file
+ *
+ * Writes a consistent copy of the open database, which also saves an in-memory database.
+ */
+void MainWindow::exportDatabase()
+{
+    QString fileName = QFileDialog::getSaveFileName(this,
+        tr("Export database file"), QDir::rootPath(), tr("SQlite Database Files (*.db3)"));
+
+    if(!fileName.isEmpty())
+    {
+        QSqlError err = db->saveSnapshot(fileName);
+        if(err.type() != QSqlError::NoError) {
+            showError(err);
+            return;
+        }
+
+        QMessageBox msgBox;
+        msgBox.setText("Database exported to:");
+        msgBox.setInformativeText(fileName);
+        msgBox.setIcon(QMessageBox::Information);
+        msgBox.exec();
+
+        checkDatabaseActions();
+        tabSelected(ui->tabWidget->currentIndex()); // Reload information
+    }
+}
+
+/*!
+ * Import users from a CSV roster file (name,nickname,email,password[,birthdate])
+ *
+ * Passwords are hashed on all the cores and the users added in one transaction. The lines with
+ * the nickname or email of an existing user are skipped and listed with the invalid ones.
+ */
+void MainWindow::importUsers()
+{
+    QString fileName = QFileDialog::getOpenFileName(this,
+        tr("Import users from roster"), QDir::rootPath(), tr("CSV Files (*.csv *.txt)"));
+
+    if(fileName.isEmpty())
+        return;
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        QMessageBox::warning(this, "Unable to import users", file.errorString());
+        return;
+    }
+
+    QStringList errors;
+    QVector<UserImport::Entry> entries = UserImport::readRoster(&file, &errors);
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    UserImport::Result result = UserImport::hashPasswords(entries);
+    QVector<int> skipped;
+    QSqlError err = store->addUsers(result.users, &skipped);
+    QApplication::restoreOverrideCursor();
+
+    if(err.type() != QSqlError::NoError)
+    {
+        showError(err);
+        return;
+    }
+    foreach (int i, skipped)
+        errors.append(QString("Line %1: The nickname or email address is already used by a user").arg(entries.at(i).line));
+
+    QMessageBox msgBox;
+    msgBox.setText(QString("%1 users imported (%2 users/s hashing on %3 threads).")
+                   .arg(result.users.size() - skipped.size()).arg(result.usersPerSecond(), 0, 'f', 0).arg(result.threads));
+    if(!errors.isEmpty())
+    {
+        msgBox.setInformativeText(QString("%1 lines were skipped.").arg(errors.size()));
+        msgBox.setDetailedText(errors.join("\n"));
+    }
+    msgBox.setIcon(errors.isEmpty() ? QMessageBox::Information : QMessageBox::Warning);
+    msgBox.exec();
+
+    checkDatabaseActions();
+    tabSelected(ui->tabWidget->currentIndex()); // Reload information
+}
+
+/*!
+ * Import transactions of an ongoing event from a CSV file (date,giver,receiver,amount[,place[,description]])
+ *
+ * The transactions are added in one transaction. Those matching an existing transaction or an
+ * earlier line, with the window of days and amount chosen in the dialog, are skipped or listed.
+ */
+void MainWindow::importTransactions()
+{
+    int eventId = chooseEvent("Import transactions", SqlFilter("finished", SqlFilter::Equal, 0));
+    if(eventId < 0)
+        return;
+
+    QString fileName = QFileDialog::getOpenFileName(this,
+        tr("Import transactions"), QDir::rootPath(), tr("CSV Files (*.csv *.txt)"));
+
+    if(fileName.isEmpty())
+        return;
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        QMessageBox::warning(this, "Unable to import transactions", file.errorString());
+        return;
+    }
+
+    QStringList errors;
+    QVector<Transaction> transactions = store->readTransactions(&file, eventId, &errors);
+
+    QDialog dialog(this);
+    QFormLayout form(&dialog);
+    dialog.setWindowFlags(Qt::Dialog|Qt::WindowTitleHint|Qt::WindowSystemMenuHint|Qt::WindowCloseButtonHint);
+    dialog.setWindowTitle("Duplicate transactions");
+
+    LedgerStore::DuplicateCheck check = store->getDuplicateCheck();
+    QComboBox *cmbAction = new QComboBox(&dialog);
+    cmbAction->addItem("Skip them", LedgerStore::DuplicateCheck::Skip);
+    cmbAction->addItem("Import and list them", LedgerStore::DuplicateCheck::Flag);
+    cmbAction->addItem("Do not look for them", LedgerStore::DuplicateCheck::Off);
+    form.addRow("Duplicates:", cmbAction);
+    QSpinBox *sbDays = new QSpinBox(&dialog);
+    sbDays->setRange(0, 31);
+    sbDays->setValue(check.days);
+    sbDays->setSuffix(" days");
+    form.addRow("Dates within:", sbDays);
+    QDoubleSpinBox *dsbAmount = new QDoubleSpinBox(&dialog);
+    dsbAmount->setDecimals(2);
+    dsbAmount->setRange(0.00, 1000.00);
+    dsbAmount->setValue(check.amount);
+    form.addRow("Amounts within:", dsbAmount);
+
+    QDialogButtonBox buttonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, Qt::Horizontal, &dialog);
+    form.addRow(&buttonBox);
+    QObject::connect(&buttonBox, SIGNAL(accepted()), &dialog, SLOT(accept()));
+    QObject::connect(&buttonBox, SIGNAL(rejected()), &dialog, SLOT(reject()));
+    if(dialog.exec() != QDialog::Accepted)
+        return;
+
+    // The window is kept for the new transaction dialog, the action only for the import
+    LedgerStore::DuplicateCheck::Action previousAction = check.action;
+    check.action = LedgerStore::DuplicateCheck::Action(cmbAction->currentData().toInt());
+    check.days = sbDays->value();
+    check.amount = dsbAmount->value();
+    store->setDuplicateCheck(check);
+
+    QVector<int> duplicates;
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QSqlError err = store->importTransactions(transactions, &duplicates);
+    QApplication::restoreOverrideCursor();
+
+    check.action = previousAction;
+    store->setDuplicateCheck(check);
+
+    if(err.type() != QSqlError::NoError)
+    {
+        showError(err);
+        return;
+    }
+
+    const bool skipped = cmbAction->currentData().toInt() == LedgerStore::DuplicateCheck::Skip;
+    QMessageBox msgBox;
+    msgBox.setText(QString("%1 transactions imported.").arg(transactions.size() - (skipped ? duplicates.size() : 0)));
+    QStringList details = errors;
+    foreach (int duplicate, duplicates)
+        details << "Duplicate: " + QString(transactions.at(duplicate));
+    if(!details.isEmpty())
+    {
+        msgBox.setInformativeText(QString("%1 lines were skipped, %2 duplicates were %3.")
+                                  .arg(errors.size()).arg(duplicates.size()).arg(skipped ? "skipped" : "imported"));
+        msgBox.setDetailedText(details.join("\n"));
+    }
+    msgBox.setIcon(details.isEmpty() ? QMessageBox::Information : QMessageBox::Warning);
+    msgBox.exec();
+
+    checkDatabaseActions();
+    tabSelected(ui->tabWidget->currentIndex()); // Reload information
+}
+
+/*!
+ * Import exchange rates from a CSV file (date,currency,base,rate)
+ *
+ * The rates are added in one transaction, replacing those of the same day. The snapshots of
+ * the finished events keep the rates they were finished with.
+ */
+void MainWindow::importExchangeRates()
+{
+    QString fileName = QFileDialog::getOpenFileName(this,
+        tr("Import exchange rates"), QDir::rootPath(), tr("CSV Files (*.csv *.txt)"));
 
-    if(!fileName.isEmpty())
+    if(fileName.isEmpty())
+        return;
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
     {
-        db.deleteDb();
-        QFile::copy(fileName, db.getDbPath());
-        db.init();
+        QMessageBox::warning(this, "Unable to import exchange rates", file.errorString());
+        return;
+    }
 
-        QMessageBox msgBox;
-        msgBox.setText("Database imported from:");
-        msgBox.setInformativeText(fileName);
-        msgBox.setIcon(QMessageBox::Information);
-        msgBox.exec();
+    QStringList errors;
+    QVector<CurrencyConverter::Rate> rates = CurrencyConverter::readRates(&file, &errors);
 
-        checkDatabaseActions();
-        tabSelected(ui->tabWidget->currentIndex()); // Reload information
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QSqlError err = store->importExchangeRates(rates);
+    QApplication::restoreOverrideCursor();
+
+    if(err.type() != QSqlError::NoError)
+    {
+        showError(err);
+        return;
+    }
+
+    QMessageBox msgBox;
+    msgBox.setText(QString("%1 exchange rates imported.").arg(rates.size()));
+    if(!errors.isEmpty())
+    {
+        msgBox.setInformativeText(QString("%1 lines were skipped.").arg(errors.size()));
+        msgBox.setDetailedText(errors.join("\n"));
     }
+    msgBox.setIcon(errors.isEmpty() ? QMessageBox::Information : QMessageBox::Warning);
+    msgBox.exec();
+
+    tabSelected(ui->tabWidget->currentIndex()); // Reload information
 }
 
 /*!
- * Export database to file
+ * Shows the transactions matching the text of the search box on the tableView
+ *
+ * The matches are kept by the database in a temporary table, ranked, and the table model
+ * selects them in that order, so the view fetches their rows as it scrolls. An empty search
+ * box shows the table chosen with the radio buttons again.
  */
-void MainWindow::exportDatabase()
+void MainWindow::searchTransactions()
+{
+    TRACE_FUNCTION();
+    searchTimer->stop();
+    QString text = ui->leSearch->text().trimmed();
+    if(text.isEmpty())
+    {
+        setTableModel(ui->tvTable, 0);
+        tabSelected(0);
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    int matches = db->searchTransactions(text);
+    if(matches < 0)
+    {
+        showError(db->getLastError());
+        return;
+    }
+
+    loadTransactionsToTable(ui->tvTable, true, true, SqlFilter("transactions.id", SqlFilter::InSelect, DataBase::searchResultsQuery()),
+                            DataBase::searchRankOrder());
+    ui->tvTable->setEditTriggers(0);
+    ui->tvTable->setSelectionMode(QAbstractItemView::SingleSelection);
+    ui->tvTable->setColumnHidden(2, false);
+    ui->statusBar->showMessage(QString("%1 transactions found in %2 ms").arg(matches).arg(timer.elapsed()), 5000);
+}
+
+/*!
+ * Rebuilds the full-text index of the transactions, creating it if the file has none
+ */
+void MainWindow::rebuildSearchIndex()
+{
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QSqlError err = db->rebuildSearchIndex();
+    QApplication::restoreOverrideCursor();
+
+    if(err.type() != QSqlError::NoError)
+    {
+        showError(err);
+        return;
+    }
+
+    ui->statusBar->showMessage("Search index rebuilt", 5000);
+    if(!ui->leSearch->text().trimmed().isEmpty())
+        searchTransactions();
+}
+
+/*!
+ * Opens another ledger file next to the ones already open and switches to it
+ *
+ * A file which does not exist is created. Every ledger keeps its own connection, statements
+ * and indexes, so switching back to one is immediate.
+ */
+void MainWindow::openLedger()
 {
     QString fileName = QFileDialog::getSaveFileName(this,
-        tr("Export database file"), QDir::rootPath(), tr("SQlite Database Files (*.db3)"));
+        tr("Open ledger"), QDir::rootPath(), tr("SQlite Database Files (*.db3)"), 0, QFileDialog::DontConfirmOverwrite);
+    if(fileName.isEmpty())
+        return;
 
-    if(!fileName.isEmpty())
+    foreach (DataBase *ledger, ledgers)
     {
-        QFile::copy(db.getDbPath(), fileName);
+        if(!ledger->isInMemory() && QFileInfo(ledger->getDbPath()) == QFileInfo(fileName))
+        {
+            switchLedger(ledger);
+            return;
+        }
+    }
 
-        QMessageBox msgBox;
-        msgBox.setText("Database exported to:");
-        msgBox.setInformativeText(fileName);
-        msgBox.setIcon(QMessageBox::Information);
-        msgBox.exec();
+    DataBase *ledger = new DataBase(true, fileName);
+    if(ledger->getLastError().type() != QSqlError::NoError) {
+        showError(ledger->getLastError());
+        delete ledger;
+        return;
+    }
+    ledgers << ledger;
+    switchLedger(ledger);
+}
 
-        checkDatabaseActions();
-        tabSelected(ui->tabWidget->currentIndex()); // Reload information
+/*!
+ * Closes the current ledger and switches to the next open one. The last ledger cannot be closed.
+ */
+void MainWindow::closeLedger()
+{
+    if(ledgers.size() < 2)
+        return;
+
+    DataBase *closed = db;
+    int index = ledgers.indexOf(closed);
+    ledgers.removeAt(index);
+    switchLedger(ledgers.at(qMin(index, ledgers.size() - 1)));
+    delete closed;
+}
+
+/*!
+ * Shows the totals of all the open ledgers side by side
+ *
+ * The ledgers are read at once, each on a worker thread with a connection of its own.
+ */
+void MainWindow::compareLedgers()
+{
+    TRACE_FUNCTION();
+    QList<QFuture<DataBase::LedgerStats> > futures;
+    foreach (DataBase *ledger, ledgers)
+        futures << QtConcurrent::run(ledger, &DataBase::getLedgerStats);
+
+    QDialog dialog(this);
+    QVBoxLayout layout(&dialog);
+
+    dialog.setWindowFlags(Qt::Dialog|Qt::WindowTitleHint|Qt::WindowSystemMenuHint|Qt::WindowCloseButtonHint);
+    dialog.setWindowTitle("Compare ledgers");
+    dialog.resize(700, 300);
+
+    QTableWidget *twLedgers = new QTableWidget(ledgers.size(), 6, &dialog);
+    twLedgers->setHorizontalHeaderLabels(QStringList() << "Ledger" << "Users" << "Events" << "Transactions" << "Volume" << "Read in (ms)");
+    twLedgers->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    for(int row = 0; row < futures.size(); row++)
+    {
+        DataBase::LedgerStats stats = futures[row].result();
+        if(stats.error.type() != QSqlError::NoError)
+            showError(stats.error);
+
+        QString name = ledgerName(ledgers.at(row));
+        if(ledgers.at(row) == db)
+            name.append(" (current)");
+        twLedgers->setItem(row, 0, new QTableWidgetItem(name));
+        twLedgers->setItem(row, 1, new QTableWidgetItem(QString::number(stats.users)));
+        twLedgers->setItem(row, 2, new QTableWidgetItem(QString::number(stats.events)));
+        twLedgers->setItem(row, 3, new QTableWidgetItem(QString::number(stats.transactions)));
+        twLedgers->setItem(row, 4, new QTableWidgetItem(QString::number(stats.volume, 'f', 2)));
+        twLedgers->setItem(row, 5, new QTableWidgetItem(QString::number(stats.elapsedMs)));
+        twLedgers->item(row, 0)->setToolTip(stats.path);
+    }
+    twLedgers->resizeColumnsToContents();
+    layout.addWidget(twLedgers);
+
+    QDialogButtonBox buttonBox(QDialogButtonBox::Ok, Qt::Horizontal, &dialog);
+    layout.addWidget(&buttonBox);
+    QObject::connect(&buttonBox, SIGNAL(accepted()), &dialog, SLOT(accept()));
+
+    dialog.exec();
+}
+
+/*!
+ * Makes a ledger the current one
+ *
+ * The views still showing the previous ledger are emptied first, so their statements go
+ * back to its pool while it is open.
+ */
+void MainWindow::switchLedger(DataBase *ledger)
+{
+    TRACE_FUNCTION();
+    setTableModel(ui->tvTable, 0);
+    setTableModel(ui->tvEventTransactions, 0);
+    foreach (QComboBox *cmbBox, QList<QComboBox *>() << ui->cmbEvent << ui->cmbUserGives << ui->cmbUserReceives)
+    {
+        bool oldState = cmbBox->blockSignals(true);
+        cmbBox->setModel(new QStandardItemModel(cmbBox));
+        cmbBox->blockSignals(oldState);
+    }
+    eventSnapshot = EventSnapshot();
+
+    db = ledger;
+    store = ledger;
+    updateLedgerMenu();
+    checkDatabaseActions();
+    tabSelected(ui->tabWidget->currentIndex());
+}
+
+/*!
+ * Lists the open ledgers in the Ledger menu, the current one checked, and shows it in the title
+ */
+void MainWindow::updateLedgerMenu()
+{
+    // Deleted later, this may run from the triggered signal of one of them
+    foreach (QAction *action, ledgerActions->actions())
+    {
+        ui->menuLedger->removeAction(action);
+        ledgerActions->removeAction(action);
+        action->deleteLater();
     }
+
+    foreach (DataBase *ledger, ledgers)
+    {
+        QAction *action = new QAction(ledgerName(ledger), ledgerActions);
+        action->setCheckable(true);
+        action->setChecked(ledger == db);
+        action->setToolTip(ledger->getDbPath());
+        ui->menuLedger->addAction(action);
+        connect(action, &QAction::triggered, this, [this, ledger]() {
+            if(ledger != db)
+                switchLedger(ledger);
+        });
+    }
+    // Other ledgers are opened next to a database only
+    ui->actionOpenLedger->setEnabled(db != 0);
+    ui->actionCloseLedger->setEnabled(ledgers.size() > 1);
+    ui->actionCompareLedgers->setEnabled(ledgers.size() > 1);
+
+    QString windowTitle = QString("CheapyApp");
+    if(!db)
+        windowTitle.append(" - ").append(store->getBackendName());
+    else if(ledgers.size() > 1)
+        windowTitle.append(" - ").append(ledgerName(db));
+    else if(db->isInMemory())
+        windowTitle.append(" (in memory)");
+    this->setWindowTitle(windowTitle);
+}
+
+/*!
+ * Returns the name of a ledger shown to the user
+ */
+QString MainWindow::ledgerName(DataBase *ledger)
+{
+    if(ledger->isInMemory())
+        return QLatin1String("in memory");
+    return QFileInfo(ledger->getDbPath()).fileName();
 }
 
 //_____GUI Slots_____
@@ -881,12 +2097,17 @@ void MainWindow::exportDatabase()
  */
 void MainWindow::tabSelected(int index)
 {
+    TRACE_FUNCTION();
     if(index==0)
     {
-        if(ui->rbKittyTransactions->isChecked())
+        if(!ui->leSearch->text().trimmed().isEmpty())
+            searchTransactions();
+        else if(ui->rbKittyTransactions->isChecked())
             ui->rbKittyTransactions->click();
         else if(ui->rbPersonalTransactions->isChecked())
             ui->rbPersonalTransactions->click();
+        else if(ui->rbSplitExpenses->isChecked())
+            ui->rbSplitExpenses->click();
         else if(ui->rbUsers->isChecked())
             ui->rbUsers->click();
         else if(ui->rbEvents->isChecked())
@@ -901,56 +2122,43 @@ void MainWindow::tabSelected(int index)
  */
 void MainWindow::selectTransaction(QModelIndex index)
 {
+    TRACE_FUNCTION();
     int row = index.row();
     QAbstractItemModel *model = ui->tvEventTransactions->model();
     int transactionId = model->data(model->index(row,0)).toInt();
-    Transaction selectedTransaction = db.getTransaction(transactionId);
+    Transaction selectedTransaction = store->getTransaction(transactionId);
 
     selectIdInCmb(ui->cmbUserGives, selectedTransaction.getUserGiving().getId());
     selectIdInCmb(ui->cmbUserReceives, selectedTransaction.getUserReceiving().getId());
 }
 
 /*!
- * Downloads the gravatar corresponding to the email of the selected user
+ * Requests the gravatar corresponding to the email of the selected user
  */
 void MainWindow::showUser(QModelIndex index)
 {
+    TRACE_FUNCTION();
     if(ui->rbUsers->isChecked())
     {
         int row = index.row();
         QAbstractItemModel *model = ui->tvTable->model();
         int userid = model->data(model->index(row,0)).toInt();
-        User selectedUser = db.getUser(userid);
+        User selectedUser = store->getUser(userid);
 
-        QNetworkAccessManager *manager = new QNetworkAccessManager(this);
-        connect(manager, SIGNAL(finished(QNetworkReply*)),
-                this, SLOT(gravatarDownloaded(QNetworkReply*)));
-        manager->get(QNetworkRequest(QUrl(QString("https://www.gravatar.com/avatar/").append(selectedUser.getEmailHash()).append("?d=404"))));
+        requestedAvatar = selectedUser.getEmailHash();
+        avatarCache.request(requestedAvatar);
     }
 }
 
 /*!
- * Shows the downloaded gravatar in a dialog
+ * Shows the gravatar in a dialog if it is the last one requested
  */
-void MainWindow::gravatarDownloaded(QNetworkReply* reply)
+void MainWindow::showAvatar(const QString &hash, const QPixmap &pixmap)
 {
-    if(reply->error() == QNetworkReply::ContentNotFoundError) {
-        return; // User has no gravatar profile
-    }
-    if(reply->error() != QNetworkReply::NoError) {
-        qDebug() << "Error in" << reply->url() << ":" << reply->errorString();
-        return;
-    }
-    QVariant attribute = reply->attribute(QNetworkRequest::RedirectionTargetAttribute);
-    if(attribute.isValid()) {
-        QUrl url = attribute.toUrl();
-        qDebug() << "must go to:" << url;
-        return;
-    }
-//    qDebug() << "ContentType:" << reply->header(QNetworkRequest::ContentTypeHeader).toString();
-    QByteArray jpegData = reply->readAll();
-    QPixmap pixmap;
-    pixmap.loadFromData(jpegData);
+    TRACE_FUNCTION();
+    if(hash != requestedAvatar)
+        return; // Prefetched or superseded by a later double-click
+    requestedAvatar.clear();
 
     // Create dialog
     QDialog dialog(this);
@@ -971,14 +2179,22 @@ void MainWindow::gravatarDownloaded(QNetworkReply* reply)
     QObject::connect(&buttonBox, SIGNAL(accepted()), &dialog, SLOT(accept()));
 
     // Show the dialog as modal
-    if (dialog.exec() == QDialog::Accepted) {
+    dialog.exec();
+}
 
-    }
+/*!
+ * Prefetches the gravatar thumbnails of the users visible in the table
+ */
+void MainWindow::prefetchAvatars()
+{
+    if(ui->tvTable->model() != avatarModel)
+        return;
 
-    // Delete QNetwork Reply and Manager
-    reply->abort();
-    reply->deleteLater();
-    reply->manager()->deleteLater();
+    int firstRow = ui->tvTable->rowAt(0);
+    int lastRow = ui->tvTable->rowAt(ui->tvTable->viewport()->height() - 1);
+    if(lastRow < 0)
+        lastRow = avatarModel->rowCount() - 1;
+    avatarModel->prefetch(firstRow, lastRow);
 }
 
 //_____Helpers_____
@@ -1042,23 +2258,101 @@ void MainWindow::selectRowInTransactionTable(QTableView *tableView, QString user
     }
 }
 
+/*!
+ * Shows a model in a table-view, deleting the model it replaces
+ *
+ * The statement of a replaced SqlFilterTableModel is given back to the cache of the database,
+ * so the next refresh of the view reuses it.
+ */
+void MainWindow::setTableModel(QTableView *tableView, QAbstractItemModel *model)
+{
+    QAbstractItemModel *old = tableView->model();
+    tableView->setModel(model);
+    if(old && old == avatarModel)
+    {
+        // The avatar proxy is kept, the users model behind it goes
+        old = avatarModel->sourceModel();
+        avatarModel->setSourceModel(0);
+    }
+    if(!old || old == model || old->parent() != tableView)
+        return;
+
+    if(SqlFilterTableModel *filtered = qobject_cast<SqlFilterTableModel *>(old))
+        filtered->releaseStatement();
+    old->deleteLater();
+}
+
+/*!
+ * Shows the day numbers of a column as dates
+ *
+ * The delegates of the other columns are removed, since the same view is reused for different tables.
+ */
+void MainWindow::setDayNumberColumn(QTableView *tableView, int column)
+{
+    for(int c = 0; c < tableView->model()->columnCount(); c++)
+    {
+        QAbstractItemDelegate *delegate = tableView->itemDelegateForColumn(c);
+        if(delegate)
+        {
+            tableView->setItemDelegateForColumn(c, 0);
+            delegate->deleteLater();
+        }
+    }
+    tableView->setItemDelegateForColumn(column, new DayNumberDelegate(tableView));
+}
+
 //_____Database functions_____
 /*!
  * Load users from database as entries of a combo-box
  */
-bool MainWindow::loadUsersToCmb(QComboBox *cmbBox, bool includeKitty, QString condition)
+bool MainWindow::loadUsersToCmb(QComboBox *cmbBox, bool includeKitty, const SqlFilter &filter)
 {
-    // Create the data model
-    QSqlQueryModel *model = new QSqlQueryModel;
-    QString strQuery = "SELECT nickname, id FROM users";
+    TRACE_FUNCTION();
+    SqlFilter where = filter;
     if(!includeKitty)
-        strQuery.append(" WHERE users.id IS NOT " + QString::number(db.getKittyId()));
-    if(!condition.isEmpty() && !includeKitty)
-        strQuery.append(" AND " + condition);
-    if(!condition.isEmpty() && includeKitty)
-        strQuery.append(" WHERE " + condition);
+        where = SqlFilter("users.id", SqlFilter::IsNot, store->getKittyId()) && filter;
+
+    if(!db)
+        return loadStoreTableToCmb(cmbBox, "users", "nickname", where);
+
+    QString statement = "SELECT nickname, id FROM users";
+    if(!where.isEmpty())
+        statement.append(" WHERE " + where.toSql());
+
+    return loadStatementToCmb(cmbBox, statement, where.bindValues());
+}
 
-    model->setQuery(strQuery);
+/*!
+ * Load events from database as entries of a combo-box
+ */
+bool MainWindow::loadEventsToCmb(QComboBox *cmbBox, const SqlFilter &filter)
+{
+    TRACE_FUNCTION();
+    if(!db)
+        return loadStoreTableToCmb(cmbBox, "events", "name", filter);
+
+    QString statement = "SELECT name, id FROM events";
+    if(!filter.isEmpty())
+        statement.append(" WHERE " + filter.toSql());
+
+    return loadStatementToCmb(cmbBox, statement, filter.bindValues());
+}
+
+/*!
+ * Load a list of events as entries of a combo-box, in the order given
+ */
+bool MainWindow::loadEventsToCmb(QComboBox *cmbBox, const QVector<Event> &events)
+{
+    // Create the data model
+    QStandardItemModel *model = new QStandardItemModel(0, 2, cmbBox);
+    foreach(const Event &event, events)
+    {
+        QList<QStandardItem *> row;
+        row << new QStandardItem(event.getName());
+        row << new QStandardItem();
+        row.last()->setData(event.getId(), Qt::DisplayRole);
+        model->appendRow(row);
+    }
 
     if(model->rowCount() != 0)
         cmbBox->setModel(model);
@@ -1067,17 +2361,58 @@ bool MainWindow::loadUsersToCmb(QComboBox *cmbBox, bool includeKitty, QString co
 }
 
 /*!
- * Load events from database as entries of a combo-box
+ * Load the rows of a statement as entries of a combo-box
+ *
+ * The statement is taken from the cache of the database and the rows copied to an item model,
+ * so the statement can be reused right away.
  */
-bool MainWindow::loadEventsToCmb(QComboBox *cmbBox, QString condition)
+bool MainWindow::loadStatementToCmb(QComboBox *cmbBox, const QString &statement, const QVariantList &values)
 {
+    QSqlQuery query = db->acquireStatement(statement);
+    query.setForwardOnly(true);
+    foreach(const QVariant &value, values)
+        query.addBindValue(value);
+    QueryStats::exec(query, Q_FUNC_INFO);
+
     // Create the data model
-    QSqlQueryModel *model = new QSqlQueryModel;
-    QString strQuery = "SELECT name, id FROM events";
-    if(!condition.isEmpty())
-        strQuery.append(" WHERE " + condition);
+    QStandardItemModel *model = new QStandardItemModel(0, 2, cmbBox);
+    while(query.next())
+    {
+        QList<QStandardItem *> row;
+        row << new QStandardItem(query.value(0).toString());
+        row << new QStandardItem();
+        row.last()->setData(query.value(1), Qt::DisplayRole);
+        model->appendRow(row);
+    }
+    db->releaseStatement(query);
+
+    if(model->rowCount() != 0)
+        cmbBox->setModel(model);
+
+    return model->rowCount() == 0;
+}
+
+/*!
+ * Load the rows of a table of the store as entries of a combo-box, for a store which is not a database
+ */
+bool MainWindow::loadStoreTableToCmb(QComboBox *cmbBox, const QString &table, const QString &textField, const SqlFilter &filter)
+{
+    LedgerTableModel rows(store);
+    rows.setTable(table);
+    rows.setSqlFilter(filter);
+    if(!rows.select())
+        showError(rows.lastError());
 
-    model->setQuery(strQuery);
+    // Create the data model
+    QStandardItemModel *model = new QStandardItemModel(0, 2, cmbBox);
+    for(int r = 0; r < rows.rowCount(); r++)
+    {
+        QList<QStandardItem *> row;
+        row << new QStandardItem(rows.data(rows.index(r, rows.fieldIndex(textField))).toString());
+        row << new QStandardItem();
+        row.last()->setData(rows.data(rows.index(r, rows.fieldIndex("id"))), Qt::DisplayRole);
+        model->appendRow(row);
+    }
 
     if(model->rowCount() != 0)
         cmbBox->setModel(model);
@@ -1086,40 +2421,124 @@ bool MainWindow::loadEventsToCmb(QComboBox *cmbBox, QString condition)
 }
 
 /*!
- * Load users from database to a table-view
+ * Load users as entries of a combo-box, with their nicknames taken from the user index
  */
-bool MainWindow::loadUsersToTable(QTableView *tableView, QString condition)
+bool MainWindow::loadUserIdsToCmb(QComboBox *cmbBox, const QList<int> &userIds)
 {
+    const UserIndex &index = store->getUserIndex();
+    QMap<QString, int> sorted;
+    foreach(int id, userIds)
+        sorted.insert(index.getRecord(id).nickname, id);
+
     // Create the data model
-    globalModel = new QSqlRelationalTableModel(tableView);
-    globalModel->setEditStrategy(QSqlTableModel::OnManualSubmit);
-    globalModel->setTable("users");
+    QStandardItemModel *model = new QStandardItemModel(0, 2, cmbBox);
+    for(QMap<QString, int>::const_iterator it = sorted.constBegin(); it != sorted.constEnd(); ++it)
+    {
+        QList<QStandardItem *> row;
+        row << new QStandardItem(it.key());
+        row << new QStandardItem();
+        row.last()->setData(it.value(), Qt::DisplayRole);
+        model->appendRow(row);
+    }
 
-    // Set the localized header captions
-    globalModel->setHeaderData(globalModel->fieldIndex("name"), Qt::Horizontal, tr("User Name"));
-    globalModel->setHeaderData(globalModel->fieldIndex("nickname"), Qt::Horizontal, tr("Nickname"));
-    globalModel->setHeaderData(globalModel->fieldIndex("email"), Qt::Horizontal, tr("Email Address"));
-    globalModel->setHeaderData(globalModel->fieldIndex("birthdate"), Qt::Horizontal, tr("Birthday Date"));
+    if(model->rowCount() != 0)
+        cmbBox->setModel(model);
+
+    return model->rowCount() == 0;
+}
+
+/*!
+ * Populates globalModel with the rows of a table matching a filter
+ *
+ * An sql table model is used for a database, with the users and events shown by name, and a
+ * LedgerTableModel for any other store. The captions are set before selecting, since the sql
+ * model renames the columns of its relations.
+ */
+bool MainWindow::selectTableModel(QTableView *tableView, const QString &table, const QHash<QString, QString> &captions,
+                                  const SqlFilter &filter, const QString &orderBy, const char *callSite)
+{
+    if(!db)
+    {
+        LedgerTableModel *model = new LedgerTableModel(store, tableView);
+        globalModel = model;
+        model->setTable(table);
+        for(QHash<QString, QString>::const_iterator it = captions.constBegin(); it != captions.constEnd(); ++it)
+            model->setHeaderData(model->fieldIndex(it.key()), Qt::Horizontal, it.value());
+        model->setSqlFilter(filter);
+
+        if (!model->select()) {
+            showError(model->lastError());
+            return false;
+        }
+        return true;
+    }
 
-    QString filter = QString();
-    filter = "id IS NOT " + QString::number(db.getKittyId());
+    SqlFilterTableModel *model = new SqlFilterTableModel(db, tableView);
+    globalModel = model;
+    model->setEditStrategy(QSqlTableModel::OnManualSubmit);
+    model->setTable(table);
 
-    if(!condition.isEmpty())
+    // Set the relations to the other database tables
+    QStringList userFields = QStringList() << "admin" << "payer" << "usergives" << "userreceives";
+    foreach(const QString &field, userFields)
     {
-        filter.append(" AND ").append(condition);
+        if(model->fieldIndex(field) >= 0)
+            model->setRelation(model->fieldIndex(field), QSqlRelation("users", "id", "nickname"));
     }
-    globalModel->setFilter(filter);
+    if(model->fieldIndex("event") >= 0)
+        model->setRelation(model->fieldIndex("event"), QSqlRelation("events", "id", "name"));
+
+    // Set the localized header captions
+    for(QHash<QString, QString>::const_iterator it = captions.constBegin(); it != captions.constEnd(); ++it)
+        model->setHeaderData(model->fieldIndex(it.key()), Qt::Horizontal, it.value());
+
+    model->setSqlFilter(filter);
+    model->setOrderBy(orderBy);
 
     // Populate the model
-    if (!globalModel->select()) {
-        showError(globalModel->lastError());
-        return true;
+    if (!QueryStats::select(model, callSite)) {
+        showError(model->lastError());
+        return false;
     }
-    tableView->setModel(globalModel);
+    return true;
+}
+
+/*!
+ * Returns the column of a field in globalModel
+ */
+int MainWindow::fieldIndex(const QString &fieldName) const
+{
+    if(QSqlTableModel *model = qobject_cast<QSqlTableModel *>(globalModel))
+        return model->fieldIndex(fieldName);
+    if(LedgerTableModel *model = qobject_cast<LedgerTableModel *>(globalModel))
+        return model->fieldIndex(fieldName);
+    return -1;
+}
+
+/*!
+ * Load users from database to a table-view
+ */
+bool MainWindow::loadUsersToTable(QTableView *tableView, const SqlFilter &filter)
+{
+    TRACE_FUNCTION();
+    QHash<QString, QString> captions;
+    captions.insert("name", tr("User Name"));
+    captions.insert("nickname", tr("Nickname"));
+    captions.insert("email", tr("Email Address"));
+    captions.insert("birthdate", tr("Birthday Date"));
+
+    // Create and populate the data model
+    if(!selectTableModel(tableView, "users", captions, SqlFilter("id", SqlFilter::IsNot, store->getKittyId()) && filter,
+                         QString(), Q_FUNC_INFO))
+        return true;
+    setTableModel(tableView, avatarModel);
+    avatarModel->setColumns(fieldIndex("email"), fieldIndex("nickname"));
+    avatarModel->setSourceModel(globalModel);
     tableView->setItemDelegate(new QSqlRelationalDelegate(tableView));
-    tableView->setColumnHidden(globalModel->fieldIndex("id"), true);
-    tableView->setColumnHidden(globalModel->fieldIndex("passwordhash"), true);
-    tableView->setColumnHidden(globalModel->fieldIndex("passwordsalt"), true);
+    tableView->setColumnHidden(fieldIndex("id"), true);
+    tableView->setColumnHidden(fieldIndex("passwordhash"), true);
+    tableView->setColumnHidden(fieldIndex("passwordsalt"), true);
+    setDayNumberColumn(tableView, fieldIndex("birthdate"));
     tableView->setCurrentIndex(globalModel->index(0, 0));
 
     return globalModel->rowCount() == 0;
@@ -1128,39 +2547,53 @@ bool MainWindow::loadUsersToTable(QTableView *tableView, QString condition)
 /*!
  * Load events from database to a table-view
  */
-bool MainWindow::loadEventsToTable(QTableView *tableView, QString condition)
+bool MainWindow::loadEventsToTable(QTableView *tableView, const SqlFilter &filter)
 {
-    // Create the data model
-    globalModel = new QSqlRelationalTableModel(tableView);
-    globalModel->setEditStrategy(QSqlTableModel::OnManualSubmit);
-    globalModel->setTable("events");
-
-    // Set the relations to the other database tables
-    globalModel->setRelation(globalModel->fieldIndex("admin"), QSqlRelation("users", "id", "nickname"));
-
-    // Set the localized header captions
-    globalModel->setHeaderData(globalModel->fieldIndex("name"), Qt::Horizontal, tr("Event Name"));
-    globalModel->setHeaderData(globalModel->fieldIndex("creation"), Qt::Horizontal, tr("Creation Date"));
-    globalModel->setHeaderData(globalModel->fieldIndex("place"), Qt::Horizontal, tr("Place"));
-    globalModel->setHeaderData(globalModel->fieldIndex("description"), Qt::Horizontal, tr("Description"));
-    globalModel->setHeaderData(globalModel->fieldIndex("finished"), Qt::Horizontal, tr("Finished?"));
-    globalModel->setHeaderData(globalModel->fieldIndex("admin"), Qt::Horizontal, tr("Administrator"));
+    TRACE_FUNCTION();
+    QHash<QString, QString> captions;
+    captions.insert("name", tr("Event Name"));
+    captions.insert("creation", tr("Creation Date"));
+    captions.insert("place", tr("Place"));
+    captions.insert("description", tr("Description"));
+    captions.insert("finished", tr("Finished?"));
+    captions.insert("admin", tr("Administrator"));
+    captions.insert("currency", tr("Currency"));
+
+    // Create and populate the data model
+    if(!selectTableModel(tableView, "events", captions, filter, QString(), Q_FUNC_INFO))
+        return true;
+    setTableModel(tableView, globalModel);
+    tableView->setItemDelegate(new QSqlRelationalDelegate(tableView));
+    setDayNumberColumn(tableView, fieldIndex("creation"));
+    tableView->setColumnHidden(fieldIndex("id"), true);
+    tableView->setCurrentIndex(globalModel->index(0, 0));
 
-    QString filter = QString();
-    if(!condition.isEmpty())
-    {
-        filter = condition;
-    }
-    globalModel->setFilter(filter);
+    return globalModel->rowCount() == 0;
+}
 
-    // Populate the model
-    if (!globalModel->select()) {
-        showError(globalModel->lastError());
+/*!
+ * Load split expenses from database to a table-view, without their shares
+ */
+bool MainWindow::loadSplitsToTable(QTableView *tableView, const SqlFilter &filter)
+{
+    TRACE_FUNCTION();
+    QHash<QString, QString> captions;
+    captions.insert("payer", tr("Paid by"));
+    captions.insert("event", tr("Event Name"));
+    captions.insert("amount", tr("Amount"));
+    captions.insert("splitDate", tr("Date"));
+    captions.insert("place", tr("Place"));
+    captions.insert("description", tr("Description"));
+    captions.insert("currency", tr("Currency"));
+
+    // Create and populate the data model
+    if(!selectTableModel(tableView, "splits", captions, filter, QString(), Q_FUNC_INFO))
         return true;
-    }
-    tableView->setModel(globalModel);
+    setTableModel(tableView, globalModel);
     tableView->setItemDelegate(new QSqlRelationalDelegate(tableView));
-    tableView->setColumnHidden(globalModel->fieldIndex("id"), true);
+    setDayNumberColumn(tableView, fieldIndex("splitDate"));
+    tableView->setColumnHidden(fieldIndex("id"), true);
+    tableView->setColumnHidden(fieldIndex("shares"), true);
     tableView->setCurrentIndex(globalModel->index(0, 0));
 
     return globalModel->rowCount() == 0;
@@ -1169,56 +2602,37 @@ bool MainWindow::loadEventsToTable(QTableView *tableView, QString condition)
 /*!
  * Load transactions from database to a table-view
  */
-bool MainWindow::loadTransactionsToTable(QTableView *tableView, bool showKitty, bool showPersonal, QString condition)
+bool MainWindow::loadTransactionsToTable(QTableView *tableView, bool showKitty, bool showPersonal, const SqlFilter &filter,
+                                         const QString &orderBy)
 {
-    // Create the data model
-    globalModel = new QSqlRelationalTableModel(tableView);
-    globalModel->setEditStrategy(QSqlTableModel::OnManualSubmit);
-    globalModel->setTable("transactions");
-    // Set the relations to the other database tables
-    globalModel->setRelation(globalModel->fieldIndex("usergives"), QSqlRelation("users", "id", "nickname"));
-    globalModel->setRelation(globalModel->fieldIndex("userreceives"), QSqlRelation("users", "id", "nickname"));
-    globalModel->setRelation(globalModel->fieldIndex("event"), QSqlRelation("events", "id", "name"));
-    // Set the localized header captions
-    globalModel->setHeaderData(globalModel->fieldIndex("usergives"), Qt::Horizontal, tr("Giving user"));
-    globalModel->setHeaderData(globalModel->fieldIndex("userreceives"), Qt::Horizontal, tr("Receiving user"));
-    globalModel->setHeaderData(globalModel->fieldIndex("event"), Qt::Horizontal, tr("Event Name"));
-    globalModel->setHeaderData(globalModel->fieldIndex("amount"), Qt::Horizontal, tr("Amount"));
-    globalModel->setHeaderData(globalModel->fieldIndex("transactionDate"), Qt::Horizontal, tr("Transaction Date"));
-    globalModel->setHeaderData(globalModel->fieldIndex("place"), Qt::Horizontal, tr("Place"));
-    globalModel->setHeaderData(globalModel->fieldIndex("description"), Qt::Horizontal, tr("Description"));
-
-    QString filter = QString();
+    TRACE_FUNCTION();
+    QHash<QString, QString> captions;
+    captions.insert("usergives", tr("Giving user"));
+    captions.insert("userreceives", tr("Receiving user"));
+    captions.insert("event", tr("Event Name"));
+    captions.insert("amount", tr("Amount"));
+    captions.insert("transactionDate", tr("Transaction Date"));
+    captions.insert("place", tr("Place"));
+    captions.insert("description", tr("Description"));
+    captions.insert("currency", tr("Currency"));
+
+    SqlFilter kittyFilter;
     if(showKitty && !showPersonal)
     {
-        filter = "userreceives = " + QString::number(db.getKittyId()) + " OR usergives = " + QString::number(db.getKittyId());
+        kittyFilter = SqlFilter("userreceives", SqlFilter::Equal, store->getKittyId()) || SqlFilter("usergives", SqlFilter::Equal, store->getKittyId());
     }
     else if(!showKitty && showPersonal)
     {
-        filter = "userreceives IS NOT " + QString::number(db.getKittyId()) +  " AND usergives IS NOT " + QString::number(db.getKittyId());
+        kittyFilter = SqlFilter("userreceives", SqlFilter::IsNot, store->getKittyId()) && SqlFilter("usergives", SqlFilter::IsNot, store->getKittyId());
     }
-    else if (!showKitty && !showPersonal)
-    {
-        filter.isEmpty();
-    }
-
-    if(!condition.isEmpty())
-    {
-        if(filter.isEmpty())
-            filter = condition;
-        else
-            filter.append(" AND (" + condition + ")");
-    }
-    globalModel->setFilter(filter);
 
-    // Populate the model
-    if (!globalModel->select()) {
-        showError(globalModel->lastError());
+    // Create and populate the data model
+    if(!selectTableModel(tableView, "transactions", captions, kittyFilter && filter, orderBy, Q_FUNC_INFO))
         return true;
-    }
-    tableView->setModel(globalModel);
+    setTableModel(tableView, globalModel);
     tableView->setItemDelegate(new QSqlRelationalDelegate(tableView));
-    tableView->setColumnHidden(globalModel->fieldIndex("id"), true);
+    setDayNumberColumn(tableView, fieldIndex("transactionDate"));
+    tableView->setColumnHidden(fieldIndex("id"), true);
     tableView->setCurrentIndex(globalModel->index(0, 0));
 
     return globalModel->rowCount() == 0;
@@ -4,10 +4,10 @@
 #include <QMainWindow>
 #include <QtWidgets>
 #include <QtSql>
-#include <QtNetwork/QNetworkAccessManager>
-#include <QtNetwork/QNetworkReply>
-#include <QtNetwork/QNetworkRequest>
+#include "avatarcache.h"
+#include "avatarproxymodel.h"
 #include "database.h"
+#include "sqlfilter.h"
 
 namespace Ui {
 class MainWindow;
@@ -21,14 +21,23 @@ class MainWindow : public QMainWindow
 public:
     /*!
      * \brief MainWindow constructor
+     * \param ledgerStore storage of the ledger shown, owned by the window: a DataBase, or e.g. a MemoryLedgerStore
      * \param parent parent widget
+     * \param deferredLoad if true and the store is a DataBase not opened yet, the window is shown before the database is opened
      */
-    explicit MainWindow(QWidget *parent = 0);
+    explicit MainWindow(LedgerStore *ledgerStore, QWidget *parent = 0, bool deferredLoad = false);
     /*!
      * \brief MainWindow destructor
      */
     ~MainWindow();
 
+protected:
+    /*!
+     * \brief Paints the window and records the first paint, and the first one with data, in the startup profile
+     * \param event paint event
+     */
+    void paintEvent(QPaintEvent *event);
+
 public slots:
 private slots:
     void showTable(); //!\brief Shows database entries on the tableView
@@ -38,14 +47,29 @@ private slots:
     void newUser(); //! \brief Create a new user with the information introduced in a dialog
     void newEvent(); //! \brief Create a new event with the information introduced in a dialog
     void newTransaction(); //! \brief Create a new transaction with the information introduced in a dialog
+    void newSplitExpense(); //! \brief Create a new split expense with the information introduced in a dialog
     void deleteUser(); //! \brief Delete an existing user chosen in a dialog
     void deleteEvent(); //! \brief Delete an existing event chosen in a dialog
     void deleteTransaction(); //! \brief Delete an existing transaction chosen in a dialog
+    void deleteSplitExpense(); //! \brief Delete an existing split expense chosen in a dialog
+    void finishEvent(); //! \brief Mark an ongoing event chosen in a dialog as finished
+    void reopenEvent(); //! \brief Mark a finished event chosen in a dialog as ongoing again
+    void showSpendingAnalytics(); //! \brief Show the spending of an event by day, user and place
+    void showGlobalSettlement(); //! \brief Show one plan of payments settling several events together
     void deleteDatabase(); //! \brief Delete database
     void initExampleDatabase(); //! \brief Trigger example data insertion to the database
     void importDatabase(); //! \brief Import database from file
     void exportDatabase(); //! \brief Export database to file
+    void importUsers(); //! \brief Import users from a roster file
+    void importTransactions(); //! \brief Import transactions of an event from a CSV file, looking for duplicates
+    void importExchangeRates(); //! \brief Import exchange rates from a CSV file
+    void searchTransactions(); //! \brief Show the transactions matching the search box on the tableView, best first
+    void rebuildSearchIndex(); //! \brief Rebuild the full-text index of the transactions
     void showAboutDialog(); //! \brief Show About Dialog with information about this app
+    void showDiagnosticsDialog(); //! \brief Show Diagnostics Dialog with the statistics of the executed queries
+    void openLedger(); //! \brief Open another ledger file chosen by the user and switch to it
+    void closeLedger(); //! \brief Close the current ledger and switch to another open one
+    void compareLedgers(); //! \brief Show the totals of all the open ledgers side by side
     /*!
      * \brief Triggers an action when a tab is selected
      * \param index index of the current tab
@@ -62,10 +86,15 @@ private slots:
      */
     void showUser(QModelIndex index);
     /*!
-     * \brief Gravatar download finished
-     * \param image
+     * \brief Shows a gravatar loaded by the avatar cache
+     * \param hash MD5 hash of the user email
+     * \param pixmap gravatar
+     */
+    void showAvatar(const QString &hash, const QPixmap &pixmap);
+    /*!
+     * \brief Prefetches the gravatar thumbnails of the users visible in the table
      */
-    void gravatarDownloaded(QNetworkReply *reply);
+    void prefetchAvatars();
 
 private:
     /*!
@@ -73,22 +102,106 @@ private:
      */
     Ui::MainWindow *ui;
     /*!
-     * \brief SQL Database
+     * \brief SQL Database of the current ledger, null if the store is not a database
+     */
+    DataBase *db;
+    /*!
+     * \brief Storage of the users, events and transactions of the current ledger, db if there is one
+     *
+     * The window adds, reads, deletes and sums up entries only through the LedgerStore interface.
+     * The table-views and combo-boxes filtered with a SqlFilter are read with sql from db, and
+     * through a LedgerTableModel without one. Ledger files, snapshots and the full-text search
+     * need db and are disabled without it.
+     */
+    LedgerStore *store;
+    /*!
+     * \brief Open ledgers, each with its own connection and caches, owned by the window
+     */
+    QList<DataBase *> ledgers;
+    /*!
+     * \brief Actions of the Ledger menu switching to each open ledger
+     */
+    QActionGroup *ledgerActions;
+    /*!
+     * \brief Makes a ledger the current one, emptying the views of the previous one
+     * \param ledger open ledger
+     */
+    void switchLedger(DataBase *ledger);
+    /*!
+     * \brief Lists the open ledgers in the Ledger menu and shows the current one in the title
+     */
+    void updateLedgerMenu();
+    /*!
+     * \brief Returns the name of a ledger shown to the user
+     * \param ledger open ledger
+     * \return file name, or "in memory"
+     */
+    static QString ledgerName(DataBase *ledger);
+    /*!
+     * \brief Cache of the gravatars of the users
+     */
+    AvatarCache avatarCache;
+    /*!
+     * \brief Hash of the gravatar to show once loaded
+     */
+    QString requestedAvatar;
+    /*!
+     * \brief Proxy of the users table with the gravatar thumbnails, created once and given a new source on every reload
+     */
+    AvatarProxyModel *avatarModel;
+    /*!
+     * \brief Delays the search while the text of the search box is being typed
+     */
+    QTimer *searchTimer;
+    /*!
+     * \brief Snapshot of the event shown in the calculations tab, not valid if the event is ongoing
+     */
+    EventSnapshot eventSnapshot;
+    /*!
+     * \brief True once the initial tab has been loaded, the next paint marks StartupProfile::FirstData
+     */
+    bool initialDataLoaded;
+    /*!
+     * \brief Opens the database and loads the initial tab once the file has been prepared
+     * \param state result of preparing the database file on a worker thread
      */
-    DataBase db;
+    void finishDeferredLoad(const DataBase::StartupState &state);
     /*!
      * \brief Check if database actions from menu are enabled depending on the database status
      */
     void checkDatabaseActions();
+    /*!
+     * \brief Check if database actions from menu are enabled, without querying if the database is empty
+     * \param empty true if the database has no entries besides the kitty
+     */
+    void checkDatabaseActions(bool empty);
     /*!
      * \brief Shows an SQL error to the User
      * \param err SQL Error
      */
     void showError(const QSqlError &err);
     /*!
-     * \brief Temporal model to store database queries
+     * \brief Temporal model to store database queries, an sql table model or a LedgerTableModel
+     */
+    QAbstractItemModel *globalModel;
+    /*!
+     * \brief Returns the column of a field in globalModel
+     * \param fieldName column name in the sql table
+     * \return column, -1 if not found
      */
-    QSqlRelationalTableModel *globalModel;
+    int fieldIndex(const QString &fieldName) const;
+    /*!
+     * \brief Populates globalModel with the rows of a table, read from db or from the store
+     * \param tableView table-view the model is created for
+     * \param table sql table: "users", "events", "transactions" or "splits"
+     * \param captions localized header caption of each column name
+     * \param filter filter given to the query as "WHERE" clause
+     * \param orderBy "ORDER BY" clause of the query, none if empty; only used with db
+     * \param callSite function loading the table, recorded in the query statistics
+     * \return true if populated, the error is shown otherwise
+     */
+    bool selectTableModel(QTableView *tableView, const QString &table, const QHash<QString, QString> &captions,
+                          const SqlFilter &filter, const QString &orderBy, const char *callSite);
     /*!
      * \brief Load transactions on the calculations tab
      */
@@ -118,44 +231,105 @@ private:
      * \param userReceives user receiving
      */
     void selectRowInTransactionTable(QTableView *tableView, QString userGives, QString userReceives);
+    /*!
+     * \brief Shows the day numbers of a column as dates
+     * \param tableView tableView with associated model
+     * \param column column with day numbers
+     */
+    void setDayNumberColumn(QTableView *tableView, int column);
+    /*!
+     * \brief Shows a model in a table-view, deleting the model it replaces
+     *
+     * When the model replaced is avatarModel only its source model is deleted, the proxy is kept.
+     * \param tableView table-view
+     * \param model new model
+     */
+    void setTableModel(QTableView *tableView, QAbstractItemModel *model);
     /*!
      * \brief Load users from database as entries of a combo-box
      * \param cmbBox combo-box
      * \param includeKitty true if kitty should be shown as well
-     * \param condition condition given to the query as "WHERE" clause
+     * \param filter filter given to the query as "WHERE" clause
      * \return true if query returns no results
      */
-    bool loadUsersToCmb(QComboBox *cmbBox, bool includeKitty, QString condition);
+    bool loadUsersToCmb(QComboBox *cmbBox, bool includeKitty, const SqlFilter &filter = SqlFilter());
     /*!
      * \brief Load events from database as entries of a combo-box
      * \param cmbBox combo-box
-     * \param condition condition given to the query as "WHERE" clause
+     * \param filter filter given to the query as "WHERE" clause
+     * \return true if query returns no results
+     */
+    bool loadEventsToCmb(QComboBox *cmbBox, const SqlFilter &filter = SqlFilter());
+    /*!
+     * \brief Load a list of events as entries of a combo-box
+     * \param cmbBox combo-box
+     * \param events events, in the order shown
+     * \return true if there are no events
+     */
+    bool loadEventsToCmb(QComboBox *cmbBox, const QVector<Event> &events);
+    /*!
+     * \brief Asks for an event in a dialog
+     * \param title title of the dialog
+     * \param filter filter of the events offered
+     * \return chosen event id, -1 if cancelled or there are no events
+     */
+    int chooseEvent(const QString &title, const SqlFilter &filter);
+    /*!
+     * \brief Load the rows of a statement as entries of a combo-box
+     * \param cmbBox combo-box
+     * \param statement sql statement selecting the text and the id of the entries
+     * \param values values bound to the statement
      * \return true if query returns no results
      */
-    bool loadEventsToCmb(QComboBox *cmbBox, QString condition);
+    bool loadStatementToCmb(QComboBox *cmbBox, const QString &statement, const QVariantList &values);
+    /*!
+     * \brief Load the rows of a table of the store as entries of a combo-box, when there is no db
+     * \param cmbBox combo-box
+     * \param table sql table, see LedgerTableModel::setTable()
+     * \param textField column shown as text of the entries
+     * \param filter filter of the rows
+     * \return true if there are no matching rows
+     */
+    bool loadStoreTableToCmb(QComboBox *cmbBox, const QString &table, const QString &textField, const SqlFilter &filter);
+    /*!
+     * \brief Load users as entries of a combo-box, sorted by nickname
+     * \param cmbBox combo-box
+     * \param userIds user ids
+     * \return true if there are no users
+     */
+    bool loadUserIdsToCmb(QComboBox *cmbBox, const QList<int> &userIds);
     /*!
      * \brief Load users from database to a table-view
      * \param tableView table-view where data is going to be shown
-     * \param condition condition given to the query as "WHERE" clause
+     * \param filter filter given to the query as "WHERE" clause
      * \return true if query returns no results
      */
-    bool loadUsersToTable(QTableView *tableView, QString condition = QString());
+    bool loadUsersToTable(QTableView *tableView, const SqlFilter &filter = SqlFilter());
     /*!
      * \brief Load events from database to a table-view
      * \param tableView table-view where data is going to be shown
-     * \param condition condition given to the query as "WHERE" clause
+     * \param filter filter given to the query as "WHERE" clause
      * \return true if query returns no results
      */
-    bool loadEventsToTable(QTableView *tableView, QString condition = QString());
+    bool loadEventsToTable(QTableView *tableView, const SqlFilter &filter = SqlFilter());
     /*!
      * \brief Load transactions from database to a table-view
      * \param tableView table-view where data is going to be shown
      * \param showKitty true if transactions with kitty shouw be shown
      * \param showPersonal true if transactions between users should be shown
-     * \param condition condition given to the query as "WHERE" clause
+     * \param filter filter given to the query as "WHERE" clause
+     * \param orderBy "ORDER BY" clause of the query, none if empty
+     * \return true if query returns no results
+     */
+    bool loadTransactionsToTable(QTableView *tableView, bool showKitty = true, bool showPersonal = true, const SqlFilter &filter = SqlFilter(),
+                                 const QString &orderBy = QString());
+    /*!
+     * \brief Load split expenses from database to a table-view
+     * \param tableView table-view where data is going to be shown
+     * \param filter filter given to the query as "WHERE" clause
      * \return true if query returns no results
      */
-    bool loadTransactionsToTable(QTableView *tableView, bool showKitty = true, bool showPersonal = true, QString condition = QString());
+    bool loadSplitsToTable(QTableView *tableView, const SqlFilter &filter = SqlFilter());
 };
 
 #endif // MAINWINDOW_H
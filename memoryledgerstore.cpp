@@ -0,0 +1,1118 @@
+#include "memoryledgerstore.h"
+
+#include <algorithm>
+
+/*!
+ * Empty store with the kitty user only, created like in DataBase::prepareSchema()
+ */
+MemoryLedgerStore::MemoryLedgerStore()
+{
+    nextUserId = 1;
+    nextEventId = 1;
+    nextTransactionId = 1;
+    nextSplitId = 1;
+    liveTransactionCount = 0;
+    DuplicateCheck noCheck = {DuplicateCheck::Off, 0, 0};
+    duplicateCheck = noCheck;
+    lastDuplicate = -1;
+
+    User kitty = User(QLatin1String("Kitty"), QLatin1String("Kitty"), QLatin1String("kitty@cheapyapp.com"), QString("password"), QDate(2000, 1, 1));
+    kittyId = addUser(kitty).toInt();
+}
+
+/*!
+ * Returns id of the kitty, which never changes in memory
+ */
+int MemoryLedgerStore::getKittyId(bool loadFromDb)
+{
+    Q_UNUSED(loadFromDb);
+    return kittyId;
+}
+
+/*!
+ * Returns last error
+ */
+QSqlError MemoryLedgerStore::getLastError()
+{
+    return lastError;
+}
+
+/*!
+ * Check if the store has any entries (besides the kitty user)
+ */
+bool MemoryLedgerStore::isDatabaseEmpty()
+{
+    return userPositions.size() == 1 && eventPositions.isEmpty() && liveTransactionCount == 0;
+}
+
+/*!
+ * Appends a user, rejecting a nickname or email already in use like the unique columns of DataBase
+ */
+QVariant MemoryLedgerStore::addUser(const User &newUser)
+{
+    if(nicknames.contains(newUser.getNickname()))
+    {
+        lastError = QSqlError(QString(), QLatin1String("UNIQUE constraint failed: users.nickname"), QSqlError::StatementError);
+        return QVariant();
+    }
+    if(emails.contains(newUser.getEmail()))
+    {
+        lastError = QSqlError(QString(), QLatin1String("UNIQUE constraint failed: users.email"), QSqlError::StatementError);
+        return QVariant();
+    }
+
+    int id = nextUserId++;
+    userPositions.insert(id, users.size());
+    nicknames.insert(newUser.getNickname(), id);
+    emails.insert(newUser.getEmail(), id);
+    users.append(User(id, newUser.getName(), newUser.getNickname(), newUser.getEmail(),
+                      newUser.getPasswordHash(), newUser.getPasswordSalt(), newUser.getBirthdate()));
+    usersDeleted.append(false);
+    UserIndex::Record record = {id, newUser.getNickname(), newUser.getName(), newUser.getEmail()};
+    userIndex.insert(record);
+
+    lastError = QSqlError();
+    return id;
+}
+
+/*!
+ * Appends users, leaving out those whose nickname or email (without case) is already used
+ * like DataBase::addUsers()
+ */
+QSqlError MemoryLedgerStore::addUsers(const QVector<User> &users, QVector<int> *skipped)
+{
+    if(skipped)
+        skipped->clear();
+
+    QSet<QString> usedEmails;
+    foreach (const QString &email, emails.keys())
+        usedEmails.insert(email.toLower());
+
+    for(int i = 0; i < users.size(); i++)
+    {
+        const User &user = users.at(i);
+        const QString email = user.getEmail().toLower();
+        if(nicknames.contains(user.getNickname()) || usedEmails.contains(email))
+        {
+            if(skipped)
+                skipped->append(i);
+            continue;
+        }
+        usedEmails.insert(email);
+        addUser(user);
+    }
+    return lastError = QSqlError();
+}
+
+/*!
+ * Appends an event
+ */
+QVariant MemoryLedgerStore::addEvent(const Event &newEvent)
+{
+    int id = nextEventId++;
+    eventPositions.insert(id, events.size());
+    eventsOfAdmin[newEvent.getAdmin().getId()].append(events.size());
+    events.append(Event(id, newEvent.getName(), newEvent.getCreationDate(), User(newEvent.getAdmin().getId()),
+                        newEvent.getPlace(), newEvent.getDescription(), newEvent.isFinished()));
+    events.last().setCurrency(newEvent.getCurrency().isEmpty() ? defaultCurrency() : newEvent.getCurrency());
+    eventsDeleted.append(false);
+
+    lastError = QSqlError();
+    return id;
+}
+
+/*!
+ * Appends a transaction, unless it is a duplicate to skip or its currency has no exchange rate
+ * to the one of the event
+ */
+QVariant MemoryLedgerStore::addTransaction(const Transaction &newTransaction)
+{
+    lastDuplicate = -1;
+    int eventId = newTransaction.getEvent().getId();
+    if(!isCurrencyConvertible(eventId, newTransaction.getCurrency()))
+    {
+        lastError = QSqlError(QString(), "No exchange rate from " + newTransaction.getCurrency() + " to "
+                              + getEventCurrency(eventId), QSqlError::StatementError);
+        return QVariant();
+    }
+    if(duplicateCheck.action != DuplicateCheck::Off)
+    {
+        lastDuplicate = findDuplicateTransaction(newTransaction);
+        if(lastDuplicate >= 0 && duplicateCheck.action == DuplicateCheck::Skip)
+        {
+            lastError = QSqlError();
+            return QVariant();
+        }
+    }
+
+    lastError = QSqlError();
+    return appendTransaction(newTransaction);
+}
+
+/*!
+ * Looks for the oldest live transaction with the same fingerprint within the window of days and amount
+ */
+int MemoryLedgerStore::findDuplicateTransaction(const Transaction &transaction)
+{
+    lastError = QSqlError();
+    const qint64 fingerprint = transactionFingerprint(transaction.getUserGiving().getId(), transaction.getUserReceiving().getId(),
+                                                      transaction.getEvent().getId(), transaction.getDescription());
+    const QDate date = transaction.getDate();
+    int id = -1;
+    for(auto it = fingerprints.constFind(fingerprint); it != fingerprints.constEnd() && it.key() == fingerprint; ++it)
+    {
+        const int position = it.value();
+        if(transactionsDeleted.at(position))
+            continue;
+        const Transaction &existing = transactions.at(position);
+        if(existing.getDate().isValid() != date.isValid()
+                || (date.isValid() && qAbs(existing.getDate().daysTo(date)) > duplicateCheck.days))
+            continue;
+        if(qAbs(existing.getAmount() - transaction.getAmount()) > duplicateCheck.amount + 1e-9)
+            continue;
+        if(id == -1 || existing.getId() < id)
+            id = existing.getId();
+    }
+    return id;
+}
+
+/*!
+ * Appends transactions one by one, each matched against the live ones, the previous ones of the
+ * batch included. They are taken in the currency of their event, as DataBase::importTransactions().
+ */
+QSqlError MemoryLedgerStore::importTransactions(const QVector<Transaction> &newTransactions, QVector<int> *duplicates)
+{
+    for(int i = 0; i < newTransactions.size(); i++)
+    {
+        if(duplicateCheck.action != DuplicateCheck::Off && findDuplicateTransaction(newTransactions.at(i)) >= 0)
+        {
+            if(duplicates)
+                duplicates->append(i);
+            if(duplicateCheck.action == DuplicateCheck::Skip)
+                continue;
+        }
+        Transaction transaction = newTransactions.at(i);
+        transaction.setCurrency(QString());
+        appendTransaction(transaction);
+    }
+    return lastError = QSqlError();
+}
+
+/*!
+ * Appends a transaction and adds it to the totals of its event, its snapshot is dropped
+ *
+ * Only the ids of the users and the event are kept, as DataBase::getTransaction() returns them.
+ */
+int MemoryLedgerStore::appendTransaction(const Transaction &newTransaction)
+{
+    int giving = newTransaction.getUserGiving().getId();
+    int receiving = newTransaction.getUserReceiving().getId();
+    int eventId = newTransaction.getEvent().getId();
+
+    int id = nextTransactionId++;
+    Transaction transaction(id, User(giving), User(receiving), Event(eventId), newTransaction.getAmount(),
+                            newTransaction.getDate(), newTransaction.getPlace(), newTransaction.getDescription());
+    transaction.setCurrency(newTransaction.getCurrency());
+
+    int position = transactions.size();
+    transactionPositions.insert(id, position);
+    transactionsOfEvent[eventId].append(position);
+    transactionsOfUser[giving].append(position);
+    if(receiving != giving)
+        transactionsOfUser[receiving].append(position);
+    transactions.append(transaction);
+    transactionsDeleted.append(false);
+    amounts.append(convertAmount(transaction));
+    fingerprints.insert(transactionFingerprint(giving, receiving, eventId, transaction.getDescription()), position);
+    liveTransactionCount++;
+    snapshots.remove(eventId);
+
+    updateTotals(position, 1);
+    QHash<int, BalanceIndex>::iterator it = balanceIndexes.find(eventId);
+    if(it != balanceIndexes.end() && transaction.getDate().isValid())
+    {
+        qint64 day = transaction.getDate().toJulianDay();
+        it->add(giving, day, amounts.at(position));
+        it->add(receiving, day, -amounts.at(position));
+    }
+    return id;
+}
+
+/*!
+ * Deletes a transaction. Deleting one which does not exist is not an error, as in sql.
+ */
+QSqlError MemoryLedgerStore::deleteTransaction(int transactionId)
+{
+    int position = livePosition(transactionPositions, transactionsDeleted, transactionId);
+    if(position != -1)
+        removeTransactionAt(position);
+    return lastError = QSqlError();
+}
+
+/*!
+ * Deletes a set of transactions
+ */
+QSqlError MemoryLedgerStore::deleteTransactions(const QVector<int> &transactionIds)
+{
+    foreach (int id, transactionIds)
+        deleteTransaction(id);
+    return lastError = QSqlError();
+}
+
+/*!
+ * Deletes an event, keeping its transactions and totals like DataBase::deleteEvent()
+ */
+QSqlError MemoryLedgerStore::deleteEvent(int eventId)
+{
+    int position = livePosition(eventPositions, eventsDeleted, eventId);
+    if(position != -1)
+    {
+        eventsDeleted[position] = true;
+        eventPositions.remove(eventId);
+    }
+    balanceIndexes.remove(eventId);
+    snapshots.remove(eventId);
+    return lastError = QSqlError();
+}
+
+/*!
+ * Deletes an event with all its transactions and split expenses
+ *
+ * The totals and the balance index of the event are dropped at once instead of being
+ * updated for each transaction.
+ */
+QSqlError MemoryLedgerStore::deleteEventCascade(int eventId)
+{
+    foreach (int position, liveTransactions(transactionsOfEvent, eventId))
+    {
+        transactionsDeleted[position] = true;
+        transactionPositions.remove(transactions.at(position).getId());
+        liveTransactionCount--;
+    }
+    transactionsOfEvent.remove(eventId);
+    totals.remove(eventId);
+    foreach (int position, liveSplits(splitsOfEvent, eventId))
+        removeSplitAt(position);
+    splitsOfEvent.remove(eventId);
+    return deleteEvent(eventId);
+}
+
+/*!
+ * Deletes a user, keeping its transactions like DataBase::deleteUser()
+ */
+QSqlError MemoryLedgerStore::deleteUser(int userId)
+{
+    int position = livePosition(userPositions, usersDeleted, userId);
+    if(position != -1)
+    {
+        usersDeleted[position] = true;
+        userPositions.remove(userId);
+        nicknames.remove(users.at(position).getNickname());
+        emails.remove(users.at(position).getEmail());
+        userIndex.remove(userId);
+    }
+    return lastError = QSqlError();
+}
+
+/*!
+ * Deletes a user with all its transactions and the events it administers
+ *
+ * The split expenses it pays are deleted. Its share is removed from the others, which are
+ * deleted if no one is left owing the payer, like DataBase::removeUserFromSplits().
+ */
+QSqlError MemoryLedgerStore::deleteUserCascade(int userId)
+{
+    foreach (int position, eventsOfAdmin.value(userId))
+    {
+        if(!eventsDeleted.at(position))
+            deleteEventCascade(events.at(position).getId());
+    }
+    eventsOfAdmin.remove(userId);
+
+    foreach (int position, liveTransactions(transactionsOfUser, userId))
+        removeTransactionAt(position);
+    transactionsOfUser.remove(userId);
+
+    foreach (int position, liveSplits(splitsOfUser, userId))
+    {
+        const SplitExpense &split = splits.at(position);
+        if(split.getPayer().getId() == userId)
+        {
+            removeSplitAt(position);
+            continue;
+        }
+
+        SplitExpense remaining(split.getPayer(), split.getEvent(), split.getAmount(), split.getDate(),
+                               split.getPlace(), split.getDescription());
+        remaining.setId(split.getId());
+        remaining.setCurrency(split.getCurrency());
+        bool owed = false;
+        foreach (const SplitExpense::Share &share, split.getShares())
+        {
+            if(share.userId == userId)
+                continue;
+            remaining.addShare(share.userId, share.weight);
+            owed = owed || (share.userId != split.getPayer().getId() && share.weight > 0);
+        }
+        if(owed)
+        {
+            splits[position] = remaining;
+            balanceIndexes.remove(remaining.getEvent().getId());
+            snapshots.remove(remaining.getEvent().getId());
+        }
+        else
+            removeSplitAt(position);
+    }
+    splitsOfUser.remove(userId);
+
+    return deleteUser(userId);
+}
+
+/*!
+ * Returns transaction for an id
+ */
+Transaction MemoryLedgerStore::getTransaction(int id)
+{
+    lastError = QSqlError();
+    int position = livePosition(transactionPositions, transactionsDeleted, id);
+    return position == -1 ? Transaction() : transactions.at(position);
+}
+
+/*!
+ * Returns event for an id
+ */
+Event MemoryLedgerStore::getEvent(int id)
+{
+    lastError = QSqlError();
+    int position = livePosition(eventPositions, eventsDeleted, id);
+    return position == -1 ? Event() : events.at(position);
+}
+
+/*!
+ * Returns user for an id
+ */
+User MemoryLedgerStore::getUser(int id)
+{
+    lastError = QSqlError();
+    int position = livePosition(userPositions, usersDeleted, id);
+    return position == -1 ? User() : users.at(position);
+}
+
+/*!
+ * Returns the live users, in insertion order which is the order of their ids
+ */
+QVector<User> MemoryLedgerStore::getUsers()
+{
+    lastError = QSqlError();
+    QVector<User> result;
+    for(int position = 0; position < users.size(); position++)
+    {
+        if(!usersDeleted.at(position))
+            result.append(users.at(position));
+    }
+    return result;
+}
+
+/*!
+ * Returns the live events, ordered by name and id
+ */
+QVector<Event> MemoryLedgerStore::getEvents()
+{
+    lastError = QSqlError();
+    QVector<Event> result;
+    for(int position = 0; position < events.size(); position++)
+    {
+        if(!eventsDeleted.at(position))
+            result.append(events.at(position));
+    }
+    // Insertion order is the order of the ids
+    std::stable_sort(result.begin(), result.end(), [](const Event &a, const Event &b) {
+        return a.getName() < b.getName();
+    });
+    return result;
+}
+
+/*!
+ * Returns the live events with live transactions or split expenses, ordered by name and id
+ */
+QVector<Event> MemoryLedgerStore::getEventsWithTransactions()
+{
+    QVector<Event> result;
+    foreach (const Event &event, getEvents())
+    {
+        if(!liveTransactions(transactionsOfEvent, event.getId()).isEmpty() || !liveSplits(splitsOfEvent, event.getId()).isEmpty())
+            result.append(event);
+    }
+    return result;
+}
+
+/*!
+ * Returns how many events a user administers
+ */
+int MemoryLedgerStore::getNumEventsOfUser(int userId)
+{
+    int count = 0;
+    foreach (int position, eventsOfAdmin.value(userId))
+    {
+        if(!eventsDeleted.at(position))
+            count++;
+    }
+    return count;
+}
+
+/*!
+ * Returns how many transactions does a user and/or an event have
+ */
+int MemoryLedgerStore::getNumTransactions(int userId, int eventId)
+{
+    if(userId == -1 && eventId == -1)
+        return 0;
+
+    if(userId == -1)
+        return getEventSummary(eventId).transactions;
+
+    int count = 0;
+    foreach (int position, liveTransactions(transactionsOfUser, userId))
+    {
+        if(eventId == -1 || transactions.at(position).getEvent().getId() == eventId)
+            count++;
+    }
+    return count;
+}
+
+/*!
+ * Calculates the money in the Kitty of an event from its totals
+ */
+double MemoryLedgerStore::calcAmountKitty(int eventId)
+{
+    EventSummary summary = getEventSummary(eventId);
+    return summary.kittyIn - summary.kittyOut;
+}
+
+/*!
+ * Returns the amount of money given from one user to another in an event, with the converted
+ * amounts and the split expenses expanded
+ */
+double MemoryLedgerStore::getAmountBetween(int eventId, int userGivingId, int userReceivingId)
+{
+    double amount = 0;
+    foreach (const Transaction &transaction, getEventTransactions(eventId))
+    {
+        if(transaction.getUserGiving().getId() == userGivingId && transaction.getUserReceiving().getId() == userReceivingId)
+            amount += transaction.getAmount();
+    }
+    return amount;
+}
+
+/*!
+ * Returns the users giving money in the live transactions of an event
+ */
+QList<int> MemoryLedgerStore::getUsersGiving(int eventId)
+{
+    lastError = QSqlError();
+    QList<int> result;
+    foreach (int position, liveTransactions(transactionsOfEvent, eventId))
+    {
+        int userId = transactions.at(position).getUserGiving().getId();
+        if(!result.contains(userId))
+            result.append(userId);
+    }
+    return result;
+}
+
+/*!
+ * Returns the users receiving money from a user in the live transactions of an event
+ */
+QList<int> MemoryLedgerStore::getUsersReceiving(int eventId, int userGivingId)
+{
+    lastError = QSqlError();
+    QList<int> result;
+    foreach (int position, liveTransactions(transactionsOfEvent, eventId))
+    {
+        const Transaction &transaction = transactions.at(position);
+        int userId = transaction.getUserReceiving().getId();
+        if(transaction.getUserGiving().getId() == userGivingId && !result.contains(userId))
+            result.append(userId);
+    }
+    return result;
+}
+
+/*!
+ * Returns the number of users with transactions in an event, the kitty excluded
+ */
+int MemoryLedgerStore::calcNumUsers(int eventId)
+{
+    return getEventSummary(eventId).participants;
+}
+
+/*!
+ * Returns the totals of an event, kept up to date on add and delete unless it has split expenses
+ */
+LedgerStore::EventSummary MemoryLedgerStore::getEventSummary(int eventId)
+{
+    lastError = QSqlError();
+    if(!liveSplits(splitsOfEvent, eventId).isEmpty())
+        return summaryOf(getEventTransactions(eventId), kittyId);
+
+    QHash<int, EventTotals>::const_iterator it = totals.constFind(eventId);
+    if(it == totals.constEnd())
+    {
+        EventSummary summary = {0, 0, 0, 0, 0, QDate()};
+        return summary;
+    }
+
+    EventSummary summary = it->summary;
+    summary.participants = it->participants.size();
+    return summary;
+}
+
+/*!
+ * Returns the balance of the Kitty of an event day by day, from its transactions with converted
+ * amounts and split expenses expanded
+ */
+QVector<LedgerStore::KittyBalancePoint> MemoryLedgerStore::getKittyBalanceSeries(int eventId)
+{
+    return kittyBalanceSeriesOf(getEventTransactions(eventId), kittyId);
+}
+
+/*!
+ * Returns the money given in an event day by day, from its expanded transactions
+ */
+QVector<LedgerStore::SpendingPoint> MemoryLedgerStore::getSpendingSeries(int eventId, int userId)
+{
+    return spendingSeriesOf(getEventTransactions(eventId), userId);
+}
+
+/*!
+ * Returns the users who gave the most money in an event, from its expanded transactions
+ */
+QVector<LedgerStore::SpenderTotal> MemoryLedgerStore::getTopSpenders(int eventId, int limit)
+{
+    return topSpendersOf(getEventTransactions(eventId), kittyId, limit);
+}
+
+/*!
+ * Returns the places where the most money was spent in an event, from its expanded transactions
+ */
+QVector<LedgerStore::PlaceTotal> MemoryLedgerStore::getTopPlaces(int eventId, int limit)
+{
+    return topPlacesOf(getEventTransactions(eventId), limit);
+}
+
+/*!
+ * Returns the distribution of the amounts given, as recorded and without the split expenses
+ *
+ * Built on each call by scanning the matching transactions.
+ */
+AmountSketch MemoryLedgerStore::getAmountSketch(int eventId, int userId)
+{
+    lastError = QSqlError();
+    AmountSketch sketch;
+    QVector<int> positions;
+    if(eventId != -1)
+        positions = liveTransactions(transactionsOfEvent, eventId);
+    else if(userId != -1)
+        positions = liveTransactions(transactionsOfUser, userId);
+    else
+    {
+        for(int position = 0; position < transactions.size(); position++)
+        {
+            if(!transactionsDeleted.at(position))
+                positions.append(position);
+        }
+    }
+    foreach (int position, positions)
+    {
+        if(userId == -1 || transactions.at(position).getUserGiving().getId() == userId)
+            sketch.add(transactions.at(position).getAmount());
+    }
+    return sketch;
+}
+
+/*!
+ * Returns the transactions between two dates (both included), ordered by date and id
+ *
+ * Scans the transactions of the event, or all of them if no event is given.
+ */
+QVector<Transaction> MemoryLedgerStore::getTransactionsBetween(QDate from, QDate to, int eventId)
+{
+    lastError = QSqlError();
+    QVector<Transaction> result;
+    auto collect = [&](int position) {
+        const Transaction &transaction = transactions.at(position);
+        if(transaction.getDate().isValid() && transaction.getDate() >= from && transaction.getDate() <= to)
+            result.append(transaction);
+    };
+    if(eventId == -1)
+    {
+        for(int position = 0; position < transactions.size(); position++)
+        {
+            if(!transactionsDeleted.at(position))
+                collect(position);
+        }
+    }
+    else
+    {
+        foreach (int position, liveTransactions(transactionsOfEvent, eventId))
+            collect(position);
+    }
+
+    std::sort(result.begin(), result.end(), [](const Transaction &a, const Transaction &b) {
+        return a.getDate() != b.getDate() ? a.getDate() < b.getDate() : a.getId() < b.getId();
+    });
+    return result;
+}
+
+/*!
+ * Returns the total amount of the transactions between two dates (both included)
+ */
+double MemoryLedgerStore::sumBetween(QDate from, QDate to, int eventId)
+{
+    double sum = 0;
+    foreach (const Transaction &transaction, getTransactionsBetween(from, to, eventId))
+        sum += transaction.getAmount();
+    return sum;
+}
+
+/*!
+ * Returns the balance of a user in an event up to a date (included)
+ */
+double MemoryLedgerStore::getBalanceAsOf(int eventId, int userId, QDate date)
+{
+    lastError = QSqlError();
+    return getBalanceIndex(eventId).balanceAsOf(userId, date.toJulianDay());
+}
+
+/*!
+ * Returns the balances of all the users of an event up to a date (included)
+ */
+QHash<int, double> MemoryLedgerStore::getBalancesAsOf(int eventId, QDate date)
+{
+    lastError = QSqlError();
+    return getBalanceIndex(eventId).balancesAsOf(date.toJulianDay());
+}
+
+/*!
+ * Returns the balances of the users of a set of events, from their expanded transactions
+ *
+ * Deleted events and events without transactions are left out, the others come ordered by id.
+ */
+QVector<Settlement::EventBalances> MemoryLedgerStore::getEventBalances(const QVector<int> &eventIds)
+{
+    QVector<int> ids = eventIds;
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    QVector<Settlement::EventBalances> result;
+    foreach (int eventId, ids)
+    {
+        if(livePosition(eventPositions, eventsDeleted, eventId) == -1)
+            continue;
+        Settlement::EventBalances event;
+        event.eventId = eventId;
+        event.currency = getEventCurrency(eventId);
+        foreach (const Transaction &transaction, getEventTransactions(eventId))
+        {
+            event.balances[transaction.getUserGiving().getId()] += transaction.getAmount();
+            event.balances[transaction.getUserReceiving().getId()] -= transaction.getAmount();
+        }
+        if(!event.balances.isEmpty())
+            result.append(event);
+    }
+    lastError = QSqlError();
+    return result;
+}
+
+/*!
+ * Marks an event as finished and keeps the snapshot built from its expanded transactions
+ */
+QSqlError MemoryLedgerStore::finishEvent(int eventId)
+{
+    int position = livePosition(eventPositions, eventsDeleted, eventId);
+    if(position != -1)
+    {
+        events[position].setFinished(true);
+        snapshots.insert(eventId, EventSnapshot::build(eventId, getEventTransactions(eventId), kittyId));
+    }
+    return lastError = QSqlError();
+}
+
+/*!
+ * Marks an event as ongoing again and drops its snapshot
+ */
+QSqlError MemoryLedgerStore::reopenEvent(int eventId)
+{
+    int position = livePosition(eventPositions, eventsDeleted, eventId);
+    if(position != -1)
+        events[position].setFinished(false);
+    snapshots.remove(eventId);
+    return lastError = QSqlError();
+}
+
+/*!
+ * Returns the snapshot of a finished event, building it again if its transactions changed
+ */
+bool MemoryLedgerStore::getEventSnapshot(int eventId, EventSnapshot *snapshot)
+{
+    lastError = QSqlError();
+    int position = livePosition(eventPositions, eventsDeleted, eventId);
+    if(position == -1 || !events.at(position).isFinished())
+        return false;
+    if(!snapshots.contains(eventId))
+        finishEvent(eventId);
+    *snapshot = snapshots.value(eventId);
+    return snapshot->isValid();
+}
+
+/*!
+ * Returns the currency of an event, the default one if not found
+ */
+QString MemoryLedgerStore::getEventCurrency(int eventId)
+{
+    int position = livePosition(eventPositions, eventsDeleted, eventId);
+    return position == -1 ? defaultCurrency() : events.at(position).getCurrency();
+}
+
+/*!
+ * Returns true if amounts in a currency can be converted to the currency of an event
+ */
+bool MemoryLedgerStore::isCurrencyConvertible(int eventId, const QString &currency)
+{
+    if(currency.isEmpty())
+        return true;
+    return getCurrencyConverter(getEventCurrency(eventId)).hasRates(currency);
+}
+
+/*!
+ * Adds exchange rates and converts the amounts in other currencies again with them
+ *
+ * The totals are rebuilt from the new amounts, the balance indexes are built again on next use.
+ */
+QSqlError MemoryLedgerStore::importExchangeRates(const QVector<CurrencyConverter::Rate> &rates)
+{
+    this->rates += rates;
+    converters.clear();
+    balanceIndexes.clear();
+
+    totals.clear();
+    for(int position = 0; position < transactions.size(); position++)
+    {
+        if(transactionsDeleted.at(position))
+            continue;
+        if(!transactions.at(position).getCurrency().isEmpty())
+            amounts[position] = convertAmount(transactions.at(position));
+        updateTotals(position, 1);
+    }
+    return lastError = QSqlError();
+}
+
+/*!
+ * Returns the transactions of an event ordered by date and id, with their converted amounts
+ *
+ * The split expenses are expanded after the transactions, and converted one by one.
+ */
+QVector<Transaction> MemoryLedgerStore::getEventTransactions(int eventId)
+{
+    lastError = QSqlError();
+    QVector<Transaction> result;
+    foreach (int position, liveTransactions(transactionsOfEvent, eventId))
+    {
+        result.append(transactions.at(position));
+        result.last().setAmount(amounts.at(position));
+    }
+    foreach (const SplitExpense &split, getEventSplits(eventId))
+    {
+        foreach (Transaction transaction, split.expand())
+        {
+            transaction.setAmount(convertAmount(transaction));
+            result.append(transaction);
+        }
+    }
+    // Undated first, the positions follow the ids and the split expenses come last within a day
+    std::stable_sort(result.begin(), result.end(), [](const Transaction &a, const Transaction &b) {
+        return a.getDate() < b.getDate();
+    });
+    return result;
+}
+
+/*!
+ * Appends a split expense, unless its currency has no exchange rate to the one of the event
+ *
+ * The balance index of the event is built again with the expanded shares on next use.
+ */
+QVariant MemoryLedgerStore::addSplit(const SplitExpense &split)
+{
+    int eventId = split.getEvent().getId();
+    if(!isCurrencyConvertible(eventId, split.getCurrency()))
+    {
+        lastError = QSqlError(QString(), "No exchange rate from " + split.getCurrency() + " to "
+                              + getEventCurrency(eventId), QSqlError::StatementError);
+        return QVariant();
+    }
+
+    int id = nextSplitId++;
+    int payer = split.getPayer().getId();
+    SplitExpense stored(User(payer), Event(eventId), split.getAmount(), split.getDate(), split.getPlace(), split.getDescription());
+    stored.setId(id);
+    stored.setCurrency(split.getCurrency());
+    QVector<int> users;
+    users << payer;
+    foreach (const SplitExpense::Share &share, split.getShares())
+    {
+        stored.addShare(share.userId, share.weight);
+        if(!users.contains(share.userId))
+            users << share.userId;
+    }
+
+    int position = splits.size();
+    splitPositions.insert(id, position);
+    splitsOfEvent[eventId].append(position);
+    foreach (int userId, users)
+        splitsOfUser[userId].append(position);
+    splits.append(stored);
+    splitsDeleted.append(false);
+
+    balanceIndexes.remove(eventId);
+    snapshots.remove(eventId);
+    lastError = QSqlError();
+    return id;
+}
+
+/*!
+ * Deletes a split expense. Deleting one which does not exist is not an error, as in sql.
+ */
+QSqlError MemoryLedgerStore::deleteSplit(int splitId)
+{
+    int position = livePosition(splitPositions, splitsDeleted, splitId);
+    if(position != -1)
+        removeSplitAt(position);
+    return lastError = QSqlError();
+}
+
+/*!
+ * Returns the split expenses of an event, ordered by date and id
+ */
+QVector<SplitExpense> MemoryLedgerStore::getEventSplits(int eventId)
+{
+    lastError = QSqlError();
+    QVector<SplitExpense> result;
+    foreach (int position, liveSplits(splitsOfEvent, eventId))
+        result.append(splits.at(position));
+    std::stable_sort(result.begin(), result.end(), [](const SplitExpense &a, const SplitExpense &b) {
+        return a.getDate() < b.getDate();
+    });
+    return result;
+}
+
+/*!
+ * Returns the number of split expenses of an event, or of all the events
+ */
+int MemoryLedgerStore::getNumSplits(int eventId)
+{
+    lastError = QSqlError();
+    if(eventId == -1)
+        return splitPositions.size();
+    return liveSplits(splitsOfEvent, eventId).size();
+}
+
+/*!
+ * Returns how many split expenses a user pays or has a share of
+ */
+int MemoryLedgerStore::getNumSplitsOfUser(int userId)
+{
+    lastError = QSqlError();
+    return liveSplits(splitsOfUser, userId).size();
+}
+
+/*!
+ * Returns the position of a live record, -1 if not found or deleted
+ */
+int MemoryLedgerStore::livePosition(const QHash<int, int> &positions, const QVector<bool> &deleted, int id)
+{
+    int position = positions.value(id, -1);
+    if(position == -1 || deleted.at(position))
+        return -1;
+    return position;
+}
+
+/*!
+ * Returns the positions of the live transactions of an event or a user
+ */
+QVector<int> MemoryLedgerStore::liveTransactions(const QHash<int, QVector<int> > &index, int id) const
+{
+    QVector<int> positions;
+    foreach (int position, index.value(id))
+    {
+        if(!transactionsDeleted.at(position))
+            positions.append(position);
+    }
+    return positions;
+}
+
+/*!
+ * Returns the positions of the live split expenses of an event or a user
+ */
+QVector<int> MemoryLedgerStore::liveSplits(const QHash<int, QVector<int> > &index, int id) const
+{
+    QVector<int> positions;
+    foreach (int position, index.value(id))
+    {
+        if(!splitsDeleted.at(position))
+            positions.append(position);
+    }
+    return positions;
+}
+
+/*!
+ * Marks a split expense as deleted, the balance index and the snapshot of its event are built
+ * again on next use
+ */
+void MemoryLedgerStore::removeSplitAt(int position)
+{
+    splitsDeleted[position] = true;
+    splitPositions.remove(splits.at(position).getId());
+    balanceIndexes.remove(splits.at(position).getEvent().getId());
+    snapshots.remove(splits.at(position).getEvent().getId());
+}
+
+/*!
+ * Marks a transaction as deleted and takes it out of the totals and the balance index
+ */
+void MemoryLedgerStore::removeTransactionAt(int position)
+{
+    const Transaction &transaction = transactions.at(position);
+    transactionsDeleted[position] = true;
+    transactionPositions.remove(transaction.getId());
+    liveTransactionCount--;
+
+    updateTotals(position, -1);
+    snapshots.remove(transaction.getEvent().getId());
+    QHash<int, BalanceIndex>::iterator it = balanceIndexes.find(transaction.getEvent().getId());
+    if(it != balanceIndexes.end() && transaction.getDate().isValid())
+    {
+        qint64 day = transaction.getDate().toJulianDay();
+        it->add(transaction.getUserGiving().getId(), day, -amounts.at(position));
+        it->add(transaction.getUserReceiving().getId(), day, amounts.at(position));
+    }
+}
+
+/*!
+ * Adds (sign 1) or removes (sign -1) a transaction from the totals of its event
+ *
+ * Same rules as the event_summary triggers of DataBase. The transaction must already be
+ * marked as deleted when removed, so the last date can be looked up again without it.
+ */
+void MemoryLedgerStore::updateTotals(int position, int sign)
+{
+    const Transaction &transaction = transactions.at(position);
+    int eventId = transaction.getEvent().getId();
+    QHash<int, EventTotals>::iterator it = totals.find(eventId);
+    if(it == totals.end())
+    {
+        if(sign < 0)
+            return;
+        EventTotals empty;
+        EventSummary summary = {0, 0, 0, 0, 0, QDate()};
+        empty.summary = summary;
+        it = totals.insert(eventId, empty);
+    }
+
+    int giving = transaction.getUserGiving().getId();
+    int receiving = transaction.getUserReceiving().getId();
+    double amount = sign * amounts.at(position);
+    EventSummary &summary = it->summary;
+    if(receiving == kittyId)
+        summary.kittyIn += amount;
+    if(giving == kittyId)
+        summary.kittyOut += amount;
+    summary.volume += amount;
+    summary.transactions += sign;
+
+    QVector<int> participants;
+    participants << giving;
+    if(receiving != giving)
+        participants << receiving;
+    foreach (int userId, participants)
+    {
+        if(userId == kittyId)
+            continue;
+        int &count = it->participants[userId];
+        count += sign;
+        if(count <= 0)
+            it->participants.remove(userId);
+    }
+
+    QDate date = transaction.getDate();
+    if(sign > 0 && date.isValid() && (!summary.lastDate.isValid() || date > summary.lastDate))
+        summary.lastDate = date;
+    else if(sign < 0 && date == summary.lastDate)
+    {
+        summary.lastDate = QDate();
+        foreach (int position, liveTransactions(transactionsOfEvent, eventId))
+        {
+            QDate other = transactions.at(position).getDate();
+            if(other.isValid() && (!summary.lastDate.isValid() || other > summary.lastDate))
+                summary.lastDate = other;
+        }
+    }
+
+    if(summary.transactions <= 0)
+        totals.erase(it);
+}
+
+/*!
+ * Returns the balance index of an event, building it from its dated transactions the first time,
+ * with the split expenses expanded
+ */
+BalanceIndex &MemoryLedgerStore::getBalanceIndex(int eventId)
+{
+    QHash<int, BalanceIndex>::iterator it = balanceIndexes.find(eventId);
+    if(it != balanceIndexes.end())
+        return it.value();
+
+    QVector<BalanceIndex::Flow> flows;
+    foreach (const Transaction &transaction, getEventTransactions(eventId))
+    {
+        if(!transaction.getDate().isValid())
+            continue;
+        qint64 day = transaction.getDate().toJulianDay();
+        BalanceIndex::Flow gives = {transaction.getUserGiving().getId(), day, transaction.getAmount()};
+        BalanceIndex::Flow receives = {transaction.getUserReceiving().getId(), day, -transaction.getAmount()};
+        flows << gives << receives;
+    }
+    return balanceIndexes.insert(eventId, BalanceIndex(flows)).value();
+}
+
+/*!
+ * Returns the converter to a currency, with the rates to it and the inverse of the rates from it
+ * like DataBase::getCurrencyConverter()
+ */
+const CurrencyConverter &MemoryLedgerStore::getCurrencyConverter(const QString &base)
+{
+    QHash<QString, CurrencyConverter>::const_iterator it = converters.constFind(base);
+    if(it != converters.constEnd())
+        return it.value();
+
+    CurrencyConverter converter(base);
+    foreach (const CurrencyConverter::Rate &rate, rates)
+    {
+        qint64 day = rate.date.isValid() ? rate.date.toJulianDay() : 0;
+        if(rate.currency == base)
+            converter.addRate(rate.base, day, rate.rate);
+        else if(rate.base == base)
+            converter.addRate(rate.currency, day, 1.0 / rate.rate);
+    }
+    return converters.insert(base, converter).value();
+}
+
+/*!
+ * Returns the amount of a transaction in the currency of its event, left as it is if there is no rate
+ */
+double MemoryLedgerStore::convertAmount(const Transaction &transaction)
+{
+    if(transaction.getCurrency().isEmpty())
+        return transaction.getAmount();
+    qint64 day = transaction.getDate().isValid() ? transaction.getDate().toJulianDay() : 0;
+    double factor = getCurrencyConverter(getEventCurrency(transaction.getEvent().getId())).factor(transaction.getCurrency(), day);
+    return factor ? transaction.getAmount() * factor : transaction.getAmount();
+}
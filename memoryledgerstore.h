@@ -0,0 +1,238 @@
+#ifndef MEMORYLEDGERSTORE_H
+#define MEMORYLEDGERSTORE_H
+
+#include "balanceindex.h"
+#include "ledgerstore.h"
+
+/*!
+ * \brief Append-only in-memory storage of the users, events and transactions
+ *
+ * Records are appended to vectors and never moved: a delete only marks the record, so the
+ * positions kept by the indexes stay valid. Hash indexes map each id to its position and each
+ * event and user to the positions of its transactions, and the totals of every event are kept
+ * up to date on add and delete like the event_summary triggers of DataBase. Split expenses are
+ * kept apart, the events with any are summed from their expanded transactions instead. Amounts
+ * in another currency are converted to the one of their event when added, and again for all of
+ * them when rates are imported. Finished events keep their snapshot until their transactions
+ * or split expenses change. Nothing is written to disk.
+ */
+class MemoryLedgerStore : public LedgerStore
+{
+public:
+    //! \brief Empty store with the kitty user only
+    MemoryLedgerStore();
+
+    // LedgerStore, see there for the documentation
+    QString getBackendName() const {return QLatin1String("Memory");}
+    int getKittyId(bool loadFromDb = false);
+    QSqlError getLastError();
+    bool isDatabaseEmpty();
+    QVariant addUser(const User &newUser);
+    QSqlError addUsers(const QVector<User> &users, QVector<int> *skipped = 0);
+    QVariant addEvent(const Event &newEvent);
+    QVariant addTransaction(const Transaction &newTransaction);
+    void setDuplicateCheck(const DuplicateCheck &check) {duplicateCheck = check;}
+    DuplicateCheck getDuplicateCheck() const {return duplicateCheck;}
+    int getLastDuplicate() const {return lastDuplicate;}
+    int findDuplicateTransaction(const Transaction &transaction);
+    QSqlError importTransactions(const QVector<Transaction> &transactions, QVector<int> *duplicates = 0);
+    QSqlError deleteTransaction(int transactionId);
+    QSqlError deleteTransactions(const QVector<int> &transactionIds);
+    QSqlError deleteEvent(int eventId);
+    QSqlError deleteEventCascade(int eventId);
+    QSqlError deleteUser(int userId);
+    QSqlError deleteUserCascade(int userId);
+    Transaction getTransaction(int id);
+    Event getEvent(int id);
+    User getUser(int id);
+    QVector<User> getUsers();
+    QVector<Event> getEvents();
+    QVector<Event> getEventsWithTransactions();
+    const UserIndex &getUserIndex() {return userIndex;}
+    int getNumEventsOfUser(int userId);
+    int getNumTransactions(int userId = -1, int eventId = -1);
+    double calcAmountKitty(int eventId);
+    double getAmountBetween(int eventId, int userGivingId, int userReceivingId);
+    QList<int> getUsersGiving(int eventId);
+    QList<int> getUsersReceiving(int eventId, int userGivingId);
+    int calcNumUsers(int eventId);
+    EventSummary getEventSummary(int eventId);
+    QVector<KittyBalancePoint> getKittyBalanceSeries(int eventId);
+    QVector<SpendingPoint> getSpendingSeries(int eventId, int userId = -1);
+    QVector<SpenderTotal> getTopSpenders(int eventId, int limit = 10);
+    QVector<PlaceTotal> getTopPlaces(int eventId, int limit = 10);
+    AmountSketch getAmountSketch(int eventId = -1, int userId = -1);
+    QVector<Transaction> getTransactionsBetween(QDate from, QDate to, int eventId = -1);
+    double sumBetween(QDate from, QDate to, int eventId = -1);
+    double getBalanceAsOf(int eventId, int userId, QDate date);
+    QHash<int, double> getBalancesAsOf(int eventId, QDate date);
+    QVector<Settlement::EventBalances> getEventBalances(const QVector<int> &eventIds);
+    QSqlError finishEvent(int eventId);
+    QSqlError reopenEvent(int eventId);
+    bool getEventSnapshot(int eventId, EventSnapshot *snapshot);
+    QString getEventCurrency(int eventId);
+    bool isCurrencyConvertible(int eventId, const QString &currency);
+    QSqlError importExchangeRates(const QVector<CurrencyConverter::Rate> &rates);
+    QVector<Transaction> getEventTransactions(int eventId);
+    QVariant addSplit(const SplitExpense &split);
+    QSqlError deleteSplit(int splitId);
+    QVector<SplitExpense> getEventSplits(int eventId);
+    int getNumSplits(int eventId = -1);
+    int getNumSplitsOfUser(int userId);
+
+private:
+    /*!
+     * \brief Totals of an event and the users taking part in it
+     */
+    struct EventTotals
+    {
+        //! \brief Totals, participants not filled in
+        EventSummary summary;
+        //! \brief Number of transactions of each user, the kitty excluded
+        QHash<int, int> participants;
+    };
+
+    /*!
+     * \brief Returns the position of a live record
+     * \param positions position of each id
+     * \param deleted deleted flag of each position
+     * \param id record id
+     * \return position, -1 if not found or deleted
+     */
+    static int livePosition(const QHash<int, int> &positions, const QVector<bool> &deleted, int id);
+    /*!
+     * \brief Returns the positions of the live transactions of an event or a user
+     * \param index positions of the transactions of each event or user
+     * \param id event or user id
+     * \return positions, in insertion order
+     */
+    QVector<int> liveTransactions(const QHash<int, QVector<int> > &index, int id) const;
+    /*!
+     * \brief Returns the positions of the live split expenses of an event or a user
+     * \param index positions of the split expenses of each event or user
+     * \param id event or user id
+     * \return positions, in insertion order
+     */
+    QVector<int> liveSplits(const QHash<int, QVector<int> > &index, int id) const;
+    /*!
+     * \brief Marks a split expense as deleted
+     * \param position position of the split expense
+     */
+    void removeSplitAt(int position);
+    /*!
+     * \brief Appends a transaction already checked and adds it to the totals of its event
+     * \param newTransaction New transaction
+     * \return Id of added transaction
+     */
+    int appendTransaction(const Transaction &newTransaction);
+    /*!
+     * \brief Marks a transaction as deleted and takes it out of the totals and the balance index
+     * \param position position of the transaction
+     */
+    void removeTransactionAt(int position);
+    /*!
+     * \brief Adds (sign 1) or removes (sign -1) a transaction from the totals of its event
+     * \param position position of the transaction
+     * \param sign 1 if added, -1 if deleted
+     */
+    void updateTotals(int position, int sign);
+    /*!
+     * \brief Returns the converter to a currency, built from the rates the first time
+     * \param base ISO 4217 code of the currency the amounts are converted to
+     * \return converter
+     */
+    const CurrencyConverter &getCurrencyConverter(const QString &base);
+    /*!
+     * \brief Returns the amount of a transaction in the currency of its event
+     * \param transaction transaction
+     * \return amount, left as it is if there is no rate
+     */
+    double convertAmount(const Transaction &transaction);
+    /*!
+     * \brief Returns the balance index of an event, building it from its transactions if needed
+     * \param eventId Event id
+     * \return balance index
+     */
+    BalanceIndex &getBalanceIndex(int eventId);
+
+    //! \brief Id of the kitty
+    int kittyId;
+    //! \brief Last error
+    QSqlError lastError;
+
+    //! \brief Users, in insertion order
+    QVector<User> users;
+    //! \brief Deleted flag of each user
+    QVector<bool> usersDeleted;
+    //! \brief Position of each user id
+    QHash<int, int> userPositions;
+    //! \brief Id of each live nickname
+    QHash<QString, int> nicknames;
+    //! \brief Id of each live email
+    QHash<QString, int> emails;
+    //! \brief Prefix search index of the live users
+    UserIndex userIndex;
+    //! \brief Next user id
+    int nextUserId;
+
+    //! \brief Events, in insertion order
+    QVector<Event> events;
+    //! \brief Deleted flag of each event
+    QVector<bool> eventsDeleted;
+    //! \brief Position of each event id
+    QHash<int, int> eventPositions;
+    //! \brief Positions of the events administered by each user id
+    QHash<int, QVector<int> > eventsOfAdmin;
+    //! \brief Snapshot of each finished event id, dropped when its transactions or split expenses change
+    QHash<int, EventSnapshot> snapshots;
+    //! \brief Next event id
+    int nextEventId;
+
+    //! \brief Transactions, in insertion order
+    QVector<Transaction> transactions;
+    //! \brief Deleted flag of each transaction
+    QVector<bool> transactionsDeleted;
+    //! \brief Position of each transaction id
+    QHash<int, int> transactionPositions;
+    //! \brief Positions of the transactions of each event id
+    QHash<int, QVector<int> > transactionsOfEvent;
+    //! \brief Positions of the transactions of each user id, giving or receiving
+    QHash<int, QVector<int> > transactionsOfUser;
+    //! \brief Amount of each transaction in the currency of its event
+    QVector<double> amounts;
+    //! \brief Positions of the transactions of each fingerprint, see transactionFingerprint()
+    QMultiHash<qint64, int> fingerprints;
+    //! \brief How duplicates are handled, see setDuplicateCheck()
+    DuplicateCheck duplicateCheck;
+    //! \brief Transaction matched by the last addTransaction(), -1 if none
+    int lastDuplicate;
+    //! \brief Number of live transactions
+    int liveTransactionCount;
+    //! \brief Next transaction id
+    int nextTransactionId;
+
+    //! \brief Split expenses, in insertion order
+    QVector<SplitExpense> splits;
+    //! \brief Deleted flag of each split expense
+    QVector<bool> splitsDeleted;
+    //! \brief Position of each split expense id
+    QHash<int, int> splitPositions;
+    //! \brief Positions of the split expenses of each event id
+    QHash<int, QVector<int> > splitsOfEvent;
+    //! \brief Positions of the split expenses of each user id, paying or with a share
+    QHash<int, QVector<int> > splitsOfUser;
+    //! \brief Next split expense id
+    int nextSplitId;
+
+    //! \brief Totals of the transactions of each event id with transactions, the split expenses not counted
+    QHash<int, EventTotals> totals;
+    //! \brief Balance index of each event id, built on first use
+    QHash<int, BalanceIndex> balanceIndexes;
+
+    //! \brief Exchange rates, in import order
+    QVector<CurrencyConverter::Rate> rates;
+    //! \brief Converter to each base currency, built on first use
+    QHash<QString, CurrencyConverter> converters;
+};
+
+#endif // MEMORYLEDGERSTORE_H
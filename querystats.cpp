@@ -0,0 +1,419 @@
+#include "querystats.h"
+#include "trace.h"
+
+#include <algorithm>
+
+/*!
+ * Returns the upper bound in microseconds of a histogram bucket
+ */
+static qint64 bucketLimitUs(int bucket)
+{
+    return Q_INT64_C(1) << bucket;
+}
+
+/*!
+ * Returns the histogram bucket of a duration
+ */
+static int bucketOf(qint64 elapsedNs)
+{
+    qint64 us = elapsedNs / 1000;
+    int bucket = 0;
+    while(bucket < QueryStats::NumBuckets - 1 && us >= bucketLimitUs(bucket))
+        bucket++;
+    return bucket;
+}
+
+/*!
+ * Returns an upper bound of a percentile estimated from the histogram of an entry
+ */
+static qint64 percentileUs(const QueryStats::Entry &entry, double percentile)
+{
+    qint64 target = qCeil(entry.count * percentile);
+    qint64 seen = 0;
+    for(int i = 0; i < QueryStats::NumBuckets; i++)
+    {
+        seen += entry.buckets[i];
+        if(seen >= target)
+            return bucketLimitUs(i);
+    }
+    return bucketLimitUs(QueryStats::NumBuckets - 1);
+}
+
+/*!
+ * Query statistics constructor
+ *
+ * The slow-query threshold can be given in milliseconds with the environment variable
+ * CHEAPYAPP_SLOW_QUERY_MS (100 ms by default).
+ */
+QueryStats::QueryStats()
+{
+    bool ok = false;
+    slowQueryMs = qEnvironmentVariableIntValue("CHEAPYAPP_SLOW_QUERY_MS", &ok);
+    if(!ok)
+        slowQueryMs = 100;
+    slowQueryLogPath = QDir::toNativeSeparators("CheapyApp_slow_queries.log");
+}
+
+/*!
+ * Returns the application wide instance
+ */
+QueryStats &QueryStats::instance()
+{
+    static QueryStats queryStats;
+    return queryStats;
+}
+
+/*!
+ * Executes a prepared query and records its statistics
+ */
+bool QueryStats::exec(QSqlQuery &query, const char *callSite)
+{
+    TRACE_SCOPE_CAT(callSite, "sql");
+    QElapsedTimer timer;
+    timer.start();
+    bool success = query.exec();
+    qint64 elapsed = timer.nsecsElapsed();
+
+    instance().record(query.lastQuery(), callSite, query.isSelect() ? -1 : query.numRowsAffected(), elapsed, query);
+    return success;
+}
+
+/*!
+ * Executes a statement and records its statistics
+ */
+bool QueryStats::exec(QSqlQuery &query, const QString &statement, const char *callSite)
+{
+    TRACE_SCOPE_CAT(callSite, "sql");
+    QElapsedTimer timer;
+    timer.start();
+    bool success = query.exec(statement);
+    qint64 elapsed = timer.nsecsElapsed();
+
+    instance().record(statement, callSite, query.isSelect() ? -1 : query.numRowsAffected(), elapsed, query);
+    return success;
+}
+
+/*!
+ * Executes a batch and records its statistics, counting the rows of the bound value lists
+ */
+bool QueryStats::execBatch(QSqlQuery &query, const char *callSite)
+{
+    TRACE_SCOPE_CAT(callSite, "sql");
+    QElapsedTimer timer;
+    timer.start();
+    bool success = query.execBatch();
+    qint64 elapsed = timer.nsecsElapsed();
+
+    QVariantList values = query.boundValues().values();
+    int rows = values.isEmpty() ? 0 : values.first().toList().size();
+    instance().record(query.lastQuery(), callSite, rows, elapsed, query);
+    return success;
+}
+
+/*!
+ * Executes a statement, assigns it to a query model and records its statistics
+ *
+ * The time to fetch the first block of rows into the model is included.
+ */
+void QueryStats::setQuery(QSqlQueryModel *model, const QString &statement, const char *callSite, const QSqlDatabase &db)
+{
+    TRACE_SCOPE_CAT(callSite, "sql");
+    QElapsedTimer timer;
+    timer.start();
+    QSqlQuery query(db);
+    query.exec(statement);
+    model->setQuery(query);
+    qint64 elapsed = timer.nsecsElapsed();
+
+    instance().record(statement, callSite, model->rowCount(), elapsed, query);
+}
+
+/*!
+ * Populates a table model and records the statistics of its select statement
+ */
+bool QueryStats::select(QSqlTableModel *model, const char *callSite)
+{
+    TRACE_SCOPE_CAT(callSite, "sql");
+    QElapsedTimer timer;
+    timer.start();
+    bool success = model->select();
+    qint64 elapsed = timer.nsecsElapsed();
+
+    QSqlQuery query = model->query();
+    instance().record(query.lastQuery(), callSite, model->rowCount(), elapsed, query);
+    return success;
+}
+
+/*!
+ * Replaces literals by '?' and collapses whitespace of a statement
+ *
+ * Numbers which are part of an identifier (e.g. a column named "value2") are kept.
+ * Lists of placeholders, as in "IN (?, ?, ?)", are collapsed to "?...".
+ */
+QString QueryStats::normalize(const QString &statement)
+{
+    QString result;
+    result.reserve(statement.size());
+
+    int i = 0;
+    const int length = statement.size();
+    while(i < length)
+    {
+        QChar c = statement.at(i);
+        if(c == QLatin1Char('\''))
+        {
+            // String literal, quotes are escaped by doubling them
+            i++;
+            while(i < length)
+            {
+                if(statement.at(i) == QLatin1Char('\''))
+                {
+                    if(i + 1 < length && statement.at(i + 1) == QLatin1Char('\''))
+                        i++;
+                    else
+                        break;
+                }
+                i++;
+            }
+            i++;
+            result.append(QLatin1Char('?'));
+        }
+        else if(c.isDigit() && (result.isEmpty() || !(result.at(result.size() - 1).isLetterOrNumber()
+                                                      || result.at(result.size() - 1) == QLatin1Char('_'))))
+        {
+            while(i < length && (statement.at(i).isDigit() || statement.at(i) == QLatin1Char('.')))
+                i++;
+            result.append(QLatin1Char('?'));
+        }
+        else if(c.isSpace())
+        {
+            while(i < length && statement.at(i).isSpace())
+                i++;
+            if(!result.isEmpty())
+                result.append(QLatin1Char(' '));
+        }
+        else
+        {
+            result.append(c);
+            i++;
+        }
+    }
+
+    static const QRegularExpression placeholderList("\\?(\\s*,\\s*\\?)+");
+    result.replace(placeholderList, QLatin1String("?..."));
+
+    return result.trimmed();
+}
+
+/*!
+ * Records one execution of a statement
+ *
+ * Executions slower than the threshold are written to the slow-query log together with
+ * their query plan. Each statement is only explained once.
+ */
+void QueryStats::record(const QString &statement, const char *callSite, int rows, qint64 elapsedNs, const QSqlQuery &query)
+{
+    QString normalized = normalize(statement);
+    QString key = normalized + QLatin1Char('\n') + QLatin1String(callSite);
+    bool slow = elapsedNs >= qint64(slowQueryMs) * 1000000;
+    bool explained = true;
+
+    {
+        QMutexLocker locker(&mutex);
+        QHash<QString, Entry>::iterator it = stats.find(key);
+        if(it == stats.end())
+        {
+            Entry entry;
+            entry.statement = normalized;
+            entry.callSite = QLatin1String(callSite);
+            entry.count = 0;
+            entry.rows = 0;
+            entry.totalNs = 0;
+            entry.maxNs = 0;
+            for(int i = 0; i < NumBuckets; i++)
+                entry.buckets[i] = 0;
+            it = stats.insert(key, entry);
+        }
+        it->count++;
+        if(rows > 0)
+            it->rows += rows;
+        it->totalNs += elapsedNs;
+        it->maxNs = qMax(it->maxNs, elapsedNs);
+        it->buckets[bucketOf(elapsedNs)]++;
+
+        if(slow)
+            explained = plans.contains(normalized);
+    }
+
+    if(!slow)
+        return;
+
+    // The plan is obtained outside the lock, it runs another statement on the same connection
+    QString plan;
+    if(!explained)
+    {
+        plan = explain(query);
+        QMutexLocker locker(&mutex);
+        plans.insert(normalized, plan);
+    }
+    else
+    {
+        QMutexLocker locker(&mutex);
+        plan = plans.value(normalized);
+    }
+
+    logSlowQuery(statement, callSite, elapsedNs, plan);
+}
+
+/*!
+ * Returns the plan of a statement as given by EXPLAIN QUERY PLAN
+ *
+ * Only data manipulation statements are explained. The explanation is executed through
+ * the driver of the given query, so it uses the same connection.
+ */
+QString QueryStats::explain(const QSqlQuery &query)
+{
+    QString statement = query.lastQuery().trimmed();
+    static const QRegularExpression dml("^(select|insert|update|delete|replace|with)\\b",
+                                        QRegularExpression::CaseInsensitiveOption);
+    if(!query.driver() || !dml.match(statement).hasMatch())
+        return QString();
+
+    QSqlQuery explainQuery(query.driver()->createResult());
+    if(!explainQuery.prepare(QLatin1String("EXPLAIN QUERY PLAN ") + statement))
+        return explainQuery.lastError().text();
+
+    int numValues = query.boundValues().size();
+    for(int i = 0; i < numValues; i++)
+        explainQuery.addBindValue(query.boundValue(i));
+
+    if(!explainQuery.exec())
+        return explainQuery.lastError().text();
+
+    QStringList steps;
+    while(explainQuery.next())
+        steps.append(explainQuery.value(3).toString());
+
+    return steps.join(QLatin1Char('\n'));
+}
+
+/*!
+ * Writes a slow statement to the slow-query log
+ */
+void QueryStats::logSlowQuery(const QString &statement, const char *callSite, qint64 elapsedNs, const QString &plan)
+{
+    QMutexLocker locker(&mutex);
+
+    QFile file(slowQueryLogPath);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+    {
+        qWarning() << "Unable to write slow-query log" << slowQueryLogPath;
+        return;
+    }
+
+    QTextStream out(&file);
+    out << QDateTime::currentDateTime().toString(Qt::ISODate)
+        << " " << QString::number(elapsedNs / 1000000.0, 'f', 3) << " ms"
+        << " in " << callSite << "\n"
+        << "    " << statement.simplified() << "\n";
+    foreach(const QString &step, plan.split(QLatin1Char('\n'), QString::SkipEmptyParts))
+        out << "    plan: " << step << "\n";
+}
+
+/*!
+ * Returns the aggregated statistics, sorted by total time
+ */
+QList<QueryStats::Entry> QueryStats::entries()
+{
+    QList<Entry> result;
+    {
+        QMutexLocker locker(&mutex);
+        result = stats.values();
+    }
+    std::sort(result.begin(), result.end(), [](const Entry &a, const Entry &b) {
+        return a.totalNs > b.totalNs;
+    });
+    return result;
+}
+
+/*!
+ * Returns the aggregated statistics as human readable text
+ */
+QString QueryStats::report()
+{
+    QList<Entry> all = entries();
+
+    QString result;
+    QTextStream out(&result);
+    out << "SQL statistics (" << all.size() << " statements, slow-query threshold "
+        << slowQueryMs << " ms, log: " << slowQueryLogPath << ")\n";
+
+    foreach(const Entry &entry, all)
+    {
+        out << "\n" << entry.statement << "\n"
+            << "    at " << entry.callSite << "\n"
+            << "    count " << entry.count
+            << ", total " << QString::number(entry.totalNs / 1000000.0, 'f', 3) << " ms"
+            << ", avg " << QString::number(entry.totalNs / 1000.0 / entry.count, 'f', 1) << " us"
+            << ", max " << QString::number(entry.maxNs / 1000000.0, 'f', 3) << " ms"
+            << ", rows " << entry.rows << "\n"
+            << "    p50 < " << percentileUs(entry, 0.50) << " us"
+            << ", p95 < " << percentileUs(entry, 0.95) << " us"
+            << ", p99 < " << percentileUs(entry, 0.99) << " us\n"
+            << "    histogram:";
+        for(int i = 0; i < NumBuckets; i++)
+        {
+            if(entry.buckets[i])
+                out << " <" << bucketLimitUs(i) << "us:" << entry.buckets[i];
+        }
+        out << "\n";
+    }
+
+    return result;
+}
+
+/*!
+ * Discards all the recorded statistics
+ */
+void QueryStats::reset()
+{
+    QMutexLocker locker(&mutex);
+    stats.clear();
+    plans.clear();
+}
+
+/*!
+ * Sets the slow-query threshold in milliseconds
+ */
+void QueryStats::setSlowQueryThreshold(int ms)
+{
+    QMutexLocker locker(&mutex);
+    slowQueryMs = ms;
+}
+
+/*!
+ * Returns the slow-query threshold in milliseconds
+ */
+int QueryStats::getSlowQueryThreshold()
+{
+    QMutexLocker locker(&mutex);
+    return slowQueryMs;
+}
+
+/*!
+ * Sets the path of the slow-query log
+ */
+void QueryStats::setSlowQueryLogPath(const QString &path)
+{
+    QMutexLocker locker(&mutex);
+    slowQueryLogPath = path;
+}
+
+/*!
+ * Returns the path of the slow-query log
+ */
+QString QueryStats::getSlowQueryLogPath()
+{
+    QMutexLocker locker(&mutex);
+    return slowQueryLogPath;
+}
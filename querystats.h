@@ -0,0 +1,172 @@
+#ifndef QUERYSTATS_H
+#define QUERYSTATS_H
+
+#include <QtSql>
+
+//! \brief Instrumentation of the SQL statements executed by the application
+class QueryStats
+{
+public:
+    /*!
+     * \brief Number of buckets of the latency histogram (powers of two in microseconds)
+     */
+    static const int NumBuckets = 24;
+
+    /*!
+     * \brief Aggregated statistics of one normalized statement at one call site
+     */
+    struct Entry
+    {
+        //! \brief Normalized statement text (literals replaced by '?')
+        QString statement;
+        //! \brief Function which executed the statement
+        QString callSite;
+        //! \brief Number of executions
+        qint64 count;
+        //! \brief Number of rows fetched or affected (only known rows are added)
+        qint64 rows;
+        //! \brief Total wall time in nanoseconds
+        qint64 totalNs;
+        //! \brief Maximum wall time of a single execution in nanoseconds
+        qint64 maxNs;
+        //! \brief Latency histogram. Bucket i counts executions below 2^i microseconds
+        qint64 buckets[NumBuckets];
+    };
+
+    /*!
+     * \brief Returns the application wide instance
+     * \return query statistics
+     */
+    static QueryStats &instance();
+
+    /*!
+     * \brief Executes a prepared query and records its statistics
+     * \param query prepared query with bound values
+     * \param callSite function executing the query (Q_FUNC_INFO)
+     * \return true if success
+     */
+    static bool exec(QSqlQuery &query, const char *callSite);
+    /*!
+     * \brief Executes a statement and records its statistics
+     * \param query query object used for the execution
+     * \param statement sql statement
+     * \param callSite function executing the query (Q_FUNC_INFO)
+     * \return true if success
+     */
+    static bool exec(QSqlQuery &query, const QString &statement, const char *callSite);
+    /*!
+     * \brief Executes a prepared query once per row of the bound value lists and records its statistics
+     * \param query prepared query with bound QVariantList values
+     * \param callSite function executing the query (Q_FUNC_INFO)
+     * \return true if success
+     */
+    static bool execBatch(QSqlQuery &query, const char *callSite);
+    /*!
+     * \brief Executes a statement, assigns it to a query model and records its statistics
+     * \param model query model
+     * \param statement sql statement
+     * \param callSite function executing the query (Q_FUNC_INFO)
+     * \param db database connection (default connection if not given)
+     */
+    static void setQuery(QSqlQueryModel *model, const QString &statement, const char *callSite,
+                         const QSqlDatabase &db = QSqlDatabase::database());
+    /*!
+     * \brief Populates a table model and records the statistics of its select statement
+     * \param model table model
+     * \param callSite function executing the query (Q_FUNC_INFO)
+     * \return true if success
+     */
+    static bool select(QSqlTableModel *model, const char *callSite);
+
+    /*!
+     * \brief Replaces literals by '?' and collapses whitespace of a statement
+     * \param statement sql statement
+     * \return normalized statement
+     */
+    static QString normalize(const QString &statement);
+
+    /*!
+     * \brief Records one execution of a statement
+     * \param statement sql statement as executed
+     * \param callSite function executing the query
+     * \param rows number of rows fetched or affected (-1 if unknown)
+     * \param elapsedNs wall time in nanoseconds
+     * \param query executed query, used to explain slow statements
+     */
+    void record(const QString &statement, const char *callSite, int rows, qint64 elapsedNs, const QSqlQuery &query);
+    /*!
+     * \brief Returns the aggregated statistics, sorted by total time
+     * \return statistics of each statement and call site
+     */
+    QList<Entry> entries();
+    /*!
+     * \brief Returns the aggregated statistics as human readable text
+     * \return report
+     */
+    QString report();
+    /*!
+     * \brief Discards all the recorded statistics
+     */
+    void reset();
+    /*!
+     * \brief Sets the duration above which a statement is written to the slow-query log
+     * \param ms threshold in milliseconds
+     */
+    void setSlowQueryThreshold(int ms);
+    /*!
+     * \brief Returns the slow-query threshold
+     * \return threshold in milliseconds
+     */
+    int getSlowQueryThreshold();
+    /*!
+     * \brief Sets the path of the slow-query log
+     * \param path log file path
+     */
+    void setSlowQueryLogPath(const QString &path);
+    /*!
+     * \brief Returns the path of the slow-query log
+     * \return log file path
+     */
+    QString getSlowQueryLogPath();
+
+private:
+    //! \brief Query statistics constructor
+    QueryStats();
+    /*!
+     * \brief Returns the plan of a statement as given by EXPLAIN QUERY PLAN
+     * \param query executed query (statement and bound values are reused)
+     * \return query plan, one step per line
+     */
+    static QString explain(const QSqlQuery &query);
+    /*!
+     * \brief Writes a slow statement to the slow-query log
+     * \param statement sql statement as executed
+     * \param callSite function executing the query
+     * \param elapsedNs wall time in nanoseconds
+     * \param plan query plan
+     */
+    void logSlowQuery(const QString &statement, const char *callSite, qint64 elapsedNs, const QString &plan);
+
+    /*!
+     * \brief Protects the statistics, queries can be executed from several threads
+     */
+    QMutex mutex;
+    /*!
+     * \brief Statistics indexed by normalized statement and call site
+     */
+    QHash<QString, Entry> stats;
+    /*!
+     * \brief Query plans of the statements already explained
+     */
+    QHash<QString, QString> plans;
+    /*!
+     * \brief Slow-query threshold in milliseconds
+     */
+    int slowQueryMs;
+    /*!
+     * \brief Path of the slow-query log
+     */
+    QString slowQueryLogPath;
+};
+
+#endif // QUERYSTATS_H
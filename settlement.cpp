@@ -0,0 +1,246 @@
+#include "settlement.h"
+#include "trace.h"
+
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+//! Balance of a user in cents
+struct Account
+{
+    int userId;
+    qint64 cents;
+};
+
+//! Net balances in cents of some events per currency, with the payments settling them one by one
+struct Totals
+{
+    Totals() : events(0), payments(0) {}
+    QHash<QString, QHash<int, qint64> > cents;
+    int events;
+    int payments;
+};
+
+//! Rounds balances to cents keeping their sum: each is rounded down, and the cents left over by the
+//! rounding go one each to the largest fractional parts, by id on ties
+QHash<int, qint64> toCents(const QHash<int, double> &balances)
+{
+    struct Fraction
+    {
+        int userId;
+        double part;
+    };
+    QHash<int, qint64> cents;
+    QVector<Fraction> fractions;
+    double total = 0;
+    qint64 rounded = 0;
+    for(QHash<int, double>::const_iterator it = balances.constBegin(); it != balances.constEnd(); ++it)
+    {
+        double exact = it.value() * 100;
+        // A balance a hair off a whole cent is that cent, not a fraction to be spread
+        if(qAbs(exact - qRound64(exact)) < 1e-6)
+            exact = qRound64(exact);
+        const qint64 down = qint64(std::floor(exact));
+        cents.insert(it.key(), down);
+        Fraction fraction = {it.key(), exact - down};
+        if(fraction.part > 0)
+            fractions.append(fraction);
+        total += exact;
+        rounded += down;
+    }
+
+    std::sort(fractions.begin(), fractions.end(), [](const Fraction &a, const Fraction &b) {
+        return a.part != b.part ? a.part > b.part : a.userId < b.userId;
+    });
+    const qint64 remainder = qMin(qRound64(total) - rounded, qint64(fractions.size()));
+    for(int i = 0; i < remainder; i++)
+        cents[fractions.at(i).userId]++;
+    return cents;
+}
+
+//! Maps an event to its totals: its balances rounded to cents and the size of its own plan
+Totals eventTotals(const Settlement::EventBalances &event)
+{
+    Totals totals;
+    totals.events = 1;
+    totals.payments = Settlement::plan(event.balances).size();
+    QHash<int, qint64> &cents = totals.cents[event.currency];
+    const QHash<int, qint64> rounded = toCents(event.balances);
+    for(QHash<int, qint64>::const_iterator it = rounded.constBegin(); it != rounded.constEnd(); ++it)
+        cents[it.key()] += it.value();
+    return totals;
+}
+
+//! Adds the totals of some events to those of others
+void addTotals(Totals &result, const Totals &totals)
+{
+    result.events += totals.events;
+    result.payments += totals.payments;
+    for(auto currency = totals.cents.constBegin(); currency != totals.cents.constEnd(); ++currency)
+    {
+        QHash<int, qint64> &cents = result.cents[currency.key()];
+        for(auto user = currency->constBegin(); user != currency->constEnd(); ++user)
+            cents[user.key()] += user.value();
+    }
+}
+
+//! Plans the payments of each currency from the net balances
+Settlement::Netting plansOf(const Totals &totals)
+{
+    Settlement::Netting netting;
+    netting.events = totals.events;
+    netting.separatePayments = totals.payments;
+    for(auto currency = totals.cents.constBegin(); currency != totals.cents.constEnd(); ++currency)
+    {
+        QHash<int, double> &balances = netting.balances[currency.key()];
+        for(auto user = currency->constBegin(); user != currency->constEnd(); ++user)
+        {
+            if(user.value() != 0)
+                balances.insert(user.key(), user.value() / 100.0);
+        }
+        netting.plans.insert(currency.key(), Settlement::plan(balances));
+    }
+    return netting;
+}
+
+}
+
+/*!
+ * Returns the payments which settle a set of balances
+ *
+ * Users who gave more than they received (positive balance) are paid by those who received
+ * more (negative balance). The balances are rounded to cents by toCents(), so balances adding
+ * up to zero still do in cents and no creditor or debtor is left with a cent. Both sides are
+ * sorted by amount and matched greedily.
+ */
+QVector<Settlement::Payment> Settlement::plan(const QHash<int, double> &balances)
+{
+    QVector<Account> creditors, debtors;
+    const QHash<int, qint64> cents = toCents(balances);
+    for(QHash<int, qint64>::const_iterator it = cents.constBegin(); it != cents.constEnd(); ++it)
+    {
+        Account account = {it.key(), it.value()};
+        if(account.cents > 0)
+            creditors.append(account);
+        else if(account.cents < 0)
+        {
+            account.cents = -account.cents;
+            debtors.append(account);
+        }
+    }
+
+    // Largest first, by id on ties so the plan does not depend on the hash order
+    auto larger = [](const Account &a, const Account &b) {
+        return a.cents != b.cents ? a.cents > b.cents : a.userId < b.userId;
+    };
+    std::sort(creditors.begin(), creditors.end(), larger);
+    std::sort(debtors.begin(), debtors.end(), larger);
+
+    QVector<Payment> payments;
+    int c = 0, d = 0;
+    while(c < creditors.size() && d < debtors.size())
+    {
+        qint64 cents = qMin(creditors[c].cents, debtors[d].cents);
+        Payment payment = {debtors[d].userId, creditors[c].userId, cents / 100.0};
+        payments.append(payment);
+
+        creditors[c].cents -= cents;
+        debtors[d].cents -= cents;
+        if(creditors[c].cents == 0)
+            c++;
+        if(debtors[d].cents == 0)
+            d++;
+    }
+    return payments;
+}
+
+/*!
+ * Returns the payments which settle a set of events together
+ *
+ * Adding up the balances of each user across the events cancels every cycle of debts among
+ * them: a user owing in one event and owed in another only pays or gets the difference. Each
+ * event is mapped on the thread pool to its balances in cents, rounded by toCents() as its own plan is,
+ * and the count of payments of that plan. The totals are added up as the events are mapped,
+ * in cents, so the result does not depend on the order.
+ */
+Settlement::Netting Settlement::net(const QVector<EventBalances> &events)
+{
+    TRACE_FUNCTION();
+    return plansOf(QtConcurrent::mappedReduced(events, eventTotals, addTotals).result());
+}
+
+/*!
+ * Times netting events with three to ten users each out of five hundred, one in ten of them in
+ * another currency, on one thread and with net()
+ */
+QString Settlement::benchmark(int events)
+{
+    const int users = 500;
+    QRandomGenerator random(1);
+    QVector<EventBalances> generated(events);
+    for(int i = 0; i < events; i++)
+    {
+        EventBalances &event = generated[i];
+        event.eventId = i + 1;
+        event.currency = random.bounded(10) ? QLatin1String("EUR") : QLatin1String("PLN");
+        const int eventUsers = random.bounded(3, 11);
+        qint64 total = 0;
+        for(int u = 0; u < eventUsers - 1; u++)
+        {
+            qint64 cents = random.bounded(-20000, 20000);
+            event.balances[random.bounded(1, users + 1)] += cents / 100.0;
+            total += cents;
+        }
+        event.balances[random.bounded(1, users + 1)] -= total / 100.0;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    Totals totals;
+    foreach(const EventBalances &event, generated)
+        addTotals(totals, eventTotals(event));
+    Netting sequential = plansOf(totals);
+    qint64 sequentialNs = timer.nsecsElapsed();
+
+    timer.restart();
+    Netting parallel = net(generated);
+    qint64 parallelNs = timer.nsecsElapsed();
+
+    int nettedPayments = 0;
+    foreach(const QVector<Payment> &payments, parallel.plans)
+        nettedPayments += payments.size();
+
+    QString report;
+    QTextStream out(&report);
+    out << "Netting of " << events << " events among " << users << " users\n";
+    out << "    one thread         " << QString::number(sequentialNs / 1e6, 'f', 1).rightJustified(10) << " ms\n";
+    out << "    thread pool        " << QString::number(parallelNs / 1e6, 'f', 1).rightJustified(10) << " ms on "
+        << QThreadPool::globalInstance()->maxThreadCount() << " threads\n";
+    out << "    " << parallel.separatePayments << " payments settling each event, " << nettedPayments
+        << " settling them together in " << parallel.plans.size() << " currencies\n";
+    out << "    " << (parallel.balances == sequential.balances && parallel.separatePayments == sequential.separatePayments
+                      ? "same net balances on both" : "NET BALANCES DIFFER") << "\n";
+    return report;
+}
+
+/*!
+ * Writes a payment to a data stream
+ */
+QDataStream &operator<<(QDataStream &out, const Settlement::Payment &payment)
+{
+    return out << qint32(payment.from) << qint32(payment.to) << payment.amount;
+}
+
+/*!
+ * Reads a payment from a data stream
+ */
+QDataStream &operator>>(QDataStream &in, Settlement::Payment &payment)
+{
+    qint32 from, to;
+    in >> from >> to >> payment.amount;
+    payment.from = from;
+    payment.to = to;
+    return in;
+}
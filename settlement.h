@@ -0,0 +1,94 @@
+#ifndef SETTLEMENT_H
+#define SETTLEMENT_H
+
+#include <QtCore>
+
+/*!
+ * \brief Plan of payments which settles the balances of an event
+ *
+ * Greedy: the largest debtor pays the largest creditor until one of them is settled, then
+ * the next one is taken. Amounts are handled in cents, so the plan settles every balance
+ * exactly and has at most one payment less than the number of users with a balance. The cents
+ * left over by rounding the balances go to the largest fractional parts, by id on ties.
+ *
+ * Several events are settled together by net(), which adds up the balances of each user
+ * across them before planning.
+ */
+class Settlement
+{
+public:
+    //! \brief Payment of the plan
+    struct Payment
+    {
+        //! \brief Id of the user paying
+        int from;
+        //! \brief Id of the user paid
+        int to;
+        //! \brief Amount of money
+        double amount;
+    };
+
+    //! \brief Balances of the users of one event, see net()
+    struct EventBalances
+    {
+        //! \brief Event id
+        int eventId;
+        //! \brief Currency of the event, ISO 4217 code
+        QString currency;
+        //! \brief Balance of each user id, money given minus money received
+        QHash<int, double> balances;
+    };
+
+    //! \brief Payments which settle a set of events together, see net()
+    struct Netting
+    {
+        //! \brief Payments of each currency, largest first
+        QMap<QString, QVector<Payment> > plans;
+        //! \brief Net balance of each user id in each currency, the settled users left out
+        QMap<QString, QHash<int, double> > balances;
+        //! \brief Number of events
+        int events;
+        //! \brief Number of payments if each event were settled on its own
+        int separatePayments;
+    };
+
+    /*!
+     * \brief Returns the payments which settle a set of balances
+     * \param balances balance of each user id, money given minus money received
+     * \return payments, largest first
+     */
+    static QVector<Payment> plan(const QHash<int, double> &balances);
+    /*!
+     * \brief Returns the payments which settle a set of events together
+     *
+     * The balances are read beforehand by the caller, see DataBase::getEventBalances(). Only the
+     * rounding to cents and the plan of each event on its own run on the threads of the global
+     * thread pool; the balances are then added up per user and one plan is made per currency.
+     * \param events balances of the users of each event
+     * \return payments and net balances
+     */
+    static Netting net(const QVector<EventBalances> &events);
+    /*!
+     * \brief Times netting generated events on one thread and on the thread pool
+     * \param events number of events
+     * \return report
+     */
+    static QString benchmark(int events);
+};
+
+/*!
+ * \brief Writes a payment to a data stream
+ * \param out data stream
+ * \param payment payment
+ * \return data stream
+ */
+QDataStream &operator<<(QDataStream &out, const Settlement::Payment &payment);
+/*!
+ * \brief Reads a payment from a data stream
+ * \param in data stream
+ * \param payment payment
+ * \return data stream
+ */
+QDataStream &operator>>(QDataStream &in, Settlement::Payment &payment);
+
+#endif // SETTLEMENT_H
@@ -0,0 +1,49 @@
+# Sources shared by the application and the tests, everything but main() and the main window
+
+INCLUDEPATH += $$PWD
+
+SOURCES += $$PWD/amountsketch.cpp \
+    $$PWD/avatarcache.cpp \
+    $$PWD/avatarproxymodel.cpp \
+    $$PWD/balanceindex.cpp \
+    $$PWD/currencyconverter.cpp \
+    $$PWD/database.cpp \
+    $$PWD/daynumberdelegate.cpp \
+    $$PWD/dbclasses.cpp \
+    $$PWD/emailvalidator.cpp \
+    $$PWD/eventsnapshot.cpp \
+    $$PWD/ledgerstore.cpp \
+    $$PWD/ledgertablemodel.cpp \
+    $$PWD/memoryledgerstore.cpp \
+    $$PWD/querystats.cpp \
+    $$PWD/settlement.cpp \
+    $$PWD/sqlfilter.cpp \
+    $$PWD/sqlfiltertablemodel.cpp \
+    $$PWD/startupprofile.cpp \
+    $$PWD/trace.cpp \
+    $$PWD/userimport.cpp \
+    $$PWD/userindex.cpp \
+    $$PWD/userpicker.cpp
+
+HEADERS += $$PWD/amountsketch.h \
+    $$PWD/avatarcache.h \
+    $$PWD/avatarproxymodel.h \
+    $$PWD/balanceindex.h \
+    $$PWD/currencyconverter.h \
+    $$PWD/database.h \
+    $$PWD/daynumberdelegate.h \
+    $$PWD/dbclasses.h \
+    $$PWD/emailvalidator.h \
+    $$PWD/eventsnapshot.h \
+    $$PWD/ledgerstore.h \
+    $$PWD/ledgertablemodel.h \
+    $$PWD/memoryledgerstore.h \
+    $$PWD/querystats.h \
+    $$PWD/settlement.h \
+    $$PWD/sqlfilter.h \
+    $$PWD/sqlfiltertablemodel.h \
+    $$PWD/startupprofile.h \
+    $$PWD/trace.h \
+    $$PWD/userimport.h \
+    $$PWD/userindex.h \
+    $$PWD/userpicker.h
@@ -0,0 +1,338 @@
+#include "sqlfilter.h"
+#include "database.h"
+#include "querystats.h"
+
+namespace {
+
+/*!
+ * Returns true if a field name can be written in a statement as it is
+ */
+bool isValidField(const QString &field)
+{
+    if(field.isEmpty() || field.at(0).isDigit())
+        return false;
+    foreach(QChar c, field)
+    {
+        if(!(c.isLetterOrNumber() || c == QLatin1Char('_') || c == QLatin1Char('.')) || c.unicode() > 127)
+            return false;
+    }
+    return true;
+}
+
+/*!
+ * Returns the sql text of an operator
+ */
+const char *opSql(SqlFilter::Op op)
+{
+    switch(op)
+    {
+    case SqlFilter::Equal: return " = ?";
+    case SqlFilter::NotEqual: return " <> ?";
+    case SqlFilter::Less: return " < ?";
+    case SqlFilter::LessEqual: return " <= ?";
+    case SqlFilter::Greater: return " > ?";
+    case SqlFilter::GreaterEqual: return " >= ?";
+    case SqlFilter::Like: return " LIKE ?";
+    case SqlFilter::Is: return " IS ?";
+    case SqlFilter::IsNot: return " IS NOT ?";
+    default: return " = ?";
+    }
+}
+
+/*!
+ * Compares two values which are not null: as numbers if both are, as text otherwise
+ */
+int compareValues(const QVariant &a, const QVariant &b)
+{
+    bool aNumber = false;
+    bool bNumber = false;
+    double aValue = a.toDouble(&aNumber);
+    double bValue = b.toDouble(&bNumber);
+    if(aNumber && bNumber)
+        return aValue < bValue ? -1 : (aValue > bValue ? 1 : 0);
+    return QString::compare(a.toString(), b.toString());
+}
+
+/*!
+ * Returns true if a text matches a LIKE pattern: '%' is any text, '_' any character, and
+ * ASCII letters match in any case
+ */
+bool matchesLike(const QString &text, const QString &pattern)
+{
+    QString expression;
+    foreach(QChar c, pattern)
+    {
+        if(c == QLatin1Char('%'))
+            expression.append(QLatin1String(".*"));
+        else if(c == QLatin1Char('_'))
+            expression.append(QLatin1Char('.'));
+        else
+            expression.append(QRegularExpression::escape(QString(c)));
+    }
+    QRegularExpression regex(QLatin1String("\\A(?:") + expression + QLatin1String(")\\z"),
+                             QRegularExpression::CaseInsensitiveOption | QRegularExpression::DotMatchesEverythingOption);
+    return regex.match(text).hasMatch();
+}
+
+}
+
+/*!
+ * Empty SqlFilter constructor
+ */
+SqlFilter::SqlFilter()
+{
+}
+
+/*!
+ * SqlFilter constructor comparing a field with a value
+ */
+SqlFilter::SqlFilter(const QString &field, Op op, const QVariant &value)
+{
+    Node *leaf = new Node;
+    leaf->kind = Compare;
+    leaf->field = field;
+    leaf->op = op;
+    leaf->value = value;
+    node = QSharedPointer<const Node>(leaf);
+}
+
+/*!
+ * Returns the conjunction of two filters
+ */
+SqlFilter SqlFilter::operator&&(const SqlFilter &other) const
+{
+    return join(And, other);
+}
+
+/*!
+ * Returns the disjunction of two filters
+ */
+SqlFilter SqlFilter::operator||(const SqlFilter &other) const
+{
+    return join(Or, other);
+}
+
+/*!
+ * Joins two filters. Children of the same kind are merged, so (a AND b) AND c and
+ * a AND (b AND c) have the same shape and the same sql.
+ */
+SqlFilter SqlFilter::join(Kind kind, const SqlFilter &other) const
+{
+    if(other.isEmpty())
+        return *this;
+    if(isEmpty())
+        return other;
+
+    Node *joined = new Node;
+    joined->kind = kind;
+    joined->op = Equal;
+    const QSharedPointer<const Node> sides[] = {node, other.node};
+    for(int i = 0; i < 2; i++)
+    {
+        const QSharedPointer<const Node> &side = sides[i];
+        if(side->kind == kind)
+            joined->children += side->children;
+        else
+            joined->children.append(side);
+    }
+
+    SqlFilter result;
+    result.node = QSharedPointer<const Node>(joined);
+    return result;
+}
+
+/*!
+ * Returns the condition with '?' placeholders
+ */
+QString SqlFilter::toSql() const
+{
+    QString sql;
+    QVariantList values;
+    if(node)
+        compile(*node, &sql, &values);
+    return sql;
+}
+
+/*!
+ * Returns the values to bind to the placeholders, in the order they appear in toSql()
+ */
+QVariantList SqlFilter::bindValues() const
+{
+    QString sql;
+    QVariantList values;
+    if(node)
+        compile(*node, &sql, &values);
+    return values;
+}
+
+/*!
+ * Appends the sql and the bind values of a node. Joined children are always parenthesized,
+ * invalid field names compile to a condition which is never true. The statement of InSelect
+ * is part of the shape, it binds nothing.
+ */
+void SqlFilter::compile(const Node &node, QString *sql, QVariantList *values)
+{
+    if(node.kind == Compare)
+    {
+        if(!isValidField(node.field))
+        {
+            qWarning() << "Invalid field in sql filter:" << node.field;
+            sql->append(QLatin1String("0"));
+            return;
+        }
+        if(node.op == InSelect)
+        {
+            sql->append(node.field).append(QLatin1String(" IN (")).append(node.value.toString()).append(QLatin1Char(')'));
+            return;
+        }
+        sql->append(node.field).append(QLatin1String(opSql(node.op)));
+        values->append(node.value);
+        return;
+    }
+
+    for(int i = 0; i < node.children.size(); i++)
+    {
+        if(i > 0)
+            sql->append(node.kind == And ? QLatin1String(" AND ") : QLatin1String(" OR "));
+        const Node &child = *node.children.at(i);
+        if(child.kind == Compare)
+            compile(child, sql, values);
+        else
+        {
+            sql->append(QLatin1Char('('));
+            compile(child, sql, values);
+            sql->append(QLatin1Char(')'));
+        }
+    }
+}
+
+/*!
+ * Returns true if a row matches the filter. An empty filter matches every row.
+ */
+bool SqlFilter::matches(const QVariantHash &row) const
+{
+    return !node || evaluate(*node, row);
+}
+
+/*!
+ * Returns true if a row matches a node. As in sql, a comparison with a null is never true
+ * but for Is and IsNot, and invalid field names never match.
+ */
+bool SqlFilter::evaluate(const Node &node, const QVariantHash &row)
+{
+    if(node.kind == And || node.kind == Or)
+    {
+        foreach(const QSharedPointer<const Node> &child, node.children)
+        {
+            if(evaluate(*child, row) != (node.kind == And))
+                return node.kind == Or;
+        }
+        return node.kind == And;
+    }
+
+    if(!isValidField(node.field) || node.op == InSelect)
+        return false;
+
+    QVariant value = row.value(node.field.mid(node.field.lastIndexOf(QLatin1Char('.')) + 1));
+    bool valueNull = value.isNull();
+    bool otherNull = node.value.isNull();
+    if(node.op == Is || node.op == IsNot)
+    {
+        bool same = (valueNull || otherNull) ? valueNull == otherNull : compareValues(value, node.value) == 0;
+        return same == (node.op == Is);
+    }
+    if(valueNull || otherNull)
+        return false;
+
+    switch(node.op)
+    {
+    case Equal: return compareValues(value, node.value) == 0;
+    case NotEqual: return compareValues(value, node.value) != 0;
+    case Less: return compareValues(value, node.value) < 0;
+    case LessEqual: return compareValues(value, node.value) <= 0;
+    case Greater: return compareValues(value, node.value) > 0;
+    case GreaterEqual: return compareValues(value, node.value) >= 0;
+    case Like: return matchesLike(value.toString(), node.value.toString());
+    default: return false;
+    }
+}
+
+/*!
+ * Compares the refresh of the transactions of an event with the event id spliced in the
+ * statement (a new statement for each event) against the cached prepared statement of the
+ * filter (one statement for all of them)
+ *
+ * The refreshes go round 16 events added beforehand, with 500 generated transactions each.
+ */
+QString SqlFilter::benchmark(DataBase &db, int refreshes)
+{
+    const QString select = QLatin1String("SELECT id, usergives, userreceives, amount, transactionDate FROM transactions WHERE ");
+    const int numEvents = 16;
+    const int eventTransactions = 500;
+    int rows = 0;
+
+    QVector<int> users;
+    QSqlQuery q(db.getConnection());
+    QueryStats::exec(q, QLatin1String("SELECT id FROM users"), Q_FUNC_INFO);
+    while(q.next())
+        users << q.value(0).toInt();
+    if(users.size() < 2)
+        return "Error: no users in the database\n";
+
+    QVector<int> events;
+    QVector<Transaction> transactions;
+    QRandomGenerator random(1);
+    for(int e = 0; e < numEvents; e++)
+    {
+        events << db.addEvent(Event(QString("Filter benchmark %1").arg(e), QDate::currentDate(), User(users.first()))).toInt();
+        for(int i = 0; i < eventTransactions; i++)
+        {
+            const int giver = random.bounded(users.size());
+            transactions.append(Transaction(User(users.at(giver)), User(users.at((giver + 1 + random.bounded(users.size() - 1)) % users.size())),
+                                            Event(events.last()), double(random.bounded(1, 10000)) / 100,
+                                            QDate::currentDate().addDays(-random.bounded(365))));
+        }
+    }
+    if(db.importTransactions(transactions).type() != QSqlError::NoError)
+        return "Error: " + db.getLastError().text() + "\n";
+
+    // Both paths count the calls to prepare() they make
+    int splicedPrepared = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for(int i = 0; i < refreshes; i++)
+    {
+        QSqlQuery query(db.getConnection());
+        if(query.prepare(select + "event = " + QString::number(events.at(i % numEvents))))
+            splicedPrepared++;
+        QueryStats::exec(query, Q_FUNC_INFO);
+        while(query.next())
+            rows++;
+    }
+    qint64 splicedNs = timer.nsecsElapsed();
+
+    int prepared = db.getStatementsPrepared();
+    timer.restart();
+    for(int i = 0; i < refreshes; i++)
+    {
+        SqlFilter filter("event", Equal, events.at(i % numEvents));
+        QSqlQuery query = db.acquireStatement(select + filter.toSql());
+        foreach(const QVariant &value, filter.bindValues())
+            query.addBindValue(value);
+        QueryStats::exec(query, Q_FUNC_INFO);
+        while(query.next())
+            rows++;
+        db.releaseStatement(query);
+    }
+    qint64 filterNs = timer.nsecsElapsed();
+    prepared = db.getStatementsPrepared() - prepared;
+
+    QString report;
+    QTextStream out(&report);
+    out << "Refresh of the transactions of an event, " << refreshes << " times (" << rows << " rows read)\n";
+    out << "    spliced literals   " << QString::number(splicedNs / 1e6, 'f', 1).rightJustified(10) << " ms, "
+        << splicedPrepared << " statements prepared\n";
+    out << "    cached filter      " << QString::number(filterNs / 1e6, 'f', 1).rightJustified(10) << " ms, "
+        << prepared << " statements prepared\n";
+    return report;
+}
@@ -0,0 +1,135 @@
+#ifndef SQLFILTER_H
+#define SQLFILTER_H
+
+#include <QtCore>
+
+class DataBase;
+
+/*!
+ * \brief Filter expression of an sql query: comparisons of fields with values joined by and/or
+ *
+ * A filter compiles to a WHERE template with '?' placeholders plus the values to bind, so
+ * filters of the same shape (same fields, operators and nesting) give the same statement
+ * text, which is prepared once and reused through DataBase::acquireStatement().
+ *
+ * \code
+ * SqlFilter filter = SqlFilter("event", SqlFilter::Equal, eventId)
+ *                 && (SqlFilter("usergives", SqlFilter::Equal, kittyId) || SqlFilter("userreceives", SqlFilter::Equal, kittyId));
+ * \endcode
+ */
+class SqlFilter
+{
+public:
+    //! \brief Comparison operators
+    enum Op {
+        Equal,          //!< field = value
+        NotEqual,       //!< field <> value
+        Less,           //!< field < value
+        LessEqual,      //!< field <= value
+        Greater,        //!< field > value
+        GreaterEqual,   //!< field >= value
+        Like,           //!< field LIKE value
+        Is,             //!< field IS value, also true when both are null
+        IsNot,          //!< field IS NOT value, also true when only one is null
+        InSelect        //!< field IN (value), value being a select statement written as it is
+    };
+
+    //! \brief Empty filter, matching every row
+    SqlFilter();
+    /*!
+     * \brief Filter comparing a field with a value
+     * \param field column name, optionally qualified by its table
+     * \param op comparison operator
+     * \param value compared value, always bound but for InSelect, whose statement must never come from user input
+     */
+    SqlFilter(const QString &field, Op op, const QVariant &value);
+    /*!
+     * \brief Returns the conjunction of two filters. An empty filter is ignored
+     * \param other other filter
+     * \return filter matching both
+     */
+    SqlFilter operator&&(const SqlFilter &other) const;
+    /*!
+     * \brief Returns the disjunction of two filters. An empty filter is ignored
+     * \param other other filter
+     * \return filter matching any of them
+     */
+    SqlFilter operator||(const SqlFilter &other) const;
+    /*!
+     * \brief Returns true if the filter matches every row
+     * \return true if empty
+     */
+    bool isEmpty() const {return node.isNull();}
+    /*!
+     * \brief Returns the condition with '?' placeholders, the same for filters of the same shape
+     * \return sql condition, empty if the filter is empty
+     */
+    QString toSql() const;
+    /*!
+     * \brief Returns the values to bind to the placeholders of toSql(), in order
+     * \return bind values
+     */
+    QVariantList bindValues() const;
+    /*!
+     * \brief Returns true if a row matches the filter, evaluated like SQLite would
+     *
+     * Used for the rows of a store which is not an sql database. InSelect is never true,
+     * since its statement cannot be run on a row.
+     * \param row value of each column, named without their table; a missing column is null
+     * \return true if the row matches
+     */
+    bool matches(const QVariantHash &row) const;
+    /*!
+     * \brief Compares the refresh of a filtered table with literals spliced in the statement
+     * against the cached prepared statement of its filter
+     *
+     * Adds 16 events with generated transactions to the database, which are refreshed in turn.
+     * \param db opened database, with at least two users
+     * \param refreshes number of refreshes
+     * \return report with the time of each approach and the statements prepared
+     */
+    static QString benchmark(DataBase &db, int refreshes);
+
+private:
+    //! \brief Kind of node of the expression tree
+    enum Kind {Compare, And, Or};
+
+    //! \brief Node of the expression tree, shared between copies of the filter
+    struct Node
+    {
+        Kind kind;
+        QString field;
+        Op op;
+        QVariant value;
+        QVector<QSharedPointer<const Node> > children;
+    };
+
+    /*!
+     * \brief Joins two filters, flattening nested nodes of the same kind
+     * \param kind And or Or
+     * \param other other filter
+     * \return joined filter
+     */
+    SqlFilter join(Kind kind, const SqlFilter &other) const;
+    /*!
+     * \brief Appends the sql and the bind values of a node
+     * \param node node of the expression tree
+     * \param sql sql condition
+     * \param values bind values
+     */
+    static void compile(const Node &node, QString *sql, QVariantList *values);
+    /*!
+     * \brief Returns true if a row matches a node
+     * \param node node of the expression tree
+     * \param row value of each column
+     * \return true if the row matches
+     */
+    static bool evaluate(const Node &node, const QVariantHash &row);
+
+    /*!
+     * \brief Root of the expression tree, null if the filter is empty
+     */
+    QSharedPointer<const Node> node;
+};
+
+#endif // SQLFILTER_H
@@ -0,0 +1,72 @@
+#include "sqlfiltertablemodel.h"
+
+/*!
+ * SqlFilterTableModel constructor
+ */
+SqlFilterTableModel::SqlFilterTableModel(DataBase *db, QObject *parent) :
+    QSqlRelationalTableModel(parent, db->getConnection()),
+    db(db)
+{
+}
+
+/*!
+ * Sets the filter applied on the next select(). The base filter holds the template with
+ * placeholders, so selectStatement() gives the statement to prepare.
+ */
+void SqlFilterTableModel::setSqlFilter(const SqlFilter &filter)
+{
+    sqlFilter = filter;
+    QSqlRelationalTableModel::setFilter(filter.toSql());
+}
+
+/*!
+ * Returns the order by clause set with setOrderBy(), or the one of the sort column
+ */
+QString SqlFilterTableModel::orderByClause() const
+{
+    if(orderBy.isEmpty())
+        return QSqlRelationalTableModel::orderByClause();
+    return orderBy;
+}
+
+/*!
+ * Populates the model with the rows matching the filter, executing the cached statement
+ * with the values of the filter bound
+ */
+bool SqlFilterTableModel::select()
+{
+    const QString text = selectStatement();
+    if(text.isEmpty())
+        return false;
+
+    QSqlQuery query = db->acquireStatement(text);
+    foreach(const QVariant &value, sqlFilter.bindValues())
+        query.addBindValue(value);
+    if(!query.exec())
+    {
+        setLastError(query.lastError());
+        db->releaseStatement(query);
+        return false;
+    }
+
+    setQuery(query);
+    if(!statement.lastQuery().isEmpty())
+        db->releaseStatement(statement);
+    statement = query;
+    return true;
+}
+
+/*!
+ * Gives back the statement to the cache of the database. The model is cleared first so it
+ * does not read rows from a statement executed by someone else.
+ */
+void SqlFilterTableModel::releaseStatement()
+{
+    if(statement.lastQuery().isEmpty())
+        return;
+
+    QSqlQuery released = statement;
+    statement = QSqlQuery();
+    clear();
+    db->releaseStatement(released);
+}
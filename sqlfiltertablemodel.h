@@ -0,0 +1,78 @@
+#ifndef SQLFILTERTABLEMODEL_H
+#define SQLFILTERTABLEMODEL_H
+
+#include <QtSql>
+#include "database.h"
+#include "sqlfilter.h"
+
+/*!
+ * \brief Relational table model filtered by an SqlFilter
+ *
+ * The filter is bound instead of spliced into the select statement, which is taken from
+ * the statement cache of the database. Refreshing the model with a filter of the same shape
+ * reuses the prepared statement.
+ */
+class SqlFilterTableModel : public QSqlRelationalTableModel
+{
+    Q_OBJECT
+
+public:
+    /*!
+     * \brief SqlFilterTableModel constructor
+     * \param db database providing the statement cache
+     * \param parent parent object
+     */
+    SqlFilterTableModel(DataBase *db, QObject *parent = 0);
+    /*!
+     * \brief Sets the filter applied on the next select()
+     * \param filter filter expression
+     */
+    void setSqlFilter(const SqlFilter &filter);
+    /*!
+     * \brief Returns the filter of the model
+     * \return filter expression
+     */
+    SqlFilter getSqlFilter() const {return sqlFilter;}
+    /*!
+     * \brief Sets the order of the rows on the next select(), instead of the column given to setSort()
+     * \param clause sql order by clause, e.g. DataBase::searchRankOrder(), empty to use setSort()
+     */
+    void setOrderBy(const QString &clause) {orderBy = clause;}
+    /*!
+     * \brief Populates the model with the rows matching the filter
+     * \return true if success
+     */
+    bool select();
+    /*!
+     * \brief Gives back the statement to the cache of the database, emptying the model
+     */
+    void releaseStatement();
+
+protected:
+    /*!
+     * \brief Returns the order by clause of the select statement
+     * \return sql order by clause
+     */
+    QString orderByClause() const;
+
+private:
+    /*!
+     * \brief Database providing the statement cache
+     */
+    DataBase *db;
+    /*!
+     * \brief Filter applied on select()
+     */
+    SqlFilter sqlFilter;
+    /*!
+     * \brief Order by clause set with setOrderBy()
+     */
+    QString orderBy;
+    /*!
+     * \brief Statement backing the current rows, given back to the cache when replaced by a new select().
+     * It is not given back on destruction since the model may outlive the database.
+     */
+    QSqlQuery statement;
+};
+
+#endif // SQLFILTERTABLEMODEL_H
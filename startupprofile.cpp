@@ -0,0 +1,84 @@
+#include "startupprofile.h"
+#include "trace.h"
+
+#include <atomic>
+
+namespace {
+
+/*!
+ * Clock started during static initialization, before main() runs
+ */
+QElapsedTimer startClock()
+{
+    QElapsedTimer timer;
+    timer.start();
+    return timer;
+}
+
+const QElapsedTimer processClock = startClock();
+
+/*!
+ * Nanoseconds since process start of each phase, -1 if not reached yet.
+ * Phases can be marked from the startup worker thread.
+ */
+std::atomic<qint64> phaseNs[StartupProfile::NumPhases] = {
+    {0}, {-1}, {-1}, {-1}, {-1}
+};
+
+}
+
+/*!
+ * Records the time of a phase, only the first mark of each phase is kept
+ */
+void StartupProfile::mark(Phase phase)
+{
+    qint64 expected = -1;
+    if(phaseNs[phase].compare_exchange_strong(expected, processClock.nsecsElapsed()))
+        Trace::instant(phaseName(phase), "startup");
+}
+
+/*!
+ * Returns the time of a phase in milliseconds since process start, -1 if not reached yet
+ */
+double StartupProfile::elapsedMs(Phase phase)
+{
+    qint64 ns = phaseNs[phase].load();
+    return ns < 0 ? -1 : ns / 1000000.0;
+}
+
+/*!
+ * Returns the name of a phase
+ */
+const char *StartupProfile::phaseName(Phase phase)
+{
+    switch(phase)
+    {
+    case ProcessStart: return "process start";
+    case DbOpen: return "database open";
+    case SchemaCheck: return "schema check";
+    case FirstPaint: return "first paint";
+    case FirstData: return "first data";
+    default: return "";
+    }
+}
+
+/*!
+ * Returns the timings of all the phases as human readable text
+ */
+QString StartupProfile::report()
+{
+    QString result;
+    QTextStream out(&result);
+    out << "Startup timings (ms since process start)\n";
+    for(int i = 0; i < NumPhases; i++)
+    {
+        Phase phase = static_cast<Phase>(i);
+        double ms = elapsedMs(phase);
+        out << "    " << QString(phaseName(phase)).leftJustified(16) << " ";
+        if(ms < 0)
+            out << "-\n";
+        else
+            out << QString::number(ms, 'f', 1) << "\n";
+    }
+    return result;
+}
@@ -0,0 +1,44 @@
+#ifndef STARTUPPROFILE_H
+#define STARTUPPROFILE_H
+
+#include <QtCore>
+
+//! \brief Timings of the startup phases of the application
+class StartupProfile
+{
+public:
+    //! \brief Startup phases, in the order they are expected
+    enum Phase {
+        ProcessStart,   //!< Static initialization of the executable
+        DbOpen,         //!< Database file opened
+        SchemaCheck,    //!< Tables checked (and created or migrated if needed)
+        FirstPaint,     //!< Main window painted for the first time
+        FirstData,      //!< Main window painted with the data of the initial tab loaded
+        NumPhases
+    };
+
+    /*!
+     * \brief Records the time of a phase. Only the first mark of each phase is kept
+     * \param phase startup phase
+     */
+    static void mark(Phase phase);
+    /*!
+     * \brief Returns the time of a phase since process start
+     * \param phase startup phase
+     * \return milliseconds since process start, -1 if not reached yet
+     */
+    static double elapsedMs(Phase phase);
+    /*!
+     * \brief Returns the name of a phase
+     * \param phase startup phase
+     * \return name
+     */
+    static const char *phaseName(Phase phase);
+    /*!
+     * \brief Returns the timings of all the phases as human readable text
+     * \return report
+     */
+    static QString report();
+};
+
+#endif // STARTUPPROFILE_H
@@ -0,0 +1,12 @@
+# Common settings of the test projects, each builds the shared sources with its test case
+
+QT       += core gui sql network concurrent testlib
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+CONFIG += c++11 testcase console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+include(../sources.pri)
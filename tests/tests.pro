@@ -0,0 +1,7 @@
+TEMPLATE = subdirs
+
+SUBDIRS = tst_amountsketch \
+    tst_avatarcache \
+    tst_database \
+    tst_emailvalidator \
+    tst_ledgerstore
@@ -0,0 +1,142 @@
+#include <QtTest>
+
+#include <algorithm>
+#include <cmath>
+
+#include "amountsketch.h"
+
+/*!
+ * \brief Tests of AmountSketch against the exact quantiles of generated amounts
+ *
+ * Each row generates the amounts of one distribution from a fixed seed, so a failure is
+ * reproduced by running the test again.
+ */
+class TestAmountSketch : public QObject
+{
+    Q_OBJECT
+
+public:
+    //! \brief Distributions of the generated amounts
+    enum Distribution {LogNormal, Uniform, HeavyTailed};
+
+private slots:
+    void accuracy_data();
+    void accuracy(); //! \brief Quantiles within the relative accuracy, merged slices and blob giving the same sketch
+    void mismatchedMerge(); //! \brief Sketches of different accuracy not merged
+
+private:
+    /*!
+     * \brief Generates amounts rounded to cents
+     * \param distribution distribution of the amounts
+     * \param values number of amounts
+     * \param seed seed of the random generator
+     * \return amounts, in generation order
+     */
+    static QVector<double> generate(Distribution distribution, int values, quint32 seed);
+};
+
+Q_DECLARE_METATYPE(TestAmountSketch::Distribution)
+
+/*!
+ * Generates amounts: log-normal like most expenses, uniform, or heavy tailed with some zeros
+ */
+QVector<double> TestAmountSketch::generate(Distribution distribution, int values, quint32 seed)
+{
+    QRandomGenerator random(seed);
+    QVector<double> amounts(values);
+    for(int i = 0; i < values; i++)
+    {
+        double amount;
+        if(distribution == LogNormal)
+        {
+            // Box-Muller, median 30 and a long right tail
+            double u = 1 - random.generateDouble(), v = random.generateDouble();
+            amount = 30 * std::exp(std::sqrt(-2 * std::log(u)) * std::cos(2 * M_PI * v));
+        }
+        else if(distribution == Uniform)
+            amount = random.bounded(1, 10000);
+        else
+            amount = random.bounded(20) ? 5 / std::pow(1 - random.generateDouble(), 1.5) : 0;
+        amounts[i] = std::round(amount * 100) / 100;
+    }
+    return amounts;
+}
+
+void TestAmountSketch::accuracy_data()
+{
+    QTest::addColumn<Distribution>("distribution");
+    QTest::addColumn<int>("values");
+    QTest::addColumn<double>("relativeAccuracy");
+
+    QTest::newRow("log-normal") << LogNormal << 20000 << 0.01;
+    QTest::newRow("uniform") << Uniform << 20000 << 0.01;
+    QTest::newRow("heavy tailed") << HeavyTailed << 20000 << 0.01;
+    QTest::newRow("log-normal, coarse") << LogNormal << 20000 << 0.05;
+}
+
+void TestAmountSketch::accuracy()
+{
+    QFETCH(Distribution, distribution);
+    QFETCH(int, values);
+    QFETCH(double, relativeAccuracy);
+
+    QVector<double> amounts = generate(distribution, values, 1);
+    QVector<double> sorted = amounts;
+    std::sort(sorted.begin(), sorted.end());
+    double exactSum = 0;
+    foreach(double amount, amounts)
+        exactSum += amount;
+
+    // The slices stand for the events of a ledger
+    const int slices = 100;
+    AmountSketch whole(relativeAccuracy);
+    QVector<AmountSketch> sliced(slices, AmountSketch(relativeAccuracy));
+    for(int i = 0; i < values; i++)
+    {
+        whole.add(amounts.at(i));
+        sliced[i % slices].add(amounts.at(i));
+    }
+    AmountSketch merged(relativeAccuracy);
+    foreach(const AmountSketch &slice, sliced)
+        QVERIFY(merged.merge(slice));
+    bool blobOk = false;
+    AmountSketch restored = AmountSketch::fromByteArray(whole.toByteArray(), &blobOk);
+    QVERIFY(blobOk);
+
+    QCOMPARE(whole.getCount(), qint64(values));
+    QCOMPARE(merged.getCount(), qint64(values));
+    QCOMPARE(whole.getMin(), sorted.first());
+    QCOMPARE(whole.getMax(), sorted.last());
+    QVERIFY(qAbs(whole.getSum() - exactSum) <= 1e-9 * exactSum);
+    QVERIFY(qAbs(merged.getSum() - exactSum) <= 1e-9 * exactSum);
+
+    const double quantiles[] = {0, 0.01, 0.25, 0.5, 0.75, 0.9, 0.95, 0.99, 0.999, 1};
+    for(const double q : quantiles)
+    {
+        const double exact = sorted.at(int(q * (values - 1)));
+        const double estimate = whole.quantile(q);
+        const double relativeError = exact == 0 ? estimate : qAbs(estimate - exact) / exact;
+        QVERIFY2(relativeError <= relativeAccuracy * (1 + 1e-9),
+                 qPrintable(QString("quantile %1 is %2, exact %3").arg(q).arg(estimate).arg(exact)));
+        QCOMPARE(merged.quantile(q), estimate);
+        QCOMPARE(restored.quantile(q), estimate);
+    }
+
+    qint64 histogramCount = 0;
+    foreach(const AmountSketch::HistogramBin &bin, whole.histogram(20))
+        histogramCount += bin.count;
+    QCOMPARE(histogramCount, qint64(values));
+}
+
+void TestAmountSketch::mismatchedMerge()
+{
+    AmountSketch coarse(0.05);
+    coarse.add(1);
+    AmountSketch fine;
+    QVERIFY(!fine.merge(coarse));
+    QVERIFY(fine.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(TestAmountSketch)
+
+#include "tst_amountsketch.moc"
@@ -0,0 +1,5 @@
+TARGET = tst_amountsketch
+
+include(../tests.pri)
+
+SOURCES += tst_amountsketch.cpp
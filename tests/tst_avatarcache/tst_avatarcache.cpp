@@ -0,0 +1,181 @@
+#include <QtTest>
+#include <QPixmapCache>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+#include "avatarcache.h"
+
+/*!
+ * \brief Tests of the requests AvatarCache sends to a fake Gravatar server on a local port
+ *
+ * The server answers with a PNG and an ETag, or with 304 if it is given that ETag in
+ * If-None-Match. Every test starts with an empty disk directory and memory tier; a cache
+ * created later in a test starts with the disk entries of the previous one, as in a new session.
+ */
+class TestAvatarCache : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+
+    void coalescing(); //! \brief Concurrent requests answered with one download, a second lookup served from memory
+    void diskTier(); //! \brief Lookup in a new session served from disk
+    void revalidation(); //! \brief Old disk entry revalidated with If-None-Match and not downloaded again
+
+private:
+    /*!
+     * \brief Answers a request read by the fake server
+     * \param socket connection of the request
+     */
+    void answer(QTcpSocket *socket);
+    /*!
+     * \brief Requests the avatar of the test hash and waits until it is ready, up to 5 seconds
+     * \param cache avatar cache
+     * \return true if the avatar is ready
+     */
+    bool requestAvatar(AvatarCache &cache);
+    /*!
+     * \brief Returns a cache using the fake server and the directory of the test
+     * \return avatar cache, owned by the caller
+     */
+    AvatarCache *createCache();
+
+    //! \brief Fake Gravatar server
+    QTcpServer server;
+    //! \brief Image served, encoded as PNG
+    QByteArray png;
+    //! \brief Disk directory of the caches of the current test
+    QScopedPointer<QTemporaryDir> directory;
+    //! \brief Requests received by the server in the current test
+    int requests;
+    //! \brief Requests answered with the image
+    int downloads;
+    //! \brief Requests answered with 304
+    int notModified;
+};
+
+namespace {
+
+//! \brief Hash requested by the tests
+const QString hash = QLatin1String("0123456789abcdef0123456789abcdef");
+//! \brief ETag of the served image
+const QByteArray etag = "\"v1\"";
+
+}
+
+void TestAvatarCache::initTestCase()
+{
+    QImage image(8, 8, QImage::Format_RGB32);
+    image.fill(Qt::darkCyan);
+    QBuffer buffer(&png);
+    QVERIFY(buffer.open(QIODevice::WriteOnly));
+    QVERIFY(image.save(&buffer, "PNG"));
+
+    connect(&server, &QTcpServer::newConnection, this, [this]() {
+        while(QTcpSocket *socket = server.nextPendingConnection())
+        {
+            connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {answer(socket);});
+        }
+    });
+    QVERIFY2(server.listen(QHostAddress::LocalHost), qPrintable(server.errorString()));
+}
+
+void TestAvatarCache::init()
+{
+    QPixmapCache::clear();
+    directory.reset(new QTemporaryDir);
+    QVERIFY(directory->isValid());
+    requests = 0;
+    downloads = 0;
+    notModified = 0;
+}
+
+void TestAvatarCache::answer(QTcpSocket *socket)
+{
+    QByteArray header = socket->property("header").toByteArray() + socket->readAll();
+    socket->setProperty("header", header);
+    if(!header.contains("\r\n\r\n"))
+        return;
+
+    requests++;
+    if(header.contains("If-None-Match: " + etag))
+    {
+        notModified++;
+        socket->write("HTTP/1.1 304 Not Modified\r\nETag: " + etag + "\r\nConnection: close\r\n\r\n");
+    }
+    else
+    {
+        downloads++;
+        socket->write("HTTP/1.1 200 OK\r\nContent-Type: image/png\r\nETag: " + etag + "\r\nContent-Length: "
+                      + QByteArray::number(png.size()) + "\r\nConnection: close\r\n\r\n" + png);
+    }
+    socket->disconnectFromHost();
+}
+
+AvatarCache *TestAvatarCache::createCache()
+{
+    AvatarCache *cache = new AvatarCache;
+    cache->setBaseUrl(QUrl(QString("http://127.0.0.1:%1/avatar/").arg(server.serverPort())));
+    cache->setCacheDirectory(directory->path());
+    return cache;
+}
+
+bool TestAvatarCache::requestAvatar(AvatarCache &cache)
+{
+    QSignalSpy ready(&cache, &AvatarCache::avatarReady);
+    cache.request(hash);
+    return ready.count() > 0 || ready.wait(5000);
+}
+
+void TestAvatarCache::coalescing()
+{
+    QScopedPointer<AvatarCache> cache(createCache());
+    QSignalSpy ready(cache.data(), &AvatarCache::avatarReady);
+    cache->request(hash);
+    cache->request(hash);
+    QVERIFY(requestAvatar(*cache));
+    QCOMPARE(ready.count(), 1);
+    QCOMPARE(cache->getNetworkRequestCount(), 1);
+    QCOMPARE(requests, 1);
+
+    // Answered right away
+    cache->request(hash);
+    QCOMPARE(ready.count(), 2);
+    QCOMPARE(cache->getNetworkRequestCount(), 1);
+}
+
+void TestAvatarCache::diskTier()
+{
+    QScopedPointer<AvatarCache> first(createCache());
+    QVERIFY(requestAvatar(*first));
+    QCOMPARE(requests, 1);
+
+    QPixmapCache::clear();
+    QScopedPointer<AvatarCache> cache(createCache());
+    QVERIFY(requestAvatar(*cache));
+    QCOMPARE(cache->getNetworkRequestCount(), 0);
+    QCOMPARE(requests, 1);
+}
+
+void TestAvatarCache::revalidation()
+{
+    QScopedPointer<AvatarCache> first(createCache());
+    QVERIFY(requestAvatar(*first));
+    QCOMPARE(downloads, 1);
+
+    QPixmapCache::clear();
+    QScopedPointer<AvatarCache> cache(createCache());
+    cache->setRevalidateAfter(0);
+    QVERIFY(requestAvatar(*cache));
+    QCOMPARE(cache->getNetworkRequestCount(), 1);
+    QCOMPARE(notModified, 1);
+    QCOMPARE(downloads, 1);
+}
+
+// QPixmap needs a GUI application
+QTEST_MAIN(TestAvatarCache)
+
+#include "tst_avatarcache.moc"
@@ -0,0 +1,5 @@
+TARGET = tst_avatarcache
+
+include(../tests.pri)
+
+SOURCES += tst_avatarcache.cpp
@@ -0,0 +1,643 @@
+#include <QtTest>
+
+#include "database.h"
+#include "settlement.h"
+
+/*!
+ * \brief Tests of DataBase on in-memory ledgers with the example data
+ *
+ * Every test starts from a new ledger, so none depends on the data left by another.
+ */
+class TestDataBase : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void summaryMaintenance(); //! \brief Tables kept by triggers against a full recompute after inserts, updates and deletes
+    void kittyLedger(); //! \brief Running balance of the kitty against the one added up from the transactions
+    void finishedEvents(); //! \brief Snapshots of finished events against the live calculations
+    void cascadeDeletes(); //! \brief Rows left by deleteEventCascade() and deleteUserCascade()
+    void snapshotRoundTrip(); //! \brief Database saved with saveSnapshot() and loaded back by an in-memory database
+    void fileSnapshot(); //! \brief Snapshot loaded into a database file, and a failed load leaving it untouched
+
+private:
+    /*!
+     * \brief Adds a user with a nickname of its own
+     * \param name name and prefix of the email
+     * \param prefix prefix of the nickname
+     * \return user id
+     */
+    int addUser(const QString &name, const QString &prefix);
+    /*!
+     * \brief Returns the ids selected by a query
+     * \param statement query with the id as first column
+     * \param values bound values
+     * \return ids
+     */
+    QVector<int> selectIds(const QString &statement, const QVariantList &values);
+    /*!
+     * \brief Compares getKittyBalanceSeries() and calcAmountKitty() with the kitty added up day by day
+     * \param eventId Event id
+     * \param step description of the step, for the failures
+     * \return description of each difference found, empty if they agree
+     */
+    QStringList compareKittyLedger(int eventId, const QString &step);
+    /*!
+     * \brief Finishes an event, compares its snapshot with the live calculations, and reopens it
+     * \param eventId Event id
+     * \return description of each difference found, empty if they agree
+     */
+    QStringList compareFinished(int eventId);
+    /*!
+     * \brief Returns a count read by a query
+     * \param statement query with the count as first column
+     * \param values bound values
+     * \return count, -1 on error
+     */
+    int count(const QString &statement, const QVariantList &values = QVariantList());
+    /*!
+     * \brief Counts the rows of an event in each table kept for the events
+     * \param eventId Event id
+     * \return rows by table, with the event itself and the triggers on transactions
+     */
+    QMap<QString, int> eventRows(int eventId);
+
+    DataBase *db;
+    int kittyId;
+};
+
+/*!
+ * Message of a check which failed, the differences found after a step
+ */
+static QString failureMessage(const QString &step, const QStringList &differences)
+{
+    return step + ": " + differences.join(QLatin1String("; "));
+}
+
+void TestDataBase::init()
+{
+    db = new DataBase(true, DataBase::memoryPath());
+    QCOMPARE(db->initExampleDatabase().type(), QSqlError::NoError);
+    kittyId = db->getKittyId();
+}
+
+void TestDataBase::cleanup()
+{
+    delete db;
+    db = 0;
+}
+
+int TestDataBase::addUser(const QString &name, const QString &prefix)
+{
+    return db->addUser(User(name, prefix + name.toLower(), name.toLower() + "@example.com",
+                            QLatin1String("hash"), QLatin1String("salt"), QDate())).toInt();
+}
+
+QVector<int> TestDataBase::selectIds(const QString &statement, const QVariantList &values)
+{
+    QSqlQuery q(db->getConnection());
+    q.prepare(statement);
+    foreach (const QVariant &value, values)
+        q.addBindValue(value);
+    QVector<int> ids;
+    if(!q.exec())
+        return ids;
+    while(q.next())
+        ids << q.value(0).toInt();
+    return ids;
+}
+
+/*!
+ * Runs inserts, in-place updates and deletes through the same paths as the application and
+ * compares the tables kept by triggers with checkEventSummaries() after each step
+ *
+ * Transactions are never updated in their amounts, users, event, date or place (see the
+ * migration to version 2), so the updates are those the application makes: descriptions, and
+ * events finished and reopened.
+ */
+void TestDataBase::summaryMaintenance()
+{
+    QStringList differences;
+    int alice = addUser("Alice", "summary_check_");
+    int bob = addUser("Bob", "summary_check_");
+    int trip = db->addEvent(Event(QLatin1String("Summary check trip"), QDate(2016, 9, 1), User(alice))).toInt();
+    int dinner = db->addEvent(Event(QLatin1String("Summary check dinner"), QDate(2016, 9, 1), User(bob))).toInt();
+    QCOMPARE(db->getLastError().type(), QSqlError::NoError);
+
+    QVector<int> ids;
+    ids << db->addTransaction(Transaction(User(alice), User(bob), Event(trip), 60, QDate(2016, 9, 2), QLatin1String("Hamburg"), QLatin1String("Airbnb"))).toInt()
+        << db->addTransaction(Transaction(User(alice), User(kittyId), Event(trip), 40, QDate(2016, 9, 2), QLatin1String("Warsaw"), QLatin1String("Cash"))).toInt()
+        << db->addTransaction(Transaction(User(bob), User(kittyId), Event(trip), 25.5, QDate(), QString(), QLatin1String("Cash"))).toInt()
+        << db->addTransaction(Transaction(User(kittyId), User(alice), Event(trip), 12.25, QDate(2016, 9, 4), QLatin1String("Warsaw"), QLatin1String("Taxi"))).toInt()
+        << db->addTransaction(Transaction(User(bob), User(alice), Event(dinner), 30, QDate(2016, 9, 3), QLatin1String("Krakow"), QLatin1String("Dinner"))).toInt();
+    differences = db->checkEventSummaries(false);
+    QVERIFY2(differences.isEmpty(), qPrintable(failureMessage("After adding transactions", differences)));
+
+    QVector<Transaction> imported;
+    for(int i = 0; i < 20; i++)
+        imported << Transaction(User(i % 2 ? alice : bob), User(i % 3 ? kittyId : (i % 2 ? bob : alice)), Event(i % 4 ? trip : dinner),
+                                1 + i * 0.75, i % 5 ? QDate(2016, 9, 1 + i % 7) : QDate(), QLatin1String("Gdansk"),
+                                QString("Import %1").arg(i));
+    QCOMPARE(db->importTransactions(imported).type(), QSqlError::NoError);
+    differences = db->checkEventSummaries(false);
+    QVERIFY2(differences.isEmpty(), qPrintable(failureMessage("After importing transactions", differences)));
+
+    QSqlQuery q(db->getConnection());
+    q.prepare("UPDATE transactions SET description = ? WHERE id = ?");
+    q.addBindValue(QLatin1String("Airbnb 3 nights"));
+    q.addBindValue(ids.at(0));
+    QVERIFY2(q.exec(), qPrintable(q.lastError().text()));
+    QCOMPARE(db->finishEvent(trip).type(), QSqlError::NoError);
+    QCOMPARE(db->reopenEvent(trip).type(), QSqlError::NoError);
+    differences = db->checkEventSummaries(false);
+    QVERIFY2(differences.isEmpty(), qPrintable(failureMessage("After updating a description and finishing and reopening an event", differences)));
+
+    db->deleteTransaction(ids.at(1));
+    db->deleteTransactions(QVector<int>() << ids.at(2) << ids.at(3));
+    differences = db->checkEventSummaries(false);
+    QVERIFY2(differences.isEmpty(), qPrintable(failureMessage("After deleting transactions", differences)));
+
+    // The last kitty transaction of the dinner goes, and with it its day in kitty_ledger
+    QVector<int> dinnerKitty = selectIds("SELECT id FROM transactions WHERE event = ? AND ? IN (usergives, userreceives)",
+                                         QVariantList() << dinner << kittyId);
+    QVERIFY(!dinnerKitty.isEmpty());
+    db->deleteTransactions(dinnerKitty);
+    differences = db->checkEventSummaries(false);
+    QVERIFY2(differences.isEmpty(), qPrintable(failureMessage("After deleting the kitty transactions of an event", differences)));
+
+    db->deleteEventCascade(dinner);
+    differences = db->checkEventSummaries(false);
+    QVERIFY2(differences.isEmpty(), qPrintable(failureMessage("After deleting an event", differences)));
+
+    db->deleteEventCascade(trip);
+    db->deleteUser(alice);
+    db->deleteUser(bob);
+    differences = db->checkEventSummaries(false);
+    QVERIFY2(differences.isEmpty(), qPrintable(failureMessage("After deleting the test data", differences)));
+}
+
+/*!
+ * Adds up the inflows and withdrawals of the kitty day by day from getEventTransactions()
+ */
+QStringList TestDataBase::compareKittyLedger(int eventId, const QString &step)
+{
+    QStringList failures;
+    auto same = [](double a, double b) {
+        return qAbs(a - b) < 1e-6;
+    };
+    QMap<qint64, QPair<double, double> > days;
+    foreach(const Transaction &transaction, db->getEventTransactions(eventId))
+    {
+        qint64 day = transaction.getDate().isValid() ? transaction.getDate().toJulianDay() : 0;
+        if(transaction.getUserReceiving().getId() == kittyId)
+            days[day].first += transaction.getAmount();
+        if(transaction.getUserGiving().getId() == kittyId)
+            days[day].second += transaction.getAmount();
+    }
+    QVector<DataBase::KittyBalancePoint> series = db->getKittyBalanceSeries(eventId);
+    if(series.size() != days.size())
+        return failures << QString("%1: %2 days in the series, %3 expected").arg(step).arg(series.size()).arg(days.size());
+    double balance = 0;
+    int i = 0;
+    for(auto it = days.constBegin(); it != days.constEnd(); ++it, i++)
+    {
+        const DataBase::KittyBalancePoint &point = series.at(i);
+        balance += it->first - it->second;
+        qint64 day = point.date.isValid() ? point.date.toJulianDay() : 0;
+        if(day != it.key() || !same(point.inflow, it->first) || !same(point.outflow, it->second) || !same(point.balance, balance))
+            failures << QString("%1, day %2: %3 in, %4 out, balance %5; expected %6 in, %7 out, balance %8")
+                        .arg(step).arg(point.date.toString(Qt::ISODate))
+                        .arg(point.inflow).arg(point.outflow).arg(point.balance).arg(it->first).arg(it->second).arg(balance);
+    }
+    if(!same(db->calcAmountKitty(eventId), balance))
+        failures << QString("%1: kitty holds %2, expected %3").arg(step).arg(db->calcAmountKitty(eventId)).arg(balance);
+    return failures;
+}
+
+int TestDataBase::count(const QString &statement, const QVariantList &values)
+{
+    QSqlQuery q(db->getConnection());
+    q.prepare(statement);
+    foreach (const QVariant &value, values)
+        q.addBindValue(value);
+    return q.exec() && q.next() ? q.value(0).toInt() : -1;
+}
+
+QMap<QString, int> TestDataBase::eventRows(int eventId)
+{
+    QMap<QString, int> rows;
+    foreach (const QString &table, QStringList() << "transactions" << "splits" << "event_summary" << "event_participants"
+                                                 << "kitty_ledger" << "spending_rollup" << "place_rollup"
+                                                 << "amount_sketches" << "event_snapshots")
+        rows[table] = count("SELECT COUNT(*) FROM " + table + " WHERE event = ?", QVariantList() << eventId);
+    rows["events"] = count("SELECT COUNT(*) FROM events WHERE id = ?", QVariantList() << eventId);
+    rows["triggers"] = count("SELECT COUNT(*) FROM sqlite_master WHERE type = 'trigger' AND tbl_name = 'transactions'");
+    return rows;
+}
+
+/*!
+ * Compares the kitty of the example event, and of an event with deposits and withdrawals
+ * while its transactions are deleted
+ */
+void TestDataBase::kittyLedger()
+{
+    QStringList differences;
+    QVector<int> events = selectIds("SELECT id FROM events WHERE name = ?", QVariantList() << QLatin1String("Warsaw Trip"));
+    QCOMPARE(events.size(), 1);
+    differences = compareKittyLedger(events.first(), "Example event");
+    QVERIFY2(differences.isEmpty(), qPrintable(differences.join(QLatin1String("; "))));
+    QCOMPARE(db->calcAmountKitty(events.first()), 155.0);
+
+    int alice = addUser("Alice", "kitty_check_");
+    int trip = db->addEvent(Event(QLatin1String("Kitty check"), QDate(2016, 9, 1), User(alice))).toInt();
+    QCOMPARE(db->getLastError().type(), QSqlError::NoError);
+
+    QVector<int> ids;
+    ids << db->addTransaction(Transaction(User(alice), User(kittyId), Event(trip), 100, QDate(2016, 9, 1))).toInt()
+        << db->addTransaction(Transaction(User(kittyId), User(alice), Event(trip), 35.5, QDate(2016, 9, 1))).toInt()
+        << db->addTransaction(Transaction(User(alice), User(kittyId), Event(trip), 20, QDate())).toInt()
+        << db->addTransaction(Transaction(User(kittyId), User(alice), Event(trip), 80, QDate(2016, 9, 3))).toInt()
+        << db->addTransaction(Transaction(User(alice), User(kittyId), Event(trip), 12.25, QDate(2016, 9, 5))).toInt();
+    differences = compareKittyLedger(trip, "With deposits and withdrawals");
+    QVERIFY2(differences.isEmpty(), qPrintable(differences.join(QLatin1String("; "))));
+
+    db->deleteTransaction(ids.at(3));
+    differences = compareKittyLedger(trip, "After deleting a withdrawal");
+    QVERIFY2(differences.isEmpty(), qPrintable(differences.join(QLatin1String("; "))));
+
+    db->deleteTransactions(QVector<int>() << ids.at(0) << ids.at(1));
+    differences = compareKittyLedger(trip, "After deleting a whole day");
+    QVERIFY2(differences.isEmpty(), qPrintable(differences.join(QLatin1String("; "))));
+}
+
+/*!
+ * \brief Numbers of an event, calculated live or read from its snapshot
+ */
+struct EventNumbers
+{
+    double kitty;
+    int users;
+    int transactions;
+    //! \brief Amount given by the first user to the second, non-zero ones only
+    QMap<QPair<int, int>, double> pairs;
+};
+
+/*!
+ * Compares the kitty, the users, the transactions, the amounts between each pair of users and
+ * the settlement plan of the balances they add up to
+ */
+QStringList TestDataBase::compareFinished(int eventId)
+{
+    QStringList failures;
+    auto same = [](double a, double b) {
+        return qAbs(a - b) < 1e-6;
+    };
+    auto live = [this, eventId]() {
+        EventNumbers numbers;
+        numbers.kitty = db->calcAmountKitty(eventId);
+        numbers.users = db->calcNumUsers(eventId);
+        numbers.transactions = db->getNumTransactions(-1, eventId);
+        QSet<int> users;
+        foreach(const Transaction &transaction, db->getEventTransactions(eventId))
+            users << transaction.getUserGiving().getId() << transaction.getUserReceiving().getId();
+        foreach(int giving, users)
+        {
+            foreach(int receiving, users)
+            {
+                double amount = giving == receiving ? 0 : db->getAmountBetween(eventId, giving, receiving);
+                if(amount != 0)
+                    numbers.pairs.insert(qMakePair(giving, receiving), amount);
+            }
+        }
+        return numbers;
+    };
+    auto frozen = [](const EventSnapshot &snapshot) {
+        EventNumbers numbers;
+        numbers.kitty = snapshot.getAmountKitty();
+        numbers.users = snapshot.getNumUsers();
+        numbers.transactions = snapshot.getNumTransactions();
+        foreach(int giving, snapshot.getUsersGiving())
+        {
+            foreach(int receiving, snapshot.getUsersReceiving(giving))
+            {
+                double amount = snapshot.getAmountBetween(giving, receiving);
+                if(amount != 0)
+                    numbers.pairs.insert(qMakePair(giving, receiving), amount);
+            }
+        }
+        return numbers;
+    };
+    auto compare = [&](const QString &what, const EventNumbers &expected, const EventNumbers &found) {
+        if(!same(found.kitty, expected.kitty) || found.users != expected.users || found.transactions != expected.transactions)
+            failures << QString("Event %1 %2: kitty %3, %4 users, %5 transactions; expected kitty %6, %7 users, %8 transactions")
+                        .arg(eventId).arg(what).arg(found.kitty).arg(found.users).arg(found.transactions)
+                        .arg(expected.kitty).arg(expected.users).arg(expected.transactions);
+        QMap<QPair<int, int>, double> all = expected.pairs;
+        all.unite(found.pairs);
+        for(auto it = all.constBegin(); it != all.constEnd(); ++it)
+        {
+            if(!same(found.pairs.value(it.key()), expected.pairs.value(it.key())))
+                failures << QString("Event %1 %2: user %3 gives %4 to user %5, expected %6")
+                            .arg(eventId).arg(what).arg(it.key().first).arg(found.pairs.value(it.key()))
+                            .arg(it.key().second).arg(expected.pairs.value(it.key()));
+        }
+    };
+
+    EventNumbers before = live();
+    if(db->finishEvent(eventId).type() != QSqlError::NoError)
+        return failures << QString("Event %1: finishing it failed: %2").arg(eventId).arg(db->getLastError().text());
+    EventSnapshot snapshot;
+    if(!db->getEventSnapshot(eventId, &snapshot))
+        return failures << QString("Event %1: no snapshot once finished").arg(eventId);
+    compare("finished", before, frozen(snapshot));
+
+    QHash<int, double> balances;
+    for(auto it = before.pairs.constBegin(); it != before.pairs.constEnd(); ++it)
+    {
+        balances[it.key().first] += it.value();
+        balances[it.key().second] -= it.value();
+    }
+    QVector<Settlement::Payment> plan = Settlement::plan(balances);
+    QVector<Settlement::Payment> frozenPlan = snapshot.getSettlement();
+    bool samePlan = plan.size() == frozenPlan.size();
+    for(int i = 0; samePlan && i < plan.size(); i++)
+        samePlan = plan.at(i).from == frozenPlan.at(i).from && plan.at(i).to == frozenPlan.at(i).to
+                && qAbs(plan.at(i).amount - frozenPlan.at(i).amount) < 0.005;
+    if(!samePlan)
+        failures << QString("Event %1 finished: the settlement has %2 payments, the live one %3")
+                    .arg(eventId).arg(frozenPlan.size()).arg(plan.size());
+
+    db->reopenEvent(eventId);
+    if(db->getEventSnapshot(eventId, &snapshot))
+        failures << QString("Event %1: snapshot still used once reopened").arg(eventId);
+    compare("reopened", before, live());
+    return failures;
+}
+
+/*!
+ * Finishes and reopens the example event, and an event with a split expense
+ */
+void TestDataBase::finishedEvents()
+{
+    QStringList differences;
+    QVector<int> events = selectIds("SELECT id FROM events WHERE name = ?", QVariantList() << QLatin1String("Warsaw Trip"));
+    QCOMPARE(events.size(), 1);
+    differences = compareFinished(events.first());
+    QVERIFY2(differences.isEmpty(), qPrintable(differences.join(QLatin1String("; "))));
+
+    int alice = addUser("Alice", "finish_check_");
+    int bob = addUser("Bob", "finish_check_");
+    int carol = addUser("Carol", "finish_check_");
+    int trip = db->addEvent(Event(QLatin1String("Finish check"), QDate(2016, 9, 1), User(alice))).toInt();
+    QCOMPARE(db->getLastError().type(), QSqlError::NoError);
+    db->addTransaction(Transaction(User(alice), User(kittyId), Event(trip), 90, QDate(2016, 9, 1)));
+    db->addTransaction(Transaction(User(bob), User(carol), Event(trip), 25, QDate(2016, 9, 2)));
+    db->addTransaction(Transaction(User(kittyId), User(carol), Event(trip), 10, QDate()));
+    SplitExpense split(User(bob), Event(trip), 60, QDate(2016, 9, 3), QLatin1String("Warsaw"), QLatin1String("Dinner"));
+    split.addShare(alice);
+    split.addShare(bob);
+    split.addShare(carol, 2);
+    QVERIFY(db->addSplit(split).isValid());
+    differences = compareFinished(trip);
+    QVERIFY2(differences.isEmpty(), qPrintable(differences.join(QLatin1String("; "))));
+}
+
+/*!
+ * Deletes an event and then a user with the cascading deletes, and counts the rows left that
+ * depend on them in every table kept for the events
+ *
+ * The rows of the event kept are counted before and after, and the triggers on transactions,
+ * dropped and recreated by the cascade, must still keep the summary tables.
+ */
+void TestDataBase::cascadeDeletes()
+{
+    const bool fullTextSearch = DataBase::hasFullTextSearch(db->getConnection());
+    auto gone = [&](int eventId, const QString &step) {
+        QStringList failures;
+        QMap<QString, int> rows = eventRows(eventId);
+        for(auto it = rows.constBegin(); it != rows.constEnd(); ++it)
+        {
+            if(it.key() != QLatin1String("triggers") && it.value() != 0)
+                failures << QString("%1: %2 rows of event %3 left in %4").arg(step).arg(it.value()).arg(eventId).arg(it.key());
+        }
+        if(fullTextSearch)
+        {
+            int orphans = count("SELECT COUNT(*) FROM transactions_fts WHERE rowid NOT IN (SELECT id FROM transactions)");
+            if(orphans != 0)
+                failures << QString("%1: %2 rows left in transactions_fts").arg(step).arg(orphans);
+        }
+        return failures;
+    };
+    auto kept = [&](int eventId, const QMap<QString, int> &before, const QString &step) {
+        QStringList failures;
+        QMap<QString, int> after = eventRows(eventId);
+        for(auto it = before.constBegin(); it != before.constEnd(); ++it)
+        {
+            if(after.value(it.key()) != it.value())
+                failures << QString("%1: %2 rows of event %3 in %4, %5 before").arg(step).arg(after.value(it.key()))
+                            .arg(eventId).arg(it.key()).arg(it.value());
+        }
+        foreach (const QString &difference, db->checkEventSummaries(false))
+            failures << step + ": " + difference;
+        return failures;
+    };
+
+    int alice = addUser("Alice", "cascade_check_");
+    int bob = addUser("Bob", "cascade_check_");
+    int carol = addUser("Carol", "cascade_check_");
+    int trip = db->addEvent(Event(QLatin1String("Cascade check trip"), QDate(2016, 9, 1), User(alice))).toInt();
+    int dinner = db->addEvent(Event(QLatin1String("Cascade check dinner"), QDate(2016, 9, 1), User(bob))).toInt();
+    int other = db->addEvent(Event(QLatin1String("Cascade check kept"), QDate(2016, 9, 1), User(carol))).toInt();
+    QCOMPARE(db->getLastError().type(), QSqlError::NoError);
+
+    foreach(int event, QVector<int>() << trip << dinner << other)
+    {
+        db->addTransaction(Transaction(User(alice), User(kittyId), Event(event), 50, QDate(2016, 9, 1), QLatin1String("Warsaw"), QLatin1String("Cash")));
+        db->addTransaction(Transaction(User(bob), User(carol), Event(event), 20, QDate(2016, 9, 2), QLatin1String("Krakow"), QLatin1String("Taxi")));
+        db->addTransaction(Transaction(User(kittyId), User(carol), Event(event), 15, QDate(), QString(), QLatin1String("Beers")));
+        SplitExpense split(User(event == other ? carol : alice), Event(event), 45, QDate(2016, 9, 3));
+        split.addShare(alice);
+        split.addShare(bob);
+        split.addShare(carol);
+        QVERIFY(db->addSplit(split).isValid());
+    }
+    // Only alice owes carol, so it goes with alice
+    SplitExpense owedByAlice(User(carol), Event(other), 12, QDate(2016, 9, 4));
+    owedByAlice.addShare(alice);
+    QVERIFY(db->addSplit(owedByAlice).isValid());
+    QCOMPARE(db->finishEvent(dinner).type(), QSqlError::NoError);
+    QCOMPARE(db->finishEvent(other).type(), QSqlError::NoError);
+    db->getAmountSketch(other);
+
+    QStringList failures;
+    QMap<QString, int> otherRows = eventRows(other);
+    QCOMPARE(db->deleteEventCascade(dinner).type(), QSqlError::NoError);
+    failures << gone(dinner, "After deleting an event") << kept(other, otherRows, "After deleting an event");
+    QVERIFY2(failures.isEmpty(), qPrintable(failures.join(QLatin1String("; "))));
+
+    // The kept event loses the transactions and shares of alice, and with them its snapshot
+    otherRows = eventRows(other);
+    QCOMPARE(db->deleteUserCascade(alice).type(), QSqlError::NoError);
+    failures << gone(trip, "After deleting a user");
+    QVERIFY2(failures.isEmpty(), qPrintable(failures.join(QLatin1String("; "))));
+    QCOMPARE(count("SELECT COUNT(*) FROM transactions WHERE ? IN (usergives, userreceives)", QVariantList() << alice), 0);
+    QCOMPARE(count("SELECT COUNT(*) FROM splits WHERE payer = ?", QVariantList() << alice), 0);
+    QCOMPARE(count("SELECT COUNT(*) FROM users WHERE id = ?", QVariantList() << alice), 0);
+    QSqlQuery q(db->getConnection());
+    QVERIFY(q.exec("SELECT shares FROM splits"));
+    while(q.next())
+    {
+        SplitExpense split;
+        QVERIFY(split.unpackShares(q.value(0).toByteArray()));
+        foreach(const SplitExpense::Share &share, split.getShares())
+            QVERIFY2(share.userId != alice, "A split expense keeps a share of the deleted user");
+    }
+    // The split expense owed only by alice is gone, the shared one is kept
+    QCOMPARE(count("SELECT COUNT(*) FROM splits WHERE event = ?", QVariantList() << other), 1);
+    QCOMPARE(count("SELECT COUNT(*) FROM event_snapshots WHERE event = ?", QVariantList() << other), 0);
+    otherRows["transactions"] -= 1;
+    otherRows["splits"] -= 1;
+    otherRows["event_snapshots"] = 0;
+    otherRows.remove("event_participants");
+    otherRows.remove("kitty_ledger");
+    otherRows.remove("spending_rollup");
+    otherRows.remove("place_rollup");
+    otherRows.remove("amount_sketches");
+    failures << kept(other, otherRows, "After deleting a user");
+    QVERIFY2(failures.isEmpty(), qPrintable(failures.join(QLatin1String("; "))));
+
+    // The recreated triggers still keep the summaries
+    db->addTransaction(Transaction(User(bob), User(kittyId), Event(other), 7.5, QDate(2016, 9, 5), QLatin1String("Gdansk"), QLatin1String("Coffee")));
+    failures = db->checkEventSummaries(false);
+    QVERIFY2(failures.isEmpty(), qPrintable(failureMessage("After a cascade, adding a transaction", failures)));
+}
+
+/*!
+ * Sorted rows of each table, and the names of the indexes and triggers and the schema version
+ * under "schema"
+ *
+ * The full-text index is left out, it is rebuilt by loadSnapshot().
+ */
+static QMap<QString, QStringList> contents(QSqlDatabase database)
+{
+    QMap<QString, QStringList> tables;
+    QSqlQuery q(database);
+    QStringList names;
+    q.exec(QLatin1String("SELECT type, name FROM sqlite_master WHERE substr(name, 1, 7) != 'sqlite_' "
+                         "AND substr(name, 1, 16) != 'transactions_fts'"));
+    while(q.next())
+    {
+        if(q.value(0).toString() == QLatin1String("table"))
+            names << q.value(1).toString();
+        else
+            tables["schema"] << q.value(0).toString() + " " + q.value(1).toString();
+    }
+    q.exec(QLatin1String("PRAGMA user_version"));
+    if(q.next())
+        tables["schema"] << "user_version " + q.value(0).toString();
+    tables["schema"].sort();
+
+    foreach (const QString &name, names)
+    {
+        QStringList &rows = tables[name];
+        q.exec(QString("SELECT * FROM \"%1\"").arg(name));
+        while(q.next())
+        {
+            QStringList row;
+            for(int i = 0; i < q.record().count(); i++)
+            {
+                const QVariant value = q.value(i);
+                if(value.isNull())
+                    row << QLatin1String("NULL");
+                else if(value.type() == QVariant::ByteArray)
+                    row << QString::fromLatin1(value.toByteArray().toHex());
+                else
+                    row << value.toString();
+            }
+            rows << row.join(QLatin1Char('|'));
+        }
+        rows.sort();
+    }
+    return tables;
+}
+
+/*!
+ * Saves the database to a temporary file, loads it into a new in-memory database and compares
+ * the rows of every table, the schema objects, the schema version and some calculations
+ *
+ * The full-text index is compared through searchTransactions().
+ */
+void TestDataBase::snapshotRoundTrip()
+{
+    int payer = addUser("Alice", "snapshot_check_");
+    int trip = db->addEvent(Event(QLatin1String("Snapshot check"), QDate(2016, 9, 1), User(payer))).toInt();
+    QCOMPARE(db->getLastError().type(), QSqlError::NoError);
+    db->addTransaction(Transaction(User(payer), User(kittyId), Event(trip), 40, QDate(2016, 9, 1), QLatin1String("Warsaw"), QLatin1String("Snapshot check cash")));
+    SplitExpense split(User(payer), Event(trip), 33, QDate(2016, 9, 2), QLatin1String("Warsaw"), QLatin1String("Snapshot check dinner"));
+    split.addShare(payer);
+    split.addShare(kittyId);
+    QVERIFY(db->addSplit(split).isValid());
+    QCOMPARE(db->finishEvent(trip).type(), QSqlError::NoError);
+
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QString path = directory.filePath(QLatin1String("snapshot.db3"));
+    QCOMPARE(db->saveSnapshot(path).type(), QSqlError::NoError);
+    QVERIFY(!QFile::exists(path + QLatin1String(".part")));
+
+    DataBase loaded(true, DataBase::memoryPath());
+    QCOMPARE(loaded.loadSnapshot(path).type(), QSqlError::NoError);
+
+    QMap<QString, QStringList> saved = contents(db->getConnection());
+    QMap<QString, QStringList> read = contents(loaded.getConnection());
+    QCOMPARE(read.keys(), saved.keys());
+    foreach (const QString &table, saved.keys())
+        QVERIFY2(saved.value(table) == read.value(table),
+                 qPrintable(QString("Table %1: %2 rows saved, %3 loaded, or their values differ")
+                            .arg(table).arg(saved.value(table).size()).arg(read.value(table).size())));
+
+    QCOMPARE(loaded.getKittyId(), kittyId);
+    EventSnapshot snapshot, loadedSnapshot;
+    QVERIFY(db->getEventSnapshot(trip, &snapshot));
+    QVERIFY(loaded.getEventSnapshot(trip, &loadedSnapshot));
+    QCOMPARE(loadedSnapshot.getAmountKitty(), snapshot.getAmountKitty());
+    foreach (int event, selectIds("SELECT id FROM events", QVariantList()))
+        QCOMPARE(loaded.calcAmountKitty(event), db->calcAmountKitty(event));
+    foreach (const QString &text, QStringList() << "snapshot check" << "cash" << "supermarket")
+        QVERIFY2(db->searchTransactions(text) == loaded.searchTransactions(text),
+                 qPrintable(QString("Searching \"%1\" finds other transactions once loaded").arg(text)));
+}
+
+/*!
+ * Loads a snapshot into a database file, then fails to load a directory and checks the file
+ * is still in place and open
+ */
+void TestDataBase::fileSnapshot()
+{
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QString snapshotPath = directory.filePath(QLatin1String("snapshot.db3"));
+    QCOMPARE(db->saveSnapshot(snapshotPath).type(), QSqlError::NoError);
+
+    // Saving again replaces the file
+    QCOMPARE(db->saveSnapshot(snapshotPath).type(), QSqlError::NoError);
+
+    const QString livePath = directory.filePath(QLatin1String("live.db3"));
+    DataBase ledger(true, livePath);
+    QCOMPARE(ledger.getLastError().type(), QSqlError::NoError);
+    QCOMPARE(ledger.loadSnapshot(snapshotPath).type(), QSqlError::NoError);
+    QCOMPARE(contents(ledger.getConnection()), contents(db->getConnection()));
+    QVERIFY(!QFile::exists(livePath + QLatin1String(".load")));
+    QVERIFY(!QFile::exists(livePath + QLatin1String(".old")));
+
+    QVERIFY(ledger.loadSnapshot(directory.path()).type() != QSqlError::NoError);
+    QVERIFY(QFile::exists(livePath));
+    QCOMPARE(contents(ledger.getConnection()), contents(db->getConnection()));
+}
+
+QTEST_GUILESS_MAIN(TestDataBase)
+
+#include "tst_database.moc"
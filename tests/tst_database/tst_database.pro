@@ -0,0 +1,5 @@
+TARGET = tst_database
+
+include(../tests.pri)
+
+SOURCES += tst_database.cpp
@@ -0,0 +1,106 @@
+#include <QtTest>
+
+#include "emailvalidator.h"
+
+/*!
+ * \brief Tests of EmailValidator against the regular expression its DFA replaces
+ */
+class TestEmailValidator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void fixedAddresses_data();
+    void fixedAddresses(); //! \brief Known valid and invalid addresses, one by one and in a batch
+    void randomAddresses(); //! \brief DFA and regular expression agreeing on seeded random addresses
+
+private:
+    /*!
+     * \brief Validates an email address with the regular expression of User::validateEmail() before the DFA
+     * \param email email address
+     * \return true if valid
+     */
+    static bool isValidReference(const QString &email);
+};
+
+bool TestEmailValidator::isValidReference(const QString &email)
+{
+    const QRegExp validMailRegExp = QRegExp("[a-z0-9._%+-]+@[a-z0-9.-]+\\.[a-z]{2,4}");
+    return validMailRegExp.exactMatch(email.trimmed().toLower());
+}
+
+void TestEmailValidator::fixedAddresses_data()
+{
+    QTest::addColumn<QString>("email");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("plain") << "alice@example.com" << true;
+    QTest::newRow("upper case") << "Alice.Smith@Example.COM" << true;
+    QTest::newRow("surrounding whitespace") << " \tbob@example.org\n" << true;
+    QTest::newRow("local symbols") << "a_b%c+d-e.f@example.info" << true;
+    QTest::newRow("subdomains") << "carol@mail.example.co.uk" << true;
+    QTest::newRow("two letter tld") << "x@y.de" << true;
+    QTest::newRow("digits in domain") << "dave@host-42.net" << true;
+    QTest::newRow("empty") << "" << false;
+    QTest::newRow("no at") << "alice.example.com" << false;
+    QTest::newRow("two ats") << "alice@bob@example.com" << false;
+    QTest::newRow("empty local part") << "@example.com" << false;
+    QTest::newRow("no dot in domain") << "alice@localhost" << false;
+    QTest::newRow("one letter tld") << "alice@example.c" << false;
+    QTest::newRow("five letter tld") << "alice@example.museum" << false;
+    QTest::newRow("digit in tld") << "alice@example.c0m" << false;
+    QTest::newRow("nothing before the last dot") << "alice@.com" << false;
+    QTest::newRow("inner space") << "ali ce@example.com" << false;
+    QTest::newRow("non-ASCII") << QString::fromUtf8("josé@example.com") << false;
+}
+
+void TestEmailValidator::fixedAddresses()
+{
+    QFETCH(QString, email);
+    QFETCH(bool, valid);
+
+    QCOMPARE(isValidReference(email), valid);
+    QCOMPARE(EmailValidator::isValid(email), valid);
+    QCOMPARE(EmailValidator::validate(QStringList() << "alice@example.com" << email).testBit(1), valid);
+}
+
+/*!
+ * Addresses are built from the characters which change the state of the DFA, plus some
+ * upper-case, whitespace and non-ASCII ones, so most of the transitions are hit. One in four
+ * is built as a plausible address.
+ */
+void TestEmailValidator::randomAddresses()
+{
+    const QString alphabet = QString::fromUtf8("abcxyzAZ09-._%+@@.. \t#éKİ");
+    const int count = 100000;
+    QRandomGenerator random(1);
+
+    QStringList emails;
+    emails.reserve(count);
+    for(int i = 0; i < count; i++)
+    {
+        QString email;
+        int length = random.bounded(1, 24);
+        for(int j = 0; j < length; j++)
+            email.append(alphabet.at(random.bounded(alphabet.size())));
+        if(i % 4 == 0)
+            email = QString("user%1@host%2.%3").arg(i).arg(email.size()).arg(QString("com").left(1 + i % 3)) + email.left(i % 2);
+        emails.append(email);
+    }
+
+    QBitArray result = EmailValidator::validate(emails);
+    int valid = 0;
+    for(int i = 0; i < count; i++)
+    {
+        QVERIFY2(result.testBit(i) == isValidReference(emails.at(i)),
+                 qPrintable(QString("\"%1\" is %2 for the DFA").arg(emails.at(i)).arg(result.testBit(i) ? "valid" : "invalid")));
+        if(result.testBit(i))
+            valid++;
+    }
+    // Both outcomes are covered
+    QVERIFY(valid > 0 && valid < count);
+}
+
+QTEST_GUILESS_MAIN(TestEmailValidator)
+
+#include "tst_emailvalidator.moc"
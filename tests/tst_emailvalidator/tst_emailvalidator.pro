@@ -0,0 +1,5 @@
+TARGET = tst_emailvalidator
+
+include(../tests.pri)
+
+SOURCES += tst_emailvalidator.cpp
@@ -0,0 +1,774 @@
+#include <QtTest>
+
+#include "database.h"
+#include "ledgertablemodel.h"
+#include "memoryledgerstore.h"
+
+/*!
+ * \brief Conformance tests of the LedgerStore backends
+ *
+ * Every test runs once per backend on a new empty store. Every backend must give the values
+ * the SQLite one gives, so the expected values are written down here instead of comparing
+ * two stores with each other.
+ */
+class TestLedgerStore : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void emptyStore_data();
+    void emptyStore(); //! \brief A new store has the kitty only
+    void users_data();
+    void users(); //! \brief Users added, read, rejected on a repeated nickname and deleted
+    void events_data();
+    void events(); //! \brief Events added and read
+    void transactions_data();
+    void transactions(); //! \brief Transactions added, read and counted
+    void summaries_data();
+    void summaries(); //! \brief Totals of the events and the kitty day by day
+    void dateRanges_data();
+    void dateRanges(); //! \brief Transactions and totals between two dates
+    void balances_data();
+    void balances(); //! \brief Balances of the users up to a date
+    void deletes_data();
+    void deletes(); //! \brief Totals after deleting transactions, events and users
+    void currencies_data();
+    void currencies(); //! \brief Amounts in other currencies rejected without a rate, converted with one
+    void splits_data();
+    void splits(); //! \brief Totals with split expenses expanded, and the shares left after deleting a user
+    void lists_data();
+    void lists(); //! \brief Users and events listed, the user index and the users of an event
+    void analytics_data();
+    void analytics(); //! \brief Spending by day, user and place, the amount sketch and the balances to settle
+    void snapshots_data();
+    void snapshots(); //! \brief Snapshots of finished events, built again after a change and dropped on reopen
+    void duplicates_data();
+    void duplicates(); //! \brief Duplicate transactions flagged or skipped, one by one and imported
+    void imports_data();
+    void imports(); //! \brief Users added at once, transactions read from CSV and the example data
+    void tables_data();
+    void tables(); //! \brief Rows of the table models of the window without a database, filtered like the sql ones
+
+private:
+    /*!
+     * \brief Ids of the entries added by populate()
+     */
+    struct Ledger
+    {
+        int kitty;
+        int alice;
+        int bob;
+        int carol;
+        //! \brief Event administered by alice with four transactions, one of them undated
+        int trip;
+        //! \brief Event administered by bob with one transaction
+        int dinner;
+        //! \brief Transactions in the order added
+        QVector<int> transactions;
+    };
+
+    /*!
+     * \brief Adds one row per backend
+     */
+    static void addBackends();
+    /*!
+     * \brief Returns a new empty store
+     * \param backend "SQLite" for an in-memory DataBase, "Memory" for a MemoryLedgerStore
+     * \return store, owned by the caller
+     */
+    static LedgerStore *createStore(const QString &backend);
+    /*!
+     * \brief Adds three users, two events and five transactions
+     * \param store empty store
+     * \return ids of the entries added
+     */
+    static Ledger populate(LedgerStore &store);
+};
+
+void TestLedgerStore::addBackends()
+{
+    QTest::addColumn<QString>("backend");
+    QTest::newRow("SQLite") << QString("SQLite");
+    QTest::newRow("Memory") << QString("Memory");
+}
+
+LedgerStore *TestLedgerStore::createStore(const QString &backend)
+{
+    if(backend == QLatin1String("Memory"))
+        return new MemoryLedgerStore();
+    return new DataBase(true, DataBase::memoryPath());
+}
+
+TestLedgerStore::Ledger TestLedgerStore::populate(LedgerStore &store)
+{
+    Ledger ledger;
+    ledger.kitty = store.getKittyId();
+    ledger.alice = store.addUser(User(QLatin1String("Alice"), QLatin1String("alice"), QLatin1String("alice@example.com"),
+                                      QLatin1String("hash"), QLatin1String("salt"), QDate(1990, 1, 1))).toInt();
+    ledger.bob = store.addUser(User(QLatin1String("Bob"), QLatin1String("bob"), QLatin1String("bob@example.com"),
+                                    QLatin1String("hash"), QLatin1String("salt"), QDate(1991, 2, 2))).toInt();
+    ledger.carol = store.addUser(User(QLatin1String("Carol"), QLatin1String("carol"), QLatin1String("carol@example.com"),
+                                      QLatin1String("hash"), QLatin1String("salt"), QDate())).toInt();
+
+    ledger.trip = store.addEvent(Event(QLatin1String("Trip"), QDate(2016, 9, 1), User(ledger.alice), QLatin1String("Warsaw"))).toInt();
+    ledger.dinner = store.addEvent(Event(QLatin1String("Dinner"), QDate(2016, 9, 1), User(ledger.bob))).toInt();
+
+    ledger.transactions
+            << store.addTransaction(Transaction(User(ledger.alice), User(ledger.bob), Event(ledger.trip), 60, QDate(2016, 9, 2), QLatin1String("Hamburg"))).toInt()
+            << store.addTransaction(Transaction(User(ledger.alice), User(ledger.kitty), Event(ledger.trip), 75, QDate(2016, 9, 3))).toInt()
+            << store.addTransaction(Transaction(User(ledger.kitty), User(ledger.bob), Event(ledger.trip), 38, QDate(2016, 9, 5))).toInt()
+            << store.addTransaction(Transaction(User(ledger.carol), User(ledger.kitty), Event(ledger.trip), 30, QDate())).toInt()
+            << store.addTransaction(Transaction(User(ledger.bob), User(ledger.carol), Event(ledger.dinner), 20, QDate(2016, 9, 1))).toInt();
+    return ledger;
+}
+
+void TestLedgerStore::emptyStore_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::emptyStore()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    QVERIFY(store->isDatabaseEmpty());
+    QCOMPARE(store->getUser(store->getKittyId()).getNickname(), QString("Kitty"));
+}
+
+void TestLedgerStore::users_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::users()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    Ledger ledger = populate(*store);
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+    QVERIFY(!store->isDatabaseEmpty());
+
+    User user = store->getUser(ledger.bob);
+    QCOMPARE(user.getId(), ledger.bob);
+    QCOMPARE(user.getName(), QString("Bob"));
+    QCOMPARE(user.getEmail(), QString("bob@example.com"));
+    QCOMPARE(user.getBirthdate(), QDate(1991, 2, 2));
+
+    QVERIFY(!store->addUser(User(QLatin1String("Other"), QLatin1String("alice"), QLatin1String("other@example.com"),
+                                 QLatin1String("hash"), QLatin1String("salt"), QDate())).isValid());
+    QVERIFY(store->getLastError().type() != QSqlError::NoError);
+
+    QCOMPARE(store->deleteUser(ledger.bob).type(), QSqlError::NoError);
+    QCOMPARE(store->getUser(ledger.bob).getId(), -1);
+    QCOMPARE(store->getUser(ledger.carol).getId(), ledger.carol);
+
+    // A deleted nickname can be used again
+    QCOMPARE(store->deleteUserCascade(ledger.alice).type(), QSqlError::NoError);
+    int again = store->addUser(User(QLatin1String("Alice"), QLatin1String("alice"), QLatin1String("alice@example.com"),
+                                    QLatin1String("hash"), QLatin1String("salt"), QDate())).toInt();
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+    QVERIFY(again != ledger.alice);
+}
+
+void TestLedgerStore::events_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::events()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    Ledger ledger = populate(*store);
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+
+    Event event = store->getEvent(ledger.trip);
+    QCOMPARE(event.getId(), ledger.trip);
+    QCOMPARE(event.getName(), QString("Trip"));
+    QCOMPARE(event.getAdmin().getId(), ledger.alice);
+    QCOMPARE(event.getCreationDate(), QDate(2016, 9, 1));
+    QVERIFY(!event.isFinished());
+    QCOMPARE(store->getNumEventsOfUser(ledger.alice), 1);
+    QCOMPARE(store->getNumEventsOfUser(ledger.carol), 0);
+}
+
+void TestLedgerStore::transactions_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::transactions()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    Ledger ledger = populate(*store);
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+
+    Transaction transaction = store->getTransaction(ledger.transactions.at(0));
+    QCOMPARE(transaction.getId(), ledger.transactions.at(0));
+    QCOMPARE(transaction.getUserGiving().getId(), ledger.alice);
+    QCOMPARE(transaction.getUserReceiving().getId(), ledger.bob);
+    QCOMPARE(transaction.getEvent().getId(), ledger.trip);
+    QCOMPARE(transaction.getAmount(), 60.0);
+    QCOMPARE(transaction.getDate(), QDate(2016, 9, 2));
+    QCOMPARE(transaction.getPlace(), QString("Hamburg"));
+
+    QCOMPARE(store->getNumTransactions(-1, ledger.trip), 4);
+    QCOMPARE(store->getNumTransactions(ledger.alice), 2);
+    QCOMPARE(store->getNumTransactions(ledger.bob, ledger.trip), 2);
+    QCOMPARE(store->getNumTransactions(), 0);
+}
+
+void TestLedgerStore::summaries_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::summaries()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    Ledger ledger = populate(*store);
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+
+    QCOMPARE(store->calcAmountKitty(ledger.trip), 67.0);
+    QCOMPARE(store->calcNumUsers(ledger.trip), 3);
+
+    LedgerStore::EventSummary summary = store->getEventSummary(ledger.trip);
+    QCOMPARE(summary.kittyIn, 105.0);
+    QCOMPARE(summary.kittyOut, 38.0);
+    QCOMPARE(summary.volume, 203.0);
+    QCOMPARE(summary.transactions, 4);
+    QCOMPARE(summary.lastDate, QDate(2016, 9, 5));
+
+    summary = store->getEventSummary(-1);
+    QCOMPARE(summary.transactions, 0);
+    QCOMPARE(summary.volume, 0.0);
+    QVERIFY(!summary.lastDate.isValid());
+
+    // Undated transactions first
+    QVector<LedgerStore::KittyBalancePoint> series = store->getKittyBalanceSeries(ledger.trip);
+    QCOMPARE(series.size(), 3);
+    QVERIFY(!series.first().date.isValid());
+    QCOMPARE(series.first().inflow, 30.0);
+    QCOMPARE(series.last().date, QDate(2016, 9, 5));
+    QCOMPARE(series.last().outflow, 38.0);
+    QCOMPARE(series.last().balance, 67.0);
+}
+
+void TestLedgerStore::dateRanges_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::dateRanges()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    Ledger ledger = populate(*store);
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+
+    // Ordered by date, the undated one skipped
+    QVector<Transaction> between = store->getTransactionsBetween(QDate(2016, 9, 1), QDate(2016, 9, 30));
+    QCOMPARE(between.size(), 4);
+    QCOMPARE(between.at(0).getId(), ledger.transactions.at(4));
+    QCOMPARE(between.at(1).getId(), ledger.transactions.at(0));
+    QCOMPARE(between.at(3).getId(), ledger.transactions.at(2));
+    QCOMPARE(store->getTransactionsBetween(QDate(2016, 9, 3), QDate(2016, 9, 4), ledger.trip).size(), 1);
+    QCOMPARE(store->sumBetween(QDate(2016, 9, 1), QDate(2016, 9, 3)), 155.0);
+    QCOMPARE(store->sumBetween(QDate(2016, 9, 1), QDate(2016, 9, 3), ledger.trip), 135.0);
+}
+
+void TestLedgerStore::balances_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::balances()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    Ledger ledger = populate(*store);
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+
+    QCOMPARE(store->getBalanceAsOf(ledger.trip, ledger.alice, QDate(2016, 9, 2)), 60.0);
+    QCOMPARE(store->getBalanceAsOf(ledger.trip, ledger.bob, QDate(2016, 9, 5)), -98.0);
+    // The undated transaction of carol is not counted
+    QCOMPARE(store->getBalanceAsOf(ledger.trip, ledger.carol, QDate(2016, 12, 31)), 0.0);
+
+    QHash<int, double> balances = store->getBalancesAsOf(ledger.trip, QDate(2016, 9, 3));
+    QCOMPARE(balances.value(ledger.alice), 135.0);
+    QCOMPARE(balances.value(ledger.kitty), -75.0);
+}
+
+void TestLedgerStore::deletes_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::deletes()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    Ledger ledger = populate(*store);
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+
+    // Built before the delete, so it must be updated
+    QCOMPARE(store->getBalanceAsOf(ledger.trip, ledger.bob, QDate(2016, 9, 5)), -98.0);
+
+    QCOMPARE(store->deleteTransaction(ledger.transactions.at(2)).type(), QSqlError::NoError);
+    QCOMPARE(store->getTransaction(ledger.transactions.at(2)).getId(), -1);
+    QCOMPARE(store->calcAmountKitty(ledger.trip), 105.0);
+    QCOMPARE(store->getEventSummary(ledger.trip).lastDate, QDate(2016, 9, 3));
+    QCOMPARE(store->getBalanceAsOf(ledger.trip, ledger.bob, QDate(2016, 9, 5)), -60.0);
+
+    QCOMPARE(store->deleteTransactions(QVector<int>() << ledger.transactions.at(0) << ledger.transactions.at(1)).type(), QSqlError::NoError);
+    QCOMPARE(store->getNumTransactions(-1, ledger.trip), 1);
+    QCOMPARE(store->calcNumUsers(ledger.trip), 1);
+
+    QCOMPARE(store->deleteEventCascade(ledger.dinner).type(), QSqlError::NoError);
+    QCOMPARE(store->getEvent(ledger.dinner).getId(), -1);
+    QCOMPARE(store->getTransaction(ledger.transactions.at(4)).getId(), -1);
+    // The other events are kept
+    QCOMPARE(store->getNumTransactions(ledger.carol), 1);
+
+    // The events administered by the user go with it
+    QCOMPARE(store->deleteUserCascade(ledger.alice).type(), QSqlError::NoError);
+    QCOMPARE(store->getUser(ledger.alice).getId(), -1);
+    QCOMPARE(store->getEvent(ledger.trip).getId(), -1);
+    QCOMPARE(store->getNumTransactions(ledger.carol), 0);
+}
+
+void TestLedgerStore::currencies_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::currencies()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    Ledger ledger = populate(*store);
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+    QCOMPARE(store->getEventCurrency(ledger.trip), LedgerStore::defaultCurrency());
+
+    Transaction zloty(User(ledger.alice), User(ledger.kitty), Event(ledger.trip), 100, QDate(2016, 9, 2));
+    zloty.setCurrency(QLatin1String("PLN"));
+    QVERIFY(!store->isCurrencyConvertible(ledger.trip, QLatin1String("PLN")));
+    QVERIFY(!store->addTransaction(zloty).isValid());
+    QCOMPARE(store->getLastError().type(), QSqlError::StatementError);
+    QCOMPARE(store->getNumTransactions(-1, ledger.trip), 4);
+    QCOMPARE(store->calcAmountKitty(ledger.trip), 67.0);
+
+    // 4 PLN for 1 EUR, used both ways
+    QVector<CurrencyConverter::Rate> rates;
+    CurrencyConverter::Rate rate = {QDate(2016, 9, 1), QLatin1String("PLN"), QLatin1String("EUR"), 4};
+    rates << rate;
+    QCOMPARE(store->importExchangeRates(rates).type(), QSqlError::NoError);
+    QVERIFY(store->isCurrencyConvertible(ledger.trip, QLatin1String("PLN")));
+
+    // Built before the add, so it must be updated
+    QCOMPARE(store->getBalanceAsOf(ledger.trip, ledger.alice, QDate(2016, 9, 2)), 60.0);
+    int id = store->addTransaction(zloty).toInt();
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+    // Kept as given, converted in the totals
+    QCOMPARE(store->getTransaction(id).getAmount(), 100.0);
+    QCOMPARE(store->getTransaction(id).getCurrency(), QString("PLN"));
+    QCOMPARE(store->calcAmountKitty(ledger.trip), 92.0);
+    QCOMPARE(store->getEventSummary(ledger.trip).volume, 228.0);
+    QCOMPARE(store->getKittyBalanceSeries(ledger.trip).last().balance, 92.0);
+    QCOMPARE(store->getBalanceAsOf(ledger.trip, ledger.alice, QDate(2016, 9, 2)), 85.0);
+
+    QVector<Transaction> transactions = store->getEventTransactions(ledger.trip);
+    QCOMPARE(transactions.size(), 5);
+    QVERIFY(!transactions.first().getDate().isValid());
+    QCOMPARE(transactions.at(2).getId(), id);
+    QCOMPARE(transactions.at(2).getAmount(), 25.0);
+
+    Event krakow(QLatin1String("Krakow"), QDate(2016, 9, 1), User(ledger.carol));
+    krakow.setCurrency(QLatin1String("PLN"));
+    int krakowId = store->addEvent(krakow).toInt();
+    Transaction euros(User(ledger.carol), User(ledger.bob), Event(krakowId), 10, QDate(2016, 9, 2));
+    euros.setCurrency(QLatin1String("EUR"));
+    store->addTransaction(euros);
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+    QCOMPARE(store->getEventSummary(krakowId).volume, 40.0);
+
+    // A newer rate converts the amounts from its day on
+    CurrencyConverter::Rate newer = {QDate(2016, 9, 2), QLatin1String("PLN"), QLatin1String("EUR"), 5};
+    QCOMPARE(store->importExchangeRates(QVector<CurrencyConverter::Rate>() << newer).type(), QSqlError::NoError);
+    QCOMPARE(store->calcAmountKitty(ledger.trip), 87.0);
+    QCOMPARE(store->getBalanceAsOf(ledger.trip, ledger.alice, QDate(2016, 9, 2)), 80.0);
+    QCOMPARE(store->getEventSummary(krakowId).volume, 50.0);
+
+    QCOMPARE(store->deleteTransaction(id).type(), QSqlError::NoError);
+    QCOMPARE(store->calcAmountKitty(ledger.trip), 67.0);
+}
+
+void TestLedgerStore::splits_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::splits()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    Ledger ledger = populate(*store);
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+
+    // Built before the add, so it must be updated
+    QCOMPARE(store->getBalanceAsOf(ledger.trip, ledger.bob, QDate(2016, 9, 5)), -98.0);
+
+    // Alice pays 90 for the three of them: 30 from her to bob and to carol
+    SplitExpense lunch(User(ledger.alice), Event(ledger.trip), 90, QDate(2016, 9, 4));
+    lunch.addShare(ledger.alice);
+    lunch.addShare(ledger.bob);
+    lunch.addShare(ledger.carol);
+    int id = store->addSplit(lunch).toInt();
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+    QCOMPARE(store->getNumSplits(ledger.trip), 1);
+    QCOMPARE(store->getNumSplits(), 1);
+    QCOMPARE(store->getNumSplitsOfUser(ledger.alice), 1);
+    QCOMPARE(store->getNumSplitsOfUser(ledger.carol), 1);
+    QCOMPARE(store->getEventSplits(ledger.trip).first().getShares().size(), 3);
+
+    SplitExpense zloty(User(ledger.bob), Event(ledger.trip), 100, QDate(2016, 9, 4));
+    zloty.setCurrency(QLatin1String("PLN"));
+    zloty.addShare(ledger.carol);
+    QVERIFY(!store->addSplit(zloty).isValid());
+    QCOMPARE(store->getLastError().type(), QSqlError::StatementError);
+    QCOMPARE(store->getNumSplits(ledger.trip), 1);
+
+    LedgerStore::EventSummary summary = store->getEventSummary(ledger.trip);
+    QCOMPARE(summary.volume, 263.0);
+    QCOMPARE(summary.transactions, 6);
+    QCOMPARE(summary.participants, 3);
+    QCOMPARE(summary.lastDate, QDate(2016, 9, 5));
+    QCOMPARE(store->calcAmountKitty(ledger.trip), 67.0);
+    QCOMPARE(store->getBalanceAsOf(ledger.trip, ledger.alice, QDate(2016, 9, 4)), 195.0);
+    QCOMPARE(store->getBalanceAsOf(ledger.trip, ledger.bob, QDate(2016, 9, 5)), -128.0);
+
+    // The expanded transactions after those of the same day
+    QVector<Transaction> transactions = store->getEventTransactions(ledger.trip);
+    QCOMPARE(transactions.size(), 6);
+    QCOMPARE(transactions.at(3).getUserReceiving().getId(), ledger.bob);
+    QCOMPARE(transactions.at(3).getAmount(), 30.0);
+    QCOMPARE(transactions.at(5).getId(), ledger.transactions.at(2));
+
+    QCOMPARE(store->deleteSplit(id).type(), QSqlError::NoError);
+    QCOMPARE(store->getNumSplits(ledger.trip), 0);
+    QCOMPARE(store->getEventSummary(ledger.trip).volume, 203.0);
+    QCOMPARE(store->getBalanceAsOf(ledger.trip, ledger.bob, QDate(2016, 9, 5)), -98.0);
+
+    // Carol leaves: the expense of bob is left without anyone owing him, the one of alice
+    // is split among the others
+    SplitExpense taxi(User(ledger.alice), Event(ledger.trip), 40, QDate(2016, 9, 4));
+    taxi.addShare(ledger.bob);
+    taxi.addShare(ledger.carol);
+    store->addSplit(taxi);
+    SplitExpense wine(User(ledger.bob), Event(ledger.dinner), 10, QDate(2016, 9, 1));
+    wine.addShare(ledger.bob);
+    wine.addShare(ledger.carol);
+    store->addSplit(wine);
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+
+    QCOMPARE(store->deleteUserCascade(ledger.carol).type(), QSqlError::NoError);
+    QCOMPARE(store->getNumSplits(ledger.dinner), 0);
+    QCOMPARE(store->getNumSplits(ledger.trip), 1);
+    QCOMPARE(store->getNumSplitsOfUser(ledger.carol), 0);
+    QCOMPARE(store->getNumSplitsOfUser(ledger.bob), 1);
+    summary = store->getEventSummary(ledger.trip);
+    QCOMPARE(summary.volume, 213.0);
+    QCOMPARE(summary.transactions, 4);
+    QCOMPARE(summary.participants, 2);
+    QCOMPARE(store->getBalanceAsOf(ledger.trip, ledger.bob, QDate(2016, 9, 5)), -138.0);
+
+    QCOMPARE(store->deleteEventCascade(ledger.trip).type(), QSqlError::NoError);
+    QCOMPARE(store->getNumSplits(), 0);
+}
+
+void TestLedgerStore::lists_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::lists()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    Ledger ledger = populate(*store);
+    int beach = store->addEvent(Event(QLatin1String("Beach"), QDate(2016, 9, 1), User(ledger.carol))).toInt();
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+
+    QVector<User> users = store->getUsers();
+    QCOMPARE(users.size(), 4);
+    QCOMPARE(users.first().getId(), ledger.kitty);
+    QCOMPARE(users.last().getNickname(), QString("carol"));
+
+    // Ordered by name
+    QVector<Event> events = store->getEvents();
+    QCOMPARE(events.size(), 3);
+    QCOMPARE(events.at(0).getId(), beach);
+    QCOMPARE(events.at(1).getId(), ledger.dinner);
+    QCOMPARE(events.at(2).getName(), QString("Trip"));
+    events = store->getEventsWithTransactions();
+    QCOMPARE(events.size(), 2);
+    QCOMPARE(events.first().getId(), ledger.dinner);
+
+    QCOMPARE(store->getUserIndex().search(QLatin1String("al"), 10), QVector<int>() << ledger.alice);
+    QCOMPARE(store->getUserIndex().getRecord(ledger.bob).email, QString("bob@example.com"));
+
+    QList<int> giving = store->getUsersGiving(ledger.trip);
+    std::sort(giving.begin(), giving.end());
+    QCOMPARE(giving, QList<int>() << ledger.kitty << ledger.alice << ledger.carol);
+    QList<int> receiving = store->getUsersReceiving(ledger.trip, ledger.alice);
+    std::sort(receiving.begin(), receiving.end());
+    QCOMPARE(receiving, QList<int>() << ledger.kitty << ledger.bob);
+    QCOMPARE(store->getAmountBetween(ledger.trip, ledger.alice, ledger.bob), 60.0);
+    QCOMPARE(store->getAmountBetween(ledger.trip, ledger.bob, ledger.alice), 0.0);
+
+    // Deleted entries are not listed
+    QCOMPARE(store->deleteUser(ledger.bob).type(), QSqlError::NoError);
+    QCOMPARE(store->deleteEvent(beach).type(), QSqlError::NoError);
+    QCOMPARE(store->getUsers().size(), 3);
+    QCOMPARE(store->getEvents().size(), 2);
+    QVERIFY(store->getUserIndex().search(QLatin1String("bob"), 10).isEmpty());
+}
+
+void TestLedgerStore::analytics_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::analytics()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    Ledger ledger = populate(*store);
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+
+    // Undated transactions first
+    QVector<LedgerStore::SpendingPoint> series = store->getSpendingSeries(ledger.trip);
+    QCOMPARE(series.size(), 4);
+    QVERIFY(!series.first().date.isValid());
+    QCOMPARE(series.first().amount, 30.0);
+    QCOMPARE(series.last().date, QDate(2016, 9, 5));
+    QCOMPARE(series.last().amount, 38.0);
+    series = store->getSpendingSeries(ledger.trip, ledger.alice);
+    QCOMPARE(series.size(), 2);
+    QCOMPARE(series.at(1).amount, 75.0);
+    QCOMPARE(series.at(1).transactions, 1);
+
+    // The kitty excluded, the largest given first
+    QVector<LedgerStore::SpenderTotal> spenders = store->getTopSpenders(ledger.trip);
+    QCOMPARE(spenders.size(), 3);
+    QCOMPARE(spenders.at(0).userId, ledger.alice);
+    QCOMPARE(spenders.at(0).given, 135.0);
+    QCOMPARE(spenders.at(0).transactions, 2);
+    QCOMPARE(spenders.at(1).userId, ledger.carol);
+    QCOMPARE(spenders.at(2).userId, ledger.bob);
+    QCOMPARE(spenders.at(2).received, 98.0);
+    QCOMPARE(store->getTopSpenders(ledger.trip, 1).size(), 1);
+
+    QVector<LedgerStore::PlaceTotal> places = store->getTopPlaces(ledger.trip);
+    QCOMPARE(places.size(), 1);
+    QCOMPARE(places.first().place, QString("Hamburg"));
+    QCOMPARE(places.first().amount, 60.0);
+
+    QCOMPARE(store->getAmountSketch(ledger.trip).getCount(), qint64(4));
+    QCOMPARE(store->getAmountSketch(-1, ledger.alice).getCount(), qint64(2));
+    QCOMPARE(store->getAmountSketch().getCount(), qint64(5));
+
+    QVector<Settlement::EventBalances> events = store->getEventBalances(QVector<int>() << ledger.dinner << ledger.trip);
+    QCOMPARE(events.size(), 2);
+    QHash<int, Settlement::EventBalances> byId;
+    foreach (const Settlement::EventBalances &event, events)
+        byId.insert(event.eventId, event);
+    QCOMPARE(byId.value(ledger.trip).currency, LedgerStore::defaultCurrency());
+    QCOMPARE(byId.value(ledger.trip).balances.value(ledger.alice), 135.0);
+    QCOMPARE(byId.value(ledger.trip).balances.value(ledger.bob), -98.0);
+    QCOMPARE(byId.value(ledger.trip).balances.value(ledger.kitty), -67.0);
+    QCOMPARE(byId.value(ledger.trip).balances.value(ledger.carol), 30.0);
+    QCOMPARE(byId.value(ledger.dinner).balances.value(ledger.carol), -20.0);
+}
+
+void TestLedgerStore::snapshots_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::snapshots()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    Ledger ledger = populate(*store);
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+
+    EventSnapshot snapshot;
+    QVERIFY(!store->getEventSnapshot(ledger.trip, &snapshot));
+
+    QCOMPARE(store->finishEvent(ledger.trip).type(), QSqlError::NoError);
+    QVERIFY(store->getEvent(ledger.trip).isFinished());
+    QVERIFY(store->getEventSnapshot(ledger.trip, &snapshot));
+    QCOMPARE(snapshot.getEventId(), ledger.trip);
+    QCOMPARE(snapshot.getAmountKitty(), 67.0);
+    QCOMPARE(snapshot.getNumUsers(), 3);
+    QVERIFY(!store->getEventSnapshot(ledger.dinner, &snapshot));
+
+    // A change of the transactions gives a new snapshot
+    store->addTransaction(Transaction(User(ledger.bob), User(ledger.kitty), Event(ledger.trip), 10, QDate(2016, 9, 6)));
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+    QVERIFY(store->getEventSnapshot(ledger.trip, &snapshot));
+    QCOMPARE(snapshot.getAmountKitty(), 77.0);
+
+    QCOMPARE(store->reopenEvent(ledger.trip).type(), QSqlError::NoError);
+    QVERIFY(!store->getEvent(ledger.trip).isFinished());
+    QVERIFY(!store->getEventSnapshot(ledger.trip, &snapshot));
+}
+
+void TestLedgerStore::duplicates_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::duplicates()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    Ledger ledger = populate(*store);
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+    QCOMPARE(store->getDuplicateCheck().action, LedgerStore::DuplicateCheck::Off);
+
+    LedgerStore::DuplicateCheck check = {LedgerStore::DuplicateCheck::Skip, 1, 0.5};
+    store->setDuplicateCheck(check);
+    Transaction again(User(ledger.alice), User(ledger.bob), Event(ledger.trip), 60.25, QDate(2016, 9, 3));
+    QCOMPARE(store->findDuplicateTransaction(again), ledger.transactions.at(0));
+    QCOMPARE(store->findDuplicateTransaction(Transaction(User(ledger.alice), User(ledger.bob), Event(ledger.trip), 60, QDate(2016, 9, 4))), -1);
+    QCOMPARE(store->findDuplicateTransaction(Transaction(User(ledger.alice), User(ledger.bob), Event(ledger.trip), 61, QDate(2016, 9, 2))), -1);
+    // Undated ones only match undated ones
+    QCOMPARE(store->findDuplicateTransaction(Transaction(User(ledger.carol), User(ledger.kitty), Event(ledger.trip), 30, QDate())),
+             ledger.transactions.at(3));
+    QCOMPARE(store->findDuplicateTransaction(Transaction(User(ledger.carol), User(ledger.kitty), Event(ledger.trip), 30, QDate(2016, 9, 1))), -1);
+
+    QVERIFY(!store->addTransaction(again).isValid());
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+    QCOMPARE(store->getLastDuplicate(), ledger.transactions.at(0));
+    QCOMPARE(store->getNumTransactions(-1, ledger.trip), 4);
+
+    check.action = LedgerStore::DuplicateCheck::Flag;
+    store->setDuplicateCheck(check);
+    QVERIFY(store->addTransaction(again).isValid());
+    QCOMPARE(store->getLastDuplicate(), ledger.transactions.at(0));
+    QCOMPARE(store->getNumTransactions(-1, ledger.trip), 5);
+
+    // Matched against the existing ones and the previous ones of the batch
+    check.action = LedgerStore::DuplicateCheck::Skip;
+    store->setDuplicateCheck(check);
+    Transaction wine(User(ledger.bob), User(ledger.carol), Event(ledger.dinner), 12, QDate(2016, 9, 1), QString(), QLatin1String("Wine"));
+    QVector<int> duplicates;
+    QCOMPARE(store->importTransactions(QVector<Transaction>() << again << wine << wine, &duplicates).type(), QSqlError::NoError);
+    QCOMPARE(duplicates, QVector<int>() << 0 << 2);
+    QCOMPARE(store->getNumTransactions(-1, ledger.dinner), 2);
+}
+
+void TestLedgerStore::imports_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::imports()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    Ledger ledger = populate(*store);
+    QCOMPARE(store->getLastError().type(), QSqlError::NoError);
+
+    // Taken nickname, taken email without case, and a nickname of an earlier user of the batch
+    QVector<User> users;
+    users << User(QLatin1String("Dave"), QLatin1String("dave"), QLatin1String("dave@example.com"), QLatin1String("hash"), QLatin1String("salt"), QDate())
+          << User(QLatin1String("Other"), QLatin1String("other"), QLatin1String("ALICE@example.com"), QLatin1String("hash"), QLatin1String("salt"), QDate())
+          << User(QLatin1String("Bob"), QLatin1String("bob"), QLatin1String("bob2@example.com"), QLatin1String("hash"), QLatin1String("salt"), QDate())
+          << User(QLatin1String("Dave"), QLatin1String("dave"), QLatin1String("dave2@example.com"), QLatin1String("hash"), QLatin1String("salt"), QDate());
+    QVector<int> skipped;
+    QCOMPARE(store->addUsers(users, &skipped).type(), QSqlError::NoError);
+    QCOMPARE(skipped, QVector<int>() << 1 << 2 << 3);
+    QCOMPARE(store->getUsers().size(), 5);
+    QCOMPARE(store->getUserIndex().search(QLatin1String("dave"), 10).size(), 1);
+
+    QByteArray csv("date,giver,receiver,amount\n"
+                   "2016-09-06,alice,bob,12.5,Warsaw,Taxi, night\n"
+                   "not,a,line\n"
+                   ",carol,nobody,5\n"
+                   ",carol,dave,5\n");
+    QBuffer buffer(&csv);
+    QVERIFY(buffer.open(QIODevice::ReadOnly | QIODevice::Text));
+    QStringList errors;
+    QVector<Transaction> transactions = store->readTransactions(&buffer, ledger.dinner, &errors);
+    QCOMPARE(transactions.size(), 2);
+    QCOMPARE(errors.size(), 2);
+    QCOMPARE(transactions.first().getUserGiving().getId(), ledger.alice);
+    QCOMPARE(transactions.first().getDescription(), QString("Taxi, night"));
+    QVERIFY(!transactions.last().getDate().isValid());
+
+    QScopedPointer<LedgerStore> example(createStore(backend));
+    QCOMPARE(example->initExampleDatabase().type(), QSqlError::NoError);
+    QVector<Event> events = example->getEventsWithTransactions();
+    QCOMPARE(events.size(), 1);
+    QCOMPARE(example->getNumTransactions(-1, events.first().getId()), 7);
+    // The zlotys converted to 30 and 13 euros
+    QCOMPARE(example->calcAmountKitty(events.first().getId()), 155.0);
+}
+
+void TestLedgerStore::tables_data()
+{
+    addBackends();
+}
+
+void TestLedgerStore::tables()
+{
+    QFETCH(QString, backend);
+    QScopedPointer<LedgerStore> store(createStore(backend));
+    Ledger ledger = populate(*store);
+    LedgerTableModel model(store.data());
+
+    model.setTable(QLatin1String("transactions"));
+    SqlFilter trip("event", SqlFilter::Equal, ledger.trip);
+    model.setSqlFilter(trip && (SqlFilter("userreceives", SqlFilter::Equal, ledger.kitty) || SqlFilter("usergives", SqlFilter::Equal, ledger.kitty)));
+    QVERIFY(model.select());
+    QCOMPARE(model.rowCount(), 3);
+    model.setSqlFilter(trip && SqlFilter("userreceives", SqlFilter::IsNot, ledger.kitty) && SqlFilter("usergives", SqlFilter::IsNot, ledger.kitty));
+    QVERIFY(model.select());
+    QCOMPARE(model.rowCount(), 1);
+    // The filter sees the ids, the view the names
+    QCOMPARE(model.data(model.index(0, model.fieldIndex("usergives"))).toString(), QString("alice"));
+    QCOMPARE(model.data(model.index(0, model.fieldIndex("event"))).toString(), QString("Trip"));
+    QCOMPARE(model.data(model.index(0, model.fieldIndex("transactionDate"))).toLongLong(), QDate(2016, 9, 2).toJulianDay());
+    model.setSqlFilter(SqlFilter("transactionDate", SqlFilter::Is, QVariant()));
+    QVERIFY(model.select());
+    QCOMPARE(model.rowCount(), 1);
+    QCOMPARE(model.data(model.index(0, model.fieldIndex("amount"))).toDouble(), 30.0);
+    // A select statement cannot be run on a row
+    model.setSqlFilter(SqlFilter("transactions.id", SqlFilter::InSelect, QLatin1String("SELECT 1")));
+    QVERIFY(model.select());
+    QCOMPARE(model.rowCount(), 0);
+
+    model.setTable(QLatin1String("users"));
+    model.setSqlFilter(SqlFilter("users.id", SqlFilter::IsNot, ledger.kitty) && SqlFilter("nickname", SqlFilter::Like, QLatin1String("%O%")));
+    QVERIFY(model.select());
+    QCOMPARE(model.rowCount(), 2);
+
+    model.setTable(QLatin1String("events"));
+    model.setSqlFilter(SqlFilter("finished", SqlFilter::Equal, 0));
+    QCOMPARE(store->finishEvent(ledger.dinner).type(), QSqlError::NoError);
+    QVERIFY(model.select());
+    QCOMPARE(model.rowCount(), 1);
+    QCOMPARE(model.data(model.index(0, model.fieldIndex("admin"))).toString(), QString("alice"));
+
+    model.setTable(QLatin1String("event_summary"));
+    QVERIFY(!model.select());
+}
+
+QTEST_GUILESS_MAIN(TestLedgerStore)
+
+#include "tst_ledgerstore.moc"
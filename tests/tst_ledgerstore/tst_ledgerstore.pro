@@ -0,0 +1,5 @@
+TARGET = tst_ledgerstore
+
+include(../tests.pri)
+
+SOURCES += tst_ledgerstore.cpp
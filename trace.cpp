@@ -0,0 +1,183 @@
+#include "trace.h"
+
+#include <atomic>
+#include <vector>
+
+bool Trace::enabled = false;
+QElapsedTimer Trace::clock;
+
+namespace {
+
+//! \brief Event buffered in a trace ring
+struct TraceEvent
+{
+    const char *name;
+    const char *category;
+    qint64 start;
+    qint64 duration; // -1 for instant events
+};
+
+/*!
+ * \brief Single-producer ring of trace events owned by one thread
+ *
+ * Only the owner thread writes. The head is published with release semantics so write()
+ * can read the completed events. When the ring is full the oldest events are overwritten.
+ */
+struct TraceRing
+{
+    static const quint64 Capacity = 1 << 16;
+
+    TraceRing(int tid, const QByteArray &threadName) : head(0), tid(tid), threadName(threadName) {}
+
+    void push(const char *name, const char *category, qint64 start, qint64 duration)
+    {
+        quint64 h = head.load(std::memory_order_relaxed);
+        TraceEvent &event = events[h & (Capacity - 1)];
+        event.name = name;
+        event.category = category;
+        event.start = start;
+        event.duration = duration;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    TraceEvent events[Capacity];
+    std::atomic<quint64> head;
+    int tid;
+    QByteArray threadName;
+};
+
+/*!
+ * \brief Rings of all the threads which recorded events.
+ *
+ * Rings are never freed, so they can be written after their thread finished.
+ */
+QMutex registryMutex;
+std::vector<TraceRing *> registry;
+
+thread_local TraceRing *localRing = 0;
+
+/*!
+ * Returns the ring of the calling thread, registering it on first use
+ */
+TraceRing *ring()
+{
+    if(localRing)
+        return localRing;
+
+    QMutexLocker locker(&registryMutex);
+    QThread *thread = QThread::currentThread();
+    QByteArray threadName = thread->objectName().toUtf8();
+    if(threadName.isEmpty())
+    {
+        if(QCoreApplication::instance() && thread == QCoreApplication::instance()->thread())
+            threadName = "main";
+        else
+            threadName = "worker " + QByteArray::number(int(registry.size()));
+    }
+    localRing = new TraceRing(int(registry.size()) + 1, threadName);
+    registry.push_back(localRing);
+    return localRing;
+}
+
+/*!
+ * Escapes a string for a JSON document
+ */
+QByteArray jsonEscape(const char *text)
+{
+    QByteArray result;
+    for(const char *c = text; *c; ++c)
+    {
+        if(*c == '"' || *c == '\\')
+            result.append('\\');
+        if(uchar(*c) >= 0x20)
+            result.append(*c);
+    }
+    return result;
+}
+
+}
+
+/*!
+ * Enables tracing if CHEAPYAPP_TRACE is set and starts the trace clock
+ */
+void Trace::init()
+{
+    clock.start();
+    enabled = !qEnvironmentVariableIsEmpty("CHEAPYAPP_TRACE");
+}
+
+/*!
+ * Records a complete span in the ring of the calling thread
+ */
+void Trace::record(const char *name, const char *category, qint64 startNs, qint64 durationNs)
+{
+    if(!enabled)
+        return;
+    ring()->push(name, category, startNs, durationNs);
+}
+
+/*!
+ * Records an instant event in the ring of the calling thread
+ */
+void Trace::instant(const char *name, const char *category)
+{
+    if(!enabled)
+        return;
+    ring()->push(name, category, now(), -1);
+}
+
+/*!
+ * Writes all the buffered events to the file given in CHEAPYAPP_TRACE
+ *
+ * Should be called when the recording threads are idle, e.g. after the event loop finished.
+ */
+bool Trace::write()
+{
+    if(!enabled)
+        return true;
+
+    QString path = QString::fromLocal8Bit(qgetenv("CHEAPYAPP_TRACE"));
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qWarning() << "Unable to write trace file" << path;
+        return false;
+    }
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    QByteArray out;
+    out.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    QMutexLocker locker(&registryMutex);
+    bool first = true;
+    for(size_t r = 0; r < registry.size(); r++)
+    {
+        TraceRing *traceRing = registry[r];
+
+        if(!first)
+            out.append(",\n");
+        first = false;
+        out.append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":").append(QByteArray::number(pid))
+           .append(",\"tid\":").append(QByteArray::number(traceRing->tid))
+           .append(",\"args\":{\"name\":\"").append(jsonEscape(traceRing->threadName.constData())).append("\"}}");
+
+        quint64 head = traceRing->head.load(std::memory_order_acquire);
+        quint64 begin = head > TraceRing::Capacity ? head - TraceRing::Capacity : 0;
+        for(quint64 i = begin; i < head; i++)
+        {
+            const TraceEvent &event = traceRing->events[i & (TraceRing::Capacity - 1)];
+            out.append(",\n{\"name\":\"").append(jsonEscape(event.name))
+               .append("\",\"cat\":\"").append(jsonEscape(event.category))
+               .append("\",\"pid\":").append(QByteArray::number(pid))
+               .append(",\"tid\":").append(QByteArray::number(traceRing->tid))
+               .append(",\"ts\":").append(QByteArray::number(event.start / 1000.0, 'f', 3));
+            if(event.duration >= 0)
+                out.append(",\"ph\":\"X\",\"dur\":").append(QByteArray::number(event.duration / 1000.0, 'f', 3)).append("}");
+            else
+                out.append(",\"ph\":\"i\",\"s\":\"t\"}");
+        }
+    }
+    out.append("\n]}\n");
+
+    return file.write(out) == out.size();
+}
@@ -0,0 +1,103 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QtCore>
+
+/*!
+ * \brief Recording of scoped trace spans in the Chrome trace-event format
+ *
+ * Tracing is enabled by setting the environment variable CHEAPYAPP_TRACE to the path of the
+ * output file. Spans are buffered in a fixed-size ring per thread, which is written without
+ * locks, and all rings are written as JSON (loadable in Perfetto or chrome://tracing) by write().
+ * When tracing is disabled a span costs a single branch.
+ */
+class Trace
+{
+public:
+    /*!
+     * \brief Enables tracing if CHEAPYAPP_TRACE is set. Must be called once at startup
+     */
+    static void init();
+    /*!
+     * \brief Returns true if tracing is enabled
+     * \return enabled
+     */
+    static bool isEnabled() {return enabled;}
+    /*!
+     * \brief Returns the trace clock
+     * \return nanoseconds since init()
+     */
+    static qint64 now() {return clock.nsecsElapsed();}
+    /*!
+     * \brief Records a complete span in the ring of the calling thread
+     * \param name span name (must be a string with static storage)
+     * \param category span category (must be a string with static storage)
+     * \param startNs start of the span (trace clock)
+     * \param durationNs duration of the span
+     */
+    static void record(const char *name, const char *category, qint64 startNs, qint64 durationNs);
+    /*!
+     * \brief Records an instant event in the ring of the calling thread
+     * \param name event name (must be a string with static storage)
+     * \param category event category (must be a string with static storage)
+     */
+    static void instant(const char *name, const char *category = "app");
+    /*!
+     * \brief Writes all the buffered events to the output file
+     * \return true if success or tracing disabled
+     */
+    static bool write();
+
+private:
+    /*!
+     * \brief True if CHEAPYAPP_TRACE was set
+     */
+    static bool enabled;
+    /*!
+     * \brief Trace clock, started by init()
+     */
+    static QElapsedTimer clock;
+};
+
+//! \brief Records the time between its construction and destruction as a trace span
+class TraceSpan
+{
+public:
+    /*!
+     * \brief Starts a span
+     * \param name span name (must be a string with static storage)
+     * \param category span category (must be a string with static storage)
+     */
+    explicit TraceSpan(const char *name, const char *category = "app")
+        : name(name), category(category), start(Trace::isEnabled() ? Trace::now() : -1) {}
+    /*!
+     * \brief Finishes the span and records it
+     */
+    ~TraceSpan() {if(start >= 0) Trace::record(name, category, start, Trace::now() - start);}
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+    /*!
+     * \brief Span name
+     */
+    const char *name;
+    /*!
+     * \brief Span category
+     */
+    const char *category;
+    /*!
+     * \brief Start of the span, -1 if tracing is disabled
+     */
+    qint64 start;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+//! \brief Traces the enclosing scope with the given name
+#define TRACE_SCOPE(name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+//! \brief Traces the enclosing scope with the given name and category
+#define TRACE_SCOPE_CAT(name, category) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name, category)
+//! \brief Traces the enclosing function
+#define TRACE_FUNCTION() TRACE_SCOPE(Q_FUNC_INFO)
+
+#endif // TRACE_H
@@ -0,0 +1,226 @@
+#include "userimport.h"
+#include "emailvalidator.h"
+#include "trace.h"
+
+namespace {
+
+/*!
+ * Hashes the passwords of a contiguous range of entries into the matching range of users
+ */
+class HashTask : public QRunnable
+{
+public:
+    HashTask(const UserImport::Entry *entries, User *users, int count) :
+        entries(entries), users(users), count(count)
+    {
+    }
+
+    void run()
+    {
+        for(int i = 0; i < count; i++)
+        {
+            const UserImport::Entry &entry = entries[i];
+            users[i] = User(entry.name, entry.nickname, entry.email, entry.password, entry.birthdate);
+        }
+    }
+
+private:
+    const UserImport::Entry *entries;
+    User *users;
+    int count;
+};
+
+/*!
+ * Reads the fields of a CSV record, going on with the next lines while a quoted field is open
+ *
+ * A field starting with a double quote ends at the next single one, two of them stand for one.
+ */
+QStringList readRecord(QTextStream &in, int *lineNumber, bool *unterminated)
+{
+    QStringList fields;
+    QString field;
+    bool quoted = false;
+    QString line = in.readLine();
+    (*lineNumber)++;
+    forever
+    {
+        for(int i = 0; i < line.size(); i++)
+        {
+            const QChar c = line.at(i);
+            if(quoted)
+            {
+                if(c != QLatin1Char('"'))
+                    field.append(c);
+                else if(i + 1 < line.size() && line.at(i + 1) == QLatin1Char('"'))
+                    field.append(line.at(++i));
+                else
+                    quoted = false;
+            }
+            else if(c == QLatin1Char('"') && field.trimmed().isEmpty())
+            {
+                field.clear();
+                quoted = true;
+            }
+            else if(c == QLatin1Char(','))
+            {
+                fields << field;
+                field.clear();
+            }
+            else
+                field.append(c);
+        }
+        if(!quoted || in.atEnd())
+            break;
+        field.append(QLatin1Char('\n'));
+        line = in.readLine();
+        (*lineNumber)++;
+    }
+    fields << field;
+    *unterminated = quoted;
+    return fields;
+}
+
+}
+
+/*!
+ * Returns the hashing throughput in users per second
+ */
+double UserImport::Result::usersPerSecond() const
+{
+    return hashNs > 0 ? users.size() * 1e9 / hashNs : 0;
+}
+
+/*!
+ * Reads a roster in CSV format, applying the same checks as the new user dialog
+ *
+ * The nickname and email of each entry are kept with its line, so a later line repeating one of
+ * them is reported against it instead of failing the whole import when the users are added.
+ */
+QVector<UserImport::Entry> UserImport::readRoster(QIODevice *device, QStringList *errors)
+{
+    TRACE_FUNCTION();
+    QVector<Entry> entries;
+    QHash<QString, int> nicknameLines, emailLines;
+    QTextStream in(device);
+    int lineNumber = 0;
+
+    while(!in.atEnd())
+    {
+        const int first = lineNumber + 1;
+        bool unterminated = false;
+        QStringList fields = readRecord(in, &lineNumber, &unterminated);
+        if(fields.size() == 1 && fields.first().trimmed().isEmpty())
+            continue;
+
+        if(first == 1 && fields.first().trimmed().compare(QLatin1String("name"), Qt::CaseInsensitive) == 0)
+            continue; // Header
+
+        Entry entry;
+        entry.line = first;
+        entry.name = fields.value(0).trimmed();
+        entry.nickname = fields.value(1).trimmed();
+        entry.email = fields.value(2).trimmed().toLower();
+        entry.password = fields.value(3);
+
+        QString birthdate = fields.value(4).trimmed();
+        if(!birthdate.isEmpty())
+        {
+            entry.birthdate = QDate::fromString(birthdate, Qt::ISODate);
+            if(!entry.birthdate.isValid())
+                entry.birthdate = QDate::fromString(birthdate, "dd.MM.yyyy");
+        }
+
+        QString problem;
+        if(unterminated)
+            problem = "A quoted field is not closed";
+        else if(fields.size() < 4 || fields.size() > 5)
+            problem = "Expected name,nickname,email,password[,birthdate]";
+        else if(entry.name.isEmpty())
+            problem = "The field 'Name' cannot be empty";
+        else if(entry.nickname.isEmpty())
+            problem = "The field 'Nickname' cannot be empty";
+        else if(!EmailValidator::isValid(entry.email))
+            problem = "The email address is not valid";
+        else if(entry.password.size() < 8)
+            problem = "The password must consist of at least 8 characters";
+        else if(!birthdate.isEmpty() && !entry.birthdate.isValid())
+            problem = "The birthdate is not valid";
+        else if(nicknameLines.contains(entry.nickname))
+            problem = QString("The nickname is already used on line %1").arg(nicknameLines.value(entry.nickname));
+        else if(emailLines.contains(entry.email))
+            problem = QString("The email address is already used on line %1").arg(emailLines.value(entry.email));
+
+        if(problem.isEmpty())
+        {
+            nicknameLines.insert(entry.nickname, first);
+            emailLines.insert(entry.email, first);
+            entries.append(entry);
+        }
+        else if(errors)
+            errors->append(QString("Line %1: %2").arg(first).arg(problem));
+    }
+
+    return entries;
+}
+
+/*!
+ * Creates the users of the entries hashing their passwords in parallel
+ *
+ * The entries are split in a few chunks per thread so the threads stay busy until the end.
+ * Each task writes to its own range of the result, which is allocated beforehand.
+ */
+UserImport::Result UserImport::hashPasswords(const QVector<Entry> &entries, int threadCount)
+{
+    TRACE_FUNCTION();
+    Result result;
+    result.threads = qMax(1, threadCount);
+    result.users.resize(entries.size());
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(result.threads);
+    int chunkSize = qMax(1, entries.size() / (result.threads * 4));
+    User *users = result.users.data();
+    for(int first = 0; first < entries.size(); first += chunkSize)
+        pool.start(new HashTask(entries.constData() + first, users + first, qMin(chunkSize, entries.size() - first)));
+    pool.waitForDone();
+
+    result.hashNs = timer.nsecsElapsed();
+    return result;
+}
+
+/*!
+ * Measures the hashing throughput of synthetic users with 1 up to the ideal number of threads
+ */
+QString UserImport::benchmark(int count)
+{
+    QVector<Entry> entries(count);
+    for(int i = 0; i < count; i++)
+    {
+        entries[i].name = QString("User %1").arg(i);
+        entries[i].nickname = QString("user%1").arg(i);
+        entries[i].email = QString("user%1@cheapyapp.com").arg(i);
+        entries[i].password = QString("password%1").arg(i);
+        entries[i].birthdate = QDate(2000, 1, 1);
+        entries[i].line = i + 1;
+    }
+
+    QString report;
+    QTextStream out(&report);
+    out << "Password hashing of " << count << " users\n";
+    // Powers of two, ending with the ideal number of threads
+    QList<int> threadCounts;
+    for(int threads = 1; threads < QThread::idealThreadCount(); threads *= 2)
+        threadCounts << threads;
+    threadCounts << qMax(1, QThread::idealThreadCount());
+
+    foreach(int threads, threadCounts)
+    {
+        Result result = hashPasswords(entries, threads);
+        out << "    " << QString::number(threads).rightJustified(3) << " threads  "
+            << QString::number(result.usersPerSecond(), 'f', 0).rightJustified(10) << " users/s\n";
+    }
+    return report;
+}
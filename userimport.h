@@ -0,0 +1,76 @@
+#ifndef USERIMPORT_H
+#define USERIMPORT_H
+
+#include <QtCore>
+#include "dbclasses.h"
+
+/*!
+ * \brief Bulk import of users from a roster file
+ *
+ * The roster is read into entries, whose passwords are hashed in parallel on the threads of a
+ * QThreadPool. The resulting users are written with DataBase::addUsers().
+ */
+class UserImport
+{
+public:
+    //! \brief User read from the roster, with the password still in clear
+    struct Entry
+    {
+        //! \brief Name of the user
+        QString name;
+        //! \brief Nickname of the user
+        QString nickname;
+        //! \brief Email of the user, trimmed and in low-case
+        QString email;
+        //! \brief Password in clear
+        QString password;
+        //! \brief Birthdate, invalid if not given
+        QDate birthdate;
+        //! \brief Line of the roster where the entry starts
+        int line;
+    };
+
+    //! \brief Users with hashed passwords and the time spent hashing them
+    struct Result
+    {
+        //! \brief Users in the order of the entries
+        QVector<User> users;
+        //! \brief Number of threads used
+        int threads;
+        //! \brief Time spent hashing in nanoseconds
+        qint64 hashNs;
+        /*!
+         * \brief Returns the hashing throughput
+         * \return users per second
+         */
+        double usersPerSecond() const;
+    };
+
+    /*!
+     * \brief Reads a roster in CSV format: name,nickname,email,password[,birthdate]
+     *
+     * The birthdate is given as yyyy-MM-dd or dd.MM.yyyy. A field in double quotes may hold commas,
+     * line breaks and doubled quotes. A first line starting with "name" is taken as header. Lines
+     * which would not pass the checks of the new user dialog, or repeat the nickname or email of
+     * an earlier line, are skipped.
+     * \param device opened device with the roster
+     * \param errors description of the skipped lines
+     * \return valid entries
+     */
+    static QVector<Entry> readRoster(QIODevice *device, QStringList *errors);
+    /*!
+     * \brief Creates the users of the entries hashing their passwords in parallel
+     * \param entries users read from a roster
+     * \param threadCount number of hashing threads
+     * \return users and hashing time
+     */
+    static Result hashPasswords(const QVector<Entry> &entries, int threadCount = QThread::idealThreadCount());
+    /*!
+     * \brief Measures the hashing throughput of synthetic users with 1 up to the ideal number of threads
+     * \param count number of users hashed per run
+     * \return report with users per second for each number of threads
+     */
+    static QString benchmark(int count);
+};
+
+#endif // USERIMPORT_H
@@ -0,0 +1,102 @@
+#include "userindex.h"
+
+#include <algorithm>
+#include <climits>
+
+/*!
+ * Empty UserIndex constructor
+ */
+UserIndex::UserIndex()
+{
+}
+
+/*!
+ * UserIndex constructor, the keys of all the users are sorted at once
+ */
+UserIndex::UserIndex(const QVector<Record> &records)
+{
+    foreach(const Record &record, records)
+    {
+        this->records.insert(record.id, record);
+        keys += keysOf(record);
+    }
+    std::sort(keys.begin(), keys.end());
+}
+
+/*!
+ * Adds a user, each of its keys is inserted at its sorted position
+ */
+void UserIndex::insert(const Record &record)
+{
+    if(records.contains(record.id))
+        remove(record.id);
+
+    records.insert(record.id, record);
+    foreach(const Key &key, keysOf(record))
+        keys.insert(std::lower_bound(keys.begin(), keys.end(), key), key);
+}
+
+/*!
+ * Removes a user, each of its keys is found by binary search
+ */
+void UserIndex::remove(int id)
+{
+    if(!records.contains(id))
+        return;
+
+    foreach(const Key &key, keysOf(records.take(id)))
+    {
+        QVector<Key>::iterator it = std::lower_bound(keys.begin(), keys.end(), key);
+        if(it != keys.end() && it->id == key.id && it->text == key.text)
+            keys.erase(it);
+    }
+}
+
+/*!
+ * Returns the users with a key starting with a prefix
+ *
+ * Keys are scanned from the first one not lower than the prefix. A user matching by several
+ * keys (e.g. nickname and email) is returned once, at the position of its first match.
+ */
+QVector<int> UserIndex::search(const QString &prefix, int limit, int excludedId) const
+{
+    QVector<int> result;
+    Key first = {prefix.trimmed().toCaseFolded(), INT_MIN};
+
+    for(QVector<Key>::const_iterator it = std::lower_bound(keys.begin(), keys.end(), first);
+        it != keys.end() && result.size() < limit && it->text.startsWith(first.text); ++it)
+    {
+        if(it->id != excludedId && !result.contains(it->id))
+            result.append(it->id);
+    }
+
+    return result;
+}
+
+/*!
+ * Returns the indexed fields of a user
+ */
+UserIndex::Record UserIndex::getRecord(int id) const
+{
+    Record missing = {-1, QString(), QString(), QString()};
+    return records.value(id, missing);
+}
+
+/*!
+ * Returns the nickname, email, full name and each further word of the name, case folded
+ */
+QVector<UserIndex::Key> UserIndex::keysOf(const Record &record)
+{
+    QVector<Key> result;
+    QStringList texts;
+    texts << record.nickname << record.email << record.name;
+    texts += record.name.split(QLatin1Char(' '), QString::SkipEmptyParts).mid(1);
+
+    foreach(const QString &text, texts)
+    {
+        Key key = {text.trimmed().toCaseFolded(), record.id};
+        if(!key.text.isEmpty())
+            result.append(key);
+    }
+    return result;
+}
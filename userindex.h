@@ -0,0 +1,100 @@
+#ifndef USERINDEX_H
+#define USERINDEX_H
+
+#include <QtCore>
+
+/*!
+ * \brief Prefix search over the nicknames, names and emails of the users
+ *
+ * Every user is indexed by its nickname, its email, its full name and each further word of
+ * the name, case folded, in one sorted array. A prefix search is a binary search followed by
+ * a scan of the matching keys, O(log n + k). Adding or removing a user moves the keys after
+ * its position, O(n) memory moves, with no rebuild of the rest.
+ */
+class UserIndex
+{
+public:
+    //! \brief Indexed fields of a user
+    struct Record
+    {
+        //! \brief User id
+        int id;
+        //! \brief Nickname of the user
+        QString nickname;
+        //! \brief Name of the user
+        QString name;
+        //! \brief Email of the user
+        QString email;
+    };
+
+    //! \brief Empty UserIndex constructor
+    UserIndex();
+    /*!
+     * \brief UserIndex constructor from a set of users, built in O(n log n)
+     * \param records users in any order
+     */
+    explicit UserIndex(const QVector<Record> &records);
+    /*!
+     * \brief Adds a user, replacing it if already indexed
+     * \param record indexed fields of the user
+     */
+    void insert(const Record &record);
+    /*!
+     * \brief Removes a user
+     * \param id user id
+     */
+    void remove(int id);
+    /*!
+     * \brief Returns the users with a nickname, name, word of the name or email starting with a prefix
+     * \param prefix searched text, case insensitive
+     * \param limit maximum number of users returned
+     * \param excludedId user id never returned (e.g. the kitty), -1 for none
+     * \return user ids ordered by the matching text
+     */
+    QVector<int> search(const QString &prefix, int limit, int excludedId = -1) const;
+    /*!
+     * \brief Returns the indexed fields of a user
+     * \param id user id
+     * \return record, with id -1 if the user is not indexed
+     */
+    Record getRecord(int id) const;
+    /*!
+     * \brief Returns the number of indexed users
+     * \return number of users
+     */
+    int size() const {return records.size();}
+
+private:
+    //! \brief Searchable text of a user
+    struct Key
+    {
+        //! \brief Case folded text
+        QString text;
+        //! \brief User id
+        int id;
+
+        bool operator<(const Key &other) const
+        {
+            int cmp = QString::compare(text, other.text);
+            return cmp < 0 || (cmp == 0 && id < other.id);
+        }
+    };
+
+    /*!
+     * \brief Returns the searchable texts of a user
+     * \param record indexed fields of the user
+     * \return keys, not sorted
+     */
+    static QVector<Key> keysOf(const Record &record);
+
+    /*!
+     * \brief Indexed fields of each user id
+     */
+    QHash<int, Record> records;
+    /*!
+     * \brief Searchable texts of all the users, sorted
+     */
+    QVector<Key> keys;
+};
+
+#endif // USERINDEX_H
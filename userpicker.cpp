@@ -0,0 +1,82 @@
+#include "userpicker.h"
+#include "trace.h"
+
+/*!
+ * UserPicker constructor. The popup offers up to 10 matches
+ */
+UserPicker::UserPicker(LedgerStore *store, bool includeKitty, QWidget *parent) :
+    QLineEdit(parent),
+    store(store),
+    excludedId(includeKitty ? -1 : store->getKittyId()),
+    userId(-1),
+    maxMatches(10)
+{
+    setPlaceholderText(tr("Type a nickname, name or email"));
+
+    // The matches are already filtered by the index, the completer only shows them
+    completer = new QCompleter(&matches, this);
+    completer->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
+    completer->setWidget(this);
+
+    connect(this, &QLineEdit::textEdited, this, &UserPicker::updateMatches);
+    connect(completer, SIGNAL(activated(QModelIndex)), this, SLOT(matchActivated(QModelIndex)));
+}
+
+/*!
+ * Returns the picked user, or the user whose nickname is the typed text
+ */
+int UserPicker::getUserId() const
+{
+    if(userId >= 0)
+        return userId;
+
+    const UserIndex &index = store->getUserIndex();
+    foreach(int id, index.search(text(), maxMatches, excludedId))
+    {
+        if(QString::compare(index.getRecord(id).nickname, text().trimmed(), Qt::CaseInsensitive) == 0)
+            return id;
+    }
+    return -1;
+}
+
+/*!
+ * Picks a user, showing its nickname
+ */
+void UserPicker::setUserId(int id)
+{
+    UserIndex::Record record = store->getUserIndex().getRecord(id);
+    userId = record.id == excludedId ? -1 : record.id;
+    setText(userId < 0 ? QString() : record.nickname);
+}
+
+/*!
+ * Offers the top matches of the typed text
+ */
+void UserPicker::updateMatches(const QString &text)
+{
+    TRACE_FUNCTION();
+    userId = -1;
+    matches.clear();
+
+    const UserIndex &index = store->getUserIndex();
+    foreach(int id, index.search(text, maxMatches, excludedId))
+    {
+        UserIndex::Record record = index.getRecord(id);
+        QStandardItem *item = new QStandardItem(QString("%1 (%2) %3").arg(record.nickname, record.name, record.email));
+        item->setData(id, Qt::UserRole);
+        matches.appendRow(item);
+    }
+
+    if(matches.rowCount() == 0 || text.trimmed().isEmpty())
+        completer->popup()->hide();
+    else
+        completer->complete();
+}
+
+/*!
+ * Picks the user chosen in the popup
+ */
+void UserPicker::matchActivated(const QModelIndex &index)
+{
+    setUserId(index.data(Qt::UserRole).toInt());
+}
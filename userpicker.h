@@ -0,0 +1,80 @@
+#ifndef USERPICKER_H
+#define USERPICKER_H
+
+#include <QtWidgets>
+#include "ledgerstore.h"
+
+/*!
+ * \brief Type-ahead line edit to pick a user
+ *
+ * While typing, the top matches of the user index of the store (by nickname, name or email
+ * prefix) are offered in a completer popup. No query is run while typing.
+ */
+class UserPicker : public QLineEdit
+{
+    Q_OBJECT
+
+public:
+    /*!
+     * \brief UserPicker constructor
+     * \param store storage providing the user index
+     * \param includeKitty true if the kitty can be picked
+     * \param parent parent widget
+     */
+    UserPicker(LedgerStore *store, bool includeKitty, QWidget *parent = 0);
+    /*!
+     * \brief Returns the picked user. A typed nickname is accepted without picking it from the popup
+     * \return user id, -1 if none
+     */
+    int getUserId() const;
+    /*!
+     * \brief Picks a user
+     * \param id user id
+     */
+    void setUserId(int id);
+    /*!
+     * \brief Sets the number of matches offered in the popup
+     * \param count number of matches
+     */
+    void setMaxMatches(int count) {maxMatches = count;}
+
+private slots:
+    /*!
+     * \brief Offers the users matching the typed text
+     * \param text typed text
+     */
+    void updateMatches(const QString &text);
+    /*!
+     * \brief Picks the user chosen in the popup
+     * \param index index of the completion model
+     */
+    void matchActivated(const QModelIndex &index);
+
+private:
+    /*!
+     * \brief Storage providing the user index
+     */
+    LedgerStore *store;
+    /*!
+     * \brief User which cannot be picked, -1 for none
+     */
+    int excludedId;
+    /*!
+     * \brief Picked user, -1 if none
+     */
+    int userId;
+    /*!
+     * \brief Number of matches offered in the popup
+     */
+    int maxMatches;
+    /*!
+     * \brief Matches of the typed text, with the user id as Qt::UserRole
+     */
+    QStandardItemModel matches;
+    /*!
+     * \brief Completer showing the matches
+     */
+    QCompleter *completer;
+};
+
+#endif // USERPICKER_H